@@ -0,0 +1,208 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include <stb/stb_image.h>
+
+using namespace std;
+
+
+// Files decoded by a pool of worker threads (Assimp, stb_image, ...)
+// Only the GL uploads are queued to the thread owning the context, which runs them within a time budget per frame
+class AssetLoader
+{
+public:
+	AssetLoader() {}
+	~AssetLoader()
+	{
+		Release();
+	}
+
+	void Init(int nThreads = 0)
+	{
+		if (mvThreads.size())
+			return;
+
+		if (nThreads <= 0)
+			nThreads = std::max(1, (int)thread::hardware_concurrency() - 1);	// One core is left to the GL thread
+
+		mbQuit = false;
+		for (int i = 0; i < nThreads; i++)
+			mvThreads.emplace_back(&AssetLoader::Worker, this);
+	}
+
+	void Release()
+	{
+		{
+			lock_guard<mutex> lock(mMutex);
+			mbQuit = true;
+		}
+		mCondition.notify_all();
+		for (auto& t : mvThreads)
+			if (t.joinable())
+				t.join();
+		mvThreads.clear();
+	}
+
+	// decode runs on a worker, then upload on the GL thread with ProcessUploads
+	void Submit(const string& name, function<void()> decode, function<void()> upload)
+	{
+		mTotal++;
+		if (mvThreads.empty())
+		{
+			// No worker: synchronous
+			decode();
+			upload();
+			mDecoded++;
+			mUploaded++;
+			return;
+		}
+
+		{
+			lock_guard<mutex> lock(mMutex);
+			mJobs.push_back({ name, std::move(decode), std::move(upload) });
+		}
+		mCondition.notify_one();
+	}
+
+	// Uploads of the decoded assets until the budget is spent, true when all the submitted assets are loaded
+	bool ProcessUploads(double budgetMs)
+	{
+		auto start = chrono::steady_clock::now();
+		while (true)
+		{
+			sJob job;
+			{
+				lock_guard<mutex> lock(mMutex);
+				if (mUploads.empty())
+					break;
+				job = std::move(mUploads.front());
+				mUploads.pop_front();
+			}
+
+			job.upload();
+			mCurrent = job.name;
+			mUploaded++;
+
+			if (chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() >= budgetMs)
+				break;
+		}
+		return IsDone();
+	}
+
+	// Blocks until everything submitted is loaded
+	void Finish()
+	{
+		while (!ProcessUploads(1e9))
+			this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	// The caller and the idle workers share the iterations, returns when all of them are done
+	void ParallelFor(int count, const function<void(int)>& f)
+	{
+		struct sState
+		{
+			atomic<int>					next{ 0 };
+			atomic<int>					done{ 0 };
+			int							count = 0;
+			const function<void(int)>*	f = nullptr;
+		};
+		auto state = make_shared<sState>();
+		state->count = count;
+		state->f = &f;
+
+		auto Run = [](shared_ptr<sState> s)
+			{
+				int i;
+				while ((i = s->next++) < s->count)		// f is only touched while the caller waits
+				{
+					(*s->f)(i);
+					s->done++;
+				}
+			};
+
+		int helpers = std::min((int)mvThreads.size(), count - 1);
+		if (helpers > 0)
+		{
+			{
+				lock_guard<mutex> lock(mMutex);
+				for (int h = 0; h < helpers; h++)
+					mJobs.push_front({ "", [state, Run]() { Run(state); }, nullptr });
+			}
+			mCondition.notify_all();
+		}
+
+		Run(state);
+		while (state->done < count)
+			this_thread::yield();
+	}
+
+	bool	IsDone()		const { return mUploaded == mTotal; }
+	int		GetTotal()		const { return mTotal; }
+	int		GetDecoded()	const { return mDecoded; }
+	int		GetUploaded()	const { return mUploaded; }
+	float	GetProgress()	const { return mTotal ? float(mUploaded) / float(mTotal) : 1.0f; }
+	string	GetCurrent()	const { return mCurrent; }		// Last asset uploaded (GL thread only)
+
+private:
+	struct sJob
+	{
+		string			name;
+		function<void()>	decode;
+		function<void()>	upload;			// Empty for the iterations of ParallelFor
+	};
+
+	void Worker()
+	{
+		// The flip flag of stb_image is global and set by the GL thread, the workers keep their own
+		stbi_set_flip_vertically_on_load_thread(0);
+
+		while (true)
+		{
+			sJob job;
+			{
+				unique_lock<mutex> lock(mMutex);
+				mCondition.wait(lock, [this] { return mbQuit || !mJobs.empty(); });
+				if (mbQuit)
+					return;
+				job = std::move(mJobs.front());
+				mJobs.pop_front();
+			}
+
+			job.decode();
+			if (!job.upload)
+				continue;
+
+			mDecoded++;
+			lock_guard<mutex> lock(mMutex);
+			mUploads.push_back(std::move(job));
+		}
+	}
+
+	vector<thread>			mvThreads;
+	mutex					mMutex;
+	condition_variable		mCondition;
+	deque<sJob>				mJobs;
+	deque<sJob>				mUploads;
+	bool					mbQuit		= false;
+
+	atomic<int>				mTotal{ 0 };
+	atomic<int>				mDecoded{ 0 };
+	atomic<int>				mUploaded{ 0 };
+	string					mCurrent;
+};
@@ -0,0 +1,232 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
+
+#include <gli/gli/gli.hpp>
+
+using namespace std;
+
+
+// Block compression on the CPU (bounding box endpoints, nearest index): fast enough to convert at the first load
+// 1 channel: BC4, 2: BC5, 3: BC1, 4: BC3
+class BCEncoder
+{
+public:
+	static gli::format Format(int channels)
+	{
+		switch (channels)
+		{
+		case 1:		return gli::FORMAT_R_ATI1N_UNORM_BLOCK8;
+		case 2:		return gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+		case 3:		return gli::FORMAT_RGB_DXT1_UNORM_BLOCK8;
+		default:	return gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16;
+		}
+	}
+
+	static size_t BlockBytes(int channels)
+	{
+		return (channels == 1 || channels == 3) ? 8 : 16;
+	}
+
+	// Texture with the full mip chain (box filter)
+	static gli::texture2d Compress(const unsigned char* pixels, int w, int h, int channels)
+	{
+		int levels = 1;
+		while ((std::max(w, h) >> levels) > 0)
+			levels++;
+
+		gli::texture2d texture(Format(channels), gli::extent2d(w, h), levels);
+		vector<unsigned char> image(pixels, pixels + size_t(w) * h * channels);
+		for (int level = 0; level < levels; level++)
+		{
+			Encode(image.data(), w, h, channels, (unsigned char*)texture.data(0, 0, level));
+			if (level + 1 < levels)
+				image = Downsample(image, w, h, channels);
+		}
+		return texture;
+	}
+
+	// Half size, w and h updated (odd sizes: the last row/column is dropped)
+	static vector<unsigned char> Downsample(const vector<unsigned char>& image, int& w, int& h, int channels)
+	{
+		int w2 = std::max(1, w / 2);
+		int h2 = std::max(1, h / 2);
+		vector<unsigned char> result(size_t(w2) * h2 * channels);
+		for (int y = 0; y < h2; y++)
+		{
+			int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+			for (int x = 0; x < w2; x++)
+			{
+				int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+				for (int c = 0; c < channels; c++)
+				{
+					int sum = image[(y0 * w + x0) * channels + c] + image[(y0 * w + x1) * channels + c] + image[(y1 * w + x0) * channels + c] + image[(y1 * w + x1) * channels + c];
+					result[(y * w2 + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		w = w2;
+		h = h2;
+		return result;
+	}
+
+	// Whole image, the texels of the edge are repeated in the partial blocks
+	static void Encode(const unsigned char* image, int w, int h, int channels, unsigned char* out)
+	{
+		unsigned char block[16 * 4];
+		for (int by = 0; by < h; by += 4)
+		{
+			for (int bx = 0; bx < w; bx += 4)
+			{
+				for (int i = 0; i < 16; i++)
+				{
+					int x = std::min(bx + (i & 3), w - 1);
+					int y = std::min(by + (i >> 2), h - 1);
+					memcpy(&block[i * channels], &image[(size_t(y) * w + x) * channels], channels);
+				}
+
+				switch (channels)
+				{
+				case 1:
+					EncodeBlockBC4(block, 1, out);
+					break;
+				case 2:
+					EncodeBlockBC4(block, 2, out);
+					EncodeBlockBC4(block + 1, 2, out + 8);
+					break;
+				case 3:
+					EncodeBlockBC1(block, 3, out);
+					break;
+				default:
+					EncodeBlockBC4(block + 3, 4, out);
+					EncodeBlockBC1(block, 4, out + 8);
+					break;
+				}
+				out += BlockBytes(channels);
+			}
+		}
+	}
+
+	// BC4 (and alpha of BC3): 2 endpoints + 16 indices of 3 bits, stride between the values of the 16 texels
+	static void EncodeBlockBC4(const unsigned char* values, int stride, unsigned char* out)
+	{
+		unsigned char lo = 255, hi = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			lo = std::min(lo, values[i * stride]);
+			hi = std::max(hi, values[i * stride]);
+		}
+
+		// 8 values between hi (index 0) and lo (index 1)
+		int palette[8] = { hi, lo };
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = ((7 - i) * hi + i * lo + 3) / 7;
+
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int v = values[i * stride];
+			int best = 0;
+			for (int j = 1; j < 8 && hi != lo; j++)
+				if (abs(v - palette[j]) < abs(v - palette[best]))
+					best = j;
+			bits |= uint64_t(best) << (3 * i);
+		}
+
+		out[0] = hi;
+		out[1] = lo;
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (unsigned char)(bits >> (8 * i));
+	}
+
+	// BC1 (and color of BC3): 2 endpoints RGB565 + 16 indices of 2 bits, always in the 4 colors mode
+	static void EncodeBlockBC1(const unsigned char* rgb, int stride, unsigned char* out)
+	{
+		int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+		int center[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 3; c++)
+			{
+				lo[c] = std::min(lo[c], (int)rgb[i * stride + c]);
+				hi[c] = std::max(hi[c], (int)rgb[i * stride + c]);
+				center[c] += rgb[i * stride + c];
+			}
+
+		// Diagonal of the bounding box along the colors (green and blue swapped if they decrease when red increases)
+		int covRG = 0, covRB = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int r = 16 * rgb[i * stride] - center[0];
+			covRG += r * (16 * rgb[i * stride + 1] - center[1]) / 256;
+			covRB += r * (16 * rgb[i * stride + 2] - center[2]) / 256;
+		}
+		if (covRG < 0)
+			swap(lo[1], hi[1]);
+		if (covRB < 0)
+			swap(lo[2], hi[2]);
+
+		uint16_t c0 = To565(hi), c1 = To565(lo);
+		if (c0 < c1)
+			swap(c0, c1);
+
+		int palette[4][3];
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		}
+
+		uint32_t bits = 0;
+		for (int i = 0; i < 16 && c0 != c1; i++)
+		{
+			int best = 0, bestDist = INT_MAX;
+			for (int j = 0; j < 4; j++)
+			{
+				int dr = rgb[i * stride] - palette[j][0];
+				int dg = rgb[i * stride + 1] - palette[j][1];
+				int db = rgb[i * stride + 2] - palette[j][2];
+				int dist = dr * dr + dg * dg + db * db;
+				if (dist < bestDist)
+				{
+					best = j;
+					bestDist = dist;
+				}
+			}
+			bits |= uint32_t(best) << (2 * i);
+		}
+
+		out[0] = (unsigned char)(c0 & 0xFF);
+		out[1] = (unsigned char)(c0 >> 8);
+		out[2] = (unsigned char)(c1 & 0xFF);
+		out[3] = (unsigned char)(c1 >> 8);
+		for (int i = 0; i < 4; i++)
+			out[4 + i] = (unsigned char)(bits >> (8 * i));
+	}
+
+private:
+	static uint16_t To565(const int* rgb)
+	{
+		return uint16_t(((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | ((rgb[2] * 31 + 127) / 255));
+	}
+	static void From565(uint16_t c, int* rgb)
+	{
+		int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+};
@@ -0,0 +1,197 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+
+#include "Clock.h"
+
+using namespace std;
+
+
+struct sBenchResult
+{
+	string	name;
+	int		repetitions	= 0;
+	double	min			= 0.0;		// us
+	double	median		= 0.0;
+	double	mean		= 0.0;
+	double	p95			= 0.0;
+	double	stddev		= 0.0;
+	double	baseline	= -1.0;		// Median of the baseline, -1 when the kernel is new
+	bool	bRegression	= false;
+};
+
+// Micro-benchmarks of the simulation kernels: warm-up, repetitions timed one by one, statistics in microseconds
+// The results are saved in JSON and compared with a baseline, a median slower than the threshold is a regression
+class Benchmark
+{
+public:
+	int		Warmup		= 5;
+	int		Repetitions	= 50;
+	float	Threshold	= 0.10f;		// Ratio to the median of the baseline
+
+	// The setup is called before each repetition, warm-up included, and is not timed
+	void Run(const string& name, const function<void()>& kernel, const function<void(int)>& setup = nullptr)
+	{
+		for (int i = 0; i < Warmup; i++)
+		{
+			if (setup)
+				setup(i);
+			kernel();
+		}
+
+		vector<double> times(Repetitions);
+		for (int i = 0; i < Repetitions; i++)
+		{
+			if (setup)
+				setup(Warmup + i);
+			uint64_t start = Clock::Ticks();
+			kernel();
+			times[i] = Clock::ToSeconds(Clock::Ticks() - start) * 1.0e6;
+		}
+		if (times.empty())
+			return;
+
+		sort(times.begin(), times.end());
+		sBenchResult r;
+		r.name = name;
+		r.repetitions = Repetitions;
+		r.min = times.front();
+		r.median = times[times.size() / 2];
+		r.p95 = times[std::min(times.size() - 1, size_t(0.95 * times.size()))];
+		for (double t : times)
+			r.mean += t;
+		r.mean /= times.size();
+		for (double t : times)
+			r.stddev += (t - r.mean) * (t - r.mean);
+		r.stddev = sqrt(r.stddev / times.size());
+
+		auto it = mBaseline.find(name);
+		if (it != mBaseline.end())
+		{
+			r.baseline = it->second;
+			r.bRegression = r.median > r.baseline * (1.0 + Threshold);
+		}
+		mvResults.push_back(r);
+		Print(r);
+	}
+
+	// Results of a previous run, only the medians are compared
+	bool LoadBaseline(const string& pathname)
+	{
+		ifstream file(pathname);
+		if (!file)
+			return false;
+
+		mBaseline.clear();
+		string line;
+		while (getline(file, line))
+		{
+			size_t n = line.find("\"name\": \"");
+			size_t m = line.find("\"median\": ");
+			if (n == string::npos || m == string::npos)
+				continue;
+			n += 9;
+			size_t end = line.find('"', n);
+			if (end == string::npos)
+				continue;
+			mBaseline[line.substr(n, end - n)] = strtod(line.c_str() + m + 10, nullptr);
+		}
+		return mBaseline.size() > 0;
+	}
+
+	// One kernel per line so that the baseline can be read back without a JSON library
+	bool Save(const string& pathname) const
+	{
+		ofstream file(pathname);
+		if (!file)
+			return false;
+
+		file << "{\n";
+		file << "  \"clock\": \"" << (Clock::IsTsc() ? "tsc" : "steady") << "\",\n";
+		file << "  \"warmup\": " << Warmup << ",\n";
+		file << "  \"repetitions\": " << Repetitions << ",\n";
+		file << "  \"unit\": \"us\",\n";
+		file << "  \"kernels\": [\n";
+		for (size_t i = 0; i < mvResults.size(); i++)
+		{
+			const sBenchResult& r = mvResults[i];
+			char line[512];
+			snprintf(line, sizeof(line), "    { \"name\": \"%s\", \"median\": %.3f, \"min\": %.3f, \"mean\": %.3f, \"p95\": %.3f, \"stddev\": %.3f }%s\n",
+				r.name.c_str(), r.median, r.min, r.mean, r.p95, r.stddev, i + 1 < mvResults.size() ? "," : "");
+			file << line;
+		}
+		file << "  ]\n}\n";
+		return true;
+	}
+
+	int GetRegressions() const
+	{
+		return (int)count_if(mvResults.begin(), mvResults.end(), [](const sBenchResult& r) { return r.bRegression; });
+	}
+
+	const vector<sBenchResult>& GetResults() const { return mvResults; }
+
+	// Keeps a result alive so that the compiler does not remove the kernel
+	static void Keep(double value)
+	{
+		static volatile double sink = 0.0;
+		sink = sink + value;
+	}
+
+	// Recorded data (displacements of the ocean, series of the buoy) as raw floats
+	static bool SaveFloats(const string& pathname, const vector<float>& data)
+	{
+		ofstream file(pathname, ios::binary);
+		if (!file)
+			return false;
+		uint64_t count = data.size();
+		file.write((const char*)&count, sizeof(count));
+		file.write((const char*)data.data(), count * sizeof(float));
+		return file.good();
+	}
+	static bool LoadFloats(const string& pathname, vector<float>& data)
+	{
+		ifstream file(pathname, ios::binary);
+		if (!file)
+			return false;
+		uint64_t count = 0;
+		file.read((char*)&count, sizeof(count));
+		if (!file || count == 0 || count > (1ull << 28))
+			return false;
+		data.resize(count);
+		file.read((char*)data.data(), count * sizeof(float));
+		return file.good();
+	}
+
+private:
+	void Print(const sBenchResult& r) const
+	{
+		char line[512];
+		snprintf(line, sizeof(line), "%-48s median %10.1f us  min %10.1f  p95 %10.1f  stddev %8.1f", r.name.c_str(), r.median, r.min, r.p95, r.stddev);
+		cout << line;
+		if (r.baseline > 0.0)
+		{
+			snprintf(line, sizeof(line), "  %+6.1f %%%s", 100.0 * (r.median / r.baseline - 1.0), r.bRegression ? "  REGRESSION" : "");
+			cout << line;
+		}
+		cout << endl;
+	}
+
+	vector<sBenchResult>	mvResults;
+	map<string, double>		mBaseline;		// Median by kernel
+};
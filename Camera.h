@@ -97,7 +97,7 @@ private:
 	mat4    mMatViewProjection;     // transform from world space to clip space [-1, 1] (WorldToView * Projection)
     mat4    mMatViewReflexion;      // transform from world space to screen UV [0, 1]
 
-    float   mMoveSpeed = 0.001f;       // movement speed in units/second
+    float   mMoveSpeed = 15.0f;        // movement speed in units/second
     float   mRotateSpeed = 0.0025f;    // mouse sensitivity in radians/pixel
 
 	vec2    mMousePos;
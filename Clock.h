@@ -0,0 +1,158 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CLOCK_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
+
+using namespace std;
+
+
+// Monotonic clock of the application, the single source of time for the timers, the simulation and the profiler
+// The ticks come from steady_clock, or from the TSC of the processor when it is invariant and Calibrate() succeeded
+class Clock
+{
+public:
+	// At startup, before any tick is kept: the ticks of the two sources can not be compared
+	static bool Calibrate()
+	{
+#ifdef CLOCK_TSC
+		if (!IsTscInvariant())
+			return false;
+
+		// TSC frequency measured against steady_clock
+		auto t0 = chrono::steady_clock::now();
+		uint64_t c0 = __rdtsc();
+		this_thread::sleep_for(chrono::milliseconds(20));
+		auto t1 = chrono::steady_clock::now();
+		uint64_t c1 = __rdtsc();
+		double seconds = chrono::duration<double>(t1 - t0).count();
+		if (seconds <= 0.0 || c1 <= c0)
+			return false;
+
+		sSecondsPerTick = seconds / double(c1 - c0);
+		sOrigin = __rdtsc();
+		sbTsc = true;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	static uint64_t Ticks()
+	{
+#ifdef CLOCK_TSC
+		if (sbTsc)
+			return __rdtsc() - sOrigin;
+#endif
+		return uint64_t(chrono::steady_clock::now().time_since_epoch().count()) - sOrigin;
+	}
+
+	static double ToSeconds(uint64_t ticks)	{ return double(ticks) * sSecondsPerTick; }
+	static double ToMs(uint64_t ticks)		{ return double(ticks) * sSecondsPerTick * 1000.0; }
+
+	// Seconds since the start of the application
+	static double Now()						{ return ToSeconds(Ticks()); }
+	static double NowMs()					{ return ToMs(Ticks()); }
+
+	static bool IsTsc()						{ return sbTsc; }
+	static double GetFrequency()			{ return 1.0 / sSecondsPerTick; }
+
+private:
+#ifdef CLOCK_TSC
+	static bool IsTscInvariant()
+	{
+		// CPUID 0x80000007, EDX bit 8: the TSC runs at a constant rate in all the power states
+		unsigned int regs[4] = {};
+#ifdef _MSC_VER
+		__cpuid((int*)regs, 0x80000000);
+		if (regs[0] < 0x80000007)
+			return false;
+		__cpuid((int*)regs, 0x80000007);
+#else
+		if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+			return false;
+		__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+		return (regs[3] & (1u << 8)) != 0;
+	}
+#endif
+
+	inline static bool		sbTsc = false;
+	inline static double	sSecondsPerTick = double(chrono::steady_clock::period::num) / chrono::steady_clock::period::den;
+	inline static uint64_t	sOrigin = uint64_t(chrono::steady_clock::now().time_since_epoch().count());
+};
+
+// Time of the simulation: real time with pause and time-warp, ticked once per frame
+// Fixed steps are accumulated for the integrations that must not depend on the frame rate
+class SimClock
+{
+public:
+	float	Speed		= 1.0f;				// Time-warp
+	float	FixedStep	= 1.0f / 60.0f;		// s
+	int		MaxSteps	= 8;				// Above, the fixed steps fall behind rather than spiral
+	float	MaxDelta	= 0.25f;			// s, a longer frame (loading, breakpoint) is cut
+	float	FrameDelta	= 0.0f;				// s, when set every frame lasts this time whatever the real time (headless runs)
+
+	void Start()
+	{
+		mLast = Clock::Ticks();
+		mbStarted = true;
+	}
+
+	// At the top of the frame
+	void Tick()
+	{
+		uint64_t now = Clock::Ticks();
+		if (!mbStarted)
+		{
+			mLast = now;
+			mbStarted = true;
+		}
+		mRealDelta = FrameDelta > 0.0f ? FrameDelta : std::min(float(Clock::ToSeconds(now - mLast)), MaxDelta);
+		mLast = now;
+
+		mDelta = mbPause ? 0.0f : mRealDelta * Speed;
+		mTime += mDelta;
+
+		mAccumulator += mDelta;
+		mSteps = int(mAccumulator / FixedStep);
+		mAccumulator -= mSteps * FixedStep;
+		if (mSteps > MaxSteps)
+			mSteps = MaxSteps;
+	}
+
+	void SetPause(bool bPause)	{ mbPause = bPause; }
+	void TogglePause()			{ mbPause = !mbPause; }
+	bool IsPaused() const		{ return mbPause; }
+
+	double GetTime() const		{ return mTime; }		// s of simulation
+	float GetDelta() const		{ return mDelta; }		// s of simulation during the last frame
+	float GetRealDelta() const	{ return mRealDelta; }	// s of real time during the last frame, also when paused
+	int GetSteps() const		{ return mSteps; }		// Fixed steps to integrate this frame
+	float GetAlpha() const		{ return mAccumulator / FixedStep; }	// Fraction of a step left for the next frame
+
+private:
+	uint64_t	mLast = 0;
+	bool		mbStarted = false;
+	bool		mbPause = false;
+	double		mTime = 0.0;
+	float		mDelta = 0.0f;
+	float		mRealDelta = 0.0f;
+	float		mAccumulator = 0.0f;
+	int			mSteps = 0;
+};
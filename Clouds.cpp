@@ -5,13 +5,17 @@ This work is licensed under a Creative Commons Attribution-NonCommercial-NoDeriv
 http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 
 #include "Clouds.h"
+#include "Clock.h"
 #include <random>
 
+extern SimClock g_SimClock;
+
 #define INT_CEIL(n,d) (int)ceil((float)n/d)
 
 VolumetricClouds::VolumetricClouds(int width, int height): SCR_WIDTH(width), SCR_HEIGHT(height)
 {
 	mVolumetricCloudsShader = make_unique<Shader>("", "", "", "Resources/Clouds/volumetric_clouds.comp");
+	mReprojectShader = make_unique<Shader>("", "", "", "Resources/Clouds/clouds_reproject.comp");
 	mWeatherShader = make_unique<Shader>("", "", "", "Resources/Clouds/weather.comp");
 
 	mPostProcessingShader = make_unique<Shader>("Resources/Clouds/screen.vert", "Resources/Clouds/clouds_post.frag");
@@ -26,21 +30,11 @@ VolumetricClouds::VolumetricClouds(int width, int height): SCR_WIDTH(width), SCR
 	// 2	alphaness
 	// 3	cloudDistance
 
-	TexClouds = new unsigned int[4];			// Generates an array of 4 textures (TexCloudsColor), each in 32-bit RGBA format
-	glGenTextures(4, TexClouds);
-	for (unsigned int i = 0; i < 4; i++) 
-	{
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, TexClouds[i]);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-
-		glBindImageTexture(0, TexClouds[i], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-	}
+	// Half floats but the distance. 2 sets at the full resolution, the current one and the history of the temporal
+	// reconstruction, and the quarter resolution set of the pixels marched in a frame
+	CreateImages(mImages[0], width, height);
+	CreateImages(mImages[1], width, height);
+	CreateImages(mFresh, (width + 1) / 2, (height + 1) / 2);
 
 	//------------------------------------------------
 
@@ -50,7 +44,7 @@ VolumetricClouds::VolumetricClouds(int width, int height): SCR_WIDTH(width), SCR
 
 	glGenTextures(1, &tex);
 	glBindTexture(GL_TEXTURE_2D, tex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
 	glGenerateMipmap(GL_TEXTURE_2D);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -73,11 +67,30 @@ VolumetricClouds::VolumetricClouds(int width, int height): SCR_WIDTH(width), SCR
 }
 VolumetricClouds::~VolumetricClouds()
 {
+	glDeleteTextures(4, mImages[0]);
+	glDeleteTextures(4, mImages[1]);
+	glDeleteTextures(4, mFresh);
 	glDeleteTextures(1, &mPerlinTex);
 	glDeleteTextures(1, &mWorley32);
 	glDeleteTextures(1, &mWeatherTex);
 }
 
+void VolumetricClouds::CreateImages(GLuint* images, int width, int height)
+{
+	glGenTextures(4, images);
+	for (int i = 0; i < 4; i++)
+	{
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, images[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, ImageFormat(i), width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void VolumetricClouds::GenerateModelTextures()
 {
 	// PERLIN texture
@@ -197,13 +210,32 @@ void VolumetricClouds::InitVariables()
 
 void VolumetricClouds::Render(Camera& camera, Sky* sky, vec2 wind)
 {
+	Compute(camera, sky, wind);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);	// The images are sampled by the post processing
+	PostProcess(camera, sky);
+}
+
+void VolumetricClouds::Compute(Camera& camera, Sky* sky, vec2 wind)
+{
+	// Only the lower left part of the images is marched at a reduced resolution
+	float scale = glm::clamp(Scale, 0.1f, 1.0f);
+	mMarchW = std::max(1, int(SCR_WIDTH * scale + 0.5f));
+	mMarchH = std::max(1, int(SCR_HEIGHT * scale + 0.5f));
+
+	// The history is rejected after a camera cut
+	vec3 at = glm::normalize(camera.GetAt());
+	bool bReset = !mbHistory || glm::distance(camera.GetPosition(), mPrevPosition) > CUT_DISTANCE || glm::dot(at, mPrevAt) < CUT_COS;
+
+	// In temporal mode the marching goes to the fresh images, then the reconstruction to the current ones
+	mCurrent = 1 - mCurrent;
+	GLuint* images = bTemporal ? mFresh : mImages[mCurrent];
 	for (int i = 0; i < 4; ++i) 
-		glBindImageTexture(i, TexClouds[i], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glBindImageTexture(i, images[i], 0, GL_FALSE, 0, GL_WRITE_ONLY, ImageFormat(i));
 
 	mVolumetricCloudsShader->use();	// volumetric_clouds.comp
 
-	mVolumetricCloudsShader->setVec2("iResolution", vec2(SCR_WIDTH, SCR_HEIGHT));
-	mVolumetricCloudsShader->setFloat("iTime", glfwGetTime());
+	mVolumetricCloudsShader->setVec2("iResolution", vec2(mMarchW, mMarchH));
+	mVolumetricCloudsShader->setFloat("iTime", (float)g_SimClock.GetTime());
 	mVolumetricCloudsShader->setMat4("inv_proj", glm::inverse(camera.GetProjection()));
 	mVolumetricCloudsShader->setMat4("inv_view", glm::inverse(camera.GetView()));
 	mVolumetricCloudsShader->setVec3("cameraPosition", camera.GetPosition());
@@ -235,9 +267,55 @@ void VolumetricClouds::Render(Camera& camera, Sky* sky, vec2 wind)
 	mVolumetricCloudsShader->setSampler2D("weatherTex", mWeatherTex, 2);
 	mVolumetricCloudsShader->setSampler2D("sky", sky->GetTexture(), 3);
 
-	glDispatchCompute(INT_CEIL(SCR_WIDTH, 16), INT_CEIL(SCR_HEIGHT, 16), 1);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	// 1 pixel of each 2x2 block per frame, in the order of a 2x2 Bayer matrix: every pixel is marched each 4 frames
+	static const vec2 offsets[4] = { vec2(0, 0), vec2(1, 1), vec2(1, 0), vec2(0, 1) };
+	vec2 offset = offsets[mFrame++ % 4];
+	mVolumetricCloudsShader->setBool("bQuarter", bTemporal);
+	mVolumetricCloudsShader->setVec2("pixelOffset", bTemporal ? offset : vec2(0.0f));
+
+	if (bTemporal)
+	{
+		glDispatchCompute(INT_CEIL((mMarchW + 1) / 2, 16), INT_CEIL((mMarchH + 1) / 2, 16), 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);		// The fresh pixels are sampled by the reconstruction
+		Reproject(camera, offset, bReset);
+	}
+	else
+		glDispatchCompute(INT_CEIL(mMarchW, 16), INT_CEIL(mMarchH, 16), 1);
+
+	mbHistory = bTemporal;
+	mHistoryW = mMarchW;
+	mHistoryH = mMarchH;
+	mPrevViewProj = vp;
+	mPrevPosition = camera.GetPosition();
+	mPrevAt = at;
+}
 
+void VolumetricClouds::Reproject(Camera& camera, vec2 offset, bool bReset)
+{
+	for (int i = 0; i < 4; ++i)
+		glBindImageTexture(i, mImages[mCurrent][i], 0, GL_FALSE, 0, GL_WRITE_ONLY, ImageFormat(i));
+
+	mReprojectShader->use();	// clouds_reproject.comp
+	mReprojectShader->setSampler2D("freshColor", mFresh[0], 0);
+	mReprojectShader->setSampler2D("freshBloom", mFresh[1], 1);
+	mReprojectShader->setSampler2D("freshAlphaness", mFresh[2], 2);
+	mReprojectShader->setSampler2D("freshDistance", mFresh[3], 3);
+	mReprojectShader->setSampler2D("historyColor", mImages[1 - mCurrent][0], 4);
+	mReprojectShader->setSampler2D("historyBloom", mImages[1 - mCurrent][1], 5);
+	mReprojectShader->setVec2("iResolution", vec2(mMarchW, mMarchH));
+	mReprojectShader->setVec2("historyResolution", vec2(mHistoryW, mHistoryH));
+	mReprojectShader->setVec2("pixelOffset", offset);
+	mReprojectShader->setMat4("inv_proj", glm::inverse(camera.GetProjection()));
+	mReprojectShader->setMat4("inv_view", glm::inverse(camera.GetView()));
+	mReprojectShader->setMat4("prevViewProj", mPrevViewProj);
+	mReprojectShader->setVec3("cameraPosition", camera.GetPosition());
+	mReprojectShader->setBool("bReset", bReset);
+
+	glDispatchCompute(INT_CEIL(mMarchW, 16), INT_CEIL(mMarchH, 16), 1);
+}
+
+void VolumetricClouds::PostProcess(Camera& camera, Sky* sky)
+{
 	if (bPostProcess) 
 	{
 		// Cloud post processing filtering
@@ -248,11 +326,13 @@ void VolumetricClouds::Render(Camera& camera, Sky* sky, vec2 wind)
 
 		mPostProcessingShader->use();	// Clouds/screen.vert Clouds/clouds_post.frag
 
-		mPostProcessingShader->setSampler2D("clouds", TexClouds[0], 0);		// Color
-		mPostProcessingShader->setSampler2D("emissions", TexClouds[1], 1);	// Bloom
-		mPostProcessingShader->setVec2("cloudRenderResolution", vec2(SCR_WIDTH, SCR_HEIGHT));
+		mPostProcessingShader->setSampler2D("clouds", mImages[mCurrent][0], 0);		// Color
+		mPostProcessingShader->setSampler2D("emissions", mImages[mCurrent][1], 1);	// Bloom
+		mPostProcessingShader->setVec2("cloudRenderResolution", vec2(mMarchW, mMarchH));
 		mPostProcessingShader->setVec2("resolution", vec2(SCR_WIDTH, SCR_HEIGHT));
+		mPostProcessingShader->setVec2("uvScale", vec2(mMarchW / (float)SCR_WIDTH, mMarchH / (float)SCR_HEIGHT));
 
+		mat4 vp = camera.GetViewProjection();
 		mat4 lightModel;
 		lightModel = glm::translate(lightModel, sky->SunPosition);
 		vec4 pos = vp * lightModel * vec4(0.0, 60.0, 0.0, 1.0);
@@ -268,7 +348,7 @@ void VolumetricClouds::Render(Camera& camera, Sky* sky, vec2 wind)
 		mPostProcessingShader->setBool("isLightInFront", isLightInFront);
 		mPostProcessingShader->setBool("enableGodRays", bEnableGodRays);
 		mPostProcessingShader->setFloat("lightDotCameraFront", lightDotCameraFront);
-		mPostProcessingShader->setFloat("time", glfwGetTime());
+		mPostProcessingShader->setFloat("time", (float)g_SimClock.GetTime());
 		mPostProcessingShader->setFloat("exposure", sky->Exposure);
 
 		mPostProcessingScreenQuad->Render();
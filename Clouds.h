@@ -29,7 +29,10 @@ public:
 	void InitVariables();
 
 	void Render(Camera& camera, Sky* sky, vec2 wind);
+	void Compute(Camera& camera, Sky* sky, vec2 wind);		// Ray marching into the images (compute)
+	void PostProcess(Camera& camera, Sky* sky);				// Filtering and god rays of the images into the texture
 	GLuint GetTexture() { return tex; }
+	GLuint GetImage(int i) { return mImages[mCurrent][i]; }	// 0 color, 1 bloom, 2 alphaness, 3 distance
 
 	float	Coverage			= 0.0f;
 	float	CloudSpeed			= 0.0f;
@@ -44,6 +47,8 @@ public:
 	float	PerlinFrequency		= 0.0f;
 	bool	bEnableGodRays		= true;
 	bool	bPostProcess		= true;
+	float	Scale				= 1.0f;		// Resolution of the ray marching (dynamic resolution)
+	bool	bTemporal			= true;		// A quarter of the pixels marched per frame, the others reprojected
 
 	vec3	CloudColorTop		= vec3(0.0f);
 	vec3	CloudColorBottom	= vec3(0.0f);
@@ -51,17 +56,37 @@ public:
 	vec3	Seed				= vec3(0.0f);
 
 private:
+	static constexpr float CUT_DISTANCE = 10.0f;		// Move of the camera in a frame beyond which the history is rejected
+	static constexpr float CUT_COS		= 0.966f;		// Same for a rotation of 15 degrees
+
+	static GLenum ImageFormat(int i) { return i == 3 ? GL_R32F : GL_RGBA16F; }
+	void CreateImages(GLuint* images, int width, int height);
+	void Reproject(Camera& camera, vec2 offset, bool bReset);
+
 	int SCR_WIDTH, SCR_HEIGHT;
 	
 	unique_ptr<Shader>		mVolumetricCloudsShader;
+	unique_ptr<Shader>		mReprojectShader;
 	unique_ptr<Shader>		mWeatherShader;
 	
 	unique_ptr<Shader>		mPostProcessingShader;
 	unique_ptr<ScreenQuad>	mPostProcessingScreenQuad;
 
-	GLuint				  * TexClouds;
+	GLuint					mImages[2][4]	= { { 0 } };	// Current and history, swapped every frame
+	GLuint					mFresh[4]		= { 0 };		// Pixels marched in the frame (temporal mode)
+	int						mCurrent		= 0;
+	int						mFrame			= 0;
+	bool					mbHistory		= false;
+	int						mHistoryW		= 0;
+	int						mHistoryH		= 0;
+	mat4					mPrevViewProj	= mat4(1.0f);
+	vec3					mPrevPosition	= vec3(0.0f);
+	vec3					mPrevAt			= vec3(0.0f);
 
 	GLuint					mCloudsPostProcessingFBO = 0;
+	int						mMarchW			= 0;		// Part of the images marched
+	int						mMarchH			= 0;
+
 	GLuint					tex				= 0;
 	GLuint					depthTex		= 0;
 	
@@ -0,0 +1,122 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+using namespace std;
+
+
+// Scale of the internal resolution of the 3D passes (reflection, scene, clouds), adjusted to hold a GPU time per frame
+// The GPU time of a frame is measured by 2 timestamps around the rendering, read FRAMES frames later, so that the CPU
+// never waits for the GPU. When the CPU alone is over the target, lowering the scale would gain nothing
+class DynamicResolution
+{
+public:
+	static const int FRAMES		= 4;
+	static const int INTERVAL	= 15;			// Frames between 2 changes of the scale
+	static constexpr float STEP	= 1.0f / 32.0f;	// The scale is a multiple of STEP, to reuse the targets
+
+	bool	bEnabled	= false;
+	float	TargetFps	= 150.0f;
+	float	MinScale	= 0.5f;
+	float	MaxScale	= 1.0f;
+
+	~DynamicResolution()
+	{
+		Release();
+	}
+
+	// After the loading of OpenGL
+	void Init()
+	{
+		glGenQueries(2 * FRAMES, mQueries);
+		mbInit = true;
+	}
+
+	// Before the destruction of the context
+	void Release()
+	{
+		if (mbInit)
+			glDeleteQueries(2 * FRAMES, mQueries);
+		mbInit = false;
+	}
+
+	// Before the rendering of the frame
+	void BeginFrame()
+	{
+		if (!mbInit)
+			return;
+		mSlot = (mSlot + 1) % FRAMES;
+		Read(mSlot);
+		glQueryCounter(mQueries[2 * mSlot], GL_TIMESTAMP);
+	}
+
+	// After the rendering of the frame, with the CPU time of the frame so far. The new scale is used by the next frame
+	void EndFrame(float cpuMs)
+	{
+		if (!mbInit)
+			return;
+		glQueryCounter(mQueries[2 * mSlot + 1], GL_TIMESTAMP);
+		mbIssued[mSlot] = true;
+		mCpuMs = mCpuMs <= 0.0f ? cpuMs : 0.9f * mCpuMs + 0.1f * cpuMs;
+
+		if (!bEnabled)
+		{
+			mScale = 1.0f;
+			return;
+		}
+		if (mGpuMs <= 0.0f || ++mFrames < INTERVAL)
+			return;
+		mFrames = 0;
+
+		// The cost of the scaled passes goes with the number of pixels, the square of the scale. The fixed costs
+		// (ocean, UI) are not scaled so the correction is repeated until the time is in the band [85%, 100%] of the target
+		float targetMs = 1000.0f / std::max(TargetFps, 1.0f);
+		if (mGpuMs < targetMs && mGpuMs > 0.85f * targetMs)
+			return;
+		if (mGpuMs >= targetMs && mCpuMs >= targetMs)
+			return;		// CPU bound
+		float scale = mScale * sqrt(targetMs / mGpuMs);
+		scale = std::max(mScale - 0.125f, std::min(mScale + 0.0625f, scale));	// Faster down than up
+		scale = std::max(MinScale, std::min(MaxScale, round(scale / STEP) * STEP));
+		mScale = scale;
+	}
+
+	float	GetScale()	{ return mScale; }
+	float	GetGpuMs()	{ return mGpuMs; }		// Smoothed
+	float	GetCpuMs()	{ return mCpuMs; }
+
+private:
+	// Time of the frame which used this slot, if the GPU has finished it
+	void Read(int slot)
+	{
+		if (!mbIssued[slot])
+			return;
+		GLint available = 0;
+		glGetQueryObjectiv(mQueries[2 * slot + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return;		// The GPU is more than FRAMES late, this sample is lost
+		mbIssued[slot] = false;
+
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(mQueries[2 * slot], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(mQueries[2 * slot + 1], GL_QUERY_RESULT, &end);
+		float ms = float(double(end - start) * 1.0e-6);
+		mGpuMs = mGpuMs <= 0.0f ? ms : 0.9f * mGpuMs + 0.1f * ms;
+	}
+
+	GLuint	mQueries[2 * FRAMES]	= { 0 };
+	bool	mbIssued[FRAMES]		= { false };
+	bool	mbInit					= false;
+	int		mSlot					= 0;
+	int		mFrames					= 0;
+	float	mScale					= 1.0f;
+	float	mGpuMs					= 0.0f;
+	float	mCpuMs					= 0.0f;
+};
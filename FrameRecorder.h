@@ -0,0 +1,328 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "stb_image_write.h"
+#include "Clock.h"
+
+using namespace std;
+
+
+// Recording of the final frames without stalling the render thread
+// The back buffer is read into a ring of persistently mapped pixel pack buffers, the fence of a slot tells when its pixels
+// are in memory, then the slot goes to the encoder thread (numbered PNG or Y4M stream) and is free again once written
+// In blocking mode (headless dumps) the render thread waits for a free slot instead of losing the frame
+class FrameRecorder
+{
+public:
+	enum class eFormat { PNG, Y4M };
+	static const int RING = 6;
+
+	int Every = 1;					// One frame out of Every is captured
+	bool bBlocking = false;			// Waits for the encoder rather than dropping a frame
+
+	~FrameRecorder()
+	{
+		Stop();
+	}
+
+	// PNG: pathname is the folder of the images, Y4M: pathname is the file of the stream
+	bool Start(const string& pathname, int width, int height, eFormat format, int fps = 60)
+	{
+		Stop();
+
+		mFormat = format;
+		mWidth = width;
+		mHeight = height;
+		mPathname = pathname;
+		if (mFormat == eFormat::PNG)
+			filesystem::create_directories(mPathname);
+		else
+		{
+			// 4:2:0 needs even dimensions
+			mWidth &= ~1;
+			mHeight &= ~1;
+			mFile.open(mPathname, ios::binary);
+			if (!mFile)
+			{
+				cerr << "FrameRecorder : cannot write " << mPathname << endl;
+				return false;
+			}
+			mFile << "YUV4MPEG2 W" << mWidth << " H" << mHeight << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+		}
+
+		// Rows of the back buffer are read with the size of the window, the Y4M frame may drop the last row and column
+		mBytes = size_t(width) * height * 4;
+		mReadWidth = width;
+		mReadHeight = height;
+		for (auto& slot : mSlots)
+		{
+			glGenBuffers(1, &slot.buffer);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_PACK_BUFFER, mBytes, nullptr, flags);
+			slot.ptr = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, mBytes, flags);
+			slot.state = FREE;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		mFrame = mCaptured = mDropped = 0;
+		mWritten = 0;
+		mCaptureMs = 0.0f;
+		mbStop = false;
+		mThread = thread(&FrameRecorder::Encode, this);
+		mbRecording = true;
+		return true;
+	}
+
+	// After the last pass of the frame, before the swap
+	void Capture(int width, int height)
+	{
+		if (!mbRecording || mFrame++ % Every != 0)
+			return;
+
+		uint64_t start = Clock::Ticks();
+		Poll(false);
+
+		// A resized window or an encoder late by the whole ring loses the frame, unless blocking
+		int slot = FindFree();
+		while (slot < 0 && bBlocking && width == mReadWidth && height == mReadHeight)
+		{
+			Poll(true);
+			unique_lock<mutex> lock(mMutex);
+			mFreed.wait_for(lock, chrono::milliseconds(100), [&] { return (slot = FindFree()) >= 0; });
+		}
+		if (slot < 0 || width != mReadWidth || height != mReadHeight)
+		{
+			mDropped++;
+			return;
+		}
+
+		sSlot& s = mSlots[slot];
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glReadBuffer(GL_BACK);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, mReadWidth, mReadHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		s.index = mFrame - 1;
+		mCaptured++;
+		s.state = READING;
+		mvReading.push_back(slot);
+		mNext = (slot + 1) % RING;
+
+		mCaptureMs = 0.95f * mCaptureMs + 0.05f * (float)Clock::ToMs(Clock::Ticks() - start);
+	}
+
+	// Waits for the frames in flight and for the encoder
+	void Stop()
+	{
+		if (!mbRecording)
+			return;
+
+		Poll(true);
+		{
+			lock_guard<mutex> lock(mMutex);
+			mbStop = true;
+		}
+		mCondition.notify_all();
+		if (mThread.joinable())
+			mThread.join();
+		if (mFile.is_open())
+			mFile.close();
+
+		for (auto& slot : mSlots)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glDeleteBuffers(1, &slot.buffer);
+			slot.buffer = 0;
+			slot.ptr = nullptr;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		mbRecording = false;
+		cout << "FrameRecorder : " << mWritten << " frames written in " << mPathname << ", " << mDropped << " dropped" << endl;
+	}
+
+	bool	IsRecording()	const { return mbRecording; }
+	int		GetCaptured()	const { return mCaptured; }
+	int		GetDropped()	const { return mDropped; }
+	int		GetWritten()	const { return mWritten; }
+	float	GetCaptureMs()	const { return mCaptureMs; }		// Time of Capture on the render thread (smoothed)
+	string	GetPathname()	const { return mPathname; }
+
+private:
+	enum { FREE, READING, ENCODING };
+
+	struct sSlot
+	{
+		GLuint					buffer	= 0;
+		const unsigned char	  * ptr		= nullptr;
+		GLsync					fence	= 0;
+		int						index	= 0;		// Number of the frame since the start of the recording
+		atomic<int>				state	= FREE;
+	};
+
+	int FindFree()
+	{
+		for (int i = 0; i < RING; i++)
+			if (mSlots[(mNext + i) % RING].state == FREE)
+				return (mNext + i) % RING;
+		return -1;
+	}
+
+	// The slots whose copy is done go to the encoder in the order of the frames
+	void Poll(bool bWait)
+	{
+		while (mvReading.size())
+		{
+			sSlot& s = mSlots[mvReading.front()];
+			GLenum status = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, bWait ? 1000000000 : 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+				return;
+			glDeleteSync(s.fence);
+			s.fence = 0;
+			s.state = ENCODING;
+			{
+				lock_guard<mutex> lock(mMutex);
+				mvQueue.push_back(mvReading.front());
+			}
+			mCondition.notify_one();
+			mvReading.pop_front();
+		}
+	}
+
+	void Encode()
+	{
+		for (;;)
+		{
+			int slot;
+			{
+				unique_lock<mutex> lock(mMutex);
+				mCondition.wait(lock, [this] { return mvQueue.size() || mbStop; });
+				if (mvQueue.empty())
+					return;
+				slot = mvQueue.front();
+				mvQueue.pop_front();
+			}
+			sSlot& s = mSlots[slot];
+			if (mFormat == eFormat::PNG)
+				WritePNG(s);
+			else
+				WriteY4M(s);
+			mWritten++;
+			{
+				lock_guard<mutex> lock(mMutex);
+				s.state = FREE;
+			}
+			mFreed.notify_one();
+		}
+	}
+
+	// OpenGL rows go from the bottom to the top, the alpha of the back buffer is not written (not always opaque)
+	void WritePNG(const sSlot& s)
+	{
+		size_t row = size_t(mReadWidth) * 3;
+		mvRows.resize(row * mReadHeight);
+		for (int y = 0; y < mReadHeight; y++)
+		{
+			const unsigned char* src = s.ptr + size_t(mReadHeight - 1 - y) * mReadWidth * 4;
+			unsigned char* dst = &mvRows[y * row];
+			for (int x = 0; x < mReadWidth; x++, src += 4, dst += 3)
+			{
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+			}
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), "/frame_%05d.png", s.index);
+		stbi_write_png((mPathname + name).c_str(), mReadWidth, mReadHeight, 3, mvRows.data(), (int)row);
+	}
+
+	// Full range BT.601 (C420jpeg), chroma averaged on 2x2 pixels
+	void WriteY4M(const sSlot& s)
+	{
+		int w = mWidth, h = mHeight;
+		mvRows.resize(size_t(w) * h * 3 / 2);
+		unsigned char* Y = mvRows.data();
+		unsigned char* U = Y + w * h;
+		unsigned char* V = U + (w / 2) * (h / 2);
+		auto pixel = [&](int x, int y) { return s.ptr + (size_t(mReadHeight - 1 - y) * mReadWidth + x) * 4; };
+
+		for (int y = 0; y < h; y++)
+		{
+			for (int x = 0; x < w; x++)
+			{
+				const unsigned char* p = pixel(x, y);
+				Y[y * w + x] = (unsigned char)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+			}
+		}
+		for (int y = 0; y < h / 2; y++)
+		{
+			for (int x = 0; x < w / 2; x++)
+			{
+				int r = 0, g = 0, b = 0;
+				for (int j = 0; j < 2; j++)
+					for (int i = 0; i < 2; i++)
+					{
+						const unsigned char* p = pixel(2 * x + i, 2 * y + j);
+						r += p[0];
+						g += p[1];
+						b += p[2];
+					}
+				// Sums of 4 pixels, hence the shift of 10 instead of 8
+				U[y * (w / 2) + x] = (unsigned char)std::clamp((-43 * r - 85 * g + 128 * b + 512) / 1024 + 128, 0, 255);
+				V[y * (w / 2) + x] = (unsigned char)std::clamp((128 * r - 107 * g - 21 * b + 512) / 1024 + 128, 0, 255);
+			}
+		}
+
+		mFile << "FRAME\n";
+		mFile.write((const char*)mvRows.data(), mvRows.size());
+	}
+
+	sSlot					mSlots[RING];
+	deque<int>				mvReading;			// Slots waiting for their fence (render thread)
+	deque<int>				mvQueue;			// Slots to encode
+	vector<unsigned char>	mvRows;				// Work buffer of the encoder
+	thread					mThread;
+	mutex					mMutex;
+	condition_variable		mCondition;
+	condition_variable		mFreed;				// A slot is free again
+	bool					mbStop = false;
+	bool					mbRecording = false;
+
+	eFormat					mFormat = eFormat::PNG;
+	string					mPathname;
+	ofstream				mFile;
+	int						mWidth = 0, mHeight = 0;			// Size of the recorded frames
+	int						mReadWidth = 0, mReadHeight = 0;	// Size of the back buffer
+	size_t					mBytes = 0;
+	int						mNext = 0;
+	int						mFrame = 0;
+	int						mCaptured = 0;
+	int						mDropped = 0;
+	atomic<int>				mWritten = 0;
+	float					mCaptureMs = 0.0f;
+};
@@ -0,0 +1,69 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "Sky.h"
+#include "Shader.h"
+#include "TransientBuffer.h"
+
+using namespace std;
+using namespace glm;
+
+extern TransientBuffer g_TransientBuffer;
+
+// Same layout (std140) as the block Frame of Resources/Shaders/frame.glsl
+struct sFrameUniforms
+{
+	mat4	matView;
+	mat4	matProjection;
+	mat4	matViewProj;
+	vec3	eyePos;				float	exposure;
+	vec3	sunPosition;		float	frameTime;
+	vec3	sunDir;				float	absorbanceCoeff;
+	vec3	sunAmbient;			int		bAbsorbance;
+	vec3	sunColor;			float	fogDensity;
+	vec3	sunSpecular;		float	mistDensity;
+	vec3	absorbanceColor;	float	pad0;
+	vec3	fogColor;			float	pad1;
+};
+static_assert(sizeof(sFrameUniforms) == 320, "sFrameUniforms must match the std140 layout of frame.glsl");
+
+// Values shared by all the passes of a frame (camera, sun, exposure, absorbance, fog)
+// Written once per frame in the transient buffer and bound to Shader::FRAME_BINDING, instead of being set in every shader
+class FrameUniforms
+{
+public:
+	void Update(Camera& camera, Sky& sky, float time)
+	{
+		sFrameUniforms f;
+		f.matView			= camera.GetView();
+		f.matProjection		= camera.GetProjection();
+		f.matViewProj		= f.matProjection * f.matView;
+		f.eyePos			= camera.GetPosition();
+		f.exposure			= sky.Exposure;
+		f.sunPosition		= sky.SunPosition;
+		f.frameTime			= time;
+		f.sunDir			= normalize(sky.SunPosition);
+		f.absorbanceCoeff	= sky.AbsorbanceCoeff;
+		f.sunAmbient		= sky.SunAmbient;
+		f.bAbsorbance		= sky.bAbsorbance;
+		f.sunColor			= sky.SunDiffuse;
+		f.fogDensity		= sky.FogDensity;
+		f.sunSpecular		= sky.SunSpecular;
+		f.mistDensity		= sky.MistDensity;
+		f.absorbanceColor	= sky.AbsorbanceColor;
+		f.pad0				= 0.0f;
+		f.fogColor			= sky.FogColor;
+		f.pad1				= 0.0f;
+
+		// The alignment of the transient buffer (256) satisfies GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+		sTransientAlloc alloc = g_TransientBuffer.Upload(&f, sizeof(f));
+		glBindBufferRange(GL_UNIFORM_BUFFER, Shader::FRAME_BINDING, alloc.buffer, alloc.offset, sizeof(f));
+	}
+};
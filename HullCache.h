@@ -0,0 +1,183 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <windows.h>
+
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+
+// Preprocessed hull stored next to the OBJ (<hull>.obj.cache) and memory-mapped on load
+// Rebuilt when the version changes or when the size or the date of the OBJ differ
+struct sHullCacheHeader
+{
+	char		Magic[4]		= { 'S', 'S', 'H', 'C' };
+	uint32_t	Version			= 0;
+	uint64_t	Hash			= 0;			// Size and modification time of the OBJ file
+	uint32_t	nVertices		= 0;
+	uint32_t	nFaces			= 0;
+	uint32_t	nEdges			= 0;
+	uint32_t	nContour		= 0;			// Waterline at rest
+	uint32_t	nContourSpray	= 0;			// Offset for the spray
+	uint32_t	nContourWake	= 0;			// Offset for the foam
+	uint32_t	MaskW			= 0;			// Foam texture
+	uint32_t	MaskH			= 0;
+	vec3		Centroid		= vec3(0.0f);
+	float		Volume			= 0.0f;
+	float		Integrals[6]	= { 0.0f };		// Volume integrals of the inertia (Ixx, Iyy, Izz, Ixy, Ixz, Iyz)
+};
+
+struct sHullCacheData
+{
+	vector<vec3>	Vertices;
+	vector<ivec3>	Faces;
+	vector<float>	Areas;						// Per triangle
+	vector<vec3>	Normals;					// Per triangle
+	vector<ivec2>	Edges;
+	vector<ivec2>	EdgeTris;
+	vector<ivec3>	TriEdges;
+	vector<vec3>	Contour;
+	vector<vec3>	ContourSpray;
+	vector<vec3>	ContourWake;
+	vector<float>	Mask;
+};
+
+class HullCache
+{
+public:
+	static const uint32_t VERSION = 2;
+
+	static string Pathname(const string& pathnameObj)
+	{
+		return pathnameObj + ".cache";
+	}
+
+	// Key of the OBJ from its size and its modification time, the file itself is not read
+	static uint64_t HashFile(const string& pathname)
+	{
+		error_code ec;
+		uint64_t size = filesystem::file_size(pathname, ec);
+		if (ec)
+			return 0;
+		uint64_t time = (uint64_t)filesystem::last_write_time(pathname, ec).time_since_epoch().count();
+		if (ec)
+			return 0;
+
+		// FNV-1a of the 2 values
+		uint64_t hash = 14695981039346656037ULL;
+		for (uint64_t v : { size, time })
+			for (int i = 0; i < 8; i++)
+			{
+				hash ^= (v >> (8 * i)) & 0xFF;
+				hash *= 1099511628211ULL;
+			}
+		return hash;
+	}
+
+	// False if the cache is missing, from another version or from another OBJ
+	static bool Load(const string& pathname, uint64_t hash, sHullCacheHeader& header, sHullCacheData& data)
+	{
+		HANDLE hFile = CreateFileA(pathname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		HANDLE hMapping = nullptr;
+		const char* view = nullptr;
+		if (GetFileSizeEx(hFile, &size) && size.QuadPart >= (LONGLONG)sizeof(sHullCacheHeader))
+			hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (hMapping)
+			view = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+
+		bool bValid = false;
+		if (view)
+		{
+			memcpy(&header, view, sizeof(sHullCacheHeader));
+			bValid = memcmp(header.Magic, "SSHC", 4) == 0 && header.Version == VERSION && header.Hash == hash;
+
+			size_t offset = sizeof(sHullCacheHeader);
+			auto Read = [&](auto& v, size_t count)
+				{
+					size_t bytes = count * sizeof(v[0]);
+					if (!bValid || offset + bytes > (size_t)size.QuadPart)
+					{
+						bValid = false;
+						return;
+					}
+					v.resize(count);
+					memcpy(v.data(), view + offset, bytes);
+					offset += bytes;
+				};
+
+			Read(data.Vertices, header.nVertices);
+			Read(data.Faces, header.nFaces);
+			Read(data.Areas, header.nFaces);
+			Read(data.Normals, header.nFaces);
+			Read(data.Edges, header.nEdges);
+			Read(data.EdgeTris, header.nEdges);
+			Read(data.TriEdges, header.nFaces);
+			Read(data.Contour, header.nContour);
+			Read(data.ContourSpray, header.nContourSpray);
+			Read(data.ContourWake, header.nContourWake);
+			Read(data.Mask, size_t(header.MaskW) * header.MaskH);
+
+			UnmapViewOfFile(view);
+		}
+		if (hMapping)
+			CloseHandle(hMapping);
+		CloseHandle(hFile);
+
+		return bValid;
+	}
+
+	static bool Save(const string& pathname, sHullCacheHeader& header, const sHullCacheData& data)
+	{
+		ofstream file(pathname, ios::binary | ios::trunc);
+		if (!file)
+		{
+			cout << "Unable to write the hull cache " << pathname << endl;
+			return false;
+		}
+
+		header.Version			= VERSION;
+		header.nVertices		= (uint32_t)data.Vertices.size();
+		header.nFaces			= (uint32_t)data.Faces.size();
+		header.nEdges			= (uint32_t)data.Edges.size();
+		header.nContour			= (uint32_t)data.Contour.size();
+		header.nContourSpray	= (uint32_t)data.ContourSpray.size();
+		header.nContourWake		= (uint32_t)data.ContourWake.size();
+
+		auto Write = [&](const auto& v)
+			{
+				if (v.size())
+					file.write((const char*)v.data(), v.size() * sizeof(v[0]));
+			};
+
+		file.write((const char*)&header, sizeof(sHullCacheHeader));
+		Write(data.Vertices);
+		Write(data.Faces);
+		Write(data.Areas);
+		Write(data.Normals);
+		Write(data.Edges);
+		Write(data.EdgeTris);
+		Write(data.TriEdges);
+		Write(data.Contour);
+		Write(data.ContourSpray);
+		Write(data.ContourWake);
+		Write(data.Mask);
+
+		return file.good();
+	}
+};
@@ -0,0 +1,231 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// glm
+#include <glm/glm.hpp>
+// Eigen
+#include <Eigen/Core>
+
+#include "MeshPlaneIntersect.hpp"
+#include "WaveField.h"
+
+using namespace std;
+using namespace glm;
+
+
+struct sTriangle
+{
+	int			I[3];								// Indices of the face
+	int			bUnder[3];							// Status relative to water height
+	int			WaterStatus;						// 0 = under, 3 = above, 1 or 2 = new triangles
+	vec3		Color	= vec3(0.0f, 0.0f, 0.0f);	// Color of the triangle in debug mode
+	float		Area	= 0.0f;						// Total area
+	vec3		CoG		= vec3(0.0f, 0.0f, 0.0f);	// Centre of gravity
+	vec3		Normal	= vec3(0.0f, 0.0f, 0.0f);	// Normal vector
+
+	float		Depth;								// Profondeur
+	vec3		vPressure;							// Vecteur force de pression
+	float		fPressure;							// Norme de la force de pression
+};
+struct sForce
+{
+	float		Magnitude	= 0.0f;
+	vec3		Vector		= vec3(0.0f);
+	vec3		Position	= vec3(0.0f);
+};
+
+// Immersion of the hull in the ocean, from the vertices of the OBJ to the Archimede force and the waterline
+// No OpenGL, so that the ship and the benchmarks share the same code
+class HullImmersion
+{
+public:
+	static void InitTriangles(const Eigen::MatrixXi& F, const vector<vec3>& vertices, vector<sTriangle>& tris)
+	{
+		tris.resize(F.rows());
+		sTriangle tri;
+		for (int i = 0; i < F.rows(); ++i)
+		{
+			tri.I[0] = F(i, 0);
+			tri.I[1] = F(i, 1);
+			tri.I[2] = F(i, 2);
+			vec3 u = vertices[tri.I[1]] - vertices[tri.I[0]];
+			vec3 v = vertices[tri.I[2]] - vertices[tri.I[0]];
+			vec3 a = glm::cross(v, u);
+			tri.Area = 0.5f * sqrtf(a.x * a.x + a.y * a.y + a.z * a.z);
+			tri.Normal = glm::normalize(a);
+			tris[i] = tri;
+		}
+	}
+
+	static void TransformVertices(const Eigen::MatrixXd& V, const mat4& world, vector<vec3>& vertices)
+	{
+		vec3 p;
+		for (int i = 0; i < V.rows(); ++i)
+		{
+			p = { static_cast<float>(V(i, 0)) , static_cast<float>(V(i, 1)) ,static_cast<float>(V(i, 2)) };
+			p = vec3(world * vec4(p, 1.0f));
+			vertices[i] = p;
+		}
+	}
+
+	// Returns the mean number of steps of the search of the water under the vertices
+	static int GetHeightOfAllVertices(const WaveField& field, const vector<vec3>& vertices, vector<int>& submerged, vector<float>& waterHeight)
+	{
+		int nSearch = 0;
+		vec3 pWater;
+
+		for (unsigned int i = 0; i < vertices.size(); i++)
+		{
+			pWater = vertices[i];
+			nSearch += field.GetHeightFast(pWater);
+			submerged[i] = (vertices[i].y < pWater.y) ? 1 : 0;  // 0 = under water, 1 = above
+			waterHeight[i] = vertices[i].y - pWater.y;
+		}
+		return vertices.size() ? int(nSearch / vertices.size()) : 0;
+	}
+
+	static void GetTrisUnderWater(vector<sTriangle>& tris, const vector<int>& submerged)
+	{
+		for (auto& tri : tris)
+		{
+			tri.WaterStatus = 0;
+			for (unsigned int i = 0; i < 3; i++)
+			{
+				tri.bUnder[i] = submerged[tri.I[i]];
+				tri.WaterStatus += tri.bUnder[i];
+			}
+			switch (tri.WaterStatus)
+			{
+			case 0: tri.Color = vec3(0.5f, 0.5f, 0.5f); break;   // Above water 0/3
+			case 1: tri.Color = vec3(0.6f, 0.6f, 1.0f); break;   // Under water 1/3
+			case 2: tri.Color = vec3(0.3f, 0.3f, 1.0f); break;   // Under water 2/3
+			case 3: tri.Color = vec3(0.0f, 0.0f, 1.0f); break;   // Under water 3/3
+			}
+		}
+	}
+
+	static void ComputeArchimede(vector<sTriangle>& tris, const vector<vec3>& vertices, const vector<float>& waterHeight, float density, float gravity, sForce& archimede, float& areaWetted, float& lwl)
+	{
+		// Force calculated as the sum of the hydrostatic pressures acting on the submerged(or partially submerged) triangles of the hull
+
+		areaWetted = 0.0f;
+		archimede.Magnitude = 0.0f;
+		archimede.Vector = vec3(0.0f);
+		archimede.Position = vec3(0.0f);
+		float tmpSumPressure = 0.0f;
+		float intensity = 0.0f;
+
+		vec3 Min = vec3(FLT_MAX);
+		vec3 Max = -vec3(FLT_MAX);
+
+		for (auto& tri : tris)
+		{
+			if (tri.WaterStatus != 0) // at least, 1 pt under water
+			{
+				vec3 u = vertices[tri.I[1]] - vertices[tri.I[0]];
+				vec3 v = vertices[tri.I[2]] - vertices[tri.I[0]];
+				vec3 a = glm::cross(v, u);
+				tri.Normal = glm::normalize(a);
+				tri.CoG = (vertices[tri.I[0]] + vertices[tri.I[1]] + vertices[tri.I[2]]) / 3.0f;
+
+				if (tri.CoG.x < Min.x) Min.x = tri.CoG.x;
+				if (tri.CoG.z < Min.z) Min.z = tri.CoG.z;
+				if (tri.CoG.x > Max.x) Max.x = tri.CoG.x;
+				if (tri.CoG.z > Max.z) Max.z = tri.CoG.z;
+
+				switch (tri.WaterStatus)
+				{
+				case 3:
+					tri.Depth = -(waterHeight[tri.I[0]] + waterHeight[tri.I[1]] + waterHeight[tri.I[2]]) / 3.0f;
+					break;
+				case 2:
+					if (tri.bUnder[0] == 0)
+						tri.Depth = -(waterHeight[tri.I[1]] + waterHeight[tri.I[2]]) / 2.0f;
+					else if (tri.bUnder[1] == 0)
+						tri.Depth = -(waterHeight[tri.I[0]] + waterHeight[tri.I[2]]) / 2.0f;
+					else
+						tri.Depth = -(waterHeight[tri.I[0]] + waterHeight[tri.I[1]]) / 2.0f;
+					break;
+				case 1:
+					if (tri.bUnder[0] == 1)
+						tri.Depth = -waterHeight[tri.I[0]];
+					else if (tri.bUnder[1] == 1)
+						tri.Depth = -waterHeight[tri.I[1]];
+					else
+						tri.Depth = -waterHeight[tri.I[2]];
+					break;
+				}
+				intensity = (float)tri.WaterStatus / 3.0f;
+				tri.fPressure = intensity * density * gravity * tri.Depth * tri.Area;
+				tri.vPressure = tri.Normal * tri.fPressure;
+
+				archimede.Vector += tri.vPressure;
+				archimede.Position += tri.CoG * tri.fPressure;  // Approximation because the 3 points do not have the same hydrostatic pressure (they are not at the same height)
+				tmpSumPressure += tri.fPressure;
+
+				areaWetted += intensity * tri.Area;
+			}
+		}
+
+		archimede.Magnitude = std::max(archimede.Vector.y, 0.0f);
+		archimede.Vector = { 0.0f, archimede.Magnitude, 0.0f };     // Always vertical
+		if (tmpSumPressure > 0) archimede.Position /= tmpSumPressure;
+		else                    archimede.Position = vec3(0.0f);
+
+		lwl = std::max(fabs(Max.x - Min.x), fabs(Max.z - Min.z));
+	}
+
+	// Intersection of the hull with the plane Y = 0
+	static vector<vec3> ComputeContour(const vector<vec3>& hullVertices, const vector<sTriangle>& tris)
+	{
+		using Intersector = MeshPlaneIntersect<float, int>;
+
+		// Local lambdas for conversion
+		auto toVec3D = [](const vec3& v) -> Intersector::Vec3D {
+			return { static_cast<float>(v.x), static_cast<float>(v.y), static_cast<float>(v.z) };
+			};
+
+		auto toFace = [](const sTriangle& tri) -> Intersector::Face {
+			return { tri.I[0], tri.I[1], tri.I[2] };
+			};
+
+		// Converting vertices
+		vector<Intersector::Vec3D> vertices;
+		vertices.reserve(hullVertices.size());
+		for (const auto& v : hullVertices)
+			vertices.push_back(toVec3D(v));
+
+		// Face Conversion
+		vector<Intersector::Face> faces;
+		faces.reserve(tris.size());
+		for (const auto& tri : tris)
+			faces.push_back(toFace(tri));
+
+		// Creating the mesh
+		Intersector::Mesh mesh(vertices, faces);
+
+		// Plan Y=0, normal (0,1,0)
+		Intersector::Plane plane{ { 0,0,0 }, { 0,1,0 } };
+
+		// Intersects the mesh with the plane
+		auto result = mesh.Intersect(plane);
+
+		// Each element of result is a contour
+		vector<vec3> contour;
+		for (const auto& path : result)
+		{
+			// path.points : vector<Vec3D> points of the contour, path.isClosed : boolean, true if the contour is closed
+			for (const auto& p : path.points)
+				contour.emplace_back(static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]));
+		}
+		return contour;
+	}
+};
@@ -0,0 +1,181 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "AssetLoader.h"
+#include "KelvinPack.h"
+
+using namespace std;
+
+
+// Kelvin wake layers resident on demand: a few slots of a GPU array hold the layers around the current Froude number
+// The layers are read from the packed file by the asset loader workers, then uploaded by the GL thread (LRU eviction)
+class KelvinCache
+{
+public:
+	static const int SLOTS = 8;					// 8 x 512 KB (BC4)
+	static const int PREFETCH = 3;				// Layers streamed ahead in the direction of the acceleration
+
+	KelvinCache(AssetLoader& loader) : mLoader(loader) {}
+	~KelvinCache()
+	{
+		mAlive.reset();							// The pending uploads are dropped
+		if (mTexture)
+			glDeleteTextures(1, &mTexture);
+	}
+
+	bool Init(const string& pathname)
+	{
+		mPack = make_shared<KelvinPack>();
+		if (!mPack->Open(pathname))
+		{
+			mPack.reset();
+			return false;
+		}
+
+		glGenTextures(1, &mTexture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_COMPRESSED_RED_RGTC1, KelvinPack::SIZE, KelvinPack::SIZE, SLOTS);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		fill(begin(mSlotLayer), end(mSlotLayer), -1);
+		fill(begin(mSlotUse), end(mSlotUse), 0);
+		fill(begin(mLayerSlot), end(mLayerSlot), -1);
+		fill(begin(mbPending), end(mbPending), false);
+		mAlive = make_shared<bool>(true);
+		return true;
+	}
+
+	// Slot to sample this frame: the requested layer, or the nearest resident one while it is streamed
+	int Request(int layer)
+	{
+		layer = std::clamp(layer, 0, KelvinPack::LAYERS - 1);
+		mFrame++;
+		if (mLastLayer >= 0 && layer != mLastLayer)
+			mDirection = layer > mLastLayer ? 1 : -1;
+		mLastLayer = layer;
+
+		// Window kept resident: the neighbours and a few layers ahead
+		mWindowMin = std::max(0, layer - (mDirection < 0 ? PREFETCH : 1));
+		mWindowMax = std::min(KelvinPack::LAYERS - 1, layer + (mDirection > 0 ? PREFETCH : 1));
+
+		// First request: nothing to show in the meantime
+		if (mLayerSlot[layer] < 0 && mResident == 0)
+			Upload(layer, mPack->GetData(layer, 0));
+
+		Stream(layer);
+		for (int d = 1; layer - d >= mWindowMin || layer + d <= mWindowMax; d++)
+		{
+			if (layer + d * mDirection >= mWindowMin && layer + d * mDirection <= mWindowMax)
+				Stream(layer + d * mDirection);
+			if (layer - d * mDirection >= mWindowMin && layer - d * mDirection <= mWindowMax)
+				Stream(layer - d * mDirection);
+		}
+
+		for (int l = mWindowMin; l <= mWindowMax; l++)
+			if (mLayerSlot[l] >= 0)
+				mSlotUse[mLayerSlot[l]] = mFrame;
+
+		for (int d = 0; d < KelvinPack::LAYERS; d++)
+		{
+			if (layer - d >= 0 && mLayerSlot[layer - d] >= 0)
+				return mLayerSlot[layer - d];
+			if (layer + d < KelvinPack::LAYERS && mLayerSlot[layer + d] >= 0)
+				return mLayerSlot[layer + d];
+		}
+		return 0;
+	}
+
+	GLuint	GetTexture()	const { return mTexture; }
+	int		GetResident()	const { return mResident; }
+
+private:
+	void Stream(int layer)
+	{
+		if (mLayerSlot[layer] >= 0 || mbPending[layer])
+			return;
+		mbPending[layer] = true;
+
+		// The copy from the map faults the pages in on the worker, the GL thread only uploads
+		auto pack = mPack;
+		auto data = make_shared<vector<unsigned char>>();
+		weak_ptr<bool> alive = mAlive;
+		mLoader.Submit("Kelvin " + to_string(layer + 1),
+			[pack, data, layer]()
+			{
+				const unsigned char* src = pack->GetData(layer, 0);
+				data->assign(src, src + pack->GetLevelBytes(0));
+			},
+			[this, alive, data, layer]()
+			{
+				if (alive.expired())
+					return;
+				mbPending[layer] = false;
+				Upload(layer, data->data());
+			});
+	}
+
+	// One level per slot, as in the pack
+	void Upload(int layer, const unsigned char* data)
+	{
+		int slot = Evict();
+		glCompressedTextureSubImage3D(mTexture, 0, 0, 0, slot, KelvinPack::SIZE, KelvinPack::SIZE, 1, GL_COMPRESSED_RED_RGTC1, (GLsizei)mPack->GetLevelBytes(0), data);
+		mSlotLayer[slot] = layer;
+		mSlotUse[slot] = mFrame;
+		mLayerSlot[layer] = slot;
+	}
+
+	// Free slot, or the least recently used one outside the window
+	int Evict()
+	{
+		int best = -1;
+		for (int slot = 0; slot < SLOTS; slot++)
+		{
+			int layer = mSlotLayer[slot];
+			if (layer < 0)
+			{
+				mResident++;
+				return slot;
+			}
+			if (layer >= mWindowMin && layer <= mWindowMax)
+				continue;
+			if (best < 0 || mSlotUse[slot] < mSlotUse[best])
+				best = slot;
+		}
+		if (best < 0)
+			best = 0;
+		mLayerSlot[mSlotLayer[best]] = -1;
+		return best;
+	}
+
+	AssetLoader&				mLoader;
+	shared_ptr<KelvinPack>		mPack;
+	shared_ptr<bool>			mAlive;
+	GLuint						mTexture	= 0;
+
+	int							mSlotLayer[SLOTS];
+	unsigned int				mSlotUse[SLOTS];
+	int							mLayerSlot[KelvinPack::LAYERS];
+	bool						mbPending[KelvinPack::LAYERS];
+	int							mResident	= 0;
+
+	unsigned int				mFrame		= 0;
+	int							mLastLayer	= -1;
+	int							mDirection	= 1;
+	int							mWindowMin	= 0;
+	int							mWindowMax	= 0;
+};
@@ -0,0 +1,186 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <windows.h>
+
+#include <gli/gli/gli.hpp>
+#include <stb/stb_image.h>
+
+#include "AssetLoader.h"
+#include "BCEncoder.h"
+
+using namespace std;
+
+
+// Kelvin wake patterns: one layer of 1024 x 1024 per Froude number (layer + 1) / 100
+// Packed offline from the PNG in a single DDS (BC4), memory-mapped and uploaded without decoding
+// No mips: the array is only sampled by the vertex shader of the wake, which always reads the level 0
+class KelvinPack
+{
+public:
+	static const int LAYERS = 100;
+	static const int SIZE = 1024;
+	static const int LEVELS = 1;
+
+	KelvinPack() {}
+	~KelvinPack()
+	{
+		Close();
+	}
+
+	static string PathnamePNG(int layer)
+	{
+		char name[64];
+		sprintf_s(name, "Resources/Kelvin/Kelvin-1024_Fr-%03d.png", layer + 1);
+		return name;
+	}
+
+	// PNG -> BC4 array, the layers are encoded in parallel
+	static bool Pack(const string& pathname, AssetLoader& loader)
+	{
+		gli::texture2d_array texture(gli::FORMAT_R_ATI1N_UNORM_BLOCK8, gli::extent2d(SIZE, SIZE), LAYERS, LEVELS);
+		atomic<bool> bOk{ true };
+
+		loader.ParallelFor(LAYERS, [&](int layer)
+			{
+				int w, h, nrChannels;
+				unsigned char* data = stbi_load(PathnamePNG(layer).c_str(), &w, &h, &nrChannels, 1);
+				if (!data || w != SIZE || h != SIZE)
+				{
+					cout << "Kelvin pack: unable to read " << PathnamePNG(layer) << endl;
+					if (data)
+						stbi_image_free(data);
+					bOk = false;
+					return;
+				}
+
+				// Same orientation as the PNG loaded with the vertical flip
+				vector<unsigned char> image(SIZE * SIZE);
+				for (int y = 0; y < SIZE; y++)
+					memcpy(&image[y * SIZE], data + (SIZE - 1 - y) * SIZE, SIZE);
+				stbi_image_free(data);
+
+				BCEncoder::Encode(image.data(), SIZE, SIZE, 1, (unsigned char*)texture.data(layer, 0, 0));
+			});
+
+		if (!bOk)
+			return false;
+		if (!gli::save_dds(texture, pathname))
+		{
+			cout << "Kelvin pack: unable to write " << pathname << endl;
+			return false;
+		}
+		return true;
+	}
+
+	bool Open(const string& pathname)
+	{
+		Close();
+
+		mFile = CreateFileA(pathname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (mFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(mFile, &size) && size.QuadPart > 148)
+			mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mMapping)
+			mView = (const unsigned char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+		if (!mView || !ReadHeader((size_t)size.QuadPart))
+		{
+			cout << "Kelvin pack: invalid file " << pathname << endl;
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close()
+	{
+		if (mView)
+			UnmapViewOfFile(mView);
+		if (mMapping)
+			CloseHandle(mMapping);
+		if (mFile != INVALID_HANDLE_VALUE)
+			CloseHandle(mFile);
+		mView = nullptr;
+		mMapping = nullptr;
+		mFile = INVALID_HANDLE_VALUE;
+	}
+
+	bool					IsOpen()					const { return mView != nullptr; }
+	int						GetLevels()					const { return mLevels; }
+	int						GetLevelSize(int level)		const { return std::max(1, SIZE >> level); }
+	size_t					GetLevelBytes(int level)	const { return mLevelBytes[level]; }
+	size_t					GetLevelOffset(int level)	const { return mLevelOffset[level]; }
+	size_t					GetLayerBytes()				const { return mLayerBytes; }
+	const unsigned char*	GetData(int layer, int level) const { return mView + mDataOffset + layer * mLayerBytes + mLevelOffset[level]; }
+
+private:
+	static uint32_t FourCC(const char* s)
+	{
+		return uint32_t(s[0]) | (uint32_t(s[1]) << 8) | (uint32_t(s[2]) << 16) | (uint32_t(s[3]) << 24);
+	}
+
+	// DDS written by gli: layer after layer, all the mips of a layer together (the packs with mips are rejected and packed again)
+	bool ReadHeader(size_t fileSize)
+	{
+		if (memcmp(mView, "DDS ", 4) != 0)
+			return false;
+
+		const uint32_t* header = (const uint32_t*)(mView + 4);
+		uint32_t height = header[2];
+		uint32_t width = header[3];
+		uint32_t levels = std::max(header[6], 1u);
+		uint32_t fourCC = header[20];
+		uint32_t layers = 1;
+		mDataOffset = 4 + 124;
+
+		if (fourCC == FourCC("DX10"))
+		{
+			const uint32_t* dx10 = (const uint32_t*)(mView + mDataOffset);
+			if (dx10[0] != 80)						// DXGI_FORMAT_BC4_UNORM
+				return false;
+			layers = dx10[3];
+			mDataOffset += 20;
+		}
+		else if (fourCC != FourCC("ATI1") && fourCC != FourCC("BC4U"))
+			return false;
+
+		if (width != SIZE || height != SIZE || layers != LAYERS || levels != LEVELS)
+			return false;
+
+		mLevels = (int)levels;
+		mLayerBytes = 0;
+		for (int level = 0; level < mLevels; level++)
+		{
+			int blocks = (GetLevelSize(level) + 3) / 4;
+			mLevelOffset[level] = mLayerBytes;
+			mLevelBytes[level] = size_t(blocks) * blocks * 8;
+			mLayerBytes += mLevelBytes[level];
+		}
+		return mDataOffset + LAYERS * mLayerBytes <= fileSize;
+	}
+
+	HANDLE					mFile			= INVALID_HANDLE_VALUE;
+	HANDLE					mMapping		= nullptr;
+	const unsigned char*	mView			= nullptr;
+	size_t					mDataOffset		= 0;
+	size_t					mLayerBytes		= 0;
+	size_t					mLevelOffset[LEVELS] = { 0 };
+	size_t					mLevelBytes[LEVELS] = { 0 };
+	int						mLevels			= 0;
+};
@@ -10,6 +10,7 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 #include <list>
 #include <vector>
 #include <limits>
+#include <unordered_map>
 
 // glm
 #include <glm/glm.hpp>
@@ -29,6 +30,9 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 #include "Shader.h"
 #include "Model.h"
 #include "Ocean.h"
+#include "TransientBuffer.h"
+
+extern TransientBuffer g_TransientBuffer;
 
 struct sMark
 {
@@ -44,6 +48,27 @@ struct sMark
 	int     mooring;
     int     N = -1;
 	double  lat, lon;
+    vec3    pos = vec3(0.0f);   // OpenGL position computed at load
+    int     floater = -1;       // Index of the floater of the buoys
+};
+
+// Buoy floating on the waves: heave, roll and pitch follow the surface under the samples as damped springs
+struct sFloater
+{
+    int     mark;
+    float   heave = 0.0f;
+    float   heaveSpeed = 0.0f;
+    vec2    tilt = vec2(0.0f);          // Angles around x and z
+    vec2    tiltSpeed = vec2(0.0f);
+    mat4    model = mat4(1.0f);
+};
+
+// Cell of the grid of the marks, with the bounding box of its marks
+struct sMarkCell
+{
+    vec3        bbMin = vec3(numeric_limits<float>::max());
+    vec3        bbMax = vec3(-numeric_limits<float>::max());
+    vector<int> marks;
 };
 
 // File must have Lon and Lat with dots dor decimal
@@ -51,65 +76,213 @@ struct sMark
 class Markup
 {
 public:
-    Markup(wstring fullname)
+    Markup(wstring fullname, AssetLoader* loader = nullptr)
     {
+        mLoader = loader;
+
 		// Load zones from XML file
         LoadMarksFromXML(fullname.c_str());
-
-        // Load the different buoys
-        mBuoy[0] = make_unique<Model>("Resources/Models/Buoys/Buoy-North.glb");
-        mBuoy[1] = make_unique<Model>("Resources/Models/Buoys/Buoy-East.glb");
-        mBuoy[2] = make_unique<Model>("Resources/Models/Buoys/Buoy-South.glb");
-        mBuoy[3] = make_unique<Model>("Resources/Models/Buoys/Buoy-West.glb");
-        mBuoy[4] = make_unique<Model>("Resources/Models/Buoys/Buoy-Port.glb");
-        mBuoy[5] = make_unique<Model>("Resources/Models/Buoys/Buoy-Starboard.glb");
-        mBuoy[6] = make_unique<Model>("Resources/Models/Buoys/Buoy-Danger.glb");
-
-		mShader = make_unique<Shader>("Resources/Shaders/sun.vert", "Resources/Shaders/sun.frag");
+        BuildGrid();
+        BuildFloaters();
+
+        // Load the different buoys (decoded in parallel with a loader)
+        const char* buoys[7] = {
+            "Resources/Models/Buoys/Buoy-North.glb",
+            "Resources/Models/Buoys/Buoy-East.glb",
+            "Resources/Models/Buoys/Buoy-South.glb",
+            "Resources/Models/Buoys/Buoy-West.glb",
+            "Resources/Models/Buoys/Buoy-Port.glb",
+            "Resources/Models/Buoys/Buoy-Starboard.glb",
+            "Resources/Models/Buoys/Buoy-Danger.glb" };
+        for (int i = 0; i < 7; i++)
+            mBuoy[i] = loader ? make_unique<Model>(buoys[i], *loader) : make_unique<Model>(buoys[i]);
+
+		mShader = make_unique<Shader>("Resources/Shaders/sun_instanced.vert", "Resources/Shaders/sun.frag");
 	};
 	~Markup() {};
 
 
-	void Render(Camera& camera, Ocean* ocean, Sky* sky)
+    // Motion of the buoys, the heights of all the samples are asked to the ocean at once
+    // The springs are integrated with the fixed steps of the simulation clock
+    void Update(Ocean* ocean, int steps, float h)
+    {
+        if (!bVisible || !ocean || mvFloaters.empty())
+            return;
+
+        ocean->GetHeights(mvSamplePoints, mvSampleHeights);
+
+        bool bFirst = mbFirstUpdate;
+        mbFirstUpdate = false;
+
+        float wHeave = 2.0f * glm::pi<float>() / HeavePeriod;
+        float wTilt = 2.0f * glm::pi<float>() / TiltPeriod;
+        auto integrate = [&](int i)
+        {
+            sFloater& f = mvFloaters[i];
+            const float* s = &mvSampleHeights[i * FLOATER_SAMPLES];
+
+            // Equilibrium given by the samples: mean level and slopes of the surface
+            float level = (s[0] + s[1] + s[2] + s[3] + s[4]) / FLOATER_SAMPLES;
+            vec2 target = vec2(-atan((s[4] - s[3]) / (2.0f * FLOATER_RADIUS)), atan((s[2] - s[1]) / (2.0f * FLOATER_RADIUS)));
+            if (bFirst)
+            {
+                f.heave = level;
+                f.tilt = target;
+            }
+
+            // Semi-implicit Euler, stable with the small steps
+            for (int n = 0; n < steps; n++)
+            {
+                f.heaveSpeed += h * (wHeave * wHeave * (level - f.heave) - 2.0f * Damping * wHeave * f.heaveSpeed);
+                f.heave += h * f.heaveSpeed;
+                f.tiltSpeed += h * (wTilt * wTilt * (target - f.tilt) - 2.0f * Damping * wTilt * f.tiltSpeed);
+                f.tilt += h * f.tiltSpeed;
+            }
+
+            mat4 model = glm::translate(mat4(1.0f), mvMarks[f.mark].pos + vec3(0.0f, f.heave, 0.0f));
+            model = glm::rotate(model, f.tilt.x, vec3(1.0f, 0.0f, 0.0f));
+            f.model = glm::rotate(model, f.tilt.y, vec3(0.0f, 0.0f, 1.0f));
+        };
+
+        // Blocks of floaters on the workers of the loader
+        const int BLOCK = 64;
+        int count = (int)mvFloaters.size();
+        int blocks = (count + BLOCK - 1) / BLOCK;
+        auto block = [&](int b)
+        {
+            for (int i = b * BLOCK; i < std::min(count, (b + 1) * BLOCK); i++)
+                integrate(i);
+        };
+        if (mLoader && blocks > 1)
+            mLoader->ParallelFor(blocks, block);
+        else
+            for (int b = 0; b < blocks; b++)
+                block(b);
+    }
+
+	void Render(Camera& camera)
 	{
 		if (!bVisible)
 			return;
 
+        // Camera and sun come from the block Frame
         mShader->use();
-        mShader->setVec3("light.position", sky->SunPosition);
-        mShader->setVec3("light.ambient", sky->SunAmbient);
-        mShader->setVec3("light.diffuse", sky->SunDiffuse);
-        mShader->setVec3("light.specular", sky->SunSpecular);
-        mShader->setVec3("viewPos", camera.GetPosition());
-        mShader->setFloat("exposure", sky->Exposure);
-        mShader->setBool("bAbsorbance", sky->bAbsorbance);
-        mShader->setVec3("absorbanceColor", sky->AbsorbanceColor);
-        mShader->setFloat("absorbanceCoeff", sky->AbsorbanceCoeff);
-        mShader->setMat4("view", camera.GetView());
-        mShader->setMat4("projection", camera.GetProjection());
 
+        // Marks of the visible cells, sorted by type of buoy
         vec3 eye = camera.GetPosition();
-        for (auto& m : mvMarks)
+        mat4 viewProj = camera.GetProjection() * camera.GetView();
+        float drawDistance2 = DrawDistance * DrawDistance;
+        for (auto& instances : mvInstances)
+            instances.clear();
+        for (auto& cell : mvCells)
+        {
+            if (!IsBoxInFrustum(viewProj, cell.bbMin, cell.bbMax))
+                continue;
+
+            for (int i : cell.marks)
+            {
+                sMark& m = mvMarks[i];
+                float d2 = glm::length2(m.pos - eye);
+                if (d2 > drawDistance2)
+                    continue;
+
+                if (m.floater != -1)
+                    mvInstances[m.N].push_back(mvFloaters[m.floater].model);
+                else
+                    mvInstances[m.N].push_back(glm::translate(mat4(1.0f), m.pos));
+            }
+        }
+
+        // One draw per type of buoy, the model matrices are read by the shader from the transient buffer
+        mDrawn = 0;
+        for (int i = 0; i < 7; i++)
         {
-            if (m.name == L"Men er Rou")
-                cout << "";
-            vec2 p = LonLatToOpenGL(m.lon, m.lat);
-            vec3 pos = vec3(p.x, 0.0f, p.y);
-            if (m.boyshp > 0 && glm::length2(pos - eye) < 10000.0f)
-                ocean->GetVertice(pos, pos);
-            mat4 model = glm::translate(mat4(1.0f), pos);
-            //model = glm::scale(model, vec3(10.0f));
-            mShader->setMat4("model", model);
-            if (m.N != -1)
-                mBuoy[m.N]->Render(*mShader); continue;
+            if (mvInstances[i].empty())
+                continue;
+
+            size_t size = mvInstances[i].size() * sizeof(mat4);
+            sTransientAlloc alloc = g_TransientBuffer.Upload(mvInstances[i].data(), size);
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, alloc.buffer, alloc.offset, size);
+            mBuoy[i]->Render(*mShader, (int)mvInstances[i].size());
+            mDrawn += (int)mvInstances[i].size();
         }
-        vec2 p = OpenGLToLonLat(17914, 8764);
 	}
+
+    int GetCount() { return (int)mvMarks.size(); }
+    int GetDrawn() { return mDrawn; }
 	
     bool bVisible = true;
+    float DrawDistance = 15000.0f;      // m
+    float HeavePeriod = 2.0f;           // s, natural periods of the buoys
+    float TiltPeriod = 3.0f;            // s
+    float Damping = 0.3f;               // Ratio to the critical damping
 
 private:
 
+    // The floaters sample the ocean at their center and at 4 points around it
+    const int   FLOATER_SAMPLES = 5;
+    const float FLOATER_RADIUS = 1.0f;          // m
+
+    void BuildFloaters()
+    {
+        mvFloaters.clear();
+        mvSamplePoints.clear();
+        for (int i = 0; i < (int)mvMarks.size(); i++)
+        {
+            sMark& m = mvMarks[i];
+            if (m.boyshp <= 0 || m.N == -1)
+                continue;
+
+            m.floater = (int)mvFloaters.size();
+            sFloater f;
+            f.mark = i;
+            f.model = glm::translate(mat4(1.0f), m.pos);
+            mvFloaters.push_back(f);
+
+            vec2 c(m.pos.x, m.pos.z);
+            mvSamplePoints.push_back(c);
+            mvSamplePoints.push_back(c + vec2(-FLOATER_RADIUS, 0.0f));
+            mvSamplePoints.push_back(c + vec2(FLOATER_RADIUS, 0.0f));
+            mvSamplePoints.push_back(c + vec2(0.0f, -FLOATER_RADIUS));
+            mvSamplePoints.push_back(c + vec2(0.0f, FLOATER_RADIUS));
+        }
+    }
+
+    // Marks with a model are put in square cells, so that a frame only looks at the cells in the frustum
+    void BuildGrid()
+    {
+        const float CELL = 500.0f;  // m
+        unordered_map<long long, int> index;
+        mvCells.clear();
+        for (int i = 0; i < (int)mvMarks.size(); i++)
+        {
+            sMark& m = mvMarks[i];
+            if (m.N == -1)
+                continue;
+
+            long long cx = (long long)floor(m.pos.x / CELL);
+            long long cz = (long long)floor(m.pos.z / CELL);
+            long long key = (cx << 32) ^ (cz & 0xffffffff);
+            auto it = index.find(key);
+            if (it == index.end())
+            {
+                it = index.emplace(key, (int)mvCells.size()).first;
+                mvCells.emplace_back();
+            }
+            sMarkCell& cell = mvCells[it->second];
+            cell.marks.push_back(i);
+            cell.bbMin = glm::min(cell.bbMin, m.pos);
+            cell.bbMax = glm::max(cell.bbMax, m.pos);
+        }
+
+        // Room for the size of the buoys and the waves
+        for (auto& cell : mvCells)
+        {
+            cell.bbMin -= vec3(10.0f, 5.0f, 10.0f);
+            cell.bbMax += vec3(10.0f, 20.0f, 10.0f);
+        }
+    }
+
     void LoadMarksFromXML(const wstring filename)
     {
         mvMarks.clear();
@@ -157,6 +330,9 @@ private:
                 else if (mark.colour == L"2,3,2")
                     mark.N = 6;
 
+                vec2 p = LonLatToOpenGL(mark.lon, mark.lat);
+                mark.pos = vec3(p.x, 0.0f, p.y);
+
                 mvMarks.push_back(mark);
             }
         }
@@ -170,6 +346,14 @@ private:
 	unique_ptr<Shader>	mShader;
 	unique_ptr<Model>	mBuoy[7];
     vector<sMark>       mvMarks;
+    vector<sMarkCell>   mvCells;
+    vector<mat4>        mvInstances[7];
+    int                 mDrawn = 0;
+    vector<sFloater>    mvFloaters;
+    vector<vec2>        mvSamplePoints;
+    vector<float>       mvSampleHeights;
+    bool                mbFirstUpdate = true;
+    AssetLoader*        mLoader = nullptr;
 };
 
 
@@ -56,8 +56,8 @@ public:
     sMaterial               material;
     unsigned int            VAO = 0;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<sTexture> textures, sMaterial material)
+    // constructor, bUpload = false when built by a worker thread (Upload is then called by the GL thread)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<sTexture> textures, sMaterial material, bool bUpload = true)
     {
         this->vertices  = vertices;
         this->indices   = indices;
@@ -65,13 +65,34 @@ public:
         this->material  = material;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (bUpload)
+            setupMesh();
     }
     ~Mesh() { }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    void Upload()
     {
+        if (!VAO)
+            setupMesh();
+    }
+
+    // the copies of a mesh share its GL objects: released explicitly by the owner
+    void Release()
+    {
+        if (!VAO)
+            return;
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+    }
+
+    // render the mesh, several instances when the shader reads its model matrices from a buffer
+    void Draw(Shader &shader, int instances = 1)
+    {
+        if (!VAO)
+            return;
+
         bool has_texture = (bool)textures.size();
         shader.setBool("has_texture", has_texture);
 
@@ -100,7 +121,7 @@ public:
             else if (name == "texture_height")      number = to_string(heightNr++);     // transfer unsigned int to string
 
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            shader.setInt(name + number, i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
@@ -111,7 +132,10 @@ public:
 
         // Draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        if (instances > 1)
+            glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0, instances);
+        else
+            glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
 
         // For the transparent windows
@@ -124,6 +148,8 @@ public:
     }
     void Bind()
     {
+        if (!VAO)
+            return;
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
@@ -10,7 +10,9 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
+#include <functional>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
@@ -22,6 +24,8 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 
 #include "Mesh.h"
 #include "Shader.h"
+#include "AssetLoader.h"
+#include "TextureCache.h"
 
 using namespace std;
 using namespace glm;
@@ -51,17 +55,62 @@ public:
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
     {
         loadModel(path);
+        Upload();
         bVisible = true;
     }
 
+    // constructor, the file is decoded by a worker of the loader and the GL objects are created later by the GL thread
+    // decoded runs on the worker after the decoding, uploaded on the GL thread after Upload
+    Model(string const &path, AssetLoader& loader, bool gamma = false, function<void(Model&)> decoded = nullptr, function<void(Model&)> uploaded = nullptr) : gammaCorrection(gamma)
+    {
+        bVisible = true;
+        loader.Submit(path,
+            [this, path, decoded]() { loadModel(path); if (decoded) decoded(*this); },
+            [this, uploaded]() { Upload(); if (uploaded) uploaded(*this); });
+    }
+
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // the textures are shared with the other models
+    ~Model()
+    {
+        for (auto& key : mvTextureKeys)
+            g_TextureCache.Release(key.second);
+    }
+
+    // creates the GL objects of the decoded meshes and textures (GL thread)
+    void Upload()
+    {
+        for (auto& key : mvTextureKeys)
+        {
+            unsigned int id = g_TextureCache.Get(key.second).id;
+            textures_loaded[mTextureIndex[key.first]].id = id;
+            for (auto& mesh : meshes)
+                for (auto& texture : mesh.textures)
+                    if (texture.path == key.first)
+                        texture.id = id;
+        }
+
+        for (auto& mesh : meshes)
+            mesh.Upload();
+    }
+
+    // deletes the GL objects of the meshes (the textures are released with the model)
+    void Release()
+    {
+        for (auto& mesh : meshes)
+            mesh.Release();
+    }
+
     // draws the model, and thus all its meshes
-    void Render(Shader &shader)
+    void Render(Shader &shader, int instances = 1)
     {
         if (!bVisible)
             return;
         
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].Draw(shader, instances);
     }
     
     void Bind()
@@ -97,7 +146,11 @@ public:
     }
 
 private:
+    vector<pair<string, string>>    mvTextureKeys;      // path in the model, key in g_TextureCache (decoded with the model, uploaded by Upload)
+    unordered_map<string, size_t>   mTextureIndex;      // path in the model -> textures_loaded
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // No GL call: can run on a worker thread
     void loadModel(string const &path)
     {
         // read file via ASSIMP
@@ -268,53 +321,17 @@ private:
         vector<sTexture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures, mat);
+        // return a mesh object created from the extracted mesh data (uploaded later)
+        return Mesh(vertices, indices, textures, mat, false);
     }
 
-    unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false)
+    void TextureFromFile(const char* path, const string& directory, bool gamma = false)
     {
         string filename = string(path);
         filename = directory + '/' + filename;
 
-        unsigned int textureID;
-        glGenTextures(1, &textureID);
-
-        int width, height, nrComponents;
-        unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-        if (data)
-        {
-            GLenum format = GL_RGBA;
-            if (nrComponents == 1)
-                format = GL_RED;
-            else if (nrComponents == 3)
-                format = GL_RGB;
-            else if (nrComponents == 4)
-                format = GL_RGBA;
-
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Essential addition for RGB textures
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-
-            //glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureID);
-            //glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGBA8, width, height, GL_TRUE);
-
-            glGenerateMipmap(GL_TEXTURE_2D);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            stbi_image_free(data);
-        }
-        else
-        {
-            cout << "Texture failed to load at path: " << path << endl;
-            stbi_image_free(data);
-        }
-
-        return textureID;
+        // decoded here unless another model already did it
+        mvTextureKeys.push_back({ path, g_TextureCache.Acquire(filename, TextureCache::MATERIAL) });
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet. The required info is returned as a Texture struct.
@@ -326,23 +343,18 @@ private:
             aiString str;
             mat->GetTexture(type, i, &str);
             // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if (strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
+            auto it = mTextureIndex.find(str.C_Str());
+            if (it != mTextureIndex.end())
+                textures.push_back(textures_loaded[it->second]);
+            else
+            {   // if texture hasn't been loaded already, load it (or share the one of another model)
                 sTexture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                texture.id = 0;                                         // set by Upload
+                TextureFromFile(str.C_Str(), this->directory);
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
+                mTextureIndex[texture.path] = textures_loaded.size();
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
             }
         }
@@ -3,12 +3,14 @@ This work is licensed under a Creative Commons Attribution-NonCommercial-NoDeriv
 http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 
 #include "Ocean.h"
+#include "Profiler.h"
 
 #include <stdlib.h>
 #include <iostream>
 #include <iomanip>
 #include <string>
 #include <vector>
+#include <filesystem>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <algorithm>
@@ -43,6 +45,8 @@ extern GLuint   TexContourShip;                     // Texture of the contour of
 extern int      TexContourShipW, TexContourShipH;   // Size of the contour of the ship
 extern GLuint   TexReflectionColor;
 extern bool     g_bShipWake;
+extern TransientBuffer g_TransientBuffer;           // Per-frame uploads
+extern AssetLoader g_AssetLoader;                   // Workers for the decoding of the files
 extern GLuint   TexWakeBuffer;                      // Buffer of wake
 extern int      TexWakeBufferSize;
 extern GLuint   TexWakeVao;                         // Texture of wake made by a projection of vao
@@ -201,7 +205,18 @@ void Ocean::Init()
     glBindTexture(GL_TEXTURE_2D, mTexWaterDuDv->id);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxanisotropy);
 
-    mTexKelvinArray = InitTexture2DArray();
+    // Kelvin layers streamed from the pack, all of them resident if it is not available
+    // Packed again when it is missing or from a previous layout
+    if (!KelvinPack().Open(KELVIN_PACK) && KelvinPack::Pack(KELVIN_PACK, g_AssetLoader))
+        cout << "Kelvin: packed in " << KELVIN_PACK << endl;
+    mKelvinCache = make_unique<KelvinCache>(g_AssetLoader);
+    if (mKelvinCache->Init(KELVIN_PACK))
+        mTexKelvinArray = mKelvinCache->GetTexture();
+    else
+    {
+        mKelvinCache.reset();
+        mTexKelvinArray = InitTexture2DArray();
+    }
     glBindTextureUnit(0, mTexKelvinArray);
 
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -288,7 +303,7 @@ void Ocean::InitFrequencies()
 {
     Lambda = EvaluateLambda(Wind);
 
-    mt19937 gen(static_cast<unsigned int>(std::time(0)));
+    mt19937 gen(Seed ? Seed : static_cast<unsigned int>(std::time(0)));
     normal_distribution<> gaussian(0.0, 1.0);
     
     complex<float>* h0data = new complex<float>[(FFT_SIZE_1) * (FFT_SIZE_1)];
@@ -297,6 +312,7 @@ void Ocean::InitFrequencies()
     //vector<float> vS(FFT_SIZE_1 * FFT_SIZE_1);
 
     float* wdata = new float[(FFT_SIZE_1) * (FFT_SIZE_1)];
+    WaveSpectra spectra(Wind, mGravity, Amplitude, MESH_SIZE);
     {
         for (int m = 0; m <= FFT_SIZE; ++m)
         {
@@ -308,14 +324,14 @@ void Ocean::InitFrequencies()
                 
                 switch (SPECTRUM)
                 {
-                case 0: sqrt_S = sqrtf(Phillips(k)); break;
-                case 1: sqrt_S = sqrtf(JONSWAP(k)); break;
-                case 2: sqrt_S = sqrtf(PiersonMoskowitz(k)); break;
-                case 3: sqrt_S = sqrtf(DonelanBanner(k)); break;
-                case 4: sqrt_S = sqrtf(Elfouhaily(k)); break;
-                case 5: sqrt_S = sqrtf(Elfouhaily2(k)); break;
-                case 6: sqrt_S = sqrtf(TexelMarsenArsloe(k)); break;
-                case 7: sqrt_S = sqrtf(TexelMarsenArsloe2(k)); break;
+                case 0: sqrt_S = sqrtf(spectra.Phillips(k)); break;
+                case 1: sqrt_S = sqrtf(spectra.JONSWAP(k)); break;
+                case 2: sqrt_S = sqrtf(spectra.PiersonMoskowitz(k)); break;
+                case 3: sqrt_S = sqrtf(spectra.DonelanBanner(k)); break;
+                case 4: sqrt_S = sqrtf(spectra.Elfouhaily(k)); break;
+                case 5: sqrt_S = sqrtf(spectra.Elfouhaily2(k)); break;
+                case 6: sqrt_S = sqrtf(spectra.TexelMarsenArsloe(k)); break;
+                case 7: sqrt_S = sqrtf(spectra.TexelMarsenArsloe2(k)); break;
                 }
                 sqrt_S *= Amplitude;
                 //vS.push_back(sqrt_S);
@@ -343,46 +359,73 @@ void Ocean::InitFrequencies()
 }
 GLuint Ocean::InitTexture2DArray()
 {
-    const int texCount = 100;
-    const int width = 1024;
-    const int height = 1024;
-
-    stbi_set_flip_vertically_on_load(true);
+    const int texCount = KelvinPack::LAYERS;
+    const int width = KelvinPack::SIZE;
+    const int height = KelvinPack::SIZE;
 
     GLuint textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
 
+    // Packed BC4 array
+    KelvinPack pack;
+    if (pack.Open(KELVIN_PACK))
+    {
+        // Uploaded from the mapped file, no decoding
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_COMPRESSED_RED_RGTC1, width, height, texCount);
+        for (int layer = 0; layer < texCount; layer++)
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_COMPRESSED_RED_RGTC1, (GLsizei)pack.GetLevelBytes(0), pack.GetData(layer, 0));
+        pack.Close();
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return textureID;
+    }
+    cout << "Kelvin: " << KELVIN_PACK << " not available, loading the PNG" << endl;
+
     // Allouer espace pour la texture 2D array
     glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R8, width, height, texCount);
 
-    for (int i = 0; i < texCount; i++) 
+    // The PNG are decoded in parallel by batches (bounded memory), the layers are uploaded by this thread
+    const int batch = 16;
+    vector<unsigned char*> layers(batch);
+    for (int first = 0; first < texCount; first += batch)
     {
-        string filename;
-        if (i < 9)
-            filename = "Resources/Kelvin/Kelvin-1024_Fr-00" + std::to_string(i + 1) + ".png";
-        else if (i < 99)
-            filename = "Resources/Kelvin/Kelvin-1024_Fr-0" + std::to_string(i + 1) + ".png";
-        else
-            filename = "Resources/Kelvin/Kelvin-1024_Fr-" + std::to_string(i + 1) + ".png";
-
-        int w, h, nrChannels;
-        unsigned char* data = stbi_load(filename.c_str(), &w, &h, &nrChannels, 1); // Charger en un canal (GL_RED)
-        if (!data) {
-            std::cerr << "Error loadind texture " << filename << std::endl;
-            continue;
-        }
+        int count = std::min(batch, texCount - first);
+        g_AssetLoader.ParallelFor(count, [&](int k)
+            {
+                int i = first + k;
+                string filename = KelvinPack::PathnamePNG(i);
+
+                // The flip flag of stb_image is global: the rows are flipped here
+                int w, h, nrChannels;
+                unsigned char* data = stbi_load(filename.c_str(), &w, &h, &nrChannels, 1); // Charger en un canal (GL_RED)
+                if (!data) {
+                    std::cerr << "Error loadind texture " << filename << std::endl;
+                }
+                else if (w != width || h != height) {
+                    std::cerr << "Incorrect size in " << filename << std::endl;
+                    stbi_image_free(data);
+                    data = nullptr;
+                }
+                else {
+                    for (int y = 0; y < height / 2; y++)
+                        std::swap_ranges(data + y * width, data + (y + 1) * width, data + (height - 1 - y) * width);
+                }
+                layers[k] = data;
+            });
 
-        if (w != width || h != height) {
-            std::cerr << "Incorrect size in " << filename << std::endl;
-            stbi_image_free(data);
-            continue;
+        for (int k = 0; k < count; k++)
+        {
+            if (!layers[k])
+                continue;
+            // Copier les données dans la couche i de la 2D texture array
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, first + k, width, height, 1, GL_RED, GL_UNSIGNED_BYTE, layers[k]);
+            stbi_image_free(layers[k]);
         }
-
-        // Copier les données dans la couche i de la 2D texture array
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RED, GL_UNSIGNED_BYTE, data);
-
-        stbi_image_free(data);
     }
 
     // Paramètres de filtrage / wrapping
@@ -392,8 +435,6 @@ GLuint Ocean::InitTexture2DArray()
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
-   
-    stbi_set_flip_vertically_on_load(false);
 
     return textureID;
 }
@@ -575,360 +616,102 @@ void Ocean::EvaluatePersistence(float seconds)
     PersistenceFactor = -std::log(0.01f) / PersistenceSec;
 }
 
-// Spectra
-float Ocean::Phillips(vec2 k)
-{
-    /*
-    *   For FFT + 1 = 513 => there are 269169 calls to this function (513 x 513).
-    *   Due to 2 possibilities to exit before the result, there are only 131854 calls which succeed.
-    *   Wind force is divided by 2 (more realistic)
-    */
-
-    float k_length = glm::length(k);
-    if (k_length < 0.000001f)
-        return 0.0f;
-    
-    // k^2 & k^4
-    float k_length2 = k_length * k_length;
-    float k_length4 = k_length2 * k_length2;
-
-    float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind * 0.7f));   
-
-    // If wave is moving against wind direction
-    if (k_dot_w < 0.0f)	
-        return 0.0f;
-
-    // Directional distribution (added to Phillips spectrum)
-    k_dot_w = pow(cos(1.0f * acos(k_dot_w)), 3);
-
-    float k_dot_w2 = k_dot_w * k_dot_w;	// The higher the exponent in (k_dot_w)exp will be set (2 in this case), the more the waves will be aligned with the wind direction
-
-    float L = glm::length2(Wind * 0.7f) / mGravity;	// Largest possible wave for wind speed V. L = V^2 / g
-    float L2 = L * L;
-
-    // Suppress waves smaller than 1 / 1000
-    float damping = 0.0001f;
-    float l2 = L2 * damping * damping;
-    float S = exp(-1.0f / (k_length2 * L2)) / k_length4 * k_dot_w2 * exp(-k_length2 * l2);
-    return S * 0.0000375f;      // Acceptable factor to have the Amplitude around 1.0f
-}
-float Ocean::JONSWAP(vec2 k)
-{
-    // Le spectre JONSWAP est plus complexe et prend en compte plus de paramètres que le spectre de Phillips. Il produit généralement des vagues plus prononcées et plus réalistes, en particulier pour les mers en développement.
- 
-    k *= 6.0f;
-
-    if (k.x == 0.0f && k.y == 0.0f)
-        return 0.0f;
-
-    float k_length = glm::length(k);
-    //MinMax(k_length);
-
-    float w_length = glm::length(Wind);
-    float fetch = 1000.0f; // Longueur du fetch en mètres (à ajuster selon vos besoins)
-    float g = mGravity;
-
-    // Paramètres JONSWAP
-    float alpha = 0.076f * pow(w_length * w_length / (fetch * g), -0.22f);
-    float omega_p = 22.0f * pow(g * g / (w_length * fetch), 1.0f / 3.0f); // Fréquence de pic
-    float gamma = 3.3f; // Facteur de pic (typiquement entre 1 et 7)
-    float sigma = (k_length <= omega_p) ? 0.07f : 0.09f;
-
-    // Calcul du spectre
-    float omega = sqrt(g * k_length);
-    float r = exp(-(omega - omega_p) * (omega - omega_p) / (2.0f * sigma * sigma * omega_p * omega_p));
-    float S_pm = (alpha * g * g / pow(omega, 5)) * exp(-1.25f * pow(omega_p / omega, 4));
-    float S_j = S_pm * pow(gamma, r);
-
-    // Directionnalité
-    float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind));
-    float D = pow(cos(0.5f * acos(k_dot_w)), 2); // Distribution directionnelle
-
-    float S = S_j * D / (k_length * k_length * k_length * k_length);
-    return S * 1.0f;
-}
-float Ocean::JONSWAP2(vec2 k)
-{
-    float k_length = glm::length(k * 0.001f);
-    if (k_length < 0.000001f)
-        return 0.0f;
-
-    float omega = sqrt(mGravity * k_length);
-    float omega_p = 0.855f * mGravity / glm::length(Wind);  // Fréquence de pic
-
-    float alpha = 0.0081f;  // Constante de Phillips
-    float gamma = 3.3f;     // Facteur de pic
-    float sigma = (omega <= omega_p) ? 0.07f : 0.09f;
-
-    float r = exp(-(omega - omega_p) * (omega - omega_p) / (2.0f * sigma * sigma * omega_p * omega_p));
-
-    float S = (alpha * mGravity * mGravity / (omega * omega * omega * omega * omega)) * exp(-1.25f * pow(omega_p / omega, 4)) * pow(gamma, r);
-
-    // Distribution directionnelle
-    float theta = atan2(k.y, k.x);
-    float cos_theta = cos(theta - atan2(Wind.y, Wind.x));
-    float D = pow(cos_theta, 2);  // Distribution cosinus carré
-
-    return S * D * 0.0375f * Amplitude;  // Facteur d'échelle pour ajuster l'amplitude
-}
-float Ocean::PiersonMoskowitz(vec2 k)
-{
-    // Ce spectre est souvent utilisé pour modéliser des mers complètement développées. Il est plus simple que le spectre JONSWAP et ne prend pas en compte le fetch limité.
-
-    k *= 5.5f;
-
-    if (k.x == 0.0f && k.y == 0.0f)
-        return 0.0f;
-
-    float k_length = glm::length(k);
-
-    float g = mGravity;
-    float w_length = glm::length(Wind);
-
-    // Paramètres du spectre Pierson-Moskowitz
-    float alpha = 0.0081f; // Constante de Phillips qui contrôle l'amplitude globale du spectre.
-    float omega_p = g / w_length; // Fréquence de pic
-
-    // Calcul du spectre
-    float omega = sqrt(g * k_length);
-    float S_pm = (alpha * g * g / pow(omega, 5)) * exp(-5.0f / 4.0f * pow(omega_p / omega, 4));
-
-    // Directionnalité
-    float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind));
-    float D = pow(cos(0.5f * acos(k_dot_w)), 2); // Distribution directionnelle
-
-    float S = S_pm * D / (k_length * k_length * k_length * k_length);
-    return S * 1.0f;
-}
-float Ocean::DonelanBanner(vec2 k)
-{
-    // Ce spectre est une amélioration du spectre JONSWAP, particulièrement adapté pour les vents forts et les vagues courtes.
-
-    k *= 3.0f;
-    
-    if (k.x == 0.0f && k.y == 0.0f)
-        return 0.0f;
-
-    float k_length = glm::length(k);
-
-    float g = mGravity;
-    float w_length = glm::length(Wind);
-
-    // Paramètres du spectre Donelan-Banner
-    float alpha = 0.006f * sqrt(w_length / g);
-    float omega_p = 0.877f * g / w_length;
-    float gamma = 1.7f;
-    float sigma = 0.08f * (1.0f + 4.0f / pow(omega_p * w_length / g, 3));
-
-    // Calcul du spectre
-    float omega = sqrt(g * k_length);
-    float r = exp(-pow(omega - omega_p, 2) / (2.0f * sigma * sigma * omega_p * omega_p));
-    float S_db = alpha * g * g / pow(omega, 4) * exp(-pow(omega_p / omega, 4)) * pow(gamma, r);
-
-    // Directionnalité
-    float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind));
-    float theta = acos(k_dot_w);
-    float beta = 2.61f * pow(omega / omega_p, 0.65f);
-    float sech = 1.0f / cosh(beta * theta);
-    float D = pow(sech, 2);
-
-    float S = S_db * D / (k_length * k_length * k_length * k_length);
-    return S * 0.1f;
-}
-float Ocean::Elfouhaily(vec2 k)
-{
-    const float KM = 370.0;
-    const float CM = 0.23;
-    
-    vec2 wave_vector = k;
-    
-    wave_vector *= 80.f;
-    
-    float k_length = length(wave_vector);
-
-    float U10 = length(Wind);
-
-    float Omega = 0.84f;
-    float kp = mGravity * (Omega / U10) * (Omega / U10);
-
-    float c = sqrt(mGravity * k_length * (1.f + ((k_length * k_length) / (KM * KM)))) / k_length;
-    float cp = sqrt(mGravity * kp * (1.f + ((kp * kp) / (KM * KM)))) / kp;
-
-    float Lpm = exp(-1.25 * (kp / k_length) * (kp / k_length));
-    float gamma = 1.7;
-    float sigma = 0.08 * (1.0 + 4.0 * pow(Omega, -3.0));
-    float Gamma = exp(-(sqrt(k_length / kp) - 1.0) * (sqrtf(k_length / kp) - 1.0) / 2.0 * (sigma * sigma));
-    float Jp = pow(gamma, Gamma);
-    float Fp = Lpm * Jp * exp(-Omega / sqrt(10.0) * (sqrt(k_length / kp) - 1.0));
-    float alphap = 0.006 * sqrt(Omega);
-    float Bl = 0.5 * alphap * cp / c * Fp;
-
-    float z0 = 0.000037 * U10 * U10 / mGravity * pow(U10 / cp, 0.9);
-    float uStar = 0.41 * U10 / log(10.0 / z0);
-    float alpham = 0.01 * ((uStar < CM) ? (1.0 + log(uStar / CM)) : (1.0 + 3.0 * log(uStar / CM)));
-    float Fm = exp(-0.25 * (k_length / KM - 1.0) * (k_length / KM - 1.0));
-    float Bh = 0.5 * alpham * CM / c * Fm * Lpm;
-
-    float a0 = log(2.0) / 4.0;
-    float am = 0.13 * uStar / CM;
-    float Delta = tanh(a0 + 4.0 * pow(c / cp, 2.5) + am * pow(CM / c, 2.5));
-
-    float cosPhi = glm::dot(glm::normalize(Wind), glm::normalize(wave_vector));
-
-    float S = (1.0 / (2.0 * M_PI)) * pow(k_length, -4.0) * (Bl + Bh) * (1.0 + Delta * (2.0 * cosPhi * cosPhi - 1.0));
-
-    float dk = 2.0 * M_PI / MESH_SIZE;
-    float h = sqrt(S / 2.0) * dk;
-
-    if (wave_vector.x == 0.0 && wave_vector.y == 0.0) h = 0.f;
-    return h;
-}
-float Ocean::Elfouhaily2(vec2 k)
-{
-    float Hs = 2.0f;
-    float U10 = glm::length(Wind);
-    float fetch = 100.0f;
-
-    float g = 9.81f; // Accélération due à la gravité
-    float kp = (g / U10) * std::pow(fetch, -0.33f); // Nombre d'onde pic
-    float alpha = 0.0074f; // Coefficient de Phillips
-
-    float k_length = glm::length(k);
-
-    if (k_length == 0.0f)
-        return 0.0f;
-
-    // Spectre d'Elfouhaily
-    float S = alpha * Hs * Hs * std::pow(kp, 2) * std::pow(k_length, -3) * std::exp(-5.0f / 4.0f * std::pow(k_length / kp, -2)) * std::exp(-0.5f * std::pow(k_length / kp - 1, 2));
-    return S * 0.01f;
-}
-float Ocean::TexelMarsenArsloe(vec2 k)
-{
-    // Ce spectre de Texel-MARSEN-ARSLOE (TMA) est une modification du spectre JONSWAP pour les eaux peu profondes
-    
-    k *= 6.f;
-
-    float windSpeed = glm::length(Wind);    // Vitesse du vent en m/s
-    float fetchLength = 100000.0f;          // 100 km
-    float peakFrequency = 0.1f;             // 0.1 Hz
-    float depth = 10.0f;
-
-    if (k.x == 0.0f && k.y == 0.0f)
-        return 0.0f;
-
-    float k_length = glm::length(k);
-
-    float g = mGravity;
-    float omega = sqrt(g * k_length * tanh(k_length * depth));
-    float omega_p = 2.0f * M_PI * peakFrequency;
-
-    // Paramètres JONSWAP
-    float alpha = 0.076f * pow(windSpeed * windSpeed / (fetchLength * g), 0.22f);
-    float gamma = 3.3f;
-    float sigma = (omega <= omega_p) ? 0.07f : 0.09f;
-
-    // Calcul du spectre JONSWAP
-    float r = exp(-pow(omega - omega_p, 2) / (2 * sigma * sigma * omega_p * omega_p));
-    float S_j = alpha * g * g / pow(omega, 5) * exp(-5.0f / 4.0f * pow(omega_p / omega, 4)) * pow(gamma, r);
-
-    // Facteur de profondeur limitée
-    float k_h = k_length * depth;
-    float phi = 0.5f + 0.5f * tanh(2.0f * k_h);
-
-    // Directionnalité
-    float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind));
-    float D = pow(cos(0.5f * acos(k_dot_w)), 2);
-
-    float S = S_j * phi * D / (k_length * k_length * k_length * k_length);
-    return S * 1.0f;
-}
-float Ocean::TexelMarsenArsloe2(vec2 k)
-{
-    float omega = glm::length(k);
-    if (omega == 0.0f)
-        return 0.0f;
-
-    float Hs = 2.0f;    // Hauteur significative
-    float Tp = 10.0f;   // Période de pic
-    float g = 9.81f;    // Accélération due à la gravité
-    float omega_p = 2 * M_PI / Tp;  // Fréquence de pic
-    float alpha = 0.0081f;  // Coefficient empirique
-
-    // Spectre de Texel Marsen Arsloe
-    float S = (alpha * Hs * Hs) / std::pow(omega, 5) * std::exp(-1.25f * std::pow(omega_p / omega, 4)) * std::exp(-0.5f * std::pow((omega - omega_p) / (0.07f * omega_p), 2));
-    return S * 0.01f;
-}
-
 // Update
 void Ocean::Update(float t)
 {
+    PROFILE_GPU("Ocean update");
+
     // Update spectra
-    mShaderSpectrum->use();     // Ocean/updatespectrum.comp
-    mShaderSpectrum->setFloat("time", t);                                                   // t * 0.6 might be a adhoc parameter to slow down the speed of the waves
-    glBindImageTexture(0, mTexInitialSpectrum, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);      // tilde_h0
-    glBindImageTexture(1, mTextFrequencies, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);          // frequencies
-    glBindImageTexture(2, mTexUpdatedSpectra[0], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);   // tilde_h
-    glBindImageTexture(3, mTexUpdatedSpectra[1], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);   // tilde_D
-    glDispatchCompute(FFT_SIZE / 16, FFT_SIZE / 16, 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    {
+        PROFILE_GPU("Spectrum");
+        mShaderSpectrum->use();     // Ocean/updatespectrum.comp
+        mShaderSpectrum->setFloat("time", t);                                                   // t * 0.6 might be a adhoc parameter to slow down the speed of the waves
+        glBindImageTexture(0, mTexInitialSpectrum, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);      // tilde_h0
+        glBindImageTexture(1, mTextFrequencies, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);          // frequencies
+        glBindImageTexture(2, mTexUpdatedSpectra[0], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);   // tilde_h
+        glBindImageTexture(3, mTexUpdatedSpectra[1], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);   // tilde_D
+        glDispatchCompute(FFT_SIZE / 16, FFT_SIZE / 16, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
 
     // Transform spectra to spatial/time domain
-    FourierTransform(mTexUpdatedSpectra[0]);   // readbuff
-    FourierTransform(mTexUpdatedSpectra[1]);   // writebuff
+    {
+        PROFILE_GPU("FFT heights");
+        FourierTransform(mTexUpdatedSpectra[0]);   // readbuff
+    }
+    {
+        PROFILE_GPU("FFT choppiness");
+        FourierTransform(mTexUpdatedSpectra[1]);   // writebuff
+    }
 
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
     // Calculate displacement map
-    mShaderDisplacements->use();    // Ocean/createdisplacement.comp
-    glBindImageTexture(0, mTexUpdatedSpectra[0], 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);    // heightmap
-    glBindImageTexture(1, mTexUpdatedSpectra[1], 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);    // choppyfield
-    glBindImageTexture(2, mTexDisplacements, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);     // displacement
-    mShaderDisplacements->setFloat("lambda", Lambda);
-    glDispatchCompute(FFT_SIZE / 16, FFT_SIZE / 16, 1);
-
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    {
+        PROFILE_GPU("Displacements");
+        mShaderDisplacements->use();    // Ocean/createdisplacement.comp
+        glBindImageTexture(0, mTexUpdatedSpectra[0], 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);    // heightmap
+        glBindImageTexture(1, mTexUpdatedSpectra[1], 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);    // choppyfield
+        glBindImageTexture(2, mTexDisplacements, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);     // displacement
+        mShaderDisplacements->setFloat("lambda", Lambda);
+        glDispatchCompute(FFT_SIZE / 16, FFT_SIZE / 16, 1);
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
 
     // Calculate normal & folding map
-    swap(mTexFoamAcc1, mTexFoamAcc2);
-    mTexFoamBuffer = mTexFoamAcc1;
-
-    mShaderGradients->use();        // Ocean/creategradients.comp
-    glBindImageTexture(0, mTexDisplacements, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);      // displacements
-    glBindImageTexture(1, mTexGradients, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);         // gradients
-    glBindImageTexture(2, mTexFoamAcc1, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);              // accumulation of foam (alternate read/write)
-    glBindImageTexture(3, mTexFoamAcc2, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);             // accumulation of foam (alternate read/write)
-
-    static float tOld = t;
-    mShaderGradients->setFloat("t", t - tOld);
-    mShaderGradients->setFloat("persistenceFactor", PersistenceFactor);
-    tOld = t;
-    glDispatchCompute(FFT_SIZE / 16, FFT_SIZE / 16, 1);
-
-    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    {
+        PROFILE_GPU("Gradients");
+        swap(mTexFoamAcc1, mTexFoamAcc2);
+        mTexFoamBuffer = mTexFoamAcc1;
+
+        mShaderGradients->use();        // Ocean/creategradients.comp
+        glBindImageTexture(0, mTexDisplacements, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);      // displacements
+        glBindImageTexture(1, mTexGradients, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);         // gradients
+        glBindImageTexture(2, mTexFoamAcc1, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);              // accumulation of foam (alternate read/write)
+        glBindImageTexture(3, mTexFoamAcc2, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);             // accumulation of foam (alternate read/write)
+
+        static float tOld = t;
+        mShaderGradients->setFloat("t", t - tOld);
+        mShaderGradients->setFloat("persistenceFactor", PersistenceFactor);
+        tOld = t;
+        glDispatchCompute(FFT_SIZE / 16, FFT_SIZE / 16, 1);
+
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
 
     // Get data of displacement (x, y, z)
-    glBindTexture(GL_TEXTURE_2D, mTexDisplacements);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, mPixelsDisplacement.get());
+    {
+        PROFILE_GPU("Readback");
+        glBindTexture(GL_TEXTURE_2D, mTexDisplacements);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, mPixelsDisplacement.get());
     
-    glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
 }
 void Ocean::FourierTransform(GLuint spectrum)
 {
     // horizontal pass
-    glBindImageTexture(0, spectrum, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
-    glBindImageTexture(1, mTexTempData, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
+    {
+        PROFILE_GPU("Rows");
+        glBindImageTexture(0, spectrum, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+        glBindImageTexture(1, mTexTempData, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
 
-    mShaderFft->use();
-    glDispatchCompute(FFT_SIZE, 1, 1);
+        mShaderFft->use();
+        glDispatchCompute(FFT_SIZE, 1, 1);
 
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
 
     // vertical pass
-    glBindImageTexture(0, mTexTempData, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
-    glBindImageTexture(1, spectrum, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
+    {
+        PROFILE_GPU("Columns");
+        glBindImageTexture(0, mTexTempData, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+        glBindImageTexture(1, spectrum, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
 
-    mShaderFft->use();
-    glDispatchCompute(FFT_SIZE, 1, 1);
+        mShaderFft->use();
+        glDispatchCompute(FFT_SIZE, 1, 1);
+    }
 }
 bool Ocean::GetVertice(vec2 pos, vec3& output)
 {
@@ -945,6 +728,10 @@ bool Ocean::GetVertice(vec2 pos, vec3& output)
     output = { pos.x + mPixelsDisplacement[index + 0], mPixelsDisplacement[index + 1] , pos.y + mPixelsDisplacement[index + 2] };
     return true;
 }
+void Ocean::GetHeights(const vector<vec2>& points, vector<float>& heights)
+{
+    GetWaveField().GetHeights(points, heights);
+}
 
 // Analysis
 void Ocean::GetAllJacobians()
@@ -1000,80 +787,9 @@ bool Ocean::GetWaveByWaveAnalysis(float& waves1_3, float& waveMax, int& nWaves,
 {
     if (!bNewData)
         return false;
-
-    const size_t size = vWaveData.size();
-    if (size < 3)
+    if (!WaveField::GetWaveByWaveAnalysis(vWaveData, waves1_3, waveMax, nWaves, average_period))
         return false;
 
-    // Temporary vectors
-    vector<size_t> crest_indices;
-    vector<size_t> trough_indices;
-
-    static vector<float> vWaves;
-    static vector<float> vPeriods;
-
-    // Peak and trough detection
-    for (size_t i = 1; i < size - 1; ++i)
-    {
-        float prev = vWaveData[i - 1].dy;
-        float curr = vWaveData[i].dy;
-        float next = vWaveData[i + 1].dy;
-
-        if (curr > prev && curr > next)
-            crest_indices.push_back(i);
-        else if (curr < prev && curr < next)
-            trough_indices.push_back(i);
-    }
-
-    if (crest_indices.size() < 2 || trough_indices.empty())
-        return false;
-
-    // Wave calculation: associate each wave with a neighboring trough
-    vWaves.clear();
-    vPeriods.clear();
-
-    // To simplify, we will go through ridges in pairs and look for hollows between these ridges
-    for (size_t i = 0; i < crest_indices.size() - 1; ++i)
-    {
-        size_t crest1 = crest_indices[i];
-        size_t crest2 = crest_indices[i + 1];
-
-        // Find the minimum trough between these two peaks
-        auto trough_it = std::min_element(trough_indices.begin(), trough_indices.end(),
-            [&](size_t a, size_t b)
-            {
-                return (vWaveData[a].dy < vWaveData[b].dy) &&
-                    (a > crest1 && a < crest2);
-            });
-
-        if (trough_it != trough_indices.end() && *trough_it > crest1 && *trough_it < crest2)
-        {
-            float height = vWaveData[crest1].dy - vWaveData[*trough_it].dy;
-            if (height > 0)
-            {
-                vWaves.push_back(height);
-                // Period between 2 crests
-                float period = vWaveData[crest2].time - vWaveData[crest1].time;
-                vPeriods.push_back(period);
-            }
-        }
-    }
-
-    nWaves = (int)vWaves.size();
-    if (nWaves == 0)
-        return false;
-
-    average_period = std::accumulate(vPeriods.begin(), vPeriods.end(), 0.0f) / vPeriods.size();
-
-    std::sort(vWaves.begin(), vWaves.end(), std::greater<float>());
-    waveMax = vWaves[0];
-
-    size_t nbSignificantWaves = nWaves / 3;
-    if (nbSignificantWaves == 0)
-        return false;
-
-    waves1_3 = std::accumulate(vWaves.begin(), vWaves.begin() + nbSignificantWaves, 0.0f) / nbSignificantWaves;
-
     bNewData = false;
     return true;
 }
@@ -1517,17 +1233,9 @@ void Ocean::Render(const float t, Camera& camera, vec3& ShipPosition, float Ship
 
     // Shader activation
     mShaderOcean->use();
-    mShaderOcean->setMat4("matViewProj", camera.GetProjection() * camera.GetView());
-    mShaderOcean->setVec3("eyePos", camera.GetPosition());
     mShaderOcean->setVec3("oceanColor", OceanColor);
     mShaderOcean->setFloat("transparency", Transparency);
-    mShaderOcean->setVec3("sunColor", mSky->SunDiffuse);
     mShaderOcean->setInt("bEnvmap", bEnvmap);
-    mShaderOcean->setFloat("exposure", mSky->Exposure);
-    mShaderOcean->setBool("bAbsorbance", mSky->bAbsorbance);
-    mShaderOcean->setVec3("absorbanceColor", mSky->AbsorbanceColor);
-    mShaderOcean->setFloat("absorbanceCoeff", mSky->AbsorbanceCoeff);
-    mShaderOcean->setVec3("sunDir", glm::normalize(mSky->SunPosition));
     mShaderOcean->setBool("bShowPatch", bShowPatch);
 
     // Bind textures
@@ -1616,33 +1324,32 @@ void Ocean::Render(const float t, Camera& camera, vec3& ShipPosition, float Ship
         }
     }
 
-    // Create and use a single VBO instance for all LODs
-    GLuint instanceVBO;
-    glGenBuffers(1, &instanceVBO);
+    // Instances of all LODs are written in the transient buffer of the frame
     for (int lodLevel = 0; lodLevel < 5; lodLevel++)
     {
         if (instanceData[lodLevel].empty())
             continue;
 
+        sTransientAlloc alloc = g_TransientBuffer.Upload(&instanceData[lodLevel][0], instanceData[lodLevel].size() * sizeof(InstanceData));
+
         glBindVertexArray(mvVAOs[lodLevel]);
-        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-        glBufferData(GL_ARRAY_BUFFER, instanceData[lodLevel].size() * sizeof(InstanceData), &instanceData[lodLevel][0], GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, alloc.buffer);
 
         // Mat4 attributes (occupy locations 2,3,4,5)
         for (unsigned int i = 0; i < 4; i++)
         {
             glEnableVertexAttribArray(2 + i);
-            glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(sizeof(vec4) * i));
+            glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(alloc.offset + sizeof(vec4) * i));
             glVertexAttribDivisor(2 + i, 1);
         }
         // Lod attribute (location 6)
         glEnableVertexAttribArray(6);
-        glVertexAttribIPointer(6, 1, GL_INT, sizeof(InstanceData), (void*)offsetof(InstanceData, lod));
+        glVertexAttribIPointer(6, 1, GL_INT, sizeof(InstanceData), (void*)(alloc.offset + offsetof(InstanceData, lod)));
         glVertexAttribDivisor(6, 1);
 
         // foamSwitch attribute (location 7)
         glEnableVertexAttribArray(7);
-        glVertexAttribIPointer(7, 1, GL_INT, sizeof(InstanceData), (void*)offsetof(InstanceData, foamSwitch));
+        glVertexAttribIPointer(7, 1, GL_INT, sizeof(InstanceData), (void*)(alloc.offset + offsetof(InstanceData, foamSwitch)));
         glVertexAttribDivisor(7, 1);
 
         // Instanced drawing
@@ -1652,14 +1359,10 @@ void Ocean::Render(const float t, Camera& camera, vec3& ShipPosition, float Ship
     
     for (int lodLevel = 0; lodLevel < 5; lodLevel++)
         sumPatches += instanceData[lodLevel].size();
-
-    glDeleteBuffers(1, &instanceVBO);
 #pragma endregion
 
 #pragma region Patches with wake
     mShaderOceanWake->use();
-    mShaderOceanWake->setMat4("matViewProj", camera.GetProjection()* camera.GetView());
-    mShaderOceanWake->setVec3("eyePos", camera.GetPosition());
     mShaderOceanWake->setVec3("oceanColor", OceanColor);
     
     mShaderOceanWake->setVec3("shipPosition", ShipPosition);
@@ -1670,15 +1373,11 @@ void Ocean::Render(const float t, Camera& camera, vec3& ShipPosition, float Ship
     int layer = int(100.0f * fabs(shipVelocity) / sqrt(9.81f * LWL)) + 20;   // Froude is (layer + 1) / 100
     layer = glm::clamp(layer, 0, 99);
     //cout << layer << endl;
+    if (mKelvinCache)
+        layer = mKelvinCache->Request(layer);       // Slot of the layer
     mShaderOceanWake->setInt("texLayer", layer);
     mShaderOceanWake->setFloat("transparency", Transparency);
-    mShaderOceanWake->setVec3("sunColor", mSky->SunDiffuse);
     mShaderOceanWake->setInt("bEnvmap", bEnvmap);
-    mShaderOceanWake->setFloat("exposure", mSky->Exposure);
-    mShaderOceanWake->setBool("bAbsorbance", mSky->bAbsorbance);
-    mShaderOceanWake->setVec3("absorbanceColor", mSky->AbsorbanceColor);
-    mShaderOceanWake->setFloat("absorbanceCoeff", mSky->AbsorbanceCoeff);
-    mShaderOceanWake->setVec3("sunDir", glm::normalize(mSky->SunPosition));
     mShaderOceanWake->setVec2("shipPivot", vec2(ShipPosition.x, ShipPosition.z));
     mShaderOceanWake->setFloat("shipRotation", -ShipRotation);
     mShaderOceanWake->setVec2("shipSize", vec2(TexContourShipW, TexContourShipH));
@@ -1740,7 +1439,7 @@ void Ocean::Render(const float t, Camera& camera, vec3& ShipPosition, float Ship
     }
     
     sumPatches += vPatches.size();
-    //cout << sumPatches << endl;
+    PROFILE_COUNT("Ocean patches", sumPatches);
 
     glActiveTexture(GL_TEXTURE0);
 #pragma endregion
@@ -22,10 +22,16 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 #include "Camera.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "TransientBuffer.h"
+#include "AssetLoader.h"
+#include "KelvinPack.h"
+#include "KelvinCache.h"
 #include "Shapes.h"
 #include "Utility.h"
 #include "mat4.h"
 #include "Sky.h"
+#include "WaveSpectra.h"
+#include "WaveField.h"
 
 using namespace std;
 using namespace glm;
@@ -35,11 +41,9 @@ struct GridVertex
 	vec3 position;
 	vec2 texCoord;
 };
-struct WaveData
-{
-	double time;
-	double dx, dy, dz;
-};
+
+// Kelvin wake array packed from the PNG (BC4 with mips)
+const string KELVIN_PACK = "Resources/Kelvin/Kelvin-1024_BC4.dds";
 
 
 class Ocean
@@ -56,20 +60,11 @@ public:
 	float		EvaluateLambda(vec2 wind);
 	void		EvaluatePersistence(float seconds);
 
-	float		Phillips(vec2 k);
-	float		JONSWAP(vec2 k);
-	float		JONSWAP2(vec2 k);
-	float		PiersonMoskowitz(vec2 k);
-	float		DonelanBanner(vec2 k);
-	float		Elfouhaily(vec2 k);
-	float		Elfouhaily2(vec2 k);
-	float		TexelMarsenArsloe(vec2 k);
-	float		TexelMarsenArsloe2(vec2 k);
-
 	void		Update(float t);
 	void		FourierTransform(GLuint spectrum);
 
 	bool		GetVertice(vec2 pos, vec3& output);
+	void		GetHeights(const vector<vec2>& points, vector<float>& heights);
 	void		GetRecordFromBuoy(vec2 pos, float t);
 	bool		GetWaveByWaveAnalysis(float& waves1_3, float& waveMax, int& nWaves, float& average_period);
 	vector<vec2>GetCut(int xN);
@@ -83,6 +78,8 @@ public:
 	GLuint		GetFoamBufferID()	{ return mTexFoamBuffer; };
 
 	float	  * GetPixelsDisplacement() { return mPixelsDisplacement.get(); };
+	WaveField	GetWaveField()			{ return WaveField(mPixelsDisplacement.get(), FFT_SIZE, MESH_SIZE, PATCH_SIZE); };
+	float		GetGravity()			{ return mGravity; };
 
 	void		Render(const float t, Camera& camera, vec3& ShipPosition, float ShipRotation, bool bWaves, float LWL, float kelvinScale, float shipVelocity, float centerFore);
 
@@ -98,6 +95,7 @@ public:
 	vec2				Wind			= { 0.0f, 1.0f };	// Input of wind (no need to be normalized at this stage)
 	float				Amplitude		= 1.0f;				// Amplitude of the waves
 	float				Lambda			= -1.0f;			// Factor of choppiness (exagerate the displacements)
+	unsigned int		Seed			= 0;				// Random phases of the spectrum, 0 for a new draw at each init
 	
 	vec3				OceanColor;
 	int					iOceanColor		= 6;
@@ -169,6 +167,7 @@ private:
 	unique_ptr<Texture>		mTexFoam;				// texture of the wake
 	unique_ptr<Texture>		mTexWaterDuDv;			// texture to bring noise for the reflection of the ship on the water 
 	GLuint					mTexKelvinArray;
+	unique_ptr<KelvinCache>	mKelvinCache;			// Slots of the Kelvin layers around the current Froude number (all the layers in mTexKelvinArray without it)
 
 	// Miscellaneous
 	float					mGravity				= 9.81f;
@@ -17,51 +17,61 @@ using namespace glm;
 struct ParticleGPU 
 {
     vec3    position;
+    float   pad;        // std430 alignment of the vec3 that follows
     vec3    velocity;
     float   life;
     vec4    color;
 };
+struct SprayEmitterGPU
+{
+    vec4    position;   // Local position, w = intensity
+    vec4    normal;     // Local normal
+};
+struct SprayParams
+{
+    mat4    world;
+    float   velocityScale;      // The speed of the particles depends on the speed of the ship
+    float   verticalBias;       // Pitch
+    vec2    cogBias;            // Drift
+    int     multiplier;         // Number of particles interpolated between 2 emitters
+    float   offsetRange;        // Random offset of the position of emission
+};
 
 class Spray
 {
 public:
     bool bVisible = true;
 
-    Spray()
+    Spray(int fftSize, int patchSize)
     {
         lifeSpan = (int)((longLife - shortLife) * 10.0f) + 1;
 
-        mvParticles.resize(mMaxParticles);
-
-        // Initializing the MultiMesh
-        glGenBuffers(1, &mVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-        glBufferData(GL_ARRAY_BUFFER, mMaxParticles * sizeof(ParticleGPU), nullptr, GL_DYNAMIC_DRAW);
-
+        // Pool of particles, all dead at the start
+        glGenBuffers(1, &mSSBO_PARTICLES);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_PARTICLES);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, mMaxParticles * sizeof(ParticleGPU), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+
+        // Indices of the living particles, written by the compute shader
+        glGenBuffers(1, &mSSBO_ALIVE);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_ALIVE);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, mMaxParticles * sizeof(GLuint), nullptr, 0);
+
+        // Indirect draw command + counter of emissions
+        GLuint counters[5] = { 1, 0, 0, 0, 0 };
+        glGenBuffers(1, &mSSBO_COUNTERS);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_COUNTERS);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(counters), counters, 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        // No attributes, the vertex shader reads the SSBOs
         glGenVertexArrays(1, &mVAO);
-        glBindVertexArray(mVAO);
 
-        // Position (attribute 0)
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleGPU), (void*)0);
-        glVertexAttribDivisor(0, 1);
-
-        // Velocity (attribute 1)
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleGPU), (void*)(3 * sizeof(float)));
-        glVertexAttribDivisor(1, 1);
-
-        // Life (attribute 2)
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(ParticleGPU), (void*)(6 * sizeof(float)));
-        glVertexAttribDivisor(2, 1);
-
-        // Color (attribute 3)
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleGPU), (void*)(7 * sizeof(float)));
-        glVertexAttribDivisor(3, 1);
-
-        glBindVertexArray(0);
+        char defines[128];
+        sprintf_s(defines, "#define FFT_SIZE %d\n#define PATCH_SIZE %d\n", fftSize, patchSize);
+        mShaderCompute = make_unique<Shader>();
+        mShaderCompute->addDefines(defines);
+        mShaderCompute->Load("", "", "", "Resources/Ship/spray.comp");
 
         glDepthMask(GL_FALSE);
         mShader = make_unique<Shader>("Resources/Ship/spray.vert", "Resources/Ship/spray.frag");
@@ -70,68 +80,75 @@ public:
 
     ~Spray()
     {
-        glDeleteBuffers(1, &mVBO);
+        glDeleteBuffers(1, &mSSBO_PARTICLES);
+        glDeleteBuffers(1, &mSSBO_ALIVE);
+        glDeleteBuffers(1, &mSSBO_COUNTERS);
+        glDeleteBuffers(1, &mSSBO_EMITTERS);
         glDeleteVertexArrays(1, &mVAO);
     }
 
-    void Emit(vec3 position, vec3 velocity)
-    {
-        if (mActiveParticles >= mMaxParticles)
-            return;
-
-        vec3 randomOffset = vec3( (rand() % 100 - 50) / 1000.0f, (rand() % 100 - 50) / 1000.0f, (rand() % 100 - 50) / 1000.0f );
-        mvParticles[mActiveParticles].position = position + randomOffset;
-
-        // Ajout de variation alatoire pour un mouvement naturel
-        vec3 randomVelocity = vec3( (rand() % 100 - 50) / 500.0f, (rand() % 100 - 50) / 500.0f, (rand() % 100 - 50) / 500.0f );
-        mvParticles[mActiveParticles].velocity = velocity + randomVelocity;
-        
-        mvParticles[mActiveParticles].life = shortLife + (rand() % lifeSpan) / 10.0f;
-
-        float gray = 0.8f + static_cast<float>(rand()) / static_cast<float>(RAND_MAX) * 0.2f;
-        mvParticles[mActiveParticles].color = vec4(gray, gray, gray, 0.8f);
-
-        mActiveParticles++;
-    }
-    void Update(float deltaTime)
+    // Points of emission in local coordinates: the left side first, then the right side
+    // Called again when the waterline moves, the buffer is only reallocated when it grows
+    void SetEmitters(const vector<SprayEmitterGPU>& emitters, int leftCount)
     {
-        const float gravity = 9.81f;
+        mNumEmitters = (int)emitters.size();
+        mLeftCount = leftCount;
 
-        for (int i = 0; i < mActiveParticles; ++i)
+        if (mSSBO_EMITTERS && mNumEmitters <= mEmittersCapacity)
         {
-            mvParticles[i].life -= deltaTime;
-            if (mvParticles[i].life < 0)   // Underwater
-            {
-                // Remplace la particule morte par la dernire
-                mvParticles[i] = mvParticles[mActiveParticles - 1];
-                mActiveParticles--;
-                i--;
-                continue;
-            }
-
-            // Applique la gravit (descente verticale)
-            mvParticles[i].velocity.y -= gravity * deltaTime;
-
-            // Turbulence lgre
-            float turbulenceStrength = 50.0f;
-            mvParticles[i].velocity += turbulenceStrength * vec3( (rand() % 100 - 50) / 100.0f, (rand() % 100 - 50) / 100.0f, (rand() % 100 - 50) / 100.0f ) * deltaTime;
-
-            // Mise  jour position
-            mvParticles[i].position += mvParticles[i].velocity * deltaTime;
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_EMITTERS);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mNumEmitters * sizeof(SprayEmitterGPU), emitters.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            return;
         }
 
-        UpdateParticleBuffers();
-    }
+        if (mSSBO_EMITTERS)
+            glDeleteBuffers(1, &mSSBO_EMITTERS);
+        mEmittersCapacity = std::max(mNumEmitters, 1) * 2;
 
-    void UpdateParticleBuffers()
-    {
-        glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, mActiveParticles * sizeof(ParticleGPU), mvParticles.data());
+        glGenBuffers(1, &mSSBO_EMITTERS);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_EMITTERS);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, mEmittersCapacity * sizeof(SprayEmitterGPU), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mNumEmitters * sizeof(SprayEmitterGPU), emitters.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     }
-    float GetNbActiveParticles()
+
+    void Update(float deltaTime, const SprayParams& params, GLuint texDisplacement)
     {
-        return mActiveParticles;
+        if (mNumEmitters < 4)
+            return;
+
+        glBindImageTexture(0, texDisplacement, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mSSBO_PARTICLES);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mSSBO_EMITTERS);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mSSBO_ALIVE);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mSSBO_COUNTERS);
+
+        mShaderCompute->use();
+        mShaderCompute->setFloat("dt", deltaTime);
+        mShaderCompute->setInt("frameCount", mFrameCount++);
+        mShaderCompute->setMat4("World", params.world);
+        mShaderCompute->setInt("numEmitters", mNumEmitters);
+        mShaderCompute->setInt("leftCount", mLeftCount);
+        mShaderCompute->setInt("multiplier", std::max(params.multiplier, 1));
+        mShaderCompute->setFloat("velocityScale", params.velocityScale);
+        mShaderCompute->setFloat("verticalBias", params.verticalBias);
+        mShaderCompute->setVec2("cogBias", params.cogBias);
+        mShaderCompute->setFloat("offsetRange", params.offsetRange);
+        mShaderCompute->setFloat("shortLife", shortLife);
+        mShaderCompute->setFloat("longLife", longLife);
+
+        // Reset of the counters
+        mShaderCompute->setInt("pass", 0);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        // Emission, motion and compaction
+        mShaderCompute->setInt("pass", 1);
+        glDispatchCompute((mMaxParticles + 255) / 256, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
     }
+
     void Render(Camera& camera, float density, float exposure)
     {
         if (!bVisible)
@@ -144,19 +161,32 @@ public:
         mShader->setFloat("lifeSpan", lifeSpan);
         mShader->setFloat("exposure", exposure);
 
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mSSBO_PARTICLES);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mSSBO_ALIVE);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mSSBO_COUNTERS);
+
+        // The number of instances is the number of living particles, counted by the compute shader
         glBindVertexArray(mVAO);
-        glDrawArraysInstanced(GL_POINTS, 0, 1, mActiveParticles);
+        glDrawArraysIndirect(GL_POINTS, nullptr);
         glBindVertexArray(0);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     }
 
 private:
     static const int    mMaxParticles = 50000;
 
-    vector<ParticleGPU> mvParticles;
-    GLuint              mVBO;
-    GLuint              mVAO;
+    GLuint              mSSBO_PARTICLES = 0;
+    GLuint              mSSBO_ALIVE     = 0;
+    GLuint              mSSBO_COUNTERS  = 0;
+    GLuint              mSSBO_EMITTERS  = 0;
+    GLuint              mVAO            = 0;
+    int                 mNumEmitters    = 0;
+    int                 mEmittersCapacity = 0;
+    int                 mLeftCount      = 0;
+    int                 mFrameCount     = 0;
+    unique_ptr<Shader>  mShaderCompute;
     unique_ptr<Shader>  mShader;
-    int                 mActiveParticles = 0;
     const float         shortLife = 1.0f;
     const float         longLife = 2.0f;
     int                 lifeSpan;
@@ -0,0 +1,414 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <cstring>
+
+#include <glad/glad.h>
+#include <imgui.h>
+
+#include "Clock.h"
+
+using namespace std;
+
+
+struct sProfileScope
+{
+	const char* name		= "";
+	int			depth		= 0;
+	double		cpuStart	= 0.0;		// ms from the start of the frame
+	double		cpuEnd		= 0.0;
+	int			query		= -1;		// First of the 2 timestamps, -1 for a CPU scope
+	double		gpuStart	= -1.0;		// ms from the first timestamp of the frame, -1 when unknown
+	double		gpuEnd		= -1.0;
+};
+
+struct sProfileFrame
+{
+	double					start	= 0.0;		// ms from the start of the profiler
+	double					cpu		= 0.0;		// ms
+	double					gpu		= -1.0;
+	vector<sProfileScope>	scopes;
+	vector<pair<const char*, double>> counters;	// Summed over the frame
+	bool					bPending = false;	// GPU timestamps not read yet
+};
+
+// Hierarchical profiler of the main loop: CPU scopes with the Clock and GPU scopes with timestamp queries
+// The queries of a frame are read FRAMES frames later so that the CPU never waits for the GPU
+class Profiler
+{
+public:
+	static const int FRAMES			= 3;
+	static const int MAX_QUERIES	= 256;		// Per frame, 2 per GPU scope
+	static const int HISTORY		= 300;		// Frames kept for the view and the trace
+
+	~Profiler()
+	{
+		Release();
+	}
+
+	// After the loading of OpenGL, on the thread that renders
+	void Init()
+	{
+		mvQueries.resize(FRAMES * MAX_QUERIES);
+		glGenQueries((GLsizei)mvQueries.size(), mvQueries.data());
+		mThread = this_thread::get_id();
+		mOrigin = Clock::NowMs();
+		mbInit = true;
+	}
+
+	// Before the destruction of the context
+	void Release()
+	{
+		if (mvQueries.size())
+			glDeleteQueries((GLsizei)mvQueries.size(), mvQueries.data());
+		mvQueries.clear();
+		mbInit = false;
+		mbInFrame = false;
+	}
+
+	void BeginFrame()
+	{
+		if (!mbInit || !bEnabled)
+			return;
+
+		mSlot = (mSlot + 1) % FRAMES;
+		Collect(mFrames[mSlot]);
+
+		sProfileFrame& frame = mFrames[mSlot];
+		frame.scopes.clear();
+		frame.counters.clear();
+		frame.start = Now();
+		frame.cpu = 0.0;
+		frame.gpu = -1.0;
+		frame.bPending = true;
+		mQueries = 0;
+		mvStack.clear();
+		mbInFrame = true;
+		Push("Frame", true);
+	}
+	void EndFrame()
+	{
+		if (!mbInFrame)
+			return;
+		while (mvStack.size())
+			Pop();
+		mbInFrame = false;
+
+		sProfileFrame& frame = mFrames[mSlot];
+		frame.cpu = frame.scopes.size() ? frame.scopes[0].cpuEnd : 0.0;
+	}
+
+	// Waits for the GPU and collects the frames still in flight, oldest first
+	void Flush()
+	{
+		if (!mbInit || mbInFrame)
+			return;
+		glFinish();
+		for (int i = 1; i <= FRAMES; i++)
+			Collect(mFrames[(mSlot + i) % FRAMES]);
+	}
+
+	// False when the scope is not recorded (profiler off, outside a frame, other thread)
+	bool Push(const char* name, bool bGpu)
+	{
+		if (!mbInFrame || this_thread::get_id() != mThread)
+			return false;
+
+		sProfileFrame& frame = mFrames[mSlot];
+		sProfileScope scope;
+		scope.name = name;
+		scope.depth = (int)mvStack.size();
+		scope.cpuStart = Now() - frame.start;
+		if (bGpu && mQueries + 2 <= MAX_QUERIES)
+		{
+			scope.query = mQueries;
+			glQueryCounter(mvQueries[mSlot * MAX_QUERIES + mQueries], GL_TIMESTAMP);
+			mQueries += 2;
+		}
+		mvStack.push_back((int)frame.scopes.size());
+		frame.scopes.push_back(scope);
+		return true;
+	}
+	void Pop()
+	{
+		if (mvStack.empty())
+			return;
+
+		sProfileFrame& frame = mFrames[mSlot];
+		sProfileScope& scope = frame.scopes[mvStack.back()];
+		mvStack.pop_back();
+		scope.cpuEnd = Now() - frame.start;
+		if (scope.query != -1)
+			glQueryCounter(mvQueries[mSlot * MAX_QUERIES + scope.query + 1], GL_TIMESTAMP);
+	}
+
+	// Value added to the counter of the frame (patches drawn, searches...)
+	void Count(const char* name, double value)
+	{
+		if (!mbInFrame || this_thread::get_id() != mThread)
+			return;
+
+		auto& counters = mFrames[mSlot].counters;
+		auto it = find_if(counters.begin(), counters.end(), [&](const pair<const char*, double>& c) { return strcmp(c.first, name) == 0; });
+		if (it != counters.end())
+			it->second += value;
+		else
+			counters.push_back({ name, value });
+	}
+
+	void RenderImGui(bool* pOpen)
+	{
+		ImGui::SetNextWindowSize(ImVec2(700, 500), ImGuiCond_FirstUseEver);
+		if (!ImGui::Begin("Profiler [F6]", pOpen))
+		{
+			ImGui::End();
+			return;
+		}
+
+		ImGui::Checkbox("Enabled", &bEnabled);
+		ImGui::SameLine();
+		ImGui::Checkbox("Pause", &bPaused);
+		ImGui::SameLine();
+		if (ImGui::Button("Export trace"))
+			mExportMessage = ExportChromeTrace(TRACE_PATHNAME) ? "Saved in " + TRACE_PATHNAME : "Cannot write " + TRACE_PATHNAME;
+		if (mExportMessage.size())
+		{
+			ImGui::SameLine();
+			ImGui::Text("%s", mExportMessage.c_str());
+		}
+
+		if (mHistory.empty())
+		{
+			ImGui::Text("No frame yet");
+			ImGui::End();
+			return;
+		}
+
+		// Rolling times of the frames
+		vector<float> cpu, gpu;
+		for (auto& frame : mHistory)
+		{
+			cpu.push_back((float)frame.cpu);
+			gpu.push_back((float)std::max(frame.gpu, 0.0));
+		}
+		const sProfileFrame& last = mHistory.back();
+		char overlay[64];
+		snprintf(overlay, sizeof(overlay), "CPU %.2f ms", last.cpu);
+		ImGui::PlotLines("##cpu", cpu.data(), (int)cpu.size(), 0, overlay, 0.0f, 2.0f * BUDGET_MS, ImVec2(-1, 40));
+		snprintf(overlay, sizeof(overlay), "GPU %.2f ms", last.gpu);
+		ImGui::PlotLines("##gpu", gpu.data(), (int)gpu.size(), 0, overlay, 0.0f, 2.0f * BUDGET_MS, ImVec2(-1, 40));
+
+		// Flame of the last frame, the width of the window is the budget of a frame or the frame if it is longer
+		double width = std::max(BUDGET_MS, std::max(last.cpu, last.gpu));
+		ImGui::Text("CPU");
+		DrawFlame(last, false, width);
+		ImGui::Text("GPU");
+		DrawFlame(last, true, width);
+
+		// Averages over the history, by name and depth in the order of the last frame
+		if (ImGui::BeginTable("Scopes", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_ScrollY))
+		{
+			ImGui::TableSetupColumn("Scope");
+			ImGui::TableSetupColumn("CPU ms", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+			ImGui::TableSetupColumn("GPU ms", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+			ImGui::TableHeadersRow();
+			for (auto& scope : last.scopes)
+			{
+				double cpuSum = 0.0, gpuSum = 0.0;
+				int cpuCount = 0, gpuCount = 0;
+				for (auto& frame : mHistory)
+					for (auto& s : frame.scopes)
+						if (s.depth == scope.depth && strcmp(s.name, scope.name) == 0)
+						{
+							cpuSum += s.cpuEnd - s.cpuStart;
+							cpuCount++;
+							if (s.gpuStart >= 0.0)
+							{
+								gpuSum += s.gpuEnd - s.gpuStart;
+								gpuCount++;
+							}
+						}
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%*s%s", 2 * scope.depth, "", scope.name);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", cpuCount ? cpuSum / cpuCount : 0.0);
+				ImGui::TableNextColumn();
+				if (gpuCount)	ImGui::Text("%.3f", gpuSum / gpuCount);
+				else			ImGui::Text("-");
+			}
+			ImGui::EndTable();
+		}
+
+		// Counters of the last frame
+		for (auto& counter : last.counters)
+			ImGui::Text("%s : %.0f", counter.first, counter.second);
+		ImGui::End();
+	}
+
+	// Chrome trace (chrome://tracing, Perfetto): one complete event per scope, CPU on thread 1 and GPU on thread 2
+	// The GPU scopes of a frame start with the CPU frame, the clocks are not synchronized
+	bool ExportChromeTrace(const string& pathname)
+	{
+		ofstream file(pathname);
+		if (!file)
+			return false;
+
+		file << "{\"traceEvents\":[\n";
+		bool bFirst = true;
+		auto event = [&](const char* name, int tid, double start, double end)
+		{
+			file << (bFirst ? "" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+				 << ",\"ts\":" << (long long)(start * 1000.0) << ",\"dur\":" << (long long)((end - start) * 1000.0) << "}";
+			bFirst = false;
+		};
+		for (auto& frame : mHistory)
+		{
+			for (auto& scope : frame.scopes)
+			{
+				event(scope.name, 1, frame.start + scope.cpuStart, frame.start + scope.cpuEnd);
+				if (scope.gpuStart >= 0.0)
+					event(scope.name, 2, frame.start + scope.gpuStart, frame.start + scope.gpuEnd);
+			}
+			for (auto& counter : frame.counters)
+			{
+				file << (bFirst ? "" : ",\n") << "{\"name\":\"" << counter.first << "\",\"ph\":\"C\",\"pid\":1,\"ts\":"
+					 << (long long)(frame.start * 1000.0) << ",\"args\":{\"value\":" << counter.second << "}}";
+				bFirst = false;
+			}
+		}
+		file << "\n],\n\"displayTimeUnit\":\"ms\"}\n";
+		return true;
+	}
+
+	bool	bEnabled = true;
+	bool	bPaused = false;		// The history is frozen to look at it
+	function<void(const sProfileFrame&)> OnFrame;	// Each frame once its GPU timestamps are read
+
+private:
+	inline static const string TRACE_PATHNAME = "profile.json";
+	inline static const double BUDGET_MS = 1000.0 / 150.0;
+
+	double Now()
+	{
+		return Clock::NowMs() - mOrigin;
+	}
+
+	// Reads the timestamps of a frame rendered FRAMES frames ago and moves it to the history
+	void Collect(sProfileFrame& frame)
+	{
+		if (!frame.bPending)
+			return;
+		frame.bPending = false;
+
+		GLuint* queries = &mvQueries[(&frame - mFrames) * MAX_QUERIES];
+		GLuint64 origin = 0;
+		for (auto& scope : frame.scopes)
+		{
+			if (scope.query == -1)
+				continue;
+
+			GLint available = 0;
+			glGetQueryObjectiv(queries[scope.query + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+
+			GLuint64 start = 0, end = 0;
+			glGetQueryObjectui64v(queries[scope.query], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(queries[scope.query + 1], GL_QUERY_RESULT, &end);
+			if (!origin)
+				origin = start;
+			scope.gpuStart = (start - origin) * 1.0e-6;
+			scope.gpuEnd = (end - origin) * 1.0e-6;
+		}
+		if (frame.scopes.size() && frame.scopes[0].gpuStart >= 0.0)
+			frame.gpu = frame.scopes[0].gpuEnd - frame.scopes[0].gpuStart;
+		if (OnFrame)
+			OnFrame(frame);
+
+		if (bPaused)
+			return;
+		mHistory.push_back(frame);
+		if (mHistory.size() > HISTORY)
+			mHistory.pop_front();
+	}
+
+	void DrawFlame(const sProfileFrame& frame, bool bGpu, double width)
+	{
+		const float ROW = ImGui::GetTextLineHeight() + 4.0f;
+		int depth = 0;
+		for (auto& scope : frame.scopes)
+			depth = std::max(depth, scope.depth + 1);
+
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		float w = ImGui::GetContentRegionAvail().x;
+		float scale = (float)(w / width);
+		ImDrawList* draw = ImGui::GetWindowDrawList();
+		for (auto& scope : frame.scopes)
+		{
+			double start = bGpu ? scope.gpuStart : scope.cpuStart;
+			double end = bGpu ? scope.gpuEnd : scope.cpuEnd;
+			if (start < 0.0)
+				continue;
+
+			ImVec2 a(origin.x + (float)start * scale, origin.y + scope.depth * ROW);
+			ImVec2 b(origin.x + std::max((float)end * scale, (float)start * scale + 1.0f), a.y + ROW - 1.0f);
+			ImU32 color = ImColor::HSV((float)(hash<string>()(scope.name) % 360) / 360.0f, 0.5f, 0.7f);
+			draw->AddRectFilled(a, b, color);
+			if (ImGui::IsMouseHoveringRect(a, b))
+				ImGui::SetTooltip("%s\n%.3f ms", scope.name, end - start);
+
+			// The name only when it fits
+			ImVec2 size = ImGui::CalcTextSize(scope.name);
+			if (size.x + 4.0f < b.x - a.x)
+				draw->AddText(ImVec2(a.x + 2.0f, a.y + 2.0f), IM_COL32(255, 255, 255, 255), scope.name);
+		}
+
+		// Budget of a frame
+		float x = origin.x + (float)BUDGET_MS * scale;
+		draw->AddLine(ImVec2(x, origin.y), ImVec2(x, origin.y + depth * ROW), IM_COL32(255, 64, 64, 255));
+		ImGui::Dummy(ImVec2(w, depth * ROW));
+	}
+
+	sProfileFrame			mFrames[FRAMES];
+	deque<sProfileFrame>	mHistory;
+	vector<GLuint>			mvQueries;
+	vector<int>				mvStack;
+	int						mSlot = 0;
+	int						mQueries = 0;
+	bool					mbInit = false;
+	bool					mbInFrame = false;
+	thread::id				mThread;
+	double					mOrigin = 0.0;
+	string					mExportMessage;
+};
+
+extern Profiler g_Profiler;
+
+// Scope recorded until the end of the block, with a GPU timing or not
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name, bool bGpu) { mbActive = g_Profiler.Push(name, bGpu); }
+	~ProfileScope() { if (mbActive) g_Profiler.Pop(); }
+private:
+	bool mbActive;
+};
+
+#define PROFILE_CONCAT2(a, b)	a##b
+#define PROFILE_CONCAT(a, b)	PROFILE_CONCAT2(a, b)
+#define PROFILE_CPU(name)		ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, false)
+#define PROFILE_GPU(name)		ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, true)
+#define PROFILE_COUNT(name, value)	g_Profiler.Count(name, (double)(value))
@@ -0,0 +1,501 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "Profiler.h"
+
+using namespace std;
+
+
+// Full screen target of the render graph, its size follows the window
+struct sRenderTarget
+{
+	GLenum		format	= GL_RGB8;		// Sized internal format
+	int			samples	= 1;			// > 1 for a multisample target
+	float		scale	= 1.0f;			// Fraction of the window size
+	bool		bDynamic = false;		// Also follows the scale of the dynamic resolution
+};
+
+class RenderGraph;
+
+// A pass of the frame, declared with what it reads and writes
+struct sRenderPass
+{
+	const char			  * name		= "";
+	vector<int>				reads;					// Sampled or blitted
+	vector<int>				writes;					// Attachments bound by the graph (colors and depth)
+	vector<int>				images;					// Written with image stores (compute)
+	vector<int>				outputs;				// Written by the pass into its own framebuffer
+	bool					bClear		= false;	// Clear the attachments before the pass
+	bool					bKeep		= false;	// Never culled (side effects outside of the graph)
+	bool					bAlive		= false;
+	function<void(RenderGraph&)> execute;
+
+	sRenderPass& Read(int h)		{ reads.push_back(h);	return *this; }
+	sRenderPass& Write(int h)		{ writes.push_back(h);	return *this; }
+	sRenderPass& WriteImage(int h)	{ images.push_back(h);	return *this; }
+	sRenderPass& Output(int h)		{ outputs.push_back(h);	return *this; }
+	sRenderPass& Clear()			{ bClear = true;		return *this; }
+	sRenderPass& Keep()				{ bKeep = true;			return *this; }
+	sRenderPass& Execute(function<void(RenderGraph&)> fn) { execute = fn; return *this; }
+};
+
+// Scheduler of the passes of a frame and of their targets
+// The passes are declared every frame in their order of execution. Compile() culls the passes whose results are never
+// used, then gives each target a texture of the pool: targets whose lifetimes do not overlap share the same texture.
+// Execute() binds and clears the attachments of each pass and adds the memory barriers required by the image stores
+class RenderGraph
+{
+public:
+	static const int BACKBUFFER = 0;		// Handle of the default framebuffer
+	static const int KEEP_FRAMES = 300;		// An unused texture of the pool is released after these frames
+
+	// Must be called while the context is alive
+	void Release()
+	{
+		for (auto& fb : mvFramebuffers)
+			glDeleteFramebuffers(1, &fb.fbo);
+		mvFramebuffers.clear();
+		for (auto& t : mvPool)
+			glDeleteTextures(1, &t.texture);
+		mvPool.clear();
+		mBytesPool = 0;
+	}
+
+	// Starts the declaration of a frame, scale is the dynamic resolution of the frame
+	void BeginFrame(int width, int height, float scale = 1.0f)
+	{
+		if (width != mWidth || height != mHeight)
+			Release();		// All the targets change of size
+		mWidth = width;
+		mHeight = height;
+		mScale = scale;
+
+		mvPasses.clear();
+		mvResources.clear();
+		sResource backbuffer;
+		backbuffer.name = "Backbuffer";
+		backbuffer.bImported = true;
+		mvResources.push_back(backbuffer);
+		mbCompiled = false;
+	}
+
+	// Target allocated by the graph, only for the passes that use it
+	int Create(const char* name, const sRenderTarget& desc)
+	{
+		sResource r;
+		r.name = name;
+		r.desc = desc;
+		mvResources.push_back(r);
+		return (int)mvResources.size() - 1;
+	}
+
+	// Texture owned outside of the graph (sky, clouds), only its dependencies are tracked
+	int Import(const char* name, GLuint texture)
+	{
+		sResource r;
+		r.name = name;
+		r.texture = texture;
+		r.bImported = true;
+		mvResources.push_back(r);
+		return (int)mvResources.size() - 1;
+	}
+
+	// The reference is valid until the next AddPass
+	sRenderPass& AddPass(const char* name)
+	{
+		mvPasses.push_back(sRenderPass());
+		mvPasses.back().name = name;
+		return mvPasses.back();
+	}
+
+	void Compile()
+	{
+		// Culling from the last pass: a pass lives if it draws on the screen or if a living pass reads what it writes
+		vector<bool> vNeeded(mvResources.size(), false);
+		mCulled = 0;
+		for (int i = (int)mvPasses.size() - 1; i >= 0; i--)
+		{
+			sRenderPass& pass = mvPasses[i];
+			bool bAlive = pass.bKeep;
+			for (int h : pass.writes)	bAlive = bAlive || h == BACKBUFFER || vNeeded[h];
+			for (int h : pass.images)	bAlive = bAlive || vNeeded[h];
+			for (int h : pass.outputs)	bAlive = bAlive || vNeeded[h];
+			pass.bAlive = bAlive;
+			if (!bAlive)
+			{
+				mCulled++;
+				continue;
+			}
+			for (int h : pass.reads)
+				vNeeded[h] = true;
+		}
+
+		// Lifetimes of the targets, in passes
+		for (int i = 0; i < (int)mvPasses.size(); i++)
+		{
+			const sRenderPass& pass = mvPasses[i];
+			if (!pass.bAlive)
+				continue;
+			for (const vector<int>* list : { &pass.reads, &pass.writes, &pass.images, &pass.outputs })
+				for (int h : *list)
+				{
+					sResource& r = mvResources[h];
+					if (r.first < 0)
+						r.first = i;
+					r.last = i;
+				}
+		}
+
+		// Textures of the pool unused for a while (rain or binoculars switched off long ago), or of a previous scale
+		for (auto& t : mvPool)
+			t.unused++;
+		for (size_t i = 0; i < mvPool.size(); )
+		{
+			int width, height;
+			GetSize(mvPool[i].desc, width, height);
+			bool bStale = mvPool[i].desc.bDynamic && (width != mvPool[i].width || height != mvPool[i].height);
+			if (mvPool[i].unused > KEEP_FRAMES || bStale)
+			{
+				Destroy(mvPool[i]);
+				mvPool.erase(mvPool.begin() + i);
+			}
+			else
+				i++;
+		}
+
+		// Allocation in the order of the passes: a texture goes back to the pool after the last pass that uses it,
+		// the targets which begin in the same pass cannot take it
+		for (auto& t : mvPool)
+			t.bBusy = false;
+		mBytesTargets = 0;
+		for (int i = 0; i < (int)mvPasses.size(); i++)
+		{
+			if (!mvPasses[i].bAlive)
+				continue;
+			for (auto& r : mvResources)
+			{
+				if (r.bImported || r.first != i)
+					continue;
+				r.physical = Acquire(r.desc);
+				r.texture = mvPool[r.physical].texture;
+				mBytesTargets += Bytes(r.desc, mvPool[r.physical].width, mvPool[r.physical].height);
+			}
+			for (auto& r : mvResources)
+				if (!r.bImported && r.last == i)
+					mvPool[r.physical].bBusy = false;
+		}
+
+		mbCompiled = true;
+	}
+
+	void Execute()
+	{
+		if (!mbCompiled)
+			Compile();
+
+		mPasses = 0;
+		mBarriers = 0;
+		for (auto& pass : mvPasses)
+		{
+			if (!pass.bAlive)
+				continue;
+			ProfileScope scope(pass.name, true);
+			mPasses++;
+
+			// The results of the image stores must be visible to this pass
+			GLbitfield barriers = 0;
+			for (int h : pass.reads)	barriers |= Pending(h, GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			for (int h : pass.writes)	barriers |= Pending(h, GL_FRAMEBUFFER_BARRIER_BIT);
+			for (int h : pass.images)	barriers |= Pending(h, GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			if (barriers)
+			{
+				glMemoryBarrier(barriers);
+				mBarriers++;
+			}
+
+			if (!pass.writes.empty())
+				Bind(pass);
+
+			if (pass.execute)
+				pass.execute(*this);
+
+			for (int h : pass.images)
+				mvResources[h].bPendingImage = true;
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, mWidth, mHeight);
+	}
+
+	GLuint GetTexture(int h) { return mvResources[h].texture; }
+
+	// Framebuffer with these attachments, for a pass which blits or reads pixels
+	GLuint GetFramebuffer(int color, int depth = -1)
+	{
+		if (color == BACKBUFFER)
+			return 0;
+		GLuint colors[1] = { mvResources[color].texture };
+		return GetFramebuffer(colors, 1, depth >= 0 ? mvResources[depth].texture : 0);
+	}
+
+	// Size in pixels of a target
+	void GetSize(int h, int& width, int& height)
+	{
+		if (h == BACKBUFFER || mvResources[h].bImported)
+		{
+			width = mWidth;
+			height = mHeight;
+		}
+		else
+			GetSize(mvResources[h].desc, width, height);
+	}
+
+	int		GetPassCount()		{ return mPasses; }
+	int		GetCulled()			{ return mCulled; }
+	int		GetBarriers()		{ return mBarriers; }
+	int		GetTextureCount()	{ return (int)mvPool.size(); }
+	size_t	GetBytes()			{ return mBytesPool; }		// Memory of the pool
+	size_t	GetBytesTargets()	{ return mBytesTargets; }	// Memory of the targets of the frame without aliasing
+
+private:
+	struct sResource
+	{
+		const char	  * name			= "";
+		sRenderTarget	desc;
+		GLuint			texture			= 0;
+		bool			bImported		= false;
+		int				physical		= -1;		// Index in the pool
+		int				first			= -1;		// First and last passes using it
+		int				last			= -1;
+		bool			bPendingImage	= false;	// Written by image stores not yet made visible
+	};
+
+	struct sPooled
+	{
+		GLuint			texture	= 0;
+		sRenderTarget	desc;
+		int				width	= 0;
+		int				height	= 0;
+		bool			bBusy	= false;
+		int				unused	= 0;				// Frames without use
+	};
+
+	struct sFramebuffer
+	{
+		GLuint			colors[4]	= { 0 };
+		int				count		= 0;
+		GLuint			depth		= 0;
+		GLuint			fbo			= 0;
+	};
+
+	static bool IsDepth(GLenum format)
+	{
+		return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32 ||
+			format == GL_DEPTH_COMPONENT32F || format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+	}
+
+	static size_t BytesPerPixel(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_R8:					return 1;
+		case GL_R16F:				return 2;
+		case GL_RG16F:
+		case GL_R32F:
+		case GL_RGB8:				// Stored as RGBA by the drivers
+		case GL_RGBA8:
+		case GL_R11F_G11F_B10F:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH_COMPONENT32F:
+		case GL_DEPTH24_STENCIL8:	return 4;
+		case GL_RGBA16F:
+		case GL_DEPTH32F_STENCIL8:	return 8;
+		case GL_RGBA32F:			return 16;
+		default:					return 4;
+		}
+	}
+
+	static size_t Bytes(const sRenderTarget& desc, int width, int height)
+	{
+		return BytesPerPixel(desc.format) * width * height * desc.samples;
+	}
+
+	void GetSize(const sRenderTarget& desc, int& width, int& height)
+	{
+		float scale = desc.bDynamic ? desc.scale * mScale : desc.scale;
+		width = std::max(1, int(mWidth * scale + 0.5f));
+		height = std::max(1, int(mHeight * scale + 0.5f));
+	}
+
+	GLbitfield Pending(int h, GLbitfield bits)
+	{
+		if (!mvResources[h].bPendingImage)
+			return 0;
+		mvResources[h].bPendingImage = false;
+		return bits;
+	}
+
+	// Free texture of the pool with this description, or a new one
+	int Acquire(const sRenderTarget& desc)
+	{
+		int width, height;
+		GetSize(desc, width, height);
+		for (size_t i = 0; i < mvPool.size(); i++)
+		{
+			sPooled& t = mvPool[i];
+			if (!t.bBusy && t.desc.format == desc.format && t.desc.samples == desc.samples && t.desc.bDynamic == desc.bDynamic &&
+				t.width == width && t.height == height)
+			{
+				t.bBusy = true;
+				t.unused = 0;
+				return (int)i;
+			}
+		}
+
+		sPooled t;
+		t.desc = desc;
+		t.width = width;
+		t.height = height;
+		t.bBusy = true;
+		glGenTextures(1, &t.texture);
+		if (desc.samples > 1)
+		{
+			glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, t.texture);
+			glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.format, width, height, GL_TRUE);
+			glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+		}
+		else
+		{
+			glBindTexture(GL_TEXTURE_2D, t.texture);
+			glTexStorage2D(GL_TEXTURE_2D, 1, desc.format, width, height);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+		mBytesPool += Bytes(desc, width, height);
+		mvPool.push_back(t);
+		return (int)mvPool.size() - 1;
+	}
+
+	// Deletes a texture of the pool and the framebuffers which use it
+	void Destroy(sPooled& t)
+	{
+		for (size_t i = 0; i < mvFramebuffers.size(); )
+		{
+			sFramebuffer& fb = mvFramebuffers[i];
+			if (fb.depth == t.texture || find(fb.colors, fb.colors + fb.count, t.texture) != fb.colors + fb.count)
+			{
+				glDeleteFramebuffers(1, &fb.fbo);
+				mvFramebuffers.erase(mvFramebuffers.begin() + i);
+			}
+			else
+				i++;
+		}
+		glDeleteTextures(1, &t.texture);
+		mBytesPool -= Bytes(t.desc, t.width, t.height);
+	}
+
+	GLuint GetFramebuffer(const GLuint* colors, int count, GLuint depth)
+	{
+		for (auto& fb : mvFramebuffers)
+			if (fb.count == count && fb.depth == depth && equal(colors, colors + count, fb.colors))
+				return fb.fbo;
+
+		// Creation without disturbing the framebuffers bound by the pass
+		GLint drawFbo, readFbo;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFbo);
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFbo);
+
+		sFramebuffer fb;
+		fb.count = std::min(count, 4);
+		fb.depth = depth;
+		glGenFramebuffers(1, &fb.fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fb.fbo);
+		GLenum drawBuffers[4];
+		for (int i = 0; i < fb.count; i++)
+		{
+			fb.colors[i] = colors[i];
+			drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+			glFramebufferTexture(GL_FRAMEBUFFER, drawBuffers[i], colors[i], 0);
+		}
+		if (depth)
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+		if (fb.count)
+			glDrawBuffers(fb.count, drawBuffers);
+		else
+			glDrawBuffer(GL_NONE);
+
+		// FBO Verification
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			cout << "Error creating FBO for the render graph" << endl;
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+		mvFramebuffers.push_back(fb);
+		return fb.fbo;
+	}
+
+	// Binds the attachments of a pass and clears them
+	void Bind(const sRenderPass& pass)
+	{
+		GLuint colors[4];
+		int count = 0;
+		GLuint depth = 0;
+		bool bBackbuffer = false;
+		int width = mWidth, height = mHeight;
+		for (int h : pass.writes)
+		{
+			if (h == BACKBUFFER)
+			{
+				bBackbuffer = true;
+				continue;
+			}
+			const sResource& r = mvResources[h];
+			if (IsDepth(r.desc.format))
+				depth = r.texture;
+			else if (count < 4)
+				colors[count++] = r.texture;
+			GetSize(h, width, height);
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, bBackbuffer ? 0 : GetFramebuffer(colors, count, depth));
+		glViewport(0, 0, width, height);
+
+		if (pass.bClear)
+		{
+			GLbitfield mask = bBackbuffer ? GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT : 0;
+			if (count)	mask |= GL_COLOR_BUFFER_BIT;
+			if (depth)	mask |= GL_DEPTH_BUFFER_BIT;
+			glClearColor(0.0, 0.0, 0.0, 0.0);
+			glClear(mask);
+		}
+	}
+
+	int						mWidth			= 0;
+	int						mHeight			= 0;
+	float					mScale			= 1.0f;
+	bool					mbCompiled		= false;
+
+	vector<sRenderPass>		mvPasses;
+	vector<sResource>		mvResources;		// 0 is the back buffer
+	vector<sPooled>			mvPool;
+	vector<sFramebuffer>	mvFramebuffers;
+
+	int						mPasses			= 0;
+	int						mCulled			= 0;
+	int						mBarriers		= 0;
+	size_t					mBytesPool		= 0;
+	size_t					mBytesTargets	= 0;
+};
@@ -11,6 +11,7 @@ uniform float       time;
 uniform vec4        lightPos;
 uniform vec2        resolution;
 uniform vec2        cloudRenderResolution;
+uniform vec2        uvScale = vec2(1.0);   // Part of the images marched (dynamic resolution)
 
 uniform bool        isLightInFront = true;
 uniform bool        enableGodRays;
@@ -21,6 +22,12 @@ uniform float	    exposure;
 #define  offset_x  1. / cloudRenderResolution.x  
 #define  offset_y  1. / cloudRenderResolution.y
 
+// Screen coordinates to the marched part of the images, without the texels outside of it
+vec2 toImage(vec2 uv)
+{
+    return clamp(uv * uvScale, vec2(0.0), uvScale - 0.5 / resolution);
+}
+
 vec4 gaussianBlur(sampler2D tex, vec2 uv)
 {
  vec2 offsets[9] = vec2[](
@@ -45,7 +52,7 @@ vec4 gaussianBlur(sampler2D tex, vec2 uv)
 
     for(int i = 0; i < 9; i++)
     {	
-		vec4 pixel = texture(tex, uv.st + offsets[i]);
+		vec4 pixel = texture(tex, toImage(uv.st + offsets[i]));
         sampleTex[i] = pixel;
     }
     vec4 col = vec4(0.0);
@@ -88,7 +95,7 @@ void main()
         for(int i = 0; i < SAMPLES; i++)
         {
             uv -= dTuv;
-            colRays += texture(emissions, uv).rgb * illuminationDecay * weight;
+            colRays += texture(emissions, toImage(uv)).rgb * illuminationDecay * weight;
             illuminationDecay *= decay;
         }
     
@@ -1,5 +1,7 @@
 #version 430
 
+#include "../Shaders/frame.glsl"
+
 #define ONE_OVER_4PI	0.0795774715459476
 
 uniform samplerCube	envmap;
@@ -17,14 +19,7 @@ flat in int		iFoam;
 
 uniform vec3	oceanColor;
 uniform float	transparency;
-uniform vec3	sunColor;
-uniform vec3	sunDir;
 uniform int		bEnvmap;
-uniform float	exposure;
-uniform bool	bAbsorbance;
-uniform vec3	absorbanceColor;
-uniform float	absorbanceCoeff;
-uniform vec3	eyePos;
 uniform bool	bShowPatch;
 
 out vec4 FragColor;
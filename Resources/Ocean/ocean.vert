@@ -1,5 +1,7 @@
 #version 430
 
+#include "../Shaders/frame.glsl"
+
 layout (location = 0) in vec3   aPosition;
 layout (location = 1) in vec2   aTexCoords;
 layout (location = 2) in mat4   instanceMatrix;
@@ -8,9 +10,6 @@ layout (location = 7) in int    instanceFoam;
 
 layout (binding = 0) uniform sampler2D displacement;
 
-uniform mat4 matViewProj;
-uniform vec3 eyePos;
-
 out vec3        vdir;
 out vec2        tex;
 out vec3        vertex;
@@ -1,5 +1,7 @@
 #version 430
 
+#include "../Shaders/frame.glsl"
+
 #define ONE_OVER_4PI	0.0795774715459476
 
 layout(binding = 1) uniform samplerCube	envmap;
@@ -20,14 +22,7 @@ in float	vFoamIntensity;
 
 uniform vec3	oceanColor;
 uniform float	transparency;
-uniform vec3	sunColor;
-uniform vec3	sunDir;
 uniform int		bEnvmap;
-uniform float	exposure;
-uniform bool	bAbsorbance;
-uniform vec3	absorbanceColor;
-uniform float	absorbanceCoeff;
-uniform vec3	eyePos;
 uniform vec2	shipPivot;
 uniform float	shipRotation;
 uniform vec2	shipSize;
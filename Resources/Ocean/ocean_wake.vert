@@ -1,5 +1,7 @@
 ﻿#version 430
 
+#include "../Shaders/frame.glsl"
+
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec2 aTexCoords;
 
@@ -8,8 +10,6 @@ layout (binding = 1) uniform sampler2DArray kelvinArray;
 uniform int     texLayer;
 
 uniform mat4    matLocal;
-uniform mat4    matViewProj;
-uniform vec3    eyePos;
 
 uniform vec3    shipPosition;   // Ship position (world)
 uniform float   shipRotation;   // Ship heading (radians, 0 = X)
@@ -0,0 +1,21 @@
+// Values shared by all the passes of a frame, written once per frame by FrameUniforms.h (same std140 layout)
+layout (std140) uniform Frame
+{
+    mat4    matView;
+    mat4    matProjection;
+    mat4    matViewProj;
+    vec3    eyePos;
+    float   exposure;
+    vec3    sunPosition;
+    float   frameTime;          // s
+    vec3    sunDir;             // Normalized
+    float   absorbanceCoeff;
+    vec3    sunAmbient;
+    bool    bAbsorbance;
+    vec3    sunColor;           // Diffuse
+    float   fogDensity;
+    vec3    sunSpecular;
+    float   mistDensity;
+    vec3    absorbanceColor;
+    vec3    fogColor;
+};
@@ -1,26 +1,18 @@
 #version 450
 
+#include "frame.glsl"
+
 uniform sampler2D texColor; // Color texture
 uniform sampler2D texDepth; // Depth texture
 
-uniform float	exposure;
 uniform float   near;
 uniform float   far;
 uniform float   horizonHeight; // Height of the horizon in NDC screen coordinate [-1, +1] [bottom, top}
-uniform vec3	eyePos;
 
 // Colors
 uniform vec3	oceanColor;
-uniform vec3	fogColor;
-
-// Mist
-uniform float	mistDensity;
-
-// Fog
-uniform float	fogDensity;
 
 // Particles
-uniform float   uTime;        // Time in second
 uniform vec2    screenSize;   // Size of the window in pixels
 
 // Effects
@@ -90,7 +82,7 @@ void main()
                 vec2 start = screenCenter + dir * radius * 0.3;
 
                 // Animated radial shift (advance from center to outward)
-                float t = mod(uTime + hash(vec2(seed, 2.0)) * 100.0, lifetime) / lifetime;
+                float t = mod(frameTime + hash(vec2(seed, 2.0)) * 100.0, lifetime) / lifetime;
                 float travel = t * (0.7 * min(screenSize.x, screenSize.y) - radius);
 
                 vec2 pos = start + dir * travel;
@@ -161,7 +153,7 @@ void main()
     {
         float luminance = dot(color.rgb, vec3(0.2126, 0.7152, 0.0722));
         vec3 nightVision = vec3(0.1, 0.95, 0.2) * luminance * 1.5;  // Midnight green
-        float noise = fract(sin(dot(tex * uTime * 400.0, vec2(12.9898, 78.233))) * 43758.5453);
+        float noise = fract(sin(dot(tex * frameTime * 400.0, vec2(12.9898, 78.233))) * 43758.5453);
         nightVision += (noise - 0.5) * 0.04;
         float vignette = smoothstep(0.75, 0.5, distance(tex, vec2(0.5, 0.5)));
         nightVision *= vignette;
@@ -1,5 +1,7 @@
 #version 330 core
 
+#include "frame.glsl"
+
 struct Material 
 {
     vec4 ambient;
@@ -23,13 +25,7 @@ in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-uniform vec3        viewPos;
-uniform float       exposure;
 uniform Material    material;
-uniform Light       light;
-uniform bool	    bAbsorbance;
-uniform vec3	    absorbanceColor;
-uniform float	    absorbanceCoeff;
 uniform float       specularIntensity = 0.3;
 
 uniform bool        has_texture;
@@ -82,8 +78,9 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0) {
 
 void main()
 {
+    Light light = Light(sunPosition, sunAmbient, sunColor, sunSpecular);
     vec3 N = normalize(Normal);
-    vec3 V = normalize(viewPos - FragPos);
+    vec3 V = normalize(eyePos - FragPos);
     vec3 L = normalize(light.position - FragPos);
     vec3 H = normalize(L + V);
     
@@ -125,7 +122,7 @@ void main()
   	if (bAbsorbance)
 	{
 		// Calculation of logarithmic fog
-		float distanceToCamera = length(viewPos - FragPos);
+		float distanceToCamera = length(eyePos - FragPos);
 		float absorbanceFactor = exp(-absorbanceCoeff * distanceToCamera);
 		absorbanceFactor = clamp(absorbanceFactor, 0.0, 1.0);
 		mapped = mix(absorbanceColor * exposure, mapped, absorbanceFactor);
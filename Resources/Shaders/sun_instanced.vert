@@ -0,0 +1,28 @@
+#version 430 core
+
+#include "frame.glsl"
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+// Model matrices of the instances, written each frame in the transient buffer
+layout (std430, binding = 0) readonly buffer Instances
+{
+    mat4 instances[];
+};
+
+
+void main()
+{
+    mat4 model = instances[gl_InstanceID];
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(model) * aNormal;
+    TexCoords = aTexCoords;
+    
+    gl_Position = matViewProj * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,45 @@
+#version 450
+
+in vec2 texCoord;
+
+uniform sampler2D   texInput;           // Scene at the internal resolution
+uniform vec2        inputSize;          // Size of texInput in pixels
+uniform float       sharpness = 0.3;
+
+out vec4 fragColor;
+
+// Edge aware upscaling of the dynamic resolution
+// Along an edge the bilinear sample is averaged with 2 samples that follow the edge, across it nothing is mixed,
+// then a light sharpening, limited to the range of the neighbours, compensates the blur of the bilinear filter
+
+const vec3 lumaWeights = vec3(0.299, 0.587, 0.114);
+
+void main()
+{
+    vec2 texel = 1.0 / inputSize;
+
+    vec3 c = texture(texInput, texCoord).rgb;
+    vec3 n = texture(texInput, texCoord + vec2(0.0, texel.y)).rgb;
+    vec3 s = texture(texInput, texCoord - vec2(0.0, texel.y)).rgb;
+    vec3 e = texture(texInput, texCoord + vec2(texel.x, 0.0)).rgb;
+    vec3 w = texture(texInput, texCoord - vec2(texel.x, 0.0)).rgb;
+
+    // The gradient of the luminance is perpendicular to the edge
+    vec2 gradient = vec2(dot(e - w, lumaWeights), dot(n - s, lumaWeights));
+    float strength = length(gradient);
+    vec3 color = c;
+    if (strength > 1.0 / 64.0)
+    {
+        vec2 along = vec2(-gradient.y, gradient.x) / strength;
+        vec3 a = texture(texInput, texCoord + 0.75 * along * texel).rgb;
+        vec3 b = texture(texInput, texCoord - 0.75 * along * texel).rgb;
+        color = mix(c, (a + b + c) / 3.0, clamp(4.0 * strength, 0.0, 1.0));
+    }
+
+    // Sharpening without halos
+    vec3 lo = min(c, min(min(n, s), min(e, w)));
+    vec3 hi = max(c, max(max(n, s), max(e, w)));
+    color = clamp(color + sharpness * (color - 0.25 * (n + s + e + w)), lo, hi);
+
+    fragColor = vec4(color, 1.0);
+}
@@ -1,5 +1,7 @@
 #version 330 core
 
+#include "../Shaders/frame.glsl"
+
 struct Material 
 {
     vec4 ambient;
@@ -25,10 +27,7 @@ in vec2 TexCoords;
 uniform sampler2D   texture_diffuse1;
 uniform samplerCube envmap;
 
-uniform vec3        viewPos;
-uniform float       exposure;
 uniform Material    material;
-uniform Light       light;
 uniform bool        has_texture;
 uniform float		envmapFactor;
 
@@ -84,8 +83,9 @@ vec3 AdjustContrast(vec3 color, float contrast) {
 
 void main()
 {
+    Light light = Light(sunPosition, sunAmbient, sunColor, sunSpecular);
     vec3 N = normalize(Normal);
-    vec3 V = normalize(viewPos - FragPos);          // Direction towards the camera
+    vec3 V = normalize(eyePos - FragPos);           // Direction towards the camera
     vec3 L = normalize(light.position - FragPos);   // Direction towards light (point)
     vec3 H = normalize(V + L);                      // Midway vector
 
@@ -10,6 +10,7 @@ struct Particle {
 };
 
 layout(std430, binding = 0) buffer Particles { Particle particles[]; };
+layout(std430, binding = 3) readonly buffer AliveList { uint alive[]; };     // Only the living particles are drawn (indirect count)
 
 uniform mat4    view;
 uniform mat4    projection;
@@ -21,7 +22,7 @@ out vec4 ParticleColor;
 
 void main() 
 {
-    Particle p = particles[gl_InstanceID];
+    Particle p = particles[alive[gl_InstanceID]];
     if (p.life <= 0.0) 
     {
         gl_Position = vec4(-1000.0, -1000.0, -1000.0, 1.0); // out of the camera
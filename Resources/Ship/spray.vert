@@ -1,8 +1,14 @@
-#version 330 core
-layout (location = 0) in vec3   aPos;
-layout (location = 1) in vec3   aVelocity;
-layout (location = 2) in float  aLife;
-layout (location = 3) in vec4   aColor;
+#version 430
+
+struct Particle {
+    vec3    position;
+    vec3    velocity;
+    float   life;
+    vec4    color;
+};
+
+layout(std430, binding = 0) readonly buffer Particles { Particle particles[]; };
+layout(std430, binding = 2) readonly buffer AliveList { uint alive[]; };     // Only the living particles are drawn (indirect count)
 
 uniform mat4    projection;
 uniform mat4    view;
@@ -15,9 +21,11 @@ out vec4 ParticleColor;
 
 void main() 
 {
-    gl_Position = projection * view * vec4(aPos, 1.0);
+    Particle p = particles[alive[gl_InstanceID]];
+
+    gl_Position = projection * view * vec4(p.position, 1.0);
     gl_PointSize = 600.0 / gl_Position.w;
 
-    float alpha = 2.0 * density * aLife / lifeSpan;
-    ParticleColor = vec4(aColor.rgb * exposure, alpha);
+    float alpha = 2.0 * density * p.life / lifeSpan;
+    ParticleColor = vec4(p.color.rgb * exposure, alpha);
 }
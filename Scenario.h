@@ -0,0 +1,167 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "pugixml/pugixml.hpp"
+
+#include "Profiler.h"
+
+using namespace std;
+using namespace glm;
+
+
+struct sCameraKey
+{
+	float	t		= 0.0f;		// s of simulation
+	vec3	position;			// In the frame of the ship
+	vec3	target;
+};
+
+// Scripted run of the headless mode: same ship, position, wind and waves, camera path played with a fixed step
+// The timings of the frames come from the profiler, once the GPU timestamps are read
+class Scenario
+{
+public:
+	int		Frames		= 600;
+	int		Warmup		= 60;				// First frames not in the summary (compilation of the shaders, streaming)
+	float	Step		= 1.0f / 60.0f;		// s of simulation per frame
+	int		Width		= 1920;
+	int		Height		= 1080;
+	int		Dump		= 0;				// Every n frames saved as PNG, 0 for none
+	int		Ship		= -1;				// -1 keeps the value of the application
+	int		Position	= -1;
+	float	WindKN		= -1.0f;
+	float	WindDEG		= -1.0f;
+	unsigned int Seed	= 1;				// Random phases of the ocean
+
+	bool Load(const wstring& pathname)
+	{
+		pugi::xml_document doc;
+		if (!doc.load_file(pathname.c_str()))
+		{
+			wcerr << L"Scenario : cannot read " << pathname << endl;
+			return false;
+		}
+
+		pugi::xml_node root = doc.child(L"Scenario");
+		Frames = root.attribute(L"frames").as_int(Frames);
+		Warmup = root.attribute(L"warmup").as_int(Warmup);
+		Step = root.attribute(L"step").as_float(Step);
+		Width = root.attribute(L"width").as_int(Width);
+		Height = root.attribute(L"height").as_int(Height);
+		Dump = root.attribute(L"dump").as_int(Dump);
+		Ship = root.attribute(L"ship").as_int(Ship);
+		Position = root.attribute(L"position").as_int(Position);
+		WindKN = root.attribute(L"wind").as_float(WindKN);
+		WindDEG = root.attribute(L"direction").as_float(WindDEG);
+		Seed = root.attribute(L"seed").as_uint(Seed);
+
+		mvKeys.clear();
+		for (pugi::xml_node key : root.children(L"Key"))
+		{
+			sCameraKey k;
+			k.t = key.attribute(L"t").as_float();
+			k.position = ParseVec3(key.attribute(L"position").as_string());
+			k.target = ParseVec3(key.attribute(L"target").as_string());
+			mvKeys.push_back(k);
+		}
+		sort(mvKeys.begin(), mvKeys.end(), [](const sCameraKey& a, const sCameraKey& b) { return a.t < b.t; });
+		if (mvKeys.empty())
+			mvKeys.push_back({ 0.0f, vec3(-60.0f, 20.0f, 0.0f), vec3(0.0f) });
+		return true;
+	}
+
+	// Smooth interpolation between the keys, in the frame of the ship
+	void GetCamera(float t, vec3& position, vec3& target) const
+	{
+		size_t i = 0;
+		while (i + 1 < mvKeys.size() && mvKeys[i + 1].t <= t)
+			i++;
+		const sCameraKey& a = mvKeys[i];
+		const sCameraKey& b = mvKeys[std::min(i + 1, mvKeys.size() - 1)];
+		float s = b.t > a.t ? glm::clamp((t - a.t) / (b.t - a.t), 0.0f, 1.0f) : 0.0f;
+		s = s * s * (3.0f - 2.0f * s);
+		position = mix(a.position, b.position, s);
+		target = mix(a.target, b.target, s);
+	}
+
+	// Receives the frames collected by the profiler
+	void Record(const sProfileFrame& frame)
+	{
+		int n = mFrame++;
+		mCsv << n << ";" << frame.cpu << ";" << frame.gpu << "\n";
+		if (n < Warmup)
+			return;
+
+		mvCpu.push_back(frame.cpu);
+		if (frame.gpu >= 0.0)		// -1 until the timestamps of the frame are read
+			mvGpu.push_back(frame.gpu);
+		for (auto& scope : frame.scopes)
+		{
+			if (scope.depth == 0 || scope.depth > 2)
+				continue;
+			sScopeTimes& times = mScopes[scope.name];
+			times.cpu.push_back(scope.cpuEnd - scope.cpuStart);
+			if (scope.gpuStart >= 0.0)
+				times.gpu.push_back(scope.gpuEnd - scope.gpuStart);
+		}
+	}
+
+	// Times of all the frames, then the medians of the frames after the warm-up and of the main scopes
+	bool Save(const string& pathname)
+	{
+		ofstream file(pathname);
+		if (!file)
+			return false;
+
+		file << "frame;cpu_ms;gpu_ms\n" << mCsv.str();
+		file << "\nscope;cpu_median_ms;gpu_median_ms\n";
+		file << "Frame;" << Median(mvCpu) << ";" << Median(mvGpu) << "\n";
+		for (auto& [name, times] : mScopes)
+			file << name << ";" << Median(times.cpu) << ";" << Median(times.gpu) << "\n";
+
+		cout << "Headless : " << mFrame << " frames, median CPU " << Median(mvCpu) << " ms, GPU " << Median(mvGpu) << " ms, p95 CPU " << Percentile(mvCpu, 0.95) << " ms, GPU " << Percentile(mvGpu, 0.95) << " ms" << endl;
+		return true;
+	}
+
+private:
+	struct sScopeTimes
+	{
+		vector<double> cpu, gpu;
+	};
+
+	static vec3 ParseVec3(const wchar_t* s)
+	{
+		vec3 v(0.0f);
+		wistringstream ss(s);
+		ss >> v.x >> v.y >> v.z;
+		return v;
+	}
+	static double Percentile(vector<double> v, double p)
+	{
+		if (v.empty())
+			return -1.0;
+		sort(v.begin(), v.end());
+		return v[std::min(v.size() - 1, size_t(p * v.size()))];
+	}
+	static double Median(const vector<double>& v) { return Percentile(v, 0.5); }
+
+	vector<sCameraKey>			mvKeys;
+	int							mFrame = 0;
+	stringstream				mCsv;
+	vector<double>				mvCpu, mvGpu;
+	map<string, sScopeTimes>	mScopes;
+};
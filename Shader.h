@@ -10,12 +10,16 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <deque>
 #include <unordered_map>
+#include <string_view>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "ShaderCache.h"
+
 using namespace std;
 using namespace glm;
 
@@ -24,6 +28,9 @@ class Shader
 public:
     GLuint ID;
 
+    // Binding point of the uniform block "Frame" (Resources/Shaders/frame.glsl)
+    static const GLuint FRAME_BINDING = 0;
+
     Shader() : ID(0) {}
     Shader(const string& vertexPath, const string& fragmentPath, const string& geometryPath = "", const string& computePath = "", const string& tessControlPath = "", const string& tessEvaluationPath = "")
     {
@@ -31,6 +38,8 @@ public:
     }
     ~Shader() 
     {
+        for (auto& shader : mvStages)
+            glDeleteShader(shader);
         glDeleteProgram(ID);
     }
 
@@ -40,36 +49,21 @@ public:
     }
     void Load(const string& vertexPath, const string& fragmentPath, const string& geometryPath = "", const string& computePath = "", const string& tessControlPath = "", const string& tessEvaluationPath = "") 
     {
-        string vertexCode           = vertexPath.empty() ?          "" : loadShaderFile(vertexPath);
-        string fragmentCode         = fragmentPath.empty() ?        "" : loadShaderFile(fragmentPath);
-        string geometryCode         = geometryPath.empty() ?        "" : loadShaderFile(geometryPath);
-        string computeCode          = computePath.empty() ?         "" : loadShaderFile(computePath);
-        string tessControlCode      = tessControlPath.empty() ?     "" : loadShaderFile(tessControlPath);
-        string tessEvaluationCode   = tessEvaluationPath.empty() ?  "" : loadShaderFile(tessEvaluationPath);
-
-        GLuint vertex           = vertexCode.empty() ?          0 : compileShader(GL_VERTEX_SHADER, vertexCode);
-        GLuint fragment         = fragmentCode.empty() ?        0 : compileShader(GL_FRAGMENT_SHADER, fragmentCode);
-        GLuint geometry         = geometryCode.empty() ?        0 : compileShader(GL_GEOMETRY_SHADER, geometryCode);
-        GLuint compute          = computeCode.empty() ?         0 : compileShader(GL_COMPUTE_SHADER, computeCode);
-        GLuint tessControl      = tessControlCode.empty() ?     0 : compileShader(GL_TESS_CONTROL_SHADER, tessControlCode);
-        GLuint tessEvaluation   = tessEvaluationCode.empty() ?  0 : compileShader(GL_TESS_EVALUATION_SHADER, tessEvaluationCode);
-
-        ID = glCreateProgram();
-        if (vertex)         glAttachShader(ID, vertex);
-        if (fragment)       glAttachShader(ID, fragment);
-        if (geometry)       glAttachShader(ID, geometry);
-        if (compute)        glAttachShader(ID, compute);
-        if (tessControl)    glAttachShader(ID, tessControl);
-        if (tessEvaluation) glAttachShader(ID, tessEvaluation);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-
-        if (vertex)         glDeleteShader(vertex);
-        if (fragment)       glDeleteShader(fragment);
-        if (geometry)       glDeleteShader(geometry);
-        if (compute)        glDeleteShader(compute);
-        if (tessControl)    glDeleteShader(tessControl);
-        if (tessEvaluation) glDeleteShader(tessEvaluation);
+        vector<pair<GLenum, string>> stages;
+        const pair<GLenum, const string*> paths[6] = {
+            { GL_VERTEX_SHADER,             &vertexPath },
+            { GL_FRAGMENT_SHADER,           &fragmentPath },
+            { GL_GEOMETRY_SHADER,           &geometryPath },
+            { GL_COMPUTE_SHADER,            &computePath },
+            { GL_TESS_CONTROL_SHADER,       &tessControlPath },
+            { GL_TESS_EVALUATION_SHADER,    &tessEvaluationPath } };
+        for (auto& [type, path] : paths)
+        {
+            string code = path->empty() ? "" : loadShaderFile(*path);
+            if (!code.empty())
+                stages.push_back({ type, preprocess(code) });
+        }
+        build(stages);
     }
 
     void LoadCombined(const string& shaderPath) 
@@ -79,90 +73,123 @@ public:
         unordered_map<GLenum, string> shaderSources;
         parseShaderFile(shaderCode, shaderSources);
 
-        vector<GLuint> shaderIDs;
+        vector<pair<GLenum, string>> stages;
         for (auto& [type, source] : shaderSources) 
         {
-            shaderIDs.push_back(compileShader(type, source));
+            stages.push_back({ type, preprocess(source) });
         }
+        build(stages);
+    }
 
-        ID = glCreateProgram();
-        for (auto& shader : shaderIDs) 
+    // With the parallel compilation, true when the driver has finished the program (use() would not wait)
+    bool isReady() const
+    {
+        if (!mbPending || !g_ShaderCache.bParallel)
+            return true;
+        GLint done = 0;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done != 0;
+    }
+    // Waits for the link, reports the errors, stores the binary and resolves the locations
+    void finish()
+    {
+        if (!mbPending)
+            return;
+        mbPending = false;
+
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success)
         {
-            glAttachShader(ID, shader);
+            for (auto& shader : mvStages)
+                checkCompileErrors(shader, "SHADER");
+            checkCompileErrors(ID, "PROGRAM");
         }
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        else
+            g_ShaderCache.Save(mHash, ID);
 
-        for (auto& shader : shaderIDs) 
+        for (auto& shader : mvStages)
         {
+            glDetachShader(ID, shader);
             glDeleteShader(shader);
         }
+        mvStages.clear();
+        cacheLocations();
     }
     void use() 
     {
+        finish();
         glUseProgram(ID);
     }
-    void setBool(const string& name, bool value) const 
+    // Locations are resolved once after the link, the unknown names return -1 as glGetUniformLocation
+    GLint getLocation(string_view name) const
+    {
+        if (mbPending)
+            const_cast<Shader*>(this)->finish();
+        auto it = mLocations.find(name);
+        return it != mLocations.end() ? it->second : -1;
+    }
+    void setBool(string_view name, bool value) const 
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(getLocation(name), (int)value);
     }
-    void setInt(const string& name, int value) const 
+    void setInt(string_view name, int value) const 
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(getLocation(name), value);
     }
-    void setFloat(const string& name, float value) const 
+    void setFloat(string_view name, float value) const 
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(getLocation(name), value);
     }
-    void setVec2(const string& name, const vec2& value) const 
+    void setVec2(string_view name, const vec2& value) const 
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(getLocation(name), 1, &value[0]);
     }
-    void setVec2(const string& name, float x, float y) const
+    void setVec2(string_view name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(getLocation(name), x, y);
     }
-    void setVec3(const string& name, const vec3& value) const
+    void setVec3(string_view name, const vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(getLocation(name), 1, &value[0]);
     }
-    void setVec3(const string& name, float x, float y, float z) const
+    void setVec3(string_view name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(getLocation(name), x, y, z);
     }
-    void setVec4(const string& name, const vec4& value) const
+    void setVec4(string_view name, const vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(getLocation(name), 1, &value[0]);
     }
-    void setVec4(const string& name, float x, float y, float z, float w)
+    void setVec4(string_view name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(getLocation(name), x, y, z, w);
     }
-    void setMat2(const string& name, const mat2& mat) const
+    void setMat2(string_view name, const mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
-    void setMat3(const string& name, const mat3& mat) const 
+    void setMat3(string_view name, const mat3& mat) const 
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
-    void setMat4(const string& name, const mat4& mat) const 
+    void setMat4(string_view name, const mat4& mat) const 
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
-    void setSampler2D(const string& name, unsigned int texture, int id) const
+    void setSampler2D(string_view name, unsigned int texture, int id) const
     {
         glActiveTexture(GL_TEXTURE0 + id);
         glBindTexture(GL_TEXTURE_2D, texture);
         this->setInt(name, id);
     }
-    void setSampler3D(const string& name, unsigned int texture, int id) const
+    void setSampler3D(string_view name, unsigned int texture, int id) const
     {
         glActiveTexture(GL_TEXTURE0 + id);
         glBindTexture(GL_TEXTURE_3D, texture);
         this->setInt(name, id);
     }
-    void setSamplerCube(const string& name, unsigned int texture, int id) const
+    void setSamplerCube(string_view name, unsigned int texture, int id) const
     {
         glActiveTexture(GL_TEXTURE0 + id);
         glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
@@ -171,6 +198,51 @@ public:
 
 
 private:
+    void cacheLocations()
+    {
+        mLocations.clear();
+        mNames.clear();
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        vector<char> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size;
+            GLenum type;
+            GLsizei length;
+            glGetActiveUniform(ID, i, maxLength + 1, &length, &size, &type, buffer.data());
+            string name(buffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0)
+                continue;   // Member of a uniform block
+            addLocation(name, location);
+
+            // Arrays are listed as "name[0]", they are also set by "name" and their elements by "name[i]"
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                string base = name.substr(0, name.size() - 3);
+                addLocation(base, location);
+                for (GLint e = 1; e < size; e++)
+                {
+                    string element = base + "[" + to_string(e) + "]";
+                    addLocation(element, glGetUniformLocation(ID, element.c_str()));
+                }
+            }
+        }
+
+        GLuint frame = glGetUniformBlockIndex(ID, "Frame");
+        if (frame != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, frame, FRAME_BINDING);
+    }
+    void addLocation(const string& name, GLint location)
+    {
+        // The keys are views on the names of the deque, that never moves them
+        mNames.push_back(name);
+        mLocations[mNames.back()] = location;
+    }
+
     string loadShaderFile(const string& shaderPath) 
     {
         ifstream shaderFile;
@@ -181,7 +253,7 @@ private:
             stringstream shaderStream;
             shaderStream << shaderFile.rdbuf();
             shaderFile.close();
-            return shaderStream.str();
+            return resolveIncludes(shaderStream.str(), shaderPath);
         }
         catch (ifstream::failure& e) 
         {
@@ -189,10 +261,52 @@ private:
             return "";
         }
     }
-    GLuint compileShader(GLenum type, const string& source) 
+    // Lines #include "file" are replaced by the file, relative to the folder of the shader
+    string resolveIncludes(const string& source, const string& shaderPath)
     {
-        GLuint shader = glCreateShader(type);
+        string folder = shaderPath.substr(0, shaderPath.find_last_of("/\\") + 1);
+        string result;
+        size_t pos = 0;
+        while (pos < source.size())
+        {
+            size_t eol = source.find('\n', pos);
+            if (eol == string::npos)
+                eol = source.size();
+            string line = source.substr(pos, eol - pos);
+            size_t token = line.find("#include");
+            size_t open = line.find('"');
+            size_t close = line.rfind('"');
+            if (token != string::npos && line.find_first_not_of(" \t") == token && open != string::npos && close > open)
+                result += loadShaderFile(folder + line.substr(open + 1, close - open - 1)) + "\n";
+            else
+                result += line + "\n";
+            pos = eol + 1;
+        }
+        return result;
+    }
+    // The program comes from the binary cache, or its stages are compiled and linked without waiting for the driver
+    void build(const vector<pair<GLenum, string>>& stages)
+    {
+        ID = glCreateProgram();
+        mHash = g_ShaderCache.Hash(stages);
+        if (g_ShaderCache.Load(mHash, ID))
+        {
+            cacheLocations();
+            return;
+        }
 
+        for (auto& [type, source] : stages)
+        {
+            GLuint shader = compileShader(type, source);
+            glAttachShader(ID, shader);
+            mvStages.push_back(shader);
+        }
+        glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+        mbPending = true;
+    }
+    string preprocess(const string& source)
+    {
         // Search for the #version directive
         string finalSource = source;
         size_t versionPos = finalSource.find("#version");
@@ -213,11 +327,14 @@ private:
             // If no #version, just add the defines
             finalSource = mDefines + finalSource;
         }
-
-        const char* src = finalSource.c_str();
+        return finalSource;
+    }
+    GLuint compileShader(GLenum type, const string& source) 
+    {
+        GLuint shader = glCreateShader(type);
+        const char* src = source.c_str();
         glShaderSource(shader, 1, &src, nullptr);
         glCompileShader(shader);
-        checkCompileErrors(shader, "SHADER");
         return shader;
     }
 
@@ -269,4 +386,9 @@ private:
     }
 
     string mDefines;
+    uint64_t                            mHash = 0;
+    bool                                mbPending = false;      // Linked by the driver, status not asked yet
+    vector<GLuint>                      mvStages;
+    deque<string>                       mNames;
+    unordered_map<string_view, GLint>   mLocations;
 };
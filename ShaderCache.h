@@ -0,0 +1,188 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+#include <glad/glad.h>
+
+using namespace std;
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRY* PFNMAXSHADERCOMPILERTHREADS)(GLuint count);
+
+// Binary of a linked program stored in Resources/Shaders/Cache/<hash>.bin
+// The hash covers the preprocessed sources of the stages and the driver, a new driver or a modified shader gives a new file
+struct sProgramBinaryHeader
+{
+	char		Magic[4]	= { 'S', 'S', 'P', 'B' };
+	uint32_t	Version		= 0;
+	uint64_t	Hash		= 0;
+	uint32_t	Format		= 0;
+	uint32_t	Length		= 0;
+};
+
+class ShaderCache
+{
+public:
+	static const uint32_t VERSION = 1;
+	inline static const string FOLDER = "Resources/Shaders/Cache/";
+
+	// After the loading of OpenGL, maxThreads is glMaxShaderCompilerThreadsKHR when the driver has GL_KHR_parallel_shader_compile
+	void Init(PFNMAXSHADERCOMPILERTHREADS maxThreads = nullptr)
+	{
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		bEnabled = formats > 0;
+
+		mDriver = string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+
+		// The compilations and links are then done by the threads of the driver, the status is only asked when the program is used
+		if (maxThreads)
+		{
+			maxThreads(0xFFFFFFFF);
+			bParallel = true;
+		}
+
+		error_code ec;
+		filesystem::create_directories(FOLDER, ec);
+		mbInit = true;
+	}
+
+	// FNV-1a of the driver and of the stages (type + source after the defines and the includes)
+	uint64_t Hash(const vector<pair<GLenum, string>>& stages) const
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		auto add = [&](const void* data, size_t size)
+		{
+			const unsigned char* p = (const unsigned char*)data;
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= p[i];
+				hash *= 1099511628211ULL;
+			}
+		};
+		add(mDriver.data(), mDriver.size());
+		for (auto& [type, source] : stages)
+		{
+			add(&type, sizeof(type));
+			add(source.data(), source.size());
+		}
+		return hash;
+	}
+
+	// Links the program from its binary, false if there is none or if the driver refuses it
+	bool Load(uint64_t hash, GLuint program)
+	{
+		if (!mbInit || !bEnabled)
+		{
+			mMisses++;
+			return false;
+		}
+
+		ifstream file(Pathname(hash), ios::binary);
+		if (!file)
+		{
+			mMisses++;
+			return false;
+		}
+
+		sProgramBinaryHeader header, expected;
+		file.read((char*)&header, sizeof(header));
+		if (!file || memcmp(header.Magic, expected.Magic, 4) != 0 || header.Version != VERSION || header.Hash != hash)
+		{
+			mMisses++;
+			return false;
+		}
+
+		vector<char> binary(header.Length);
+		file.read(binary.data(), binary.size());
+		if (!file)
+		{
+			mMisses++;
+			return false;
+		}
+
+		glProgramBinary(program, header.Format, binary.data(), header.Length);
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			mMisses++;
+			return false;
+		}
+		mHits++;
+		return true;
+	}
+
+	// Stores the binary of a program that has been linked successfully
+	void Save(uint64_t hash, GLuint program)
+	{
+		if (!mbInit || !bEnabled)
+			return;
+
+		sProgramBinaryHeader header;
+		header.Version = VERSION;
+		header.Hash = hash;
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+		vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(program, length, &length, &format, binary.data());
+		header.Format = format;
+		header.Length = length;
+
+		// Written in a temporary file, so that a stopped application never leaves a truncated binary
+		string pathname = Pathname(hash);
+		stringstream tmp;
+		tmp << pathname << '.' << this_thread::get_id() << ".tmp";
+		{
+			ofstream file(tmp.str(), ios::binary);
+			if (!file)
+				return;
+			file.write((const char*)&header, sizeof(header));
+			file.write(binary.data(), length);
+		}
+		error_code ec;
+		filesystem::rename(tmp.str(), pathname, ec);
+		if (ec)
+			filesystem::remove(tmp.str(), ec);
+	}
+
+	int GetHits()	{ return mHits; }
+	int GetMisses()	{ return mMisses; }
+
+	bool bEnabled = true;			// Off when the driver has no binary format
+	bool bParallel = false;			// GL_KHR_parallel_shader_compile
+
+private:
+	string Pathname(uint64_t hash)
+	{
+		stringstream ss;
+		ss << FOLDER << hex << hash << ".bin";
+		return ss.str();
+	}
+
+	bool	mbInit = false;
+	string	mDriver;
+	int		mHits = 0;
+	int		mMisses = 0;
+};
+
+extern ShaderCache g_ShaderCache;
@@ -3,9 +3,11 @@ This work is licensed under a Creative Commons Attribution-NonCommercial-NoDeriv
 http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 
 #include "Ship.h"
+#include "Profiler.h"
 #include <omp.h>
-#include "MeshPlaneIntersect.hpp"
 #include <math.h>
+#include <chrono>
+#include "stb_image_write.h"
 
 #include "clipper/clipper.h"
 #ifdef _DEBUG
@@ -15,13 +17,15 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 #endif
 using namespace Clipper2Lib;
 
-//#define DEBUG_SMOKE // Update smoke.comp with 2 lines: layout(std430, binding = 1) buffer CounterBuffer { int liveCounter; }; atomicAdd(liveCounter, 1);
+//#define DEBUG_SMOKE // Print the number of living smoke particles (synchronous read of the counters)
 
 extern float            g_WindSpeedKN;
 extern vec2             g_Wind;
 extern SoundManager   * g_SoundMgr;
-extern bool             g_bPause;
+extern SimClock         g_SimClock;
 extern Camera           g_Camera;
+extern TransientBuffer  g_TransientBuffer;
+extern AssetLoader      g_AssetLoader;
 
 GLuint                  TexContourShip      = 0;                // Texture of the contour of the ship
 int                     TexContourShipW;
@@ -43,6 +47,12 @@ Ship::~Ship()
     glDeleteBuffers(1, &mVboHull);
     glDeleteVertexArrays(1, &mVaoLines);
 
+    glDeleteVertexArrays(1, &mVaoSmoke);
+    glDeleteBuffers(1, &mSSBO_SMOKE);
+    glDeleteBuffers(1, &mSSBO_SMOKE_DEAD);
+    glDeleteBuffers(2, mSSBO_SMOKE_ALIVE);
+    glDeleteBuffers(1, &mSSBO_SMOKE_COUNTERS);
+
     mModelFull.reset();
     mPropeller.reset();
     mRudder.reset();
@@ -68,7 +78,6 @@ Ship::~Ship()
     mSoundBowThruster.reset();
 
     glDeleteVertexArrays(1, &mVaoWake);
-    glDeleteBuffers(1, &mVboWake);
 
     mShaderWakeVao.reset();
     mTexWake.reset();
@@ -84,17 +93,37 @@ Ship::~Ship()
     mvVertWaterHeight.clear();
     mvVertWaterHeight.resize(0);
 
-    mvWaterPos.clear();
-    mvWaterPos.resize(0);
-
     glDeleteVertexArrays(1, &mVaoContour1);
     glDeleteBuffers(1, &mVboContour1);
+
+    mShaderHydrostatics.reset();
+    glDeleteBuffers(1, &mSSBO_HULL_VERTICES);
+    glDeleteBuffers(1, &mSSBO_HULL_TRIANGLES);
+    glDeleteBuffers(1, &mSSBO_WATER_VERTICES);
+    glDeleteBuffers(1, &mSSBO_HYDRO_PARTIALS);
+    for (int i = 0; i < HYDRO_FRAMES; i++)
+    {
+        if (mHydroFence[i])
+            glDeleteSync(mHydroFence[i]);
+        if (mpHydroResult[i])
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_HYDRO_RESULT[i]);
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        }
+        if (mpHydroHeights[i])
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_HYDRO_HEIGHTS[i]);
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        }
+    }
+    glDeleteBuffers(HYDRO_FRAMES, mSSBO_HYDRO_RESULT);
+    glDeleteBuffers(HYDRO_FRAMES, mSSBO_HYDRO_HEIGHTS);
 }
 
 void Ship::SetOcean(Ocean* ocean)
 {
     mOcean = ocean;
-    pDisplacement = ocean->GetPixelsDisplacement();
+    mWaveField = ocean->GetWaveField();
 };
 void Ship::Init(sShip& ship, Camera& camera)
 {
@@ -102,8 +131,11 @@ void Ship::Init(sShip& ship, Camera& camera)
 
     this->ship = ship;
     
-    // Read the mvVertices and the faces
-    igl::readOBJ(ship.PathnameHull.c_str(), mV, mF);
+    // Read the mvVertices and the faces, the preprocessing comes from the cache when the OBJ did not change
+    uint64_t hash = HullCache::HashFile(ship.PathnameHull);
+    mbHullCached = LoadHullCache(hash);
+    if (!mbHullCached)
+        igl::readOBJ(ship.PathnameHull.c_str(), mV, mF);
     stringstream ssHull;
     ssHull << mV.rows() << " vertices & " << mF.rows() << " faces" << endl;
 
@@ -121,11 +153,15 @@ void Ship::Init(sShip& ship, Camera& camera)
     UpdateWorldMatrix();                        // Necessary for several calculations to come
 
     mvTris.resize(mF.rows());
-    InitTriangles();                             // Create the list of the triangles
-    InitCentroid();                              // Compute the centre of the volume
+    if (!mbHullCached)
+    {
+        InitTriangles();                         // Create the list of the triangles
+        InitCentroid();                          // Compute the centre of the volume
+        InitVolume();                            // Total volume of the hull
+        InitInertia();                           // Volume integrals of the moments of inertia
+    }
     InitSurfaces();                              // Certain surfaces
-    InitVolume();                                // Total volume of the hull
-    InitInertia();                      // Compute all moments of inertia (Ixx, Iyy, Izz, Ixy, Ixz, Iyz)
+    InitMassProperties();                        // Compute all moments of inertia (Ixx, Iyy, Izz, Ixy, Ixz, Iyz)
     
     // Info to display with interface
     ssHull << "Length/Width : " << std::fixed << std::setprecision(2) << mLength << " m x " << mWidth << " m " << endl;
@@ -133,17 +169,21 @@ void Ship::Init(sShip& ship, Camera& camera)
     ssHull << "Mass : " << std::setprecision(0) << int(ship.Mass_t) << " t" << endl;
     InfoHull = ssHull.str();
    
-    InitWaterVertices();                         // Create the list of water vertices in the reference patch
     InitVaoHull();                                // Create the VAO of the colored hull
+    InitWaterline();                             // Adjacency of the triangles for the dynamic waterline
     InitContours();
+    if (!mbHullCached)
+        SaveHullCache(hash);
     InitShaders();
     InitTextures();
     InitVaoWake();
     InitModels();
     InitSounds(camera);
     InitSmoke();
+    InitHydrostatics();
 
-    mSpray = make_unique<Spray>();
+    mSpray = make_unique<Spray>(mOcean->FFT_SIZE, mOcean->PATCH_SIZE);
+    InitSprayEmitters();
 
     ResetVelocities();
     bMotion = false;
@@ -189,19 +229,7 @@ void Ship::InitDimensions()
 }
 void Ship::InitTriangles()
 {
-    sTriangle tri;
-    for (int i = 0; i < mF.rows(); ++i)
-    {
-        tri.I[0] = mF(i, 0);
-        tri.I[1] = mF(i, 1);
-        tri.I[2] = mF(i, 2);
-        vec3 u = mvVertices[tri.I[1]] - mvVertices[tri.I[0]];
-        vec3 v = mvVertices[tri.I[2]] - mvVertices[tri.I[0]];
-        vec3 a = glm::cross(v, u);
-        tri.Area = 0.5f * sqrtf(a.x * a.x + a.y * a.y + a.z * a.z);
-        tri.Normal = glm::normalize(a);
-        mvTris[i] = tri;
-    }
+    HullImmersion::InitTriangles(mF, mvVertices, mvTris);
 }
 void Ship::InitCentroid()
 {
@@ -292,6 +320,23 @@ void Ship::InitInertia()
         Iyz += (2 * p0.y * p0.z + 2 * p1.y * p1.z + 2 * p2.y * p2.z + p0.y * p1.z + p0.y * p2.z + p1.y * p0.z + p1.y * p2.z + p2.y * p0.z + p2.y * p1.z) * volume / 20.0f;
     }
 
+    // Geometry only, kept in the hull cache
+    mIntegrals[0] = Ixx;
+    mIntegrals[1] = Iyy;
+    mIntegrals[2] = Izz;
+    mIntegrals[3] = Ixy;
+    mIntegrals[4] = Ixz;
+    mIntegrals[5] = Iyz;
+}
+void Ship::InitMassProperties()
+{
+    Ixx = mIntegrals[0];
+    Iyy = mIntegrals[1];
+    Izz = mIntegrals[2];
+    Ixy = mIntegrals[3];
+    Ixz = mIntegrals[4];
+    Iyz = mIntegrals[5];
+
     if (mVolume != 0.0f)
     {
         // Calculation of density
@@ -320,24 +365,6 @@ void Ship::InitInertia()
     cout << endl;
 #endif
 }
-void Ship::InitWaterVertices()
-{
-    // Positions
-    for (int z = 0; z <= mOcean->MESH_SIZE; ++z)
-    {
-        vector<vec3> vPos;
-        for (int x = 0; x <= mOcean->MESH_SIZE; ++x)
-        {
-            int index = z * mOcean->MESH_SIZE_1 + x;
-            vec3 v;
-            v.x = (x - mOcean->MESH_SIZE / 2.0f) * mOcean->PATCH_SIZE / mOcean->MESH_SIZE;
-            v.y = 0.0f;
-            v.z = (z - mOcean->MESH_SIZE / 2.0f) * mOcean->PATCH_SIZE / mOcean->MESH_SIZE;
-            vPos.push_back(v);
-        }
-        mvWaterPos.push_back(vPos);
-    }
-}
 void Ship::InitVaoHull()
 {
     // Converting mvVertices, Normals and Colors
@@ -389,19 +416,146 @@ void Ship::InitVaoHull()
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 }
-void Ship::InitContours()
+void Ship::InitWaterline()
+{
+    mvTriVisited.assign(mvTris.size(), 0);
+    mWaterlineWalk = 0;
+    if (mbHullCached)
+        return;
+
+    // Unique edges of the hull with the 2 triangles sharing each of them
+    mvEdges.clear();
+    mvEdgeTris.clear();
+    mvTriEdges.assign(mvTris.size(), ivec3(-1));
+
+    unordered_map<int64_t, int> edgeIndex;
+    edgeIndex.reserve(mvTris.size() * 3 / 2);
+
+    for (int t = 0; t < (int)mvTris.size(); t++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            int a = mvTris[t].I[j];
+            int b = mvTris[t].I[(j + 1) % 3];
+            int64_t key = (int64_t(std::min(a, b)) << 32) | int64_t(std::max(a, b));
+
+            auto it = edgeIndex.find(key);
+            if (it == edgeIndex.end())
+            {
+                edgeIndex[key] = (int)mvEdges.size();
+                mvTriEdges[t][j] = (int)mvEdges.size();
+                mvEdges.push_back(ivec2(a, b));
+                mvEdgeTris.push_back(ivec2(t, -1));
+            }
+            else
+            {
+                mvTriEdges[t][j] = it->second;
+                if (mvEdgeTris[it->second].y == -1)     // Non manifold edges keep their 2 first triangles
+                    mvEdgeTris[it->second].y = t;
+            }
+        }
+    }
+}
+bool Ship::LoadHullCache(uint64_t hash)
+{
+    sHullCacheHeader header;
+    sHullCacheData data;
+    if (!HullCache::Load(HullCache::Pathname(ship.PathnameHull), hash, header, data))
+        return false;
+
+    mV.resize(data.Vertices.size(), 3);
+    for (int i = 0; i < (int)data.Vertices.size(); i++)
+    {
+        mV(i, 0) = data.Vertices[i].x;
+        mV(i, 1) = data.Vertices[i].y;
+        mV(i, 2) = data.Vertices[i].z;
+    }
+
+    mF.resize(data.Faces.size(), 3);
+    mvTris.resize(data.Faces.size());
+    for (int i = 0; i < (int)data.Faces.size(); i++)
+    {
+        sTriangle& tri = mvTris[i];
+        for (int j = 0; j < 3; j++)
+        {
+            mF(i, j) = data.Faces[i][j];
+            tri.I[j] = data.Faces[i][j];
+        }
+        tri.Area = data.Areas[i];
+        tri.Normal = data.Normals[i];
+    }
+
+    mCentroid = header.Centroid;
+    mVolume = header.Volume;
+    for (int i = 0; i < 6; i++)
+        mIntegrals[i] = header.Integrals[i];
+
+    mvEdges = std::move(data.Edges);
+    mvEdgeTris = std::move(data.EdgeTris);
+    mvTriEdges = std::move(data.TriEdges);
+
+    mvContour = std::move(data.Contour);
+    mvContourSpray = std::move(data.ContourSpray);
+    mvContourWake = std::move(data.ContourWake);
+    mvTexWakeMask = std::move(data.Mask);
+    TexContourShipW = header.MaskW;
+    TexContourShipH = header.MaskH;
+
+    return true;
+}
+void Ship::SaveHullCache(uint64_t hash)
 {
-    // Contour
-    vector<vec3> contour = ComputeContour();    // Intersect the mesh with the ocean (Y = 0)
-    contour = ArrangeContour(contour);          // Sort the points
-    CreateContourVAO1(contour);                 // Create the first contour which has the size of the ship
+    // Everything which depends only on the OBJ, the mass and the centre of gravity are applied after
+    sHullCacheHeader header;
+    sHullCacheData data;
+
+    header.Hash = hash;
+    header.Centroid = mCentroid;
+    header.Volume = mVolume;
+    for (int i = 0; i < 6; i++)
+        header.Integrals[i] = mIntegrals[i];
+    header.MaskW = TexContourShipW;
+    header.MaskH = TexContourShipH;
+
+    data.Vertices.resize(mV.rows());
+    for (int i = 0; i < mV.rows(); i++)
+        data.Vertices[i] = vec3(mV(i, 0), mV(i, 1), mV(i, 2));
+
+    data.Faces.resize(mvTris.size());
+    data.Areas.resize(mvTris.size());
+    data.Normals.resize(mvTris.size());
+    for (size_t i = 0; i < mvTris.size(); i++)
+    {
+        data.Faces[i] = ivec3(mvTris[i].I[0], mvTris[i].I[1], mvTris[i].I[2]);
+        data.Areas[i] = mvTris[i].Area;
+        data.Normals[i] = mvTris[i].Normal;
+    }
 
-    vector<vec3> contourSpray = OffsetContour(contour, 0.05f);
-    InitSpray(contourSpray);
+    data.Edges = mvEdges;
+    data.EdgeTris = mvEdgeTris;
+    data.TriEdges = mvTriEdges;
+    data.Contour = mvContour;
+    data.ContourSpray = mvContourSpray;
+    data.ContourWake = mvContourWake;
+    data.Mask = mvTexWakeMask;
+
+    HullCache::Save(HullCache::Pathname(ship.PathnameHull), header, data);
+}
+void Ship::InitContours()
+{
+    if (!mbHullCached)
+    {
+        mvContour = ComputeContour();                       // Intersect the mesh with the ocean (Y = 0)
+        mvContour = ArrangeContour(mvContour);              // Sort the points
+        mvContourSpray = OffsetContour(mvContour, 0.05f);
+        mvContourWake = OffsetContour(mvContour, 1.0f);     // Expand the contour with a constant offset
+        ComputeTexWakeMask(mvContourWake);                  // Foam inside the expanded contour
+    }
 
-    contour = OffsetContour(contour, 1.0f);     // Expand the contour with a constant offset
-    CreateContourVAO2(contour);                 // Create the second contour which is expanded
-    CreateTexWake(contour);                     // Create the texture formed with foam inside the exapnded contour
+    CreateContourVAO1(mvContour);               // Create the first contour which has the size of the ship
+    InitSpray(mvContourSpray);
+    CreateContourVAO2(mvContourWake);           // Create the second contour which is expanded
+    UploadTexWake();                            // Create the texture formed with foam inside the exapnded contour
 }
 void Ship::InitShaders()
 {
@@ -516,33 +670,35 @@ void Ship::InitTextures()
 }
 void Ship::InitVaoWake()
 {
+    // The vertices are uploaded in the transient buffer when needed (BindVaoWake)
     glGenVertexArrays(1, &mVaoWake);
-
-    glGenBuffers(1, &mVboWake);
     glBindVertexArray(mVaoWake);
-    glBindBuffer(GL_ARRAY_BUFFER, mVboWake);
-    glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
     // position (3 floats)
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(sFoamVertex), (void*)offsetof(sFoamVertex, pos));
     // alpha (1 float)
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(sFoamVertex), (void*)offsetof(sFoamVertex, alpha));
+    glBindVertexArray(0);
 
+    // Same thing for the lines of pressure
+    glGenVertexArrays(1, &mVaoLines);
+    glBindVertexArray(mVaoLines);
+    glEnableVertexAttribArray(0);
     glBindVertexArray(0);
 }
 void Ship::InitModels()
 {
-    // Models
-    mModelFull = make_unique<Model>(ship.PathnameFull);
+    // Models, decoded in parallel (the bounding box needs the full model)
+    mModelFull = make_unique<Model>(ship.PathnameFull, g_AssetLoader);
+    mPropeller = make_unique<Model>(ship.PathnamePropeller, g_AssetLoader);
+    mRudder = make_unique<Model>(ship.PathnameRudder, g_AssetLoader);
+    mRadar1 = make_unique<Model>(ship.PathnameRadar1, g_AssetLoader);
+    if (ship.nRadar > 1)
+        mRadar2 = make_unique<Model>(ship.PathnameRadar2, g_AssetLoader);
+    g_AssetLoader.Finish();
+
     stringstream ssFull;
     ssFull << mModelFull->totalVertices << " vertices & " << mModelFull->totalFaces << " faces" << endl;
     InfoFull = ssFull.str();
-    mPropeller = make_unique<Model>(ship.PathnamePropeller);
-    mRudder = make_unique<Model>(ship.PathnameRudder);
-    mRadar1 = make_unique<Model>(ship.PathnameRadar1);
-    if (ship.nRadar > 1)
-        mRadar2 = make_unique<Model>(ship.PathnameRadar2);
 
     sBBvec3 bb = mModelFull->calculateBoundingBox();
     BBoxShape = make_unique<BBox>(bb.min, bb.max);
@@ -575,17 +731,43 @@ void Ship::InitSounds(Camera& camera)
 }
 void Ship::InitSmoke()
 {
+    // Pool sized by the number of chimneys
+    mSmokeMaxParticles = mSMOKE_PARTICLES * std::max(ship.nChimney, 1);
+
     // Initialize array of "dead" particles
     vector<ParticleGPU> particles(mSmokeMaxParticles);
+    vector<uint> dead(mSmokeMaxParticles);
 
     for (int i = 0; i < mSmokeMaxParticles; ++i)
+    {
         particles[i].life = 0.0f; // dead at the start
+        dead[i] = i;
+    }
 
     // Generate and allocate SSBO
     glGenBuffers(1, &mSSBO_SMOKE);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_SMOKE);
     glBufferData(GL_SHADER_STORAGE_BUFFER, mSmokeMaxParticles * sizeof(ParticleGPU), particles.data(), GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mSSBO_SMOKE);
+
+    // Free particles
+    glGenBuffers(1, &mSSBO_SMOKE_DEAD);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_SMOKE_DEAD);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, mSmokeMaxParticles * sizeof(uint), dead.data(), GL_DYNAMIC_DRAW);
+
+    // Living particles, written by one frame and read by the next
+    glGenBuffers(2, mSSBO_SMOKE_ALIVE);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_SMOKE_ALIVE[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, mSmokeMaxParticles * sizeof(uint), nullptr, GL_DYNAMIC_DRAW);
+    }
+    mSmokeAliveIdx = 0;
+
+    // Counters (see smoke.comp): draw command, 2 dispatch commands, aliveInCount, deadCount, emitCount
+    uint counters[15] = { 1, 0, 0, 0,   0, 1, 1, 0,   0, 1, 1, 0,   0, (uint)mSmokeMaxParticles, 0 };
+    glGenBuffers(1, &mSSBO_SMOKE_COUNTERS);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_SMOKE_COUNTERS);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(counters), counters, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
     // VAO setup for drawing points
@@ -594,17 +776,65 @@ void Ship::InitSmoke()
     // No attributes needed, data will be read into vertex shader via SSBO
     glBindVertexArray(0);
 
-#ifdef DEBUG_SMOKE
-    glGenBuffers(1, &SSBO_LIVE_COUNTER);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO_LIVE_COUNTER);
-    int zero = 0;
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(int), &zero, GL_DYNAMIC_COPY);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-#endif
-
     mShaderSmokeCompute = make_unique<Shader>("", "", "", "Resources/Ship/smoke.comp");
     mShaderSmokeRender = make_unique<Shader>("Resources/Ship/smoke.vert", "Resources/Ship/smoke.frag");
 }
+void Ship::InitHydrostatics()
+{
+    // Hull in local coordinates (vec4 for std430)
+    vector<vec4> vertices(mV.rows());
+    for (int i = 0; i < mV.rows(); ++i)
+        vertices[i] = vec4(mV(i, 0), mV(i, 1), mV(i, 2), 1.0f);
+
+    // Triangles : indices + area (the area does not depend on the world matrix)
+    struct sHydroTriangle { ivec4 I; vec4 data; };
+    vector<sHydroTriangle> triangles(mvTris.size());
+    for (size_t i = 0; i < mvTris.size(); ++i)
+    {
+        triangles[i].I = ivec4(mvTris[i].I[0], mvTris[i].I[1], mvTris[i].I[2], 0);
+        triangles[i].data = vec4(mvTris[i].Area, 0.0f, 0.0f, 0.0f);
+    }
+    mHydroGroups = ((int)mvTris.size() + 255) / 256;
+
+    glGenBuffers(1, &mSSBO_HULL_VERTICES);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_HULL_VERTICES);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, vertices.size() * sizeof(vec4), vertices.data(), 0);
+
+    glGenBuffers(1, &mSSBO_HULL_TRIANGLES);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_HULL_TRIANGLES);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, triangles.size() * sizeof(sHydroTriangle), triangles.data(), 0);
+
+    glGenBuffers(1, &mSSBO_WATER_VERTICES);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_WATER_VERTICES);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, vertices.size() * sizeof(vec4), nullptr, 0);
+
+    glGenBuffers(1, &mSSBO_HYDRO_PARTIALS);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_HYDRO_PARTIALS);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, std::max(mHydroGroups, 1) * sizeof(sHydroSum), nullptr, 0);
+
+    // Results : a few floats read back asynchronously through persistent mappings
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    // as well as the heights of the vertices above the water, which give the waterline without the CPU immersion
+    glGenBuffers(HYDRO_FRAMES, mSSBO_HYDRO_RESULT);
+    glGenBuffers(HYDRO_FRAMES, mSSBO_HYDRO_HEIGHTS);
+    for (int i = 0; i < HYDRO_FRAMES; i++)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_HYDRO_RESULT[i]);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(sHydroSum), nullptr, flags);
+        mpHydroResult[i] = (sHydroSum*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sizeof(sHydroSum), flags);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_HYDRO_HEIGHTS[i]);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, vertices.size() * sizeof(float), nullptr, flags);
+        mpHydroHeights[i] = (float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, vertices.size() * sizeof(float), flags);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    char defines[128];
+    sprintf_s(defines, "#define FFT_SIZE %d\n#define PATCH_SIZE %d\n", mOcean->FFT_SIZE, mOcean->PATCH_SIZE);
+    mShaderHydrostatics = make_unique<Shader>();
+    mShaderHydrostatics->addDefines(defines);
+    mShaderHydrostatics->Load("", "", "", "Resources/Ship/hydrostatics.comp");
+}
 void FilterClosePoints(std::vector<sSprayPt>& pts)
 {
     if (pts.size() < 2)
@@ -726,6 +956,34 @@ void Ship::InitSpray(vector<vec3>& contour)
         mRandomOffsetRange *= 0.5f;
     }
 }
+void Ship::InitSprayEmitters()
+{
+    // Points of the contour uploaded once for spray.comp, the intensity decreases from the bow
+    vector<SprayEmitterGPU> emitters;
+
+    if (mLeft.size() < 2 || mRight.size() < 2)
+    {
+        mSpray->SetEmitters(emitters, 0);
+        return;
+    }
+
+    auto AddSide = [&](const vector<sSprayPt>& side)
+        {
+            for (size_t i = 0; i < side.size(); ++i)
+            {
+                float intensity = 1.0f - float(i) / float(side.size() - 1);
+                if (ship.SprayType == 1)
+                    intensity = sinf(1.57079632679f * intensity);   // Using a sine in [0, pi/2] to vary from 1.0 to 0
+
+                emitters.push_back({ vec4(side[i].p, intensity), vec4(side[i].n, 0.0f) });
+            }
+        };
+
+    AddSide(mLeft);
+    AddSide(mRight);
+
+    mSpray->SetEmitters(emitters, (int)mLeft.size());
+}
 
 GLuint	Ship::GetTraceID() 
 { 
@@ -780,47 +1038,7 @@ void Ship::UpdateTrace()
 // Contour
 vector<vec3> Ship::ComputeContour()
 {
-    using Intersector = MeshPlaneIntersect<float, int>;
-
-    // Local lambdas for conversion
-    auto toVec3D = [](const vec3& v) -> Intersector::Vec3D {
-        return { static_cast<float>(v.x), static_cast<float>(v.y), static_cast<float>(v.z) };
-        };
-
-    auto toFace = [](const sTriangle& tri) -> Intersector::Face {
-        return { tri.I[0], tri.I[1], tri.I[2] };
-        };
-
-    // Converting vertices
-    vector<Intersector::Vec3D> vertices;
-    vertices.reserve(mvVertices.size());
-    for (const auto& v : mvVertices)
-        vertices.push_back(toVec3D(v));
-
-    // Face Conversion
-    vector<Intersector::Face> faces;
-    faces.reserve(mvTris.size());
-    for (const auto& tri : mvTris)
-        faces.push_back(toFace(tri));
-
-    // Creating the mesh
-    Intersector::Mesh mesh(vertices, faces);
-
-    // Plan Y=0, normal (0,1,0)
-    Intersector::Plane plane({ 0,0,0 }, { 0,1,0 });
-
-    // Intersects the mesh with the plane
-    auto result = mesh.Intersect(plane);
-
-    // Each element of result is a contour
-    vector<vec3> contour;
-    for (const auto& path : result)
-    {
-        // path.points : vector<Vec3D> points of the contour, path.isClosed : boolean, true if the contour is closed
-        for (const auto& p : path.points)
-            contour.emplace_back(static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]));
-    }
-    return contour;
+    return HullImmersion::ComputeContour(mvVertices, mvTris);
 }
 vector<vec3> Ship::ArrangeContour(const vector<vec3>& contourUnordered)
 {
@@ -920,47 +1138,18 @@ vector<vec3> Ship::OffsetContour(const vector<vec3>& contour, float offset)
 
     return result;
 }
-bool isPointInPolygon(const vec2& pt, const vector<vec2>& contour2D)
+void Ship::CreateTexWake(const vector<vec3>& contour)
 {
-    // Tests if a point (x, z) is inside a polygon (ray algorithm)
-    // contour2D : vector<vec2> (x, z)
-    
-    bool inside = false;
-    size_t n = contour2D.size();
-    for (size_t i = 0, j = n - 1; i < n; j = i++) 
-    {
-        const vec2& vi = contour2D[i];
-        const vec2& vj = contour2D[j];
-        if (((vi.y > pt.y) != (vj.y > pt.y)) && (pt.x < (vj.x - vi.x) * (pt.y - vi.y) / (vj.y - vi.y + 1e-8f) + vi.x))
-            inside = !inside;
-    }
-    return inside;
+    ComputeTexWakeMask(contour);
+    UploadTexWake();
 }
-float minDistanceToContour(const vec2& pt, const vector<vec2>& contour2D) 
-{
-    // Minimum distance between a point and a polyline (to draw the outline in white)
-    
-    float minDist = numeric_limits<float>::max();
-    size_t n = contour2D.size();
-    for (size_t i = 0; i < n; ++i) 
-    {
-        const vec2& a = contour2D[i];
-        const vec2& b = contour2D[(i + 1) % n];
-        vec2 ab = b - a;
-        vec2 ap = pt - a;
-        float t = glm::clamp(glm::dot(ap, ab) / glm::dot(ab, ab), 0.0f, 1.0f);
-        vec2 proj = a + t * ab;
-        float dist = glm::distance(pt, proj);
-        if (dist < minDist) minDist = dist;
-    }
-    return minDist;
-}
-void Ship::CreateTexWake(const vector<vec3>& contour)
+void Ship::ComputeTexWakeMask(const vector<vec3>& contour)
 {
     TexContourShipW = std::ceil((mLength + 5.0f) / 10.0f) * 10.0f;
     TexContourShipH = std::ceil((mWidth + 5.0f) / 10.0f) * 10.0f;
 
-    vector<float> mask(TexContourShipW * TexContourShipH, 0.0f);
+    vector<float>& mask = mvTexWakeMask;
+    mask.assign(TexContourShipW * TexContourShipH, 0.0f);
 
     // Determines the actual boundaries of the contour
     float minX = contour[0].x, maxX = contour[0].x;
@@ -983,30 +1172,78 @@ void Ship::CreateTexWake(const vector<vec3>& contour)
         contour2D.emplace_back(v.x + offsetX, v.z + offsetZ);
     
     float edgeWidth = 1.0f; // Épaisseur du contour adouci, en pixels
+    const int W = TexContourShipW;
+    const int H = TexContourShipH;
+    size_t n = contour2D.size();
+
+    // Inside the outline: scanline fill between the crossings of the edges with the centre of each row (even-odd rule)
+    vector<float> crossings;
+    for (int j = 0; j < H; ++j)
+    {
+        float y = j + 0.5f;
+        crossings.clear();
+        for (size_t i = 0, k = n - 1; i < n; k = i++)
+        {
+            const vec2& vi = contour2D[i];
+            const vec2& vk = contour2D[k];
+            if ((vi.y > y) != (vk.y > y))
+                crossings.push_back((vk.x - vi.x) * (y - vi.y) / (vk.y - vi.y + 1e-8f) + vi.x);
+        }
+        std::sort(crossings.begin(), crossings.end());
+        for (size_t c = 0; c + 1 < crossings.size(); c += 2)
+        {
+            // Pixels whose centre is in [crossings[c], crossings[c + 1])
+            int i0 = std::max(0, (int)std::ceil(crossings[c] - 0.5f));
+            int i1 = std::min(W - 1, (int)std::ceil(crossings[c + 1] - 0.5f) - 1);
+            for (int i = i0; i <= i1; ++i)
+                mask[j * W + i] = 1.0f;
+        }
+    }
 
-    // For each pixel, determine whether it is within the outline or on the edge
-    for (int j = 0; j < TexContourShipH; ++j) 
+    // Degraded outside: only the pixels around each segment of the outline
+    for (size_t k = 0; k < n; ++k)
     {
-        for (int i = 0; i < TexContourShipW; ++i)
+        const vec2& a = contour2D[k];
+        const vec2& b = contour2D[(k + 1) % n];
+        vec2 ab = b - a;
+        float ab2 = glm::dot(ab, ab);
+        int i0 = std::max(0, (int)std::floor(std::min(a.x, b.x) - edgeWidth));
+        int i1 = std::min(W - 1, (int)std::ceil(std::max(a.x, b.x) + edgeWidth));
+        int j0 = std::max(0, (int)std::floor(std::min(a.y, b.y) - edgeWidth));
+        int j1 = std::min(H - 1, (int)std::ceil(std::max(a.y, b.y) + edgeWidth));
+        for (int j = j0; j <= j1; ++j)
         {
-            vec2 pt(i + 0.5f, j + 0.5f);
-            bool inside = isPointInPolygon(pt, contour2D);
-            float dist = minDistanceToContour(pt, contour2D);
-            float sd = inside ? -dist : dist; // Signed distance
-
-            float bias = 0.0f;
-            if (sd <= 0.0f)              // inside or on the outline
-                bias = 1.0f;
-            else if (sd < edgeWidth)     // degraded outside
-                bias = 1.0f - (sd / edgeWidth);
-            else                        // far outside
-                bias = 0.0f;
-
-            mask[j * TexContourShipW + i] = bias;
+            for (int i = i0; i <= i1; ++i)
+            {
+                vec2 pt(i + 0.5f, j + 0.5f);
+                float t = ab2 > 0.0f ? glm::clamp(glm::dot(pt - a, ab) / ab2, 0.0f, 1.0f) : 0.0f;
+                float dist = glm::distance(pt, a + t * ab);
+                float& bias = mask[j * W + i];
+                bias = std::max(bias, 1.0f - dist / edgeWidth);
+            }
         }
     }
+}
+void Ship::UploadTexWake()
+{
+    if ((int)mvTexWakeMask.size() != TexContourShipW * TexContourShipH)
+        return;
+    const vector<float>& mask = mvTexWakeMask;
+
     if (TexContourShip)
     {
+        GLint w = 0, h = 0;
+        glBindTexture(GL_TEXTURE_2D, TexContourShip);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+        if (w == TexContourShipW && h == TexContourShipH)
+        {
+            // Same size, only the content follows the waterline
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TexContourShipW, TexContourShipH, GL_RED, GL_FLOAT, mask.data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+            return;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
         glDeleteTextures(1, &TexContourShip);
         TexContourShip = 0;
     }
@@ -1074,223 +1311,121 @@ void Ship::CreateContourVAO2(vector<vec3>& contour)
 
     mIndicesContour2 = contour.size();
 }
-
-// Support
-vec3 Ship::GetVerticeAtMeshIndex(int x, int z)
-{
-    int xx = x;
-    int zz = z;
-
-    int i = 0;
-    int j = 0;
-
-    while (xx < 0)
-    {
-        xx += mOcean->MESH_SIZE;
-        i--;
-    }
-    while (zz < 0)
-    {
-        zz += mOcean->MESH_SIZE;
-        j--;
-    }
-
-    while (xx >= mOcean->MESH_SIZE)
-    {
-        xx -= mOcean->MESH_SIZE;
-        i++;
-    }
-    while (zz >= mOcean->MESH_SIZE)
-    {
-        zz -= mOcean->MESH_SIZE;
-        j++;
-    }
-
-    vec3 pos;
-    // Correspondence between MESH coordinates and FFT coordinates
-    int xFft = (xx - mOcean->MESH_SIZE / 2) * mOcean->FFT_SIZE / mOcean->MESH_SIZE + mOcean->FFT_SIZE / 2;
-    int yFft = (zz - mOcean->MESH_SIZE / 2) * mOcean->FFT_SIZE / mOcean->MESH_SIZE + mOcean->FFT_SIZE / 2;
-    int index = 4 * (yFft * mOcean->FFT_SIZE + xFft);
-
-    pos.x = mvWaterPos[zz][xx].x + i * mOcean->PATCH_SIZE + pDisplacement[index + 0];
-    pos.y = pDisplacement[index + 1];
-    pos.z = mvWaterPos[zz][xx].z + j * mOcean->PATCH_SIZE + pDisplacement[index + 2];
-
-    return pos;
-}
-int Ship::GetHeightFast(vec3& pos)
+void Ship::UpdateWaterline(float dt)
 {
-    // Update pos vector and return the number of computations (higher the lambda is, higher the computations are)
-
-    int x = pos.x * mOcean->MESH_SIZE / mOcean->PATCH_SIZE + mOcean->MESH_SIZE / 2;
-    int z = pos.z * mOcean->MESH_SIZE / mOcean->PATCH_SIZE + mOcean->MESH_SIZE / 2;
+    // Only the triangles crossing the water (WaterStatus 1 or 2) are walked, from edge to edge through the adjacency
+    auto IsCrossing = [&](int e) { return mvVertSubmerged[mvEdges[e].x] != mvVertSubmerged[mvEdges[e].y]; };
 
-    vec3 posR = pos;
-
-    while (x < 0)
-    {
-        x += mOcean->MESH_SIZE;
-        posR.x += mOcean->PATCH_SIZE;
-    }
-    while (z < 0)
-    {
-        z += mOcean->MESH_SIZE;
-        posR.z += mOcean->PATCH_SIZE;
-    }
-
-    while (x >= mOcean->MESH_SIZE)
-    {
-        x -= mOcean->MESH_SIZE;
-        posR.x -= mOcean->PATCH_SIZE;
-    }
-    while (z >= mOcean->MESH_SIZE)
-    {
-        z -= mOcean->MESH_SIZE;
-        posR.z -= mOcean->PATCH_SIZE;
-    }
-
-
-    int n = 0;
-    int index;
-    float xOrig, xReal;
-    float zOrig, zReal;
-    vec3 p1, p2, p3, p4;
-
-    // First level of searching, step by step, x then z
-
-    // X to the left
-    int xGrid;
-    for (xGrid = x; xGrid >= 0; xGrid--)
-    {
-        n++;
-        xReal = GetVerticeAtMeshIndex(xGrid, z).x;
-        if (xReal < posR.x)
-            break;
-    }
-    int indexX1 = xGrid;
-    if (x == indexX1)
-    {
-        // X to the right
-        for (xGrid = x; xGrid < mOcean->MESH_SIZE_1; xGrid++)
+    // Follows the waterline from a triangle, leaving it by the crossing edge other than edgeIn
+    auto Walk = [&](int tri, int edgeIn, vector<vec3>& path) -> bool
         {
-            n++;
-            xReal = GetVerticeAtMeshIndex(xGrid, z).x;
-            if (xReal > posR.x)
-                break;
-        }
-        indexX1 = xGrid - 1;
-    }
+            int start = tri;
+            while (tri != -1)
+            {
+                mvTriVisited[tri] = mWaterlineWalk;
+                int edgeOut = -1;
+                for (int j = 0; j < 3; j++)
+                {
+                    int e = mvTriEdges[tri][j];
+                    if (e != edgeIn && IsCrossing(e))
+                    {
+                        edgeOut = e;
+                        break;
+                    }
+                }
+                if (edgeOut == -1)
+                    return false;
+                path.push_back(GetWaterlineCrossing(edgeOut));
+
+                tri = (mvEdgeTris[edgeOut].x == tri) ? mvEdgeTris[edgeOut].y : mvEdgeTris[edgeOut].x;
+                edgeIn = edgeOut;
+                if (tri == start)
+                    return true;                        // Closed loop
+                if (tri != -1 && mvTriVisited[tri] == mWaterlineWalk)
+                    return false;
+            }
+            return false;                               // Border of the mesh
+        };
 
+    mWaterlineWalk++;
+    mvWaterline.clear();
+    vector<vec3> loop, back;
 
-    // Z to the bottom
-    int zGrid;
-    for (zGrid = z; zGrid >= 0; zGrid--)
+    for (int t = 0; t < (int)mvTris.size(); t++)
     {
-        n++;
-        zReal = GetVerticeAtMeshIndex(x, zGrid).z;
-        if (zReal < posR.z)
-            break;
-    }
-    int indexZ1 = zGrid;
-    if (z == indexZ1)
-    {
-        // Z to the top
-        for (zGrid = z; zGrid < mOcean->MESH_SIZE_1; zGrid++)
+        if (mvTris[t].WaterStatus == 0 || mvTris[t].WaterStatus == 3 || mvTriVisited[t] == mWaterlineWalk)
+            continue;
+
+        loop.clear();
+        if (!Walk(t, -1, loop) && loop.size())
         {
-            n++;
-            zReal = GetVerticeAtMeshIndex(x, zGrid).z;
-            if (zReal > posR.z)
-                break;
+            // Open path: the other side of the starting triangle is walked too
+            back.clear();
+            int firstEdge = -1;
+            for (int j = 0; j < 3 && firstEdge == -1; j++)
+                if (IsCrossing(mvTriEdges[t][j]))
+                    firstEdge = mvTriEdges[t][j];
+            Walk(t, firstEdge, back);
+            loop.insert(loop.begin(), back.rbegin(), back.rend());
         }
-        indexZ1 = zGrid - 1;
+        if (loop.size() > mvWaterline.size())
+            mvWaterline.swap(loop);
     }
-    if (indexZ1 == -1)  indexZ1 = 0;
 
-    // Try with these indexes
-    p1 = GetVerticeAtMeshIndex(indexX1, indexZ1);          // Bottom Left
-    p2 = GetVerticeAtMeshIndex(indexX1 + 1, indexZ1);      // Bottom Right
-    p3 = GetVerticeAtMeshIndex(indexX1 + 1, indexZ1 + 1);  // Top Right
+    if (mvWaterline.size() < 3)
+        return;
 
-    if (InterpolateTriangle(p1, p2, p3, posR))
+    // Line of the waterline
+    if (bContour && mVboContour1)
     {
-        pos.y = posR.y;
-        return n;
+        glBindBuffer(GL_ARRAY_BUFFER, mVboContour1);
+        glBufferData(GL_ARRAY_BUFFER, mvWaterline.size() * sizeof(vec3), mvWaterline.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        mIndicesContour1 = (int)mvWaterline.size();
     }
 
-    p4 = GetVerticeAtMeshIndex(indexX1, indexZ1 + 1);      // Top Left
-    if (InterpolateTriangle(p1, p3, p4, posR))
-    {
-        pos.y = posR.y;
-        return n;
-    }
+    // Foam and spray need an offset of the waterline, they are rebuilt only when the attitude or the draft has changed
+    mWaterlineTimer += dt;
+    if (mWaterlineTimer < WATERLINE_REFRESH)
+        return;
+    float level = 0.0f;
+    for (const auto& p : mvWaterline)
+        level += p.y;
+    level /= mvWaterline.size();                        // Height of the water on the hull
+    if (fabs(Roll - mWaterlineRoll) < WATERLINE_ANGLE && fabs(Pitch - mWaterlinePitch) < WATERLINE_ANGLE && fabs(level - mWaterlineLevel) < WATERLINE_DRAFT)
+        return;
+    mWaterlineTimer = 0.0f;
+    mWaterlineRoll = Roll;
+    mWaterlinePitch = Pitch;
+    mWaterlineLevel = level;
 
-    // Second level of searching. From the indexes, start around the last indexes on a 5 x 5 basis
-    for (int i = -2; i <= 2; i++)
+    if (bSpray && mSpray)
     {
-        for (int j = -2; j <= 2; j++)
-        {
-            n++;
-            p1 = GetVerticeAtMeshIndex(indexX1 + i, indexZ1 + j);          // Bottom Left
-            p2 = GetVerticeAtMeshIndex(indexX1 + 1 + i, indexZ1 + j);      // Bottom Right
-            p3 = GetVerticeAtMeshIndex(indexX1 + 1 + i, indexZ1 + 1 + j);  // Top Right
-
-            if (InterpolateTriangle(p1, p2, p3, posR))
-            {
-                pos.y = posR.y;
-                return n;
-            }
-
-            p4 = GetVerticeAtMeshIndex(indexX1 + i, indexZ1 + 1 + j);      // Top Left
-            if (InterpolateTriangle(p1, p3, p4, posR))
-            {
-                pos.y = posR.y;
-                return n;
-            }
-        }
+        vector<vec3> contourSpray = OffsetContour(mvWaterline, 0.05f);
+        InitSpray(contourSpray);
+        InitSprayEmitters();
     }
 
-    // Second level of searching, extend the grid in another method
-    n += GetHeightSlow(pos);
-
-    return n;
+    vector<vec3> contour = OffsetContour(mvWaterline, 1.0f);
+    if (contour.size() < 3)
+        return;
+    if (bContour)
+        CreateContourVAO2(contour);
+    CreateTexWake(contour);
 }
-int Ship::GetHeightSlow(vec3& pos)
+vec3 Ship::GetWaterlineCrossing(int edge)
 {
-    int x = pos.x * mOcean->MESH_SIZE / mOcean->PATCH_SIZE + mOcean->MESH_SIZE / 2;
-    int z = pos.z * mOcean->MESH_SIZE / mOcean->PATCH_SIZE + mOcean->MESH_SIZE / 2;
-
-    int n = 0;
-    int index;
-    float xOrig, xReal;
-    float zOrig, zReal;
+    // Point of the edge at the water height, in local coordinates
+    int a = mvEdges[edge].x;
+    int b = mvEdges[edge].y;
+    float t = mvVertWaterHeight[a] / (mvVertWaterHeight[a] - mvVertWaterHeight[b]);
 
-    // Find the index in pDisplacement
-
-    vec3 p1, p2, p3, p4;
-    int xGrid, zGrid;
-    bool bAssert12, bAssert43, bAssert14, bAssert23;
-    for (xGrid = x - 20; xGrid <= x + 20; xGrid++)
-    {
-        for (zGrid = z - 20; zGrid <= z + 20; zGrid++)
-        {
-            n++;
-            p1 = GetVerticeAtMeshIndex(xGrid, zGrid);          // Bottom Left
-            p2 = GetVerticeAtMeshIndex(xGrid + 1, zGrid);      // Bottom Right
-            p3 = GetVerticeAtMeshIndex(xGrid + 1, zGrid + 1);  // Top Right
-
-            if (InterpolateTriangle(p1, p2, p3, pos))
-                return n;
-            
-            p4 = GetVerticeAtMeshIndex(xGrid, zGrid + 1);      // Top Left
-            if (InterpolateTriangle(p1, p3, p4, pos))
-                return n;
-        }
-    }
-   
-    // No triangle found
-    pos.y = 0.0f;
-    return 0;
+    vec3 pa = { static_cast<float>(mV(a, 0)), static_cast<float>(mV(a, 1)), static_cast<float>(mV(a, 2)) };
+    vec3 pb = { static_cast<float>(mV(b, 0)), static_cast<float>(mV(b, 1)), static_cast<float>(mV(b, 2)) };
+    return glm::mix(pa, pb, t);
 }
+
+// Support
 void Ship::UpdateWorldMatrix()
 {
     World = mat4(1.0f);
@@ -1313,13 +1448,7 @@ void Ship::ResetVelocities()
 }
 void Ship::TransformVertices()
 {
-    vec3 p;
-    for (int i = 0; i < mV.rows(); ++i)
-    {
-        p = { static_cast<float>(mV(i, 0)) , static_cast<float>(mV(i, 1)) ,static_cast<float>(mV(i, 2)) };
-        p = vec3(World * vec4(p, 1.0f));
-        mvVertices[i] = p;
-    }
+    HullImmersion::TransformVertices(mV, World, mvVertices);
 }
 vec3 Ship::TransformPosition(vec3 v)
 {
@@ -1338,38 +1467,16 @@ void Ship::SetYawFromHDG(float hdg)
 }
 void Ship::GetHeightOfAllVertices()
 {
-    int nSearch = 0;
-    vec3 pWater;
-
-    for (unsigned int i = 0; i < mvVertices.size(); i++)
-    {
-        pWater = mvVertices[i];
-        nSearch += GetHeightFast(pWater);
-        mvVertSubmerged[i] = (mvVertices[i].y < pWater.y) ? 1 : 0;  // 0 = under water, 1 = above
-        mvVertWaterHeight[i] = mvVertices[i].y - pWater.y;
-    }
-    if (mvVertices.size())
-        WaterSearch = int(nSearch / mvVertices.size());
+    WaterSearch = HullImmersion::GetHeightOfAllVertices(mWaveField, mvVertices, mvVertSubmerged, mvVertWaterHeight);
+    PROFILE_COUNT("Ocean search", WaterSearch);
 }
 void Ship::GetTrisUnderWater()
 {
-    int vertex = 0;
-    for (auto& tri : mvTris)
-    {
-        tri.WaterStatus = 0;
-        for (unsigned int i = 0; i < 3; i++)
-        {
-            tri.bUnder[i] = mvVertSubmerged[tri.I[i]];
-            tri.WaterStatus += tri.bUnder[i];
-        }
-        switch (tri.WaterStatus)
-        {
-        case 0: tri.Color = vec3(0.5f, 0.5f, 0.5f); break;   // Above water 0/3
-        case 1: tri.Color = vec3(0.6f, 0.6f, 1.0f); break;   // Under water 1/3
-        case 2: tri.Color = vec3(0.3f, 0.3f, 1.0f); break;   // Under water 2/3
-        case 3: tri.Color = vec3(0.0f, 0.0f, 1.0f); break;   // Under water 3/3
-        }
-    }
+    HullImmersion::GetTrisUnderWater(mvTris, mvVertSubmerged);
+
+    // The colors are only displayed with the triangles
+    if (Rendering != eRendering::TRIANGLES)
+        return;
 
     // Update the vertex array object
     int index = 0;
@@ -1394,72 +1501,74 @@ constexpr int IMAGE_WIDTH = 512;
 constexpr int IMAGE_WIDTH_2SIDES = 2 * IMAGE_WIDTH;
 constexpr float MAX_Y_TILDE = 10.0f;
 constexpr float PI = 3.14159265358979323846f;
-float pressure_field(float theta, float FR)
+double pressure_field(double theta, double FR)
 {
     // Adaptation de pressure_field
 
-    float K0_inv = (FR * std::cos(theta)) * (FR * std::cos(theta));
-    float denom = 2.0f * M_PI * K0_inv;
-    float exponent = -1.0f / (denom * denom);
+    double K0_inv = (FR * std::cos(theta)) * (FR * std::cos(theta));
+    double denom = 2.0 * M_PI * K0_inv;
+    double exponent = -1.0 / (denom * denom);
     return std::exp(exponent);
 }
-float fonction_a_integrer(float theta, float x_tilde, float y_tilde, float froude_nbr)
-{
-    // Fonction sous intégrale (fonction_a_integrer)
-
-    float sin_num = 2.0f * M_PI * (std::cos(theta) * x_tilde - std::sin(theta) * y_tilde);
-    float sin_den = std::pow(std::cos(theta), 2);
-    float numerator = std::sin(sin_num / sin_den);
-    float denominator = std::pow(std::cos(theta), 4);
-
-    return pressure_field(theta, froude_nbr) * numerator / denominator;
-}
-float integrate(std::function<float(float)> f, float a, float b, int n = 1000)
-{
-    // Intégration numérique simple par méthode des trapèzes
-
-    float h = (b - a) / n;
-    float sum = 0.5f * (f(a) + f(b));
-    for (int i = 1; i < n; ++i)
-    {
-        float x = a + i * h;
-        sum += f(x);
-    }
-    return sum * h;
-}
-float surface_displacement(float x_tilde, float y_tilde, float froude_nbr)
-{
-    // surface_displacement
-
-    // Rotation 90 degrés
-    std::swap(x_tilde, y_tilde);
-
-    auto integrand = [&](float theta) {
-        return fonction_a_integrer(theta, x_tilde, y_tilde, froude_nbr);
-        };
-
-    float val = integrate(integrand, -M_PI_2, M_PI_2, 1000);
-    return -val;
-}
 void wake_simulation(float froude_nbr, vector<float>& buffer)
 {
     // Calcul de la simulation entière dans un buffer 2D
 
-    // Vous pouvez éventuellement gérer les masques, offsets, symétries ici
     buffer.resize(IMAGE_HEIGHT * IMAGE_WIDTH);
 
     float subpixel_nbr = IMAGE_HEIGHT / MAX_Y_TILDE;
     int y_offset = -44;// static_cast<int>(IMAGE_HEIGHT * 0.05f); // ex: offset vertical
 
-    for (int y_img = 0; y_img < IMAGE_HEIGHT; ++y_img)
-    {
-        for (int x_img = 0; x_img < IMAGE_WIDTH; ++x_img)
+    // Trapezoids over theta in [-pi/2, pi/2] (1000 steps), the terms depending on theta only are computed once per Froude number
+    // The terms where the pressure field underflows are dropped (ends of the interval, small Froude numbers)
+    // Pixel (x_img, y_img) rotated by 90°: phase = 2pi (cos x - sin y) / cos² with x from y_img and y from x_img
+    const int n = 1000;
+    const double h = M_PI / n;
+    vector<double> amp, wRow, wCol, sinCol, cosCol;
+    for (int i = 0; i <= n; i++)
+    {
+        double theta = -M_PI_2 + i * h;
+        double c = std::cos(theta);
+        double p = pressure_field(theta, froude_nbr);
+        if (p == 0.0)
+            continue;
+        amp.push_back((i == 0 || i == n ? 0.5 : 1.0) * h * p / (c * c * c * c));
+        wRow.push_back(2.0 * M_PI / c / subpixel_nbr);
+        wCol.push_back(2.0 * M_PI * std::sin(theta) / (c * c) / subpixel_nbr);
+        sinCol.push_back(std::sin(wCol.back()));
+        cosCol.push_back(std::cos(wCol.back()));
+    }
+    const int terms = (int)amp.size();
+
+    // Rows in parallel; along a row the phases decrease by wCol per pixel, sin/cos are rotated instead of evaluated
+    g_AssetLoader.ParallelFor(IMAGE_HEIGHT, [&](int y_img)
         {
-            float x_tilde = x_img / subpixel_nbr;
-            float y_tilde = (y_img - y_offset) / subpixel_nbr;
-            buffer[y_img * IMAGE_WIDTH + x_img] = surface_displacement(x_tilde, y_tilde, froude_nbr);
-        }
-    }
+            vector<double> s(terms), c(terms);
+            double rowPhase = y_img - y_offset;
+            for (int x_img = 0; x_img < IMAGE_WIDTH; ++x_img)
+            {
+                // Exact phases every 64 pixels to bound the drift of the rotations
+                if (x_img % 64 == 0)
+                {
+                    for (int i = 0; i < terms; i++)
+                    {
+                        double phase = rowPhase * wRow[i] - x_img * wCol[i];
+                        s[i] = std::sin(phase);
+                        c[i] = std::cos(phase);
+                    }
+                }
+
+                double sum = 0.0;
+                for (int i = 0; i < terms; i++)
+                {
+                    sum += amp[i] * s[i];
+                    double sn = s[i] * cosCol[i] - c[i] * sinCol[i];
+                    c[i] = c[i] * cosCol[i] + s[i] * sinCol[i];
+                    s[i] = sn;
+                }
+                buffer[y_img * IMAGE_WIDTH + x_img] = (float)-sum;
+            }
+        });
 }
 void normalizeBuffer(vector<float>& buffer) 
 {
@@ -1514,15 +1623,9 @@ void normalizeBuffer(vector<float>& buffer)
 }
 void Ship::CreateKelvinImages()
 {
-    GLuint kelvinTex3;
-    glGenTextures(1, &kelvinTex3);
-    glBindTexture(GL_TEXTURE_2D, kelvinTex3);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, IMAGE_WIDTH_2SIDES, IMAGE_HEIGHT, 0, GL_RED, GL_FLOAT, nullptr);
-    
+    // Generator of Resources/Kelvin (written in Outputs), the PNG are written directly without going through a texture
+    auto start = chrono::steady_clock::now();
+
     for (int fr = 1; fr < 101; fr++)
     {
         vector<float> buffer;
@@ -1530,45 +1633,34 @@ void Ship::CreateKelvinImages()
         wake_simulation(froude, buffer);
         normalizeBuffer(buffer);
 
-        // Préparation d'un buffer complet avec les deux côtés
-        vector<float> buffer_two_sides(IMAGE_HEIGHT * IMAGE_WIDTH_2SIDES);
+        // Both sides: mirror of the original on the left, original on the right
+        // The first row of the PNG is the last row of the buffer (same orientation as the former read back of the texture)
+        vector<unsigned char> image(IMAGE_HEIGHT * IMAGE_WIDTH_2SIDES);
         for (int y = 0; y < IMAGE_HEIGHT; ++y)
         {
-            for (int x = 0; x < IMAGE_WIDTH_2SIDES; ++x)
+            const float* row = &buffer[(IMAGE_HEIGHT - 1 - y) * IMAGE_WIDTH];
+            unsigned char* out = &image[y * IMAGE_WIDTH_2SIDES];
+            for (int x = 0; x < IMAGE_WIDTH; ++x)
             {
-                if (x < IMAGE_WIDTH)
-                {
-                    // Partie miroir à gauche : miroir horizontal de la bordure gauche de l'image originelle
-                    int mirror_x = IMAGE_WIDTH - 1 - x;
-                    buffer_two_sides[y * IMAGE_WIDTH_2SIDES + x] = buffer[y * IMAGE_WIDTH + mirror_x];
-                }
-                else
-                {
-                    // Partie originale à droite, placée à partir de IMAGE_WIDTH
-                    int original_x = x - IMAGE_WIDTH;
-                    buffer_two_sides[y * IMAGE_WIDTH_2SIDES + x] = buffer[y * IMAGE_WIDTH + original_x];
-                }
+                unsigned char v = (unsigned char)std::min(std::max(row[x] * 255.0f, 0.0f), 255.0f);
+                out[IMAGE_WIDTH - 1 - x] = v;
+                out[IMAGE_WIDTH + x] = v;
             }
         }
 
-        string name;
-        if (fr == 100)
-            name = "Outputs/Kelvin-1024_Fr-100.png";
-        else if (fr < 10)
-            name = "Outputs/Kelvin-1024_Fr-00" + to_string(fr) + ".png";
-        else
-            name = "Outputs/Kelvin-1024_Fr-0" + to_string(fr) + ".png";
-
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, IMAGE_WIDTH_2SIDES, IMAGE_HEIGHT, 0, GL_RED, GL_FLOAT, buffer_two_sides.data());
-        SaveTexture2D(kelvinTex3, IMAGE_WIDTH_2SIDES, IMAGE_HEIGHT, 1, GL_RED, name);
+        char name[64];
+        sprintf_s(name, "Outputs/Kelvin-1024_Fr-%03d.png", fr);
+        stbi_write_png(name, IMAGE_WIDTH_2SIDES, IMAGE_HEIGHT, 1, image.data(), IMAGE_WIDTH_2SIDES);
     }
+
+    float seconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+    cout << "Kelvin: 100 layers generated in " << seconds << " s" << endl;
 }
 
 // Update
 void Ship::Update(float time)
 {
-    if (g_bPause)
+    if (g_SimClock.IsPaused())
         return;
 
     if (!bVisible)
@@ -1579,41 +1671,117 @@ void Ship::Update(float time)
     mDt = dt;
     static float prevYaw = 0.0f;
 
+    PROFILE_CPU("Ship update");
+
     UpdateWorldMatrix();
 
+    // The CPU path is still needed for the colored triangles, the pressure lines and the first frames of the GPU path
+    if (!bHydrostaticsGPU)
+        mbHydroValid = false;
+    bool bCPU = !mbHydroValid || bHydrostaticsCheck || bPressure || Rendering == eRendering::TRIANGLES;
+
     // Preparation
-    TransformVertices();
-    // Computation
-    GetHeightOfAllVertices();
-    GetTrisUnderWater();
+    {
+        PROFILE_CPU("Transform");
+        TransformVertices();
+    }
+    // Computation (the waterline needs the status of the vertices, read back with the GPU hydrostatics when they run)
+    mbImmersionGPU = bWaterline && !bCPU && bHydrostaticsGPU;
+    if (bCPU || (bWaterline && !mbImmersionGPU))
+    {
+        PROFILE_CPU("Immersion");
+        GetHeightOfAllVertices();
+        GetTrisUnderWater();
+    }
+    else if (mbImmersionGPU)
+    {
+        PROFILE_CPU("Immersion GPU");
+        HullImmersion::GetTrisUnderWater(mvTris, mvVertSubmerged);
+    }
+    if (bWaterline)
+    {
+        PROFILE_CPU("Waterline");
+        UpdateWaterline(dt);
+    }
     // Forces
-    ComputeArchimede();
-    ComputeGravity();
-    ComputeHeave(dt);
-    ComputeThrust(dt);
-    ComputeResistanceViscous(dt);
-    ComputeResistanceWaves(dt);
-    ComputeResistanceResidual(dt);
-    ComputeBowThrust(dt);
-    ComputeRudder(dt);
-    ComputeWind(dt);
-    ComputeCentrifugal(dt);
-    // Result
-    ComputeForces(dt);
+    if (bCPU)
+    {
+        PROFILE_CPU("Archimede");
+        ComputeArchimede();
+    }
+    if (bHydrostaticsGPU)
+    {
+        PROFILE_GPU("Hydrostatics");
+        UpdateHydrostatics();
+    }
+    {
+        PROFILE_CPU("Forces");
+        {
+            PROFILE_CPU("Gravity");
+            ComputeGravity();
+        }
+        {
+            PROFILE_CPU("Heave");
+            ComputeHeave(dt);
+        }
+        {
+            PROFILE_CPU("Thrust");
+            ComputeThrust(dt);
+        }
+        {
+            PROFILE_CPU("ResistanceViscous");
+            ComputeResistanceViscous(dt);
+        }
+        {
+            PROFILE_CPU("ResistanceWaves");
+            ComputeResistanceWaves(dt);
+        }
+        {
+            PROFILE_CPU("ResistanceResidual");
+            ComputeResistanceResidual(dt);
+        }
+        {
+            PROFILE_CPU("BowThrust");
+            ComputeBowThrust(dt);
+        }
+        {
+            PROFILE_CPU("Rudder");
+            ComputeRudder(dt);
+        }
+        {
+            PROFILE_CPU("Wind");
+            ComputeWind(dt);
+        }
+        {
+            PROFILE_CPU("Centrifugal");
+            ComputeCentrifugal(dt);
+        }
+        // Result
+        {
+            PROFILE_CPU("Result");
+            ComputeForces(dt);
+        }
+    }
    
-    UpdateSounds();
-    UpdateSmoke(dt);
-    UpdateSpray(dt);
-    UpdateAutopilot(dt);
+    {
+        PROFILE_CPU("Effects");
+        UpdateSounds();
+        UpdateSmoke(dt);
+        UpdateSpray(dt);
+        UpdateAutopilot(dt);
 
-    if (bPressure)
-        UpdateVaoPressureLines();
+        if (bPressure)
+            UpdateVaoPressureLines();
+    }
 
-    UpdateWakeVao();
-    if(bTexWakeByVAO)
-        UpdateTextureWakeVao();
-    else
-        UpdateWakeBuffer();
+    {
+        PROFILE_GPU("Wake");
+        UpdateWakeVao();
+        if(bTexWakeByVAO)
+            UpdateTextureWakeVao();
+        else
+            UpdateWakeBuffer();
+    }
 
 #ifdef TRACE
     UpdateTrace();
@@ -1627,73 +1795,117 @@ void Ship::Update(float time)
 }
 void Ship::ComputeArchimede()
 {
-    // Force calculated as the sum of the hydrostatic pressures acting on the submerged(or partially submerged) triangles of the hull
-    
-    AreaWetted = 0.0f;
-    Archimede.Magnitude = 0.0f;
-    Archimede.Vector = vec3(0.0f);
-    Archimede.Position = vec3(0.0f);
-    float tmpSumPressure = 0.0f;
-    float intensity = 0.0f;
+    HullImmersion::ComputeArchimede(mvTris, mvVertices, mvVertWaterHeight, mWATER_DENSITY, mGRAVITY, Archimede, AreaWetted, LWL);
+}
+void Ship::UpdateHydrostatics()
+{
+    // Same model as ComputeArchimede but the displacement map is sampled by hydrostatics.comp,
+    // only the reduced sums are read back, one or two frames later
+    ReadHydrostatics();
 
-    vec3 Min = vec3(FLT_MAX);
-    vec3 Max = -vec3(FLT_MAX);
+    int slot = mHydroWrite % HYDRO_FRAMES;
+    int nVertices = (int)mV.rows();
 
-    for (auto& tri : mvTris)
+    mShaderHydrostatics->use();
+    mShaderHydrostatics->setMat4("World", World);
+    mShaderHydrostatics->setInt("numVertices", nVertices);
+    mShaderHydrostatics->setInt("numTriangles", (int)mvTris.size());
+    mShaderHydrostatics->setInt("numPartials", mHydroGroups);
+    mShaderHydrostatics->setFloat("rhoG", mWATER_DENSITY * mGRAVITY);
+
+    glBindImageTexture(0, mOcean->GetDisplacementID(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mSSBO_HULL_VERTICES);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mSSBO_HULL_TRIANGLES);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mSSBO_WATER_VERTICES);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mSSBO_HYDRO_PARTIALS);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mSSBO_HYDRO_RESULT[slot]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, mSSBO_HYDRO_HEIGHTS[slot]);
+
+    // Vertices : world position and height above the water
+    mShaderHydrostatics->setInt("pass", 0);
+    glDispatchCompute((nVertices + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Triangles : pressure and partial sums per workgroup
+    mShaderHydrostatics->setInt("pass", 1);
+    glDispatchCompute(mHydroGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Final sum
+    mShaderHydrostatics->setInt("pass", 2);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+
+    mHydroFence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mHydroCpu[slot] = Archimede;
+    mHydroCpuArea[slot] = AreaWetted;
+    mHydroWrite++;
+
+    for (int i = 0; i <= 5; i++)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+
+    if (mbHydroValid && !bHydrostaticsCheck)
+        ApplyHydrostatics(mHydroLast);
+}
+void Ship::ReadHydrostatics()
+{
+    // Consume the finished results in order, wait only if all the slots are in flight
+    bool bNew = false;
+    while (mHydroRead != mHydroWrite)
     {
-        if (tri.WaterStatus != 0) // at least, 1 pt under water
+        int slot = mHydroRead % HYDRO_FRAMES;
+        bool bFull = (mHydroWrite - mHydroRead) >= HYDRO_FRAMES;
+        GLenum status = bFull ? glClientWaitSync(mHydroFence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) : glClientWaitSync(mHydroFence[slot], 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED && !bFull)
+            break;
+
+        glDeleteSync(mHydroFence[slot]);
+        mHydroFence[slot] = 0;
+        mHydroLast = *mpHydroResult[slot];
+        mHydroRead++;
+        bNew = true;
+
+        // Status of the vertices for the waterline, as GetHeightOfAllVertices (1 = under water)
+        if (mbImmersionGPU)
         {
-            vec3 u = mvVertices[tri.I[1]] - mvVertices[tri.I[0]];
-            vec3 v = mvVertices[tri.I[2]] - mvVertices[tri.I[0]];
-            vec3 a = glm::cross(v, u);
-            tri.Normal = glm::normalize(a);
-            tri.CoG = (mvVertices[tri.I[0]] + mvVertices[tri.I[1]] + mvVertices[tri.I[2]]) / 3.0f;
-            
-            if (tri.CoG.x < Min.x) Min.x = tri.CoG.x;
-            if (tri.CoG.z < Min.z) Min.z = tri.CoG.z;
-            if (tri.CoG.x > Max.x) Max.x = tri.CoG.x;
-            if (tri.CoG.z > Max.z) Max.z = tri.CoG.z;
-            
-            switch (tri.WaterStatus)
+            const float* heights = mpHydroHeights[slot];
+            for (size_t i = 0; i < mvVertWaterHeight.size(); i++)
             {
-            case 3:
-                tri.Depth = -(mvVertWaterHeight[tri.I[0]] + mvVertWaterHeight[tri.I[1]] + mvVertWaterHeight[tri.I[2]]) / 3.0f;
-                break;
-            case 2:
-                if (tri.bUnder[0] == 0)
-                    tri.Depth = -(mvVertWaterHeight[tri.I[1]] + mvVertWaterHeight[tri.I[2]]) / 2.0f;
-                else if (tri.bUnder[1] == 0)
-                    tri.Depth = -(mvVertWaterHeight[tri.I[0]] + mvVertWaterHeight[tri.I[2]]) / 2.0f;
-                else
-                    tri.Depth = -(mvVertWaterHeight[tri.I[0]] + mvVertWaterHeight[tri.I[1]]) / 2.0f;
-                break;
-            case 1:
-                if (tri.bUnder[0] == 1)
-                    tri.Depth = -mvVertWaterHeight[tri.I[0]];
-                else if (tri.bUnder[1] == 1)
-                    tri.Depth = -mvVertWaterHeight[tri.I[1]];
-                else
-                    tri.Depth = -mvVertWaterHeight[tri.I[2]];
-                break;
+                mvVertWaterHeight[i] = heights[i];
+                mvVertSubmerged[i] = (heights[i] < 0.0f) ? 1 : 0;
             }
-            intensity = (float)tri.WaterStatus / 3.0f;
-            tri.fPressure = intensity * mWATER_DENSITY * mGRAVITY * tri.Depth * tri.Area;
-            tri.vPressure = tri.Normal * tri.fPressure;
-
-            Archimede.Vector += tri.vPressure;
-            Archimede.Position += tri.CoG * tri.fPressure;  // Approximation because the 3 points do not have the same hydrostatic pressure (they are not at the same height)
-            tmpSumPressure += tri.fPressure;
+        }
 
-            AreaWetted += intensity * tri.Area;
+        if (bHydrostaticsCheck)
+        {
+            // Compare with the CPU result of the same frame
+            sForce cpu = Archimede;
+            float cpuArea = AreaWetted;
+            float cpuLWL = LWL;
+            ApplyHydrostatics(mHydroLast);
+            float dForce = fabs(Archimede.Magnitude - mHydroCpu[slot].Magnitude) / std::max(mHydroCpu[slot].Magnitude, 1.0f);
+            float dPosition = glm::length(Archimede.Position - mHydroCpu[slot].Position);
+            float dArea = fabs(AreaWetted - mHydroCpuArea[slot]) / std::max(mHydroCpuArea[slot], 1.0f);
+            if (dForce > 0.05f || dPosition > 0.5f || dArea > 0.05f)
+                cout << "Hydrostatics GPU/CPU : force " << 100.0f * dForce << " %, position " << dPosition << " m, area " << 100.0f * dArea << " %" << endl;
+            Archimede = cpu;
+            AreaWetted = cpuArea;
+            LWL = cpuLWL;
         }
     }
-    
-    Archimede.Magnitude = std::max(Archimede.Vector.y, 0.0f);
+    if (bNew)
+        mbHydroValid = true;
+}
+void Ship::ApplyHydrostatics(const sHydroSum& sum)
+{
+    Archimede.Magnitude = std::max(sum.force.y, 0.0f);
     Archimede.Vector = { 0.0f, Archimede.Magnitude, 0.0f };     // Always vertical
-    if (tmpSumPressure > 0) Archimede.Position /= tmpSumPressure;
-    else                    Archimede.Position = vec3(0.0f);
-    
-    LWL = std::max(fabs(Max.x - Min.x), fabs(Max.z - Min.z));
+    if (sum.force.w > 0) Archimede.Position = vec3(sum.moment) / sum.force.w;
+    else                 Archimede.Position = vec3(0.0f);
+    AreaWetted = sum.moment.w;
+
+    if (sum.extent.x <= sum.extent.z)
+        LWL = std::max(sum.extent.z - sum.extent.x, sum.extent.w - sum.extent.y);
 }
 void Ship::ComputeGravity()
 {
@@ -2223,17 +2435,32 @@ void Ship::UpdateVaoPressureLines()
         }
     }
     mLinesCount = linePoints.size();
-
-    GLuint VBO;
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, linePoints.size() * sizeof(vec3), linePoints.data(), GL_STATIC_DRAW);
-
-    glGenVertexArrays(1, &mVaoLines);
+    mvLinePoints = std::move(linePoints);
+    mLinesFrame = 0;
+}
+void Ship::BindVaoPressureLines()
+{
+    // Upload once per frame, also when the simulation is paused (the previous allocation may have been recycled)
     glBindVertexArray(mVaoLines);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+    if (mLinesFrame == g_TransientBuffer.GetFrame() || mvLinePoints.empty())
+        return;
 
-    glEnableVertexAttribArray(0);
+    sTransientAlloc alloc = g_TransientBuffer.Upload(mvLinePoints.data(), mvLinePoints.size() * sizeof(vec3));
+    glBindBuffer(GL_ARRAY_BUFFER, alloc.buffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)alloc.offset);
+    mLinesFrame = g_TransientBuffer.GetFrame();
+}
+void Ship::BindVaoWake()
+{
+    glBindVertexArray(mVaoWake);
+    if (mWakeFrame == g_TransientBuffer.GetFrame() || vWakeVertices.empty())
+        return;
+
+    sTransientAlloc alloc = g_TransientBuffer.Upload(vWakeVertices.data(), vWakeVertices.size() * sizeof(sFoamVertex));
+    glBindBuffer(GL_ARRAY_BUFFER, alloc.buffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(sFoamVertex), (void*)(alloc.offset + offsetof(sFoamVertex, pos)));
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(sFoamVertex), (void*)(alloc.offset + offsetof(sFoamVertex, alpha)));
+    mWakeFrame = g_TransientBuffer.GetFrame();
 }
 void Ship::UpdateSounds()
 {   
@@ -2292,17 +2519,11 @@ void Ship::UpdateSmoke(float dt)
     if (ship.nChimney == 0)
         return;
 
-#ifdef DEBUG_SMOKE
-    // Reset the counter
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO_LIVE_COUNTER);
-    int zero = 0;
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(int), &zero);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-    // Bind buffer to binding point 1 before dispatch
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, SSBO_LIVE_COUNTER);
-#endif
-
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mSSBO_SMOKE);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mSSBO_SMOKE_DEAD);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mSSBO_SMOKE_ALIVE[mSmokeAliveIdx]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mSSBO_SMOKE_ALIVE[1 - mSmokeAliveIdx]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mSSBO_SMOKE_COUNTERS);
 
     vec3 windDirection = 0.25f * vec3(-g_Wind.x, 0.1f * g_WindSpeedKN, -g_Wind.y);
 
@@ -2321,21 +2542,35 @@ void Ship::UpdateSmoke(float dt)
     mShaderSmokeCompute->setInt("frameCount", mFrameSmokeCount);
     mShaderSmokeCompute->setFloat("shortLife", 5.0f);
     mShaderSmokeCompute->setFloat("longLife", 10.0f);
-    // Dispatch compute shader (dividing mSmokeMaxParticles by local_size_x)
-    glDispatchCompute((mSmokeMaxParticles + 255) / 256, 1, 1);
 
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT); // guarantee write before read
+    // Counters and sizes of the 2 next dispatches, nothing is read back
+    mShaderSmokeCompute->setInt("pass", 0);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, mSSBO_SMOKE_COUNTERS);
+
+    // Emission
+    mShaderSmokeCompute->setInt("pass", 1);
+    glDispatchComputeIndirect(4 * sizeof(uint));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Living particles of the previous frame
+    mShaderSmokeCompute->setInt("pass", 2);
+    glDispatchComputeIndirect(8 * sizeof(uint));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT); // guarantee write before draw
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+    mSmokeAliveIdx = 1 - mSmokeAliveIdx;
 
 #ifdef DEBUG_SMOKE
     // Reading after dispatch
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO_LIVE_COUNTER);
-    int* counterValue = (int*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sizeof(int), GL_MAP_READ_BIT);
-    if (counterValue) {
-        int liveParticlesCount = *counterValue;
-        cout << "Number of living particles: " << liveParticlesCount << std::endl;
-        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-    }
+    uint liveParticlesCount = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO_SMOKE_COUNTERS);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(uint), sizeof(uint), &liveParticlesCount);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    cout << "Number of living particles: " << liveParticlesCount << " / " << mSmokeMaxParticles << std::endl;
 #endif
 
     mFrameSmokeCount++;
@@ -2348,87 +2583,16 @@ void Ship::UpdateSpray(float dt)
     if (!bSpray)
         return;
 
-    // Emits particules of spray from points distributed on the contour
-    
-    size_t leftCount = mLeft.size();
-    size_t rightCount = mRight.size();
-
-    if (leftCount < 2 || rightCount < 2)
-        return;
-
-    float intensity1, intensity2;
-
-    // Lambda function to emit multiple interpolated particles between two points
-    auto EmitInterpolatedSpray = [&](const sSprayPt& pt1, const sSprayPt& pt2, float intensity1, float intensity2)
-        {
-            for (int j = 0; j <= ship.SprayMultiplier; ++j)
-            {
-                float t = float(j) / float(ship.SprayMultiplier);
-                // Local position interpolation
-                vec3 interpPos = pt1.p * (1.0f - t) + pt2.p * t;
-
-                vec3 emitPosWorld = TransformPosition(interpPos);
-                GetHeightFast(emitPosWorld);
-                
-                // Added random offset to start position only
-                vec3 randomOffset(
-                    ((float)rand() / RAND_MAX - 0.5f) * 2.0f * mRandomOffsetRange,
-                    ((float)rand() / RAND_MAX - 0.5f) * 2.0f * mRandomOffsetRange,
-                    ((float)rand() / RAND_MAX - 0.5f) * 2.0f * mRandomOffsetRange
-                );
-                emitPosWorld += randomOffset;
-
-                // Vertical interpolation factor
-                float intensity = intensity1 * (1.0f - t) + intensity2 * t;
-
-                // Normal interpolation and velocity calculation
-                vec3 interpNormal = pt1.n * (1.0f - t) + pt2.n * t;
-
-                vec3 velocity = TransformVector(interpNormal) * intensity;
-                velocity.y += intensity + 2.0f * ship.SprayVerticalPerf * PitchVelocity;
-                velocity.x += 2.0f * vCOG.x;
-                velocity.z += 2.0f * vCOG.y;
-                velocity *= Velocity * 0.5f;
-                if (intensity > 0.0f)
-                    mSpray->Emit(emitPosWorld, velocity);
-            }
-        };
-
-    // Emission on the left with interpolation between points
-    for (size_t i = 0; i < leftCount - 1; ++i)
-    {
-        intensity1 = 1.0f - float(i) / float(leftCount - 1);
-        intensity2 = 1.0f - float(i + 1) / float(leftCount - 1);
-        
-        if (ship.SprayType == 1)
-        {
-            // Using a sine in [0, pi/2] to vary from 1.0 to 0
-            intensity1 = sinf(1.57079632679f * intensity1);
-            intensity2 = sinf(1.57079632679f * intensity2);
-        }
+    // Emission from the points distributed on the contour, motion and death in spray.comp
+    SprayParams params;
+    params.world = World;
+    params.velocityScale = Velocity * 0.5f;
+    params.verticalBias = 2.0f * ship.SprayVerticalPerf * PitchVelocity;
+    params.cogBias = 2.0f * vCOG;
+    params.multiplier = ship.SprayMultiplier;
+    params.offsetRange = mRandomOffsetRange;
 
-        EmitInterpolatedSpray(mLeft[i], mLeft[i + 1], intensity1, intensity2);
-    }
-    mSpray->Update(dt);
-
-    // Emission on the right with interpolation between points
-    for (size_t i = 0; i < rightCount - 1; ++i)
-    {
-        intensity1 = 1.0f - float(i) / float(rightCount - 1);
-        intensity2 = 1.0f - float(i + 1) / float(rightCount - 1);
-        
-        if (ship.SprayType == 1)
-        {
-            // Using a sine in [0, pi/2] to vary from 1.0 to 0
-            intensity1 = sinf(1.57079632679f * intensity1);
-            intensity2 = sinf(1.57079632679f * intensity2);
-        }
-        
-        EmitInterpolatedSpray(mRight[i], mRight[i + 1], intensity1, intensity2);
-    }
-    mSpray->Update(dt);
-
-    //cout << mSpray->GetNbActiveParticles() << endl;
+    mSpray->Update(dt, params, mOcean->GetDisplacementID());
 }
 void Ship::UpdateWakeBuffer()
 {
@@ -2513,7 +2677,7 @@ void Ship::UpdateWakeVao()
         sFoamPts sfp;
         sfp.pos = TransformPosition(mWakePivot);
         sfp.pos.y = 1.0f;
-        sfp.time = glfwGetTime();
+        sfp.time = (float)g_SimClock.GetTime();
         vWakePoints.push_back(sfp);
         // Cleaning to not exceed a limit
         if (vWakePoints.size() > 100) vWakePoints.erase(vWakePoints.begin());
@@ -2524,7 +2688,7 @@ void Ship::UpdateWakeVao()
     sFoamPts sfp;
     sfp.pos = TransformPosition(mWakePivot);
     sfp.pos.y = 1.0f;
-    sfp.time = glfwGetTime();
+    sfp.time = (float)g_SimClock.GetTime();
     vWakePoints.push_back(sfp);
 
     size_t n = vWakePoints.size();
@@ -2588,7 +2752,7 @@ void Ship::UpdateWakeVao()
     vWakeVertices.clear();
     float uv_v = 0.0f, dv = 1.0f / n;
 
-    float now = glfwGetTime();
+    float now = (float)g_SimClock.GetTime();
     
     /*
     // 1 trail
@@ -2645,9 +2809,8 @@ void Ship::UpdateWakeVao()
     // Remove the temporary stitch after use
     vWakePoints.pop_back();
 
-    // Update the vbo
-    glBindBuffer(GL_ARRAY_BUFFER, mVboWake);
-    glBufferData(GL_ARRAY_BUFFER, vWakeVertices.size() * sizeof(sFoamVertex), vWakeVertices.data(), GL_DYNAMIC_DRAW);
+    // The vertices have changed, they will be uploaded again by BindVaoWake
+    mWakeFrame = 0;
 }
 void Ship::UpdateTextureWakeVao()
 {
@@ -2671,7 +2834,7 @@ void Ship::UpdateTextureWakeVao()
     mShaderWakeVaoToTex->setFloat("originX", ship.Position.x);
     mShaderWakeVaoToTex->setFloat("originZ", ship.Position.z);
 
-    glBindVertexArray(mVaoWake);
+    BindVaoWake();
     glDrawArrays(GL_TRIANGLES, 0, vWakeVertices.size());
 
     // Blit to normal sample
@@ -2780,7 +2943,7 @@ void Ship::RenderWakeVao(Camera& camera)
     mShaderWakeVao->setMat4("view", camera.GetView());
     mShaderWakeVao->setMat4("projection", camera.GetProjection());
 
-    glBindVertexArray(mVaoWake);
+    BindVaoWake();
     glDrawArrays(GL_TRIANGLES, 0, vWakeVertices.size());
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -2828,12 +2991,6 @@ void Ship::RenderPropellers(Camera& camera,Sky* sky)
 {
     // Light from sun
     mShaderShip->use();     // Shaders/ship.vert, Shaders/ship.frag
-    mShaderShip->setVec3("light.position", sky->SunPosition);
-    mShaderShip->setVec3("light.ambient", sky->SunAmbient);
-    mShaderShip->setVec3("light.diffuse", sky->SunDiffuse);
-    mShaderShip->setVec3("light.specular", sky->SunSpecular);
-    mShaderShip->setVec3("viewPos", camera.GetPosition());
-    mShaderShip->setFloat("exposure", sky->Exposure);
     // Matricies
     float omega = PowerRpm * (2.0f * M_PI) / 60.0f; // radians par seconde
     static float rotation = 0.0f;
@@ -2872,12 +3029,6 @@ void Ship::RenderRudders(Camera& camera, Sky* sky)
 {
     // Light from sun
     mShaderShip->use();     // Shaders/ship.vert, Shaders/ship.frag
-    mShaderShip->setVec3("light.position", sky->SunPosition);
-    mShaderShip->setVec3("light.ambient", sky->SunAmbient);
-    mShaderShip->setVec3("light.diffuse", sky->SunDiffuse);
-    mShaderShip->setVec3("light.specular", sky->SunSpecular);
-    mShaderShip->setVec3("viewPos", camera.GetPosition());
-    mShaderShip->setFloat("exposure", sky->Exposure);
     // Matricies
     float rotation = -RudderAngleDeg * M_PI / 180.0f;
     mat4 matRudder1 = mat4(1.0f);
@@ -2924,12 +3075,6 @@ void Ship::RenderRadars(Camera& camera, Sky* sky, bool bReflexion)
 
     // Light from sun
     mShaderShip->use();     // Shaders/ship.vert, Shaders/ship.frag
-    mShaderShip->setVec3("light.position", sky->SunPosition);
-    mShaderShip->setVec3("light.ambient", sky->SunAmbient);
-    mShaderShip->setVec3("light.diffuse", sky->SunDiffuse);
-    mShaderShip->setVec3("light.specular", sky->SunSpecular);
-    mShaderShip->setVec3("viewPos", camera.GetPosition());
-    mShaderShip->setFloat("exposure", sky->Exposure);
     // Matricies
     static float rot1 = 0.0f;
     rot1 -= ship.RotationRadar1 * 6.0f * mDt;
@@ -2977,8 +3122,13 @@ void Ship::RenderSmoke(Camera& camera, Sky* sky)
     mShaderSmokeRender->setFloat("lifeSpan", 5.0f);
     mShaderSmokeRender->setFloat("exposure", sky->Exposure);
 
+    // Only the living particles, their number is in the counters written by the compute shader
     glBindVertexArray(mVaoSmoke);
-    glDrawArraysInstanced(GL_POINTS, 0, 1, mSmokeMaxParticles);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mSSBO_SMOKE);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mSSBO_SMOKE_ALIVE[mSmokeAliveIdx]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mSSBO_SMOKE_COUNTERS);
+    glDrawArraysIndirect(GL_POINTS, nullptr);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     glDepthMask(GL_TRUE);
 
     glBindVertexArray(0);
@@ -3040,12 +3190,6 @@ void Ship::RenderReflexion(Camera& camera, Sky* sky)
         {
             // Light from sun
             mShaderShip->use();     // Shaders/ship.vert, Shaders/ship.frag
-            mShaderShip->setVec3("light.position", sky->SunPosition);
-            mShaderShip->setVec3("light.ambient", sky->SunAmbient);
-            mShaderShip->setVec3("light.diffuse", sky->SunDiffuse);
-            mShaderShip->setVec3("light.specular", sky->SunSpecular);
-            mShaderShip->setVec3("viewPos", camera.GetPosition());
-            mShaderShip->setFloat("exposure", sky->Exposure);
             if (camera.GetMode() == eCameraMode::ORBITAL || camera.GetMode() == eCameraMode::FPS)
                 mShaderShip->setFloat("envmapFactor", ship.EnvMapFactor);
             else
@@ -3115,12 +3259,6 @@ void Ship::Render(Camera& camera, Sky* sky)
         {
             // Light from sun
             mShaderShip->use();     // Shaders/ship.vert, Shaders/ship.frag
-            mShaderShip->setVec3("light.position", sky->SunPosition);
-            mShaderShip->setVec3("light.ambient", sky->SunAmbient);
-            mShaderShip->setVec3("light.diffuse", sky->SunDiffuse);
-            mShaderShip->setVec3("light.specular", sky->SunSpecular);
-            mShaderShip->setVec3("viewPos", camera.GetPosition());
-            mShaderShip->setFloat("exposure", sky->Exposure);
             if (camera.GetMode() == eCameraMode::ORBITAL || camera.GetMode() == eCameraMode::FPS)
                 mShaderShip->setFloat("envmapFactor", ship.EnvMapFactor);
             else
@@ -3213,7 +3351,7 @@ void Ship::Render(Camera& camera, Sky* sky)
         mShaderPressure->setMat4("projection", camera.GetProjection());
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        glBindVertexArray(mVaoLines);
+        BindVaoPressureLines();
         glDrawArrays(GL_LINES, 0, mLinesCount);
         glBindVertexArray(0);
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
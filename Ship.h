@@ -44,31 +44,13 @@ using namespace glm;
 #include "Sound.h"
 #include "Timer.h"
 #include "Particles.h"
+#include "HullCache.h"
+#include "HullImmersion.h"
 
-struct sTriangle
-{
-	int			I[3];								// Indices of the face
-	int			bUnder[3];							// Status relative to water height
-	int			WaterStatus;						// 0 = under, 3 = above, 1 or 2 = new triangles
-	vec3		Color	= vec3(0.0f, 0.0f, 0.0f);	// Color of the triangle in debug mode
-	float		Area	= 0.0f;						// Total area
-	vec3		CoG		= vec3(0.0f, 0.0f, 0.0f);	// Centre of gravity
-	vec3		Normal	= vec3(0.0f, 0.0f, 0.0f);	// Normal vector
-
-	float		Depth;								// Profondeur
-	vec3		vPressure;							// Vecteur force de pression
-	float		fPressure;							// Norme de la force de pression
-};
 struct sSegment 
 {
 	vec3 a, b;
 };
-struct sForce
-{
-	float		Magnitude	= 0.0f;
-	vec3		Vector		= vec3(0.0f);
-	vec3		Position	= vec3(0.0f);
-};
 enum eRendering { TRIANGLES = 0, BASIC_LIGHT, SUN };
 
 struct sFoamPts
@@ -83,6 +65,12 @@ struct sFoamVertex
 	float		alpha;
 };
 struct sSprayPt { vec3 p; vec3 n; };
+struct sHydroSum
+{
+	vec4		force;		// xyz = sum of the pressure vectors, w = sum of the pressures
+	vec4		moment;		// xyz = sum of CoG * pressure, w = wetted area
+	vec4		extent;		// min x, min z, max x, max z of the wetted CoGs
+};
 
 #define TRACE
 
@@ -189,6 +177,9 @@ public:
 	bool				bWaves				= true;
 	bool				bWakeVao			= false;
 	bool				bContour			= false;
+	bool				bHydrostaticsGPU	= false;	// Archimede computed by hydrostatics.comp
+	bool				bHydrostaticsCheck	= false;	// Compare the GPU result with the CPU one
+	bool				bWaterline			= true;		// Waterline following the attitude of the ship (foam & spray)
 
 	unique_ptr<BBox>	BBoxShape;
 
@@ -201,8 +192,11 @@ private:
 	void	InitSurfaces();
 	void	InitVolume();
 	void	InitInertia();
-	void	InitWaterVertices();
+	void	InitMassProperties();
+	bool	LoadHullCache(uint64_t hash);
+	void	SaveHullCache(uint64_t hash);
 	void	InitVaoHull();
+	void	InitWaterline();
 	void	InitContours();
 	void	InitShaders();
 	void	InitTextures();
@@ -210,7 +204,9 @@ private:
 	void	InitModels();
 	void	InitSounds(Camera& camera);
 	void	InitSpray(vector<vec3>& contour);
+	void	InitSprayEmitters();
 	void	InitSmoke();
+	void	InitHydrostatics();
 
 
 	// Contour
@@ -218,12 +214,13 @@ private:
 	vector<vec3> ArrangeContour(const vector<vec3>& contourUnordered); 
 	vector<vec3> OffsetContour(const vector<vec3>& contour, float offset);
 	void	CreateTexWake(const vector<vec3>& contour);
+	void	ComputeTexWakeMask(const vector<vec3>& contour);
+	void	UploadTexWake();
 	void	CreateContourVAO1(vector<vec3>& contour);
 	void	CreateContourVAO2(vector<vec3>& contour);
+	void	UpdateWaterline(float dt);
+	vec3	GetWaterlineCrossing(int edge);
 
-	vec3	GetVerticeAtMeshIndex(int x, int z);
-	int		GetHeightFast(vec3& pos);
-	int		GetHeightSlow(vec3& pos);
 	void	UpdateWorldMatrix();
 	void	TransformVertices();
 	void	GetHeightOfAllVertices();
@@ -233,6 +230,11 @@ private:
 	// Wake by vao
 	void	UpdateWakeVao();
 
+	// Hydrostatics on the GPU
+	void	UpdateHydrostatics();
+	void	ReadHydrostatics();
+	void	ApplyHydrostatics(const sHydroSum& sum);
+
 	// SYSTEM OF FORCES
 	void	ComputeArchimede();
 	void    ComputeGravity();
@@ -248,6 +250,8 @@ private:
 	void	ComputeForces(float dt);
 	void	UpdateAutopilot(float dt);
 	void	UpdateVaoPressureLines();
+	void	BindVaoPressureLines();
+	void	BindVaoWake();
 
 	void	UpdateSounds();
 	void	UpdateSmoke(float dt);
@@ -283,6 +287,8 @@ private:
 	// Hydrostatic pressure forces
 	GLuint				mVaoLines	= 0;
 	int					mLinesCount = 0;
+	vector<vec3>		mvLinePoints;
+	unsigned int		mLinesFrame	= 0;		// Frame of the last upload in the transient buffer
 
 	// Forces
 	sForce				Archimede;
@@ -310,11 +316,15 @@ private:
 	unique_ptr<Model>	mRadar2;
 
 	// Smoke
-	const int			mSmokeMaxParticles	= 5000;
+	const int			mSMOKE_PARTICLES	= 5000;		// Pool per chimney
+	int					mSmokeMaxParticles	= 0;
 	GLuint				mSSBO_SMOKE			= 0;
+	GLuint				mSSBO_SMOKE_DEAD	= 0;		// Free particles
+	GLuint				mSSBO_SMOKE_ALIVE[2]= { 0 };	// Living particles (ping-pong between 2 frames)
+	GLuint				mSSBO_SMOKE_COUNTERS= 0;		// Counters + indirect draw & dispatch arguments
+	int					mSmokeAliveIdx		= 0;		// Alive list written by the last update
 	GLuint				mVaoSmoke			= 0;
 	uint				mFrameSmokeCount	= 0;
-	GLuint				SSBO_LIVE_COUNTER	= 0;
 
 	// Shaders
 	unique_ptr<Shader>	mShaderHullColored;
@@ -332,8 +342,7 @@ private:
 	float				mEnvMapfactor = 0.0f;
 
 	Ocean			  * mOcean = nullptr;			// Reference to the ocean object
-	float			  * pDisplacement = nullptr;	// Map of the displacement of the vertices of the ocean mesh
-	vector<vector<vec3>>mvWaterPos;
+	WaveField			mWaveField;					// Map of the displacement of the vertices of the ocean mesh
 
 	// Physical characteristics
 	float				mMass			= 1.0f;			// kg
@@ -354,6 +363,8 @@ private:
 	float				Ixy				= 0.0f;
 	float				Ixz				= 0.0f;
 	float				Iyz				= 0.0f;
+	float				mIntegrals[6]	= { 0.0f };		// Volume integrals of Ixx, Iyy, Izz, Ixy, Ixz, Iyz (geometry only)
+	bool				mbHullCached	= false;		// Hull preprocessing read from the cache
 	vec3				mBow			= vec3(0.0f);	// From centre to bow
 	vec3				mStern			= vec3(0.0f);	// From centre to stern
 	vec3				mWakePivot		= vec3(0.0f);	// Close to the stern;
@@ -387,6 +398,28 @@ private:
 	GLuint				mVboContour2		= 0;
 	int					mIndicesContour2	= 0;
 
+	// Dynamic waterline, walked through the straddling triangles
+	vector<ivec2>		mvEdges;						// Vertices of the edges
+	vector<ivec2>		mvEdgeTris;						// Triangles on both sides of the edges (-1 = none)
+	vector<ivec3>		mvTriEdges;						// Edges of the triangles
+	vector<int>			mvTriVisited;					// Last walk through the triangle
+	int					mWaterlineWalk		= 0;
+	vector<vec3>		mvWaterline;					// Longest loop, local coordinates
+	float				mWaterlineTimer		= 0.0f;		// Refresh of the foam texture and of the spray
+	const float			WATERLINE_REFRESH	= 0.1f;		// s, at most
+	float				mWaterlineRoll		= 0.0f;		// Attitude and draft of the last foam texture and spray (at rest after Init)
+	float				mWaterlinePitch		= 0.0f;
+	float				mWaterlineLevel		= 0.0f;
+	const float			WATERLINE_ANGLE		= 0.02f;	// rad, change of attitude which rebuilds them
+	const float			WATERLINE_DRAFT		= 0.05f;	// m, change of draft which rebuilds them
+	bool				mbImmersionGPU		= false;	// Status of the vertices read back with the hydrostatics
+
+	// Waterline at rest and its offsets (cached with the hull)
+	vector<vec3>		mvContour;
+	vector<vec3>		mvContourSpray;
+	vector<vec3>		mvContourWake;
+	vector<float>		mvTexWakeMask;
+
 	//= T R A I L 1 (Accumulation buffer) ===================
 	
 	unique_ptr<Shader>	mShaderWakeBuffer;
@@ -404,7 +437,7 @@ private:
 	vector<sFoamPts>	vWakePoints;				// Points taken every second to mark the wake
 	vector<sFoamVertex>	vWakeVertices;				// From the points create a vao with vertices making triangles
 	GLuint				mVaoWake		= 0;
-	GLuint				mVboWake		= 0;
+	unsigned int		mWakeFrame		= 0;		// Frame of the last upload in the transient buffer
 	unique_ptr<Shader>	mShaderWakeVao;
 	
 	GLuint				msFBO_WAKE		= 0;
@@ -421,6 +454,27 @@ private:
 
 	unique_ptr<Shader>	mShaderWakeVaoToTex;
 
+	//= H Y D R O S T A T I C S (GPU) ==============
+
+	static const int	HYDRO_FRAMES = 3;					// Results in flight before waiting for the GPU
+	unique_ptr<Shader>	mShaderHydrostatics;
+	GLuint				mSSBO_HULL_VERTICES		= 0;		// Uploaded once
+	GLuint				mSSBO_HULL_TRIANGLES	= 0;		// Uploaded once
+	GLuint				mSSBO_WATER_VERTICES	= 0;
+	GLuint				mSSBO_HYDRO_PARTIALS	= 0;
+	GLuint				mSSBO_HYDRO_RESULT[HYDRO_FRAMES] = { 0 };
+	sHydroSum		  * mpHydroResult[HYDRO_FRAMES]	= { nullptr };	// Persistent mapping of the results
+	GLuint				mSSBO_HYDRO_HEIGHTS[HYDRO_FRAMES] = { 0 };
+	float			  * mpHydroHeights[HYDRO_FRAMES] = { nullptr };	// Heights of the vertices above the water
+	GLsync				mHydroFence[HYDRO_FRAMES]	= { 0 };
+	sForce				mHydroCpu[HYDRO_FRAMES];			// CPU result of the same frame (check mode)
+	float				mHydroCpuArea[HYDRO_FRAMES] = { 0.0f };
+	sHydroSum			mHydroLast;							// Last result read back
+	int					mHydroGroups			= 0;
+	unsigned int		mHydroWrite				= 0;
+	unsigned int		mHydroRead				= 0;
+	bool				mbHydroValid			= false;	// At least one result received
+
 	//= S P R A Y ==================================
 	
 	vector<sSprayPt>	mLeft;
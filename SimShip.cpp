@@ -1,4 +1,4 @@
-/* SimShip by Edouard Halbert
+﻿SimShip by Edouard Halbert
 This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
 http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 
@@ -80,81 +80,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, g_WindowW, g_WindowH);
     g_Camera.SetViewportSize(g_WindowW, g_WindowH);
 
-    // Resize the reflection textures
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO_REFLECTION);
-    
-    glBindTexture(GL_TEXTURE_2D, TexReflectionColor);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_WindowW, g_WindowH, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TexReflectionColor, 0);
-
-    glBindTexture(GL_TEXTURE_2D, TexReflectionDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, g_WindowW, g_WindowH, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, TexReflectionDepth, 0);
-
-    // Checking framebuffer status after update
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) 
-        cout << "Error creating FBO for the reflection" << endl;
-
-    // Resize scene render textures
-    glBindFramebuffer(GL_FRAMEBUFFER, msFBO_SCENE);
-    
-    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msTexSceneColor);
-    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGB, g_WindowW, g_WindowH, GL_TRUE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, msTexSceneColor, 0);
-
-    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msTexSceneDepth);
-    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_DEPTH_COMPONENT32F, g_WindowW, g_WindowH, GL_TRUE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, msTexSceneDepth, 0);
-
-    // Checking framebuffer status after update
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "Error creating FBO for the scene" << endl;
-    
-    // Resize post processing textures
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO_SCENE);
-    
-    glBindTexture(GL_TEXTURE_2D, TexSceneColor);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_WindowW, g_WindowH, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TexSceneColor, 0);
-
-    glBindTexture(GL_TEXTURE_2D, TexSceneDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, g_WindowW, g_WindowH, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, TexSceneDepth, 0);
-
-    // Checking framebuffer status after update
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "Error creating FBO for the post processing" << endl;
-
-    // FBO normal for post processing ================================================
-
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO_POST);
-
-    glBindTexture(GL_TEXTURE_2D, TexPostColor);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_WindowW, g_WindowH, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TexPostColor, 0);
-
-    glBindTexture(GL_TEXTURE_2D, TexPostDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, g_WindowW, g_WindowH, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, TexPostDepth, 0);
-
-    // FBO Verification
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "Error creating FBO for the post processing" << endl;
-
-    // FBO normal for rain & binoculars ================================================
-
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO_RAIN);
-
-    glBindTexture(GL_TEXTURE_2D, TexRainColor);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_WindowW, g_WindowH, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TexRainColor, 0);
-
-    glBindTexture(GL_TEXTURE_2D, TexRainDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, g_WindowW, g_WindowH, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, TexRainDepth, 0);
-
-    // Revert to default framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // The targets of the render graph take the new size at the next frame
 
     g_Clouds.release();
     g_Clouds = make_unique<VolumetricClouds>(g_WindowW, g_WindowH);
@@ -355,9 +281,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
             break;
         // Pause
         case GLFW_KEY_SPACE:
-            g_bPause = !g_bPause;
-            if(g_bPause)g_Timer.stop();
-            else        g_Timer.start();
+            g_SimClock.TogglePause();
             break;
         // Horn
         case GLFW_KEY_H:
@@ -462,9 +386,17 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         case GLFW_KEY_F5:
             g_bShowAutopilotWindow = !g_bShowAutopilotWindow;
             break;
+        case GLFW_KEY_F6:
+            g_bShowProfilerWindow = !g_bShowProfilerWindow;
+            break;
+#ifdef _WIN32
         case GLFW_KEY_F8:
             g_CaptureName = SaveClientArea(g_hWnd);
             break;
+#endif
+        case GLFW_KEY_F9:
+            SwitchRecording();
+            break;
         case GLFW_KEY_F11:
             SwitchToFullScreen();
             break;
@@ -523,7 +455,7 @@ void debugCallbackToFile(GLenum source, GLenum type, GLuint id, GLenum severity,
 #endif
 #define RECORD
 
-int main()
+int main(int argc, char* argv[])
 {
     // The real entry point is mainCRTStartup (see Linker / Advanced / Entry Point)
 
@@ -531,6 +463,42 @@ int main()
     InitConsole();
 #endif
 
+    // Command line
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--bench-record")                            g_bBenchRecord = true;
+        else if (arg == "--headless")
+        {
+            g_bHeadless = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                g_ScenarioPathname = filesystem::path(argv[++i]).wstring();
+        }
+        else if (arg == "--headless-output" && i + 1 < argc)    g_HeadlessOutput = argv[++i];
+        else if (arg == "--context" && i + 1 < argc)
+        {
+            string api = argv[++i];
+            if (api == "osmesa")    g_ContextApi = GLFW_OSMESA_CONTEXT_API;
+            else if (api == "egl")  g_ContextApi = GLFW_EGL_CONTEXT_API;
+        }
+    }
+
+    // Headless: the scenario sets the size of the frames, the ship and its position
+    if (g_bHeadless)
+    {
+        if (!g_Scenario.Load(g_ScenarioPathname))
+            return -1;
+        g_WindowW = g_Scenario.Width;
+        g_WindowH = g_Scenario.Height;
+        if (g_Scenario.Ship >= 0)       g_NoShip = g_Scenario.Ship;
+        if (g_Scenario.Position >= 0)   g_NoPosition = g_Scenario.Position;
+        g_bVsync = false;
+    }
+
+    // Time source of the application, before any time is kept
+    if (Clock::Calibrate())
+        cout << "Clock : invariant TSC at " << Clock::GetFrequency() / 1.0e9 << " GHz" << endl;
+
     // Initializing GLFW
     if (!glfwInit())
         return -1;  // GLFW initialization failed
@@ -540,6 +508,9 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_SAMPLES, 4);
+    if (g_bBenchRecord || g_bHeadless)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, g_ContextApi);
 
     // Creating the window
     g_hWindow = glfwCreateWindow(g_WindowW, g_WindowH, "SimShip", NULL, NULL);
@@ -548,11 +519,14 @@ int main()
         glfwTerminate();
         return -1;  // Failed to create GLFW window
     }
-    // Window in the middle of the screen
-    const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
-    g_WindowX = (mode->width - g_WindowW) / 2;
-    g_WindowY = (mode->height - g_WindowH) / 2;
-    glfwSetWindowPos(g_hWindow, g_WindowX, g_WindowY);
+    // Window in the middle of the screen (a machine without display has no monitor)
+    GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+    if (const GLFWvidmode* mode = monitor ? glfwGetVideoMode(monitor) : nullptr)
+    {
+        g_WindowX = (mode->width - g_WindowW) / 2;
+        g_WindowY = (mode->height - g_WindowH) / 2;
+        glfwSetWindowPos(g_hWindow, g_WindowX, g_WindowY);
+    }
 
     glfwMakeContextCurrent(g_hWindow);
 
@@ -564,6 +538,15 @@ int main()
     if (!gladLoadGL())
         return -1;  // Unable to load OpenGL extensions
 
+    // Shaders: binaries of the programs already linked, parallel compilation of the others when the driver has it
+    PFNMAXSHADERCOMPILERTHREADS maxThreads = nullptr;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        maxThreads = (PFNMAXSHADERCOMPILERTHREADS)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    g_ShaderCache.Init(maxThreads);
+
+    g_Profiler.Init();
+    g_DynamicResolution.Init();
+
 #if 0
     GLint profile;
     glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
@@ -574,7 +557,9 @@ int main()
 
     glEnable(GL_MULTISAMPLE);
 
+#ifdef _WIN32
     g_hWnd = glfwGetWin32Window(g_hWindow);
+#endif
     g_DirExecutable = GetExecutablePath();
 
     // Viewport Configuration
@@ -606,9 +591,23 @@ int main()
     InitScene();
     //DisplayWaveParametersFromModels(KnotsToMS(g_WindSpeedKN), 50000.0);
 
+    // The data of the benchmarks needs the FFT of the GPU, SimShipBench times the kernels without OpenGL
+    if (g_bBenchRecord)
+    {
+        RecordBenchmarks();
+        glfwSetWindowShouldClose(g_hWindow, true);
+    }
+    else if (g_bHeadless)
+        StartHeadless();
+
     // Main rendering loop
     while (!glfwWindowShouldClose(g_hWindow))
     {
+        uint64_t frameStart = Clock::Ticks();
+        g_Profiler.BeginFrame();
+        g_SimClock.Tick();
+        float simTime = (float)g_SimClock.GetTime();
+
         // Camera zoom
         static float fov = g_Camera.GetZoom();
         if (g_bBinoculars && g_Camera.GetPosition().y > 0.0f)
@@ -617,46 +616,109 @@ int main()
             g_Camera.SetZoom(fov);
 
         // Camera update
-        if (g_vShips.size() && g_NoShip >= 0 && g_NoShip < g_vShips.size())
+        if (g_bHeadless)
+        {
+            vec3 p, t;
+            g_Scenario.GetCamera((float)g_SimClock.GetTime(), p, t);
+            g_Camera.LookAt(g_Ship->TransformPosition(p), g_Ship->TransformPosition(t));
+        }
+        else if (g_vShips.size() && g_NoShip >= 0 && g_NoShip < g_vShips.size())
         {
             vec3 p = g_Ship->TransformPosition(g_vShips[g_NoShip].View1);
             if (g_Camera.GetMode() == eCameraMode::OUT_FREE)
                 p = g_Ship->TransformPosition(g_vShips[g_NoShip].View2);
             vec3 t = g_Ship->TransformPosition(vec3(50.0f, p.y, 0.0f));
             vec3 orbitalTarget = g_Ship->ship.Position + vec3(0.0f, 1.5f, 0.0f);
-            g_Camera.Animate(g_TimeSpeed * g_Timer.getTime(), orbitalTarget, p, t);
+            g_Camera.Animate(g_SimClock.GetRealDelta(), orbitalTarget, p, t);
         }
         else
         {
             vec3 pos = vec3(0.0f);
             vec3 p = vec3(0.0f);
             vec3 t = vec3(0.0f);
-            g_Camera.Animate(g_TimeSpeed * g_Timer.getTime(), pos, p, t);
+            g_Camera.Animate(g_SimClock.GetRealDelta(), pos, p, t);
+
+        }
+
+        g_TransientBuffer.BeginFrame();
 
+        // Assets streamed during the simulation (Kelvin layers)
+        {
+            PROFILE_CPU("Uploads");
+            g_AssetLoader.ProcessUploads(STREAM_BUDGET_MS);
         }
 
         // Updates
-        if (g_Ocean)    g_Ocean->Update(g_TimeSpeed * g_Timer.getTime());
-        if (g_Ship)     g_Ship->Update(g_TimeSpeed * g_Timer.getTime());
+        {
+            PROFILE_GPU("Updates");
+            if (g_Ocean)    g_Ocean->Update(simTime);
+            if (g_Ship)     g_Ship->Update(simTime);
+            {
+                PROFILE_CPU("Terrain");
+                g_Terrains.Update(g_Camera.GetPosition(), g_AssetLoader);
+            }
+            {
+                PROFILE_CPU("Marks");
+                if (g_Markup)   g_Markup->Update(g_Ocean.get(), g_SimClock.GetSteps(), g_SimClock.FixedStep);
+            }
+        }
 
 #ifdef RECORD
         static int counter = 0;
         //if(counter % 100 == 0)
-            g_Ocean->GetRecordFromBuoy(vec2(0.0f, 0.0f), g_TimeSpeed * g_Timer.getTime());
+            g_Ocean->GetRecordFromBuoy(vec2(0.0f, 0.0f), simTime);
         counter++;
 #endif
         UpdateFPS();
         UpdateSounds();
 
         // Render all
-        Render();
+        uint64_t renderStart = Clock::Ticks();
+        g_DynamicResolution.BeginFrame();
+        {
+            PROFILE_GPU("Render");
+            Render();
+        }
+        g_RenderCpuMs = 0.95f * g_RenderCpuMs + 0.05f * (float)Clock::ToMs(Clock::Ticks() - renderStart);
+
+        g_DynamicResolution.EndFrame((float)Clock::ToMs(Clock::Ticks() - frameStart));
+        g_TransientBuffer.EndFrame();
+
+        // Copy of the back buffer for the video, read later by the encoder
+        if (g_FrameRecorder.IsRecording())
+        {
+            PROFILE_CPU("Capture");
+            g_FrameRecorder.Capture(g_WindowW, g_WindowH);
+        }
+
+        if (g_bHeadless)
+            EndHeadlessFrame();
 
         // Buffer swapping and event handling
-        glfwSwapBuffers(g_hWindow);
+        {
+            PROFILE_CPU("Swap");
+            glfwSwapBuffers(g_hWindow);
+        }
+        g_Profiler.EndFrame();
         glfwPollEvents();
     }
 
+    // Times of the frames still in flight
+    if (g_bHeadless)
+    {
+        g_Profiler.Flush();
+        if (!g_Scenario.Save(g_HeadlessOutput))
+            cerr << "Headless : cannot write " << g_HeadlessOutput << endl;
+    }
+
     // Cleaning
+    g_FrameRecorder.Stop();
+    g_AssetLoader.Release();
+    g_TransientBuffer.Release();
+    g_Terrains.Release();
+    g_RenderGraph.Release();
+    g_DynamicResolution.Release();
+    g_Profiler.Release();
 	SAFE_DELETE(g_SoundMgr);
     nvgDeleteGL3(g_Nvg);
     ImGui_ImplOpenGL3_Shutdown();
@@ -664,18 +726,6 @@ int main()
     ImGui::DestroyContext();
     glfwTerminate();
 
-    glDeleteFramebuffers(1, &FBO_REFLECTION);
-    glDeleteTextures(1, &TexReflectionColor);
-    glDeleteTextures(1, &TexReflectionDepth);
-
-    glDeleteFramebuffers(1, &msFBO_SCENE);
-    glDeleteTextures(1, &msTexSceneColor);
-    glDeleteTextures(1, &msTexSceneDepth);
-
-    glDeleteFramebuffers(1, &FBO_SCENE);
-    glDeleteTextures(1, &TexSceneColor);
-    glDeleteTextures(1, &TexSceneDepth);
-
     //system("ffmpeg -y -i ./Outputs/fold%04d.png fold.mp4");
     return 0;
 }
@@ -689,7 +739,7 @@ void InitScene()
     // Camera
     g_Camera.SetProjection(45.0f, g_WindowW, g_WindowH, 0.1f, 30000.f);
     g_Camera.LookAt(vec3(-12.0f, 21.f, 100.f), vec3(0.f, 0.f, 0.f));
-    g_Camera.SetSpeeds(0.01f, 0.0025f);
+    g_Camera.SetSpeeds(15.0f, 0.0025f);  // m/s, rad/pixel
     g_Camera.SetTarget(vec3(0.0f, 0.0f, 0.0f));
     g_Camera.SetMode(eCameraMode::ORBITAL);
 
@@ -708,11 +758,24 @@ void InitScene()
     g_ShaderBackground = make_unique<Shader>("Resources/Clouds/background.vert", "Resources/Clouds/background.frag");     // To draw the clouds in a separate process
     g_ShaderPostProcessing = make_unique<Shader>("Resources/Shaders/post_processing.vert", "Resources/Shaders/post_processing.frag");   // Mist + fog + underwater
     g_ShaderFXAA = make_unique<Shader>("Resources/Shaders/fxaa.vert", "Resources/Shaders/fxaa.frag");
+    g_ShaderUpscale = make_unique<Shader>("Resources/Shaders/fxaa.vert", "Resources/Shaders/upscale.frag");    // Dynamic resolution
     g_ShaderRain = make_unique<Shader>("Resources/Sky/rain.vert", "Resources/Sky/rain.frag");
     
+    // Workers decoding the files, the models are submitted first so that they are decoded while the rest is initialized
+    g_AssetLoader.Init();
+
     // Models
     LoadModels();
 
+    // Terrains
+    LoadTerrains();
+
+    // Markup
+    g_Markup = make_unique<Markup>(L"Resources/Terrains/Houat/Markup-houat.xml", &g_AssetLoader);
+
+    // Dynamic buffers (grows if necessary)
+    g_TransientBuffer.Init(4 * 1024 * 1024);
+
     // Oceans
     g_Ocean = make_unique<Ocean>(g_Wind, g_Sky.get());
     g_Ocean->bVisible = true;
@@ -720,17 +783,14 @@ void InitScene()
     // Quad for texture display
     g_QuadTexture = make_unique<QuadTexture>();
     
-    // Timer
-    g_Timer.start();
-
-    // Terrains
-    LoadTerrains();
-
-    // Markup
-    g_Markup = make_unique<Markup>(L"Resources/Terrains/Houat/Markup-houat.xml");
+    // Simulation time
+    g_SimClock.Start();
 
     // Sounds
     LoadSounds();
+
+    // Uploads of the models with a progress bar
+    WaitAssets();
     
     // Ship
     LoadShips();
@@ -740,140 +800,7 @@ void InitScene()
 }
 void InitFBO()
 {
-    // FBO for the reflection of the ship on the ocean ===============================
-
-    glGenFramebuffers(1, &FBO_REFLECTION);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO_REFLECTION);
-
-    // Creating the reflection texture
-    glGenTextures(1, &TexReflectionColor);
-    glBindTexture(GL_TEXTURE_2D, TexReflectionColor);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_WindowW, g_WindowH, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TexReflectionColor, 0);
-
-    glGenTextures(1, &TexReflectionDepth);
-    glBindTexture(GL_TEXTURE_2D, TexReflectionDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, g_WindowW, g_WindowH, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, TexReflectionDepth, 0);
-
-    // FBO Verification
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "Error creating FBO for the reflection" << endl;
-
-
-    // FBO Multisample for the entire scene ===========================================
-    
-    glGenFramebuffers(1, &msFBO_SCENE);
-    glBindFramebuffer(GL_FRAMEBUFFER, msFBO_SCENE);
-
-    // Creating the multisample color texture
-    glGenTextures(1, &msTexSceneColor);
-    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msTexSceneColor);
-    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGB, g_WindowW, g_WindowH, GL_TRUE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, msTexSceneColor, 0);
-
-    // Creating the multisample depth texture
-    glGenTextures(1, &msTexSceneDepth);
-    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msTexSceneDepth);
-    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_DEPTH_COMPONENT32F, g_WindowW, g_WindowH, GL_TRUE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, msTexSceneDepth, 0);
-
-    GLenum drawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
-    glDrawBuffers(1, drawBuffers);
-    
-    // FBO Verification
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "Error creating FBO for the scene" << endl;
-
-    // FBO normal (blit from the multisample FBO ================================================
-    
-    glGenFramebuffers(1, &FBO_SCENE);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO_SCENE);
-
-    // Create a non-multisample texture for color
-    glGenTextures(1, &TexSceneColor);
-    glBindTexture(GL_TEXTURE_2D, TexSceneColor);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_WindowW, g_WindowH, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TexSceneColor, 0);
-
-    // Create a non-multisample texture for depth
-    glGenTextures(1, &TexSceneDepth);
-    glBindTexture(GL_TEXTURE_2D, TexSceneDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, g_WindowW, g_WindowH, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, TexSceneDepth, 0);
-    
-    glDrawBuffers(1, drawBuffers);
-
-    // FBO Verification
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "Error creating FBO for the post processing" << endl;
-    
-    // FBO normal for post processing ================================================
-
-    glGenFramebuffers(1, &FBO_POST);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO_POST);
-
-    // Create a non-multisample texture for color
-    glGenTextures(1, &TexPostColor);
-    glBindTexture(GL_TEXTURE_2D, TexPostColor);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_WindowW, g_WindowH, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TexPostColor, 0);
-
-    // Create a non-multisample texture for depth
-    glGenTextures(1, &TexPostDepth);
-    glBindTexture(GL_TEXTURE_2D, TexPostDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, g_WindowW, g_WindowH, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, TexPostDepth, 0);
-
-    glDrawBuffers(1, drawBuffers);
-
-    // FBO Verification
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "Error creating FBO for the post processing" << endl;
-    
-    // FBO normal for rain & binoculars ================================================
-
-    glGenFramebuffers(1, &FBO_RAIN);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO_RAIN);
-
-    // Create a non-multisample texture for color
-    glGenTextures(1, &TexRainColor);
-    glBindTexture(GL_TEXTURE_2D, TexRainColor);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_WindowW, g_WindowH, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TexRainColor, 0);
-
-    // Create a non-multisample texture for depth
-    glGenTextures(1, &TexRainDepth);
-    glBindTexture(GL_TEXTURE_2D, TexRainDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, g_WindowW, g_WindowH, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, TexRainDepth, 0);
-
-    glDrawBuffers(1, drawBuffers);
-
-    // FBO Verification
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "Error creating FBO for the post processing" << endl;
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    ////////////////////
-
+    // The framebuffers and their textures are created by the render graph, for the passes which use them
     g_ScreenQuadPost = make_unique<ScreenQuad>();
     g_ScreenQuadCloud = make_unique<ScreenQuad>();
 }
@@ -906,8 +833,7 @@ void InitNanoVg()
 }
 void InitFPSCounter()
 {
-    QueryPerformanceFrequency(&g_Frequency);
-    QueryPerformanceCounter(&g_LastTime);
+    g_LastTime = Clock::Now();
 }
 void LoadPositions()
 {
@@ -961,58 +887,50 @@ void LoadModels()
     g_Axe->bVisible = false;
 
     // Arrow for the wind
-    g_ArrowWind = make_unique<Model>("Resources/Interface/direction_wind.glb");
+    g_ArrowWind = make_unique<Model>("Resources/Interface/direction_wind.glb", g_AssetLoader);
     g_ArrowWind->bVisible = false;
 }
-void ReadObjHeader(sTerrain& terrain)
+void WaitAssets()
 {
-	ifstream file(terrain.file);
-    string line;
-
-    if (file.is_open()) 
+    // Loading screen: the uploads are spread over the frames while the workers keep decoding
+    while (!g_AssetLoader.ProcessUploads(ASSETS_BUDGET_MS) && !glfwWindowShouldClose(g_hWindow))
     {
-        while (std::getline(file, line)) 
-        {
-            istringstream iss(line);
-            string token;
-            iss >> token;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, g_WindowW, g_WindowH);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+
+        ImGui::SetNextWindowPos(ImVec2(0.5f * g_WindowW, 0.5f * g_WindowH), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+        ImGui::SetNextWindowSize(ImVec2(400, 0), ImGuiCond_Always);
+        ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings);
+        char label[64];
+        sprintf_s(label, "%d / %d", g_AssetLoader.GetUploaded(), g_AssetLoader.GetTotal());
+        ImGui::Text("Decoded : %d / %d", g_AssetLoader.GetDecoded(), g_AssetLoader.GetTotal());
+        ImGui::ProgressBar(g_AssetLoader.GetProgress(), ImVec2(-1.0f, 0.0f), label);
+        ImGui::TextUnformatted(g_AssetLoader.GetCurrent().c_str());
+        ImGui::End();
 
-            if (token == "#") 
-            {
-                iss >> token;
-                if (token == "Centre") 
-                    iss >> terrain.center.x >> terrain.center.y;
-                else if (token == "Corner") 
-                {
-                    iss >> token;
-                    if (token == "NW")
-                        iss >> terrain.xMin >> terrain.zMax;
-                    else if (token == "SE") 
-                        iss >> terrain.xMax >> terrain.zMin;
-                }
-            }
-        }
-        file.close();
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+        glfwSwapBuffers(g_hWindow);
+        glfwPollEvents();
     }
 }
 void LoadTerrains()
 {
-    if (g_vTerrains.size() == 0)
-    {
-        vector<string> files = ListFiles("Resources/Terrains/Houat/", ".obj");
-        for (auto& file : files)
-		{
-			sTerrain terrain;
-			terrain.file = file;
-			ReadObjHeader(terrain);
-			vec2 p = LonLatToOpenGL(terrain.center.x, terrain.center.y);
-			terrain.pos = vec3(p.x, 0.0f, p.y);
-			terrain.scale = vec3(1.0f);
-			terrain.model = make_unique<Model>(terrain.file);
-			g_vTerrains.push_back(move(terrain));
-		}
-    }
-    g_Pier = make_unique<Model>("Resources/Terrains/Houat/pier.gltf");
+    // Tiles indexed once, the ones around the camera are decoded with the other assets
+    if (g_Terrains.GetCount() == 0)
+        g_Terrains.AddFolder("Resources/Terrains/Houat/");
+    g_Terrains.Update(g_Camera.GetPosition(), g_AssetLoader, true);
+
+    // The pier is modelled in the frame of the tile of the island
+    g_Pier = make_unique<Model>("Resources/Terrains/Houat/pier.gltf", g_AssetLoader);
+    g_PierPosition = g_Terrains.GetPosition("c3_z17_island.obj");
 }
 void LoadShips()
 {
@@ -1923,6 +1841,94 @@ void LoadShips()
     g_Ship->ResetVelocities();
     g_Ship->bVisible = true;
 }
+// Data of the micro-benchmarks (--bench-record): displacements and series of a buoy from the FFT of the GPU
+// SimShipBench times the kernels on these files without OpenGL, so that every run times the same data
+void RecordBenchmarks()
+{
+    const int   SNAPSHOTS = 8;
+    const int   BUOY_SAMPLES = 1200;
+    const float BUOY_STEP = 0.05f;      // s, 60 s of record
+    const size_t size = 4 * g_Ocean->FFT_SIZE * g_Ocean->FFT_SIZE;
+
+    filesystem::create_directories(BENCH_FOLDER);
+    cout << "Benchmark : recording the ocean in " << BENCH_FOLDER << endl;
+
+    // Sizes and parameters of the spectra
+    vector<float> ocean = { (float)g_Ocean->FFT_SIZE, (float)g_Ocean->MESH_SIZE, (float)g_Ocean->PATCH_SIZE, (float)g_Ocean->LengthWave,
+                            g_Ocean->Wind.x, g_Ocean->Wind.y, g_Ocean->Amplitude, g_Ocean->GetGravity() };
+    Benchmark::SaveFloats(BENCH_FOLDER + "ocean.bin", ocean);
+
+    g_Ocean->vWaveData.clear();
+    for (int f = 0; f < BUOY_SAMPLES; f++)
+    {
+        float t = f * BUOY_STEP;
+        g_Ocean->Update(t);
+        g_Ocean->GetRecordFromBuoy(vec2(0.0f, 0.0f), t);
+        if (f % (BUOY_SAMPLES / SNAPSHOTS) == 0)
+        {
+            float* displacement = g_Ocean->GetPixelsDisplacement();
+            vector<float> snapshot(displacement, displacement + size);
+            Benchmark::SaveFloats(BENCH_FOLDER + "ocean_" + to_string(f / (BUOY_SAMPLES / SNAPSHOTS)) + ".bin", snapshot);
+        }
+    }
+
+    vector<float> buoy;
+    for (auto& wd : g_Ocean->vWaveData)
+        buoy.insert(buoy.end(), { (float)wd.time, (float)wd.dx, (float)wd.dy, (float)wd.dz });
+    if (!Benchmark::SaveFloats(BENCH_FOLDER + "buoy.bin", buoy))
+        cerr << "Benchmark : cannot write " << BENCH_FOLDER << "buoy.bin" << endl;
+}
+// Scripted run (--headless): fixed step, same waves at each run, timings from the profiler
+void StartHeadless()
+{
+    if (g_Scenario.WindKN > 0.0f)      g_WindSpeedKN = g_Scenario.WindKN;
+    if (g_Scenario.WindDEG >= 0.0f)    g_WindDirectionDEG = g_Scenario.WindDEG;
+    g_Wind = WindDirSpeed_Vec(g_WindDirectionDEG, g_WindSpeedKN);
+    g_Ocean->Seed = g_Scenario.Seed;
+    g_Ocean->GetWind(g_Wind);
+    g_Ocean->InitFrequencies();
+
+    g_SimClock.FrameDelta = g_Scenario.Step;
+    g_Profiler.OnFrame = [](const sProfileFrame& frame) { g_Scenario.Record(frame); };
+    filesystem::path folder = filesystem::path(g_HeadlessOutput).parent_path();
+    if (!folder.empty())
+        filesystem::create_directories(folder);
+    if (g_Scenario.Dump > 0)
+    {
+        g_FrameRecorder.Every = g_Scenario.Dump;
+        g_FrameRecorder.bBlocking = true;
+        g_FrameRecorder.Start("Outputs/headless", g_WindowW, g_WindowH, FrameRecorder::eFormat::PNG);
+    }
+
+    wcout << L"Headless : " << g_ScenarioPathname << L", " << g_Scenario.Frames << L" frames of " << g_WindowW << L" x " << g_WindowH << endl;
+}
+void EndHeadlessFrame()
+{
+    if (++g_HeadlessFrame >= g_Scenario.Frames)
+        glfwSetWindowShouldClose(g_hWindow, true);
+}
+// Video of the window in a raw Y4M stream (ffmpeg -i Video000.y4m Video000.mp4)
+void SwitchRecording()
+{
+    if (g_FrameRecorder.IsRecording())
+    {
+        g_FrameRecorder.Stop();
+        return;
+    }
+
+    filesystem::create_directories("Outputs");
+    string pathname;
+    for (int n = 0; pathname.empty() || filesystem::exists(pathname); n++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Outputs/Video%03d.y4m", n);
+        pathname = name;
+    }
+    g_FrameRecorder.Every = 1;
+    g_FrameRecorder.bBlocking = false;
+    if (g_FrameRecorder.Start(pathname, g_WindowW, g_WindowH, FrameRecorder::eFormat::Y4M))
+        g_CaptureName = filesystem::path(pathname).wstring();
+}
 void LoadSounds()
 {
     g_SoundMgr = SoundManager::getInstance();
@@ -1947,14 +1953,14 @@ void UpdateFPS()
 {
     g_FrameCount++;
 
-    QueryPerformanceCounter(&g_CurrentTime);
-    float deltaTime = (g_CurrentTime.QuadPart - g_LastTime.QuadPart) / (float)g_Frequency.QuadPart;
+    double currentTime = Clock::Now();
+    float deltaTime = float(currentTime - g_LastTime);
 
     if (deltaTime >= 1.0f)
     {
         g_Fps = 0.5 + (float)g_FrameCount / deltaTime;
         g_FrameCount = 0;
-        g_LastTime = g_CurrentTime;
+        g_LastTime = currentTime;
     }
 }
 void UpdateSounds()
@@ -2088,6 +2094,7 @@ void RenderOcean()
     if (!g_Ocean)
         return;
 
+    PROFILE_GPU("Ocean");
     if (!g_Ocean->bVisible)
         return;
 
@@ -2096,7 +2103,7 @@ void RenderOcean()
     
     float waveLength = glm::two_pi<float>() * g_Ship->Velocity * g_Ship->Velocity / 9.81f;  // length between 2 crests
     float kelvinScale = 101.0f / waveLength;                // the texture is 1024 and there are 9 wavelengths in 910 pixels
-    g_Ocean->Render(g_TimeSpeed * g_Timer.getTime(), g_Camera, g_Ship->ship.Position, g_Ship->Yaw, g_Ship->bWaves, g_Ship->LWL, kelvinScale, g_Ship->Velocity, g_Ship->ship.CenterFore);
+    g_Ocean->Render((float)g_SimClock.GetTime(), g_Camera, g_Ship->ship.Position, g_Ship->Yaw, g_Ship->bWaves, g_Ship->LWL, kelvinScale, g_Ship->Velocity, g_Ship->ship.CenterFore);
 
     if (!g_bWireframe && g_bOceanWireframe) 
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -2106,6 +2113,7 @@ void RenderShip()
     if (!g_Ship)
         return;
 
+    PROFILE_GPU("Ship");
     if (!g_Ship->bVisible)
         return;
 
@@ -2116,30 +2124,18 @@ void RenderTerrains(int t)
 {
     // Terrain
     g_ShaderSun->use();
-    g_ShaderSun->setVec3("light.position", g_Sky->SunPosition);
-    g_ShaderSun->setVec3("light.ambient", g_Sky->SunAmbient);
-    g_ShaderSun->setVec3("light.diffuse", g_Sky->SunDiffuse);
-    g_ShaderSun->setVec3("light.specular", g_Sky->SunSpecular);
-    g_ShaderSun->setVec3("viewPos", g_Camera.GetPosition());
-    g_ShaderSun->setFloat("exposure", g_Sky->Exposure);
-    g_ShaderSun->setBool("bAbsorbance", g_Sky->bAbsorbance);
-    g_ShaderSun->setVec3("absorbanceColor", g_Sky->AbsorbanceColor);
-    g_ShaderSun->setFloat("absorbanceCoeff", g_Sky->AbsorbanceCoeff);
     g_ShaderSun->setFloat("specularIntensity", 0.0f);
 
     g_ShaderSun->setMat4("view", g_Camera.GetView());
     g_ShaderSun->setMat4("projection", g_Camera.GetProjection());
 
-    for (size_t t = 0; t < g_vTerrains.size(); t++)
-    {
-        mat4 model = glm::translate(mat4(1.0f), g_vTerrains[t].pos);
-        model = glm::scale(model, g_vTerrains[t].scale);
-        g_ShaderSun->setMat4("model", model);
-        g_vTerrains[t].model->Render(*g_ShaderSun);
-    }
+    g_Terrains.Render(*g_ShaderSun, g_Camera.GetProjection() * g_Camera.GetView(), g_Camera.GetPosition());
     
-    if (g_vTerrains[0].model->bVisible && g_Pier)
+    if (g_Terrains.bVisible && g_Pier)
+    {
+        g_ShaderSun->setMat4("model", glm::translate(mat4(1.0f), g_PierPosition));
         g_Pier->Render(*g_ShaderSun);
+    }
 }
 void RenderArrowWind()
 {
@@ -2236,6 +2232,17 @@ void RenderImGui()
             case eInterpolation::EaseInOut: ImGui::Text("( EaseInOut )");   break;
             }
             ImGui::PopStyleColor(1);                                                            
+            ImGui::Text("Render CPU : %.2f ms", g_RenderCpuMs);
+            ImGui::Text("Clock : %s, simulation %.1f s", Clock::IsTsc() ? "TSC" : "steady", g_SimClock.GetTime());
+            if (g_FrameRecorder.IsRecording())
+                ImGui::Text("Recording : %d frames, %d dropped, %.2f ms / frame", g_FrameRecorder.GetWritten(), g_FrameRecorder.GetDropped(), g_FrameRecorder.GetCaptureMs());
+            ImGui::Text("Transient : %d KB / frame (max %d KB of %d KB)", int(g_TransientBuffer.GetBytesLastFrame() / 1024), int(g_TransientBuffer.GetHighWater() / 1024), int(g_TransientBuffer.GetCapacity() / 1024));
+            ImGui::Text("Render graph : %d passes (%d culled), %d barriers, %d MB in %d textures (%d MB without aliasing)", g_RenderGraph.GetPassCount(), g_RenderGraph.GetCulled(), g_RenderGraph.GetBarriers(), int(g_RenderGraph.GetBytes() / (1024 * 1024)), g_RenderGraph.GetTextureCount(), int(g_RenderGraph.GetBytesTargets() / (1024 * 1024)));
+            ImGui::Text("Resolution : %d%% of %dx%d, GPU %.2f ms, CPU %.2f ms / frame", int(100.0f * g_DynamicResolution.GetScale() + 0.5f), g_WindowW, g_WindowH, g_DynamicResolution.GetGpuMs(), g_DynamicResolution.GetCpuMs());
+            ImGui::Text("Shaders : %d from cache, %d compiled%s", g_ShaderCache.GetHits(), g_ShaderCache.GetMisses(), g_ShaderCache.bParallel ? " (parallel)" : "");
+            ImGui::Text("Textures : %d (%d shared loads) %d MB", g_TextureCache.GetCount(), g_TextureCache.GetHits(), int(g_TextureCache.GetBytes() / (1024 * 1024)));
+            ImGui::Text("Terrain : %d tiles loaded of %d, %d drawn", g_Terrains.GetLoaded(), g_Terrains.GetCount(), g_Terrains.GetDrawn());
+            ImGui::Text("Marks : %d drawn of %d", g_Markup->GetDrawn(), g_Markup->GetCount());
             // ------------
             ImGui::Checkbox("Night vision", &g_bNightVision);
             ImGui::SameLine();
@@ -2243,15 +2250,18 @@ void RenderImGui()
             // ------------
             if (ImGui::Button(" PAUSE "))
             {
-                g_bPause = !g_bPause;
-                if (g_bPause)
-                    g_Timer.stop();
-                else
-                    g_Timer.start();
+                g_SimClock.TogglePause();
             }
             ImGui::SameLine();
             if (ImGui::Button(" FULLSCREEN "))
                 SwitchToFullScreen();
+            ImGui::SliderFloat("Time warp", &g_SimClock.Speed, 0.1f, 10.0f, "x %0.1f", ImGuiSliderFlags_Logarithmic);
+            ImGui::Checkbox("Dynamic resolution", &g_DynamicResolution.bEnabled);
+            if (g_DynamicResolution.bEnabled)
+            {
+                ImGui::SliderFloat("Target FPS", &g_DynamicResolution.TargetFps, 30.0f, 240.0f, "%.0f");
+                ImGui::SliderFloat("Min scale", &g_DynamicResolution.MinScale, 0.25f, g_DynamicResolution.MaxScale, "%.2f");
+            }
 
             /////////////////////////////////
             if (ImGui::CollapsingHeader("SCENE", ImGuiTreeNodeFlags_DefaultOpen))
@@ -2280,7 +2290,7 @@ void RenderImGui()
                 ImGui::SameLine();
                 ImGui::Checkbox("Sound##1", &g_SoundMgr->bSound);
                 // ------------
-                if (g_vTerrains.size()) ImGui::Checkbox("Terrain", &g_vTerrains[0].model->bVisible);
+                ImGui::Checkbox("Terrain", &g_Terrains.bVisible);
                 ImGui::SameLine();
                 ImGui::Checkbox("Markup", &g_Markup->bVisible);
                 ImGui::SameLine();
@@ -2381,7 +2391,7 @@ void RenderImGui()
                     static double lastUpdateTime = 0.0;
                     if (g_bShowOceanAnalysisWindow)
                     {
-                        double currentTime = glfwGetTime(); // temps actuel en secondes depuis l'initialisation GLFW
+                        double currentTime = Clock::Now();
                         if (currentTime - lastUpdateTime >= 1.0)
                         {
                             lastUpdateTime = currentTime;
@@ -2472,6 +2482,8 @@ void RenderImGui()
                 ImGui::ColorEdit3("Cloud top", (float*)&g_Clouds->CloudColorTop[0], 0);
                 ImGui::ColorEdit3("Cloud bottom", (float*)&g_Clouds->CloudColorBottom[0], 0);
                 ImGui::Checkbox("Godrays", &g_Clouds->bEnableGodRays);
+                ImGui::SameLine();
+                ImGui::Checkbox("Temporal", &g_Clouds->bTemporal);
             }
            
             /////////////////////////////////
@@ -2587,6 +2599,12 @@ void RenderImGui()
             ImGui::Checkbox("Contours D", &g_Ship->bContour);
             ImGui::SameLine();
             ImGui::Checkbox("BBox", &g_Ship->BBoxShape->bVisible);
+            // ------------
+            ImGui::Checkbox("Hydrostatics GPU", &g_Ship->bHydrostaticsGPU);
+            ImGui::SameLine();
+            ImGui::Checkbox("Check CPU", &g_Ship->bHydrostaticsCheck);
+            ImGui::SameLine();
+            ImGui::Checkbox("Waterline", &g_Ship->bWaterline);
 
             /////////////////////////////////
             ImGui::SeparatorText("AUTOPILOT");
@@ -2705,6 +2723,9 @@ void RenderImGui()
         ImGui::End();
     }
     
+    if (g_bShowProfilerWindow)
+        g_Profiler.RenderImGui(&g_bShowProfilerWindow);
+
     if (g_bShowAutopilotWindow)
     {
         ImGui::SetNextWindowSize(ImVec2(350, 300), ImGuiCond_FirstUseEver);
@@ -2837,11 +2858,11 @@ void RenderInfo()
     static bool textVisible = false;
 
     if (!textVisible) {
-        textStartTime = glfwGetTime();
+        textStartTime = Clock::Now();
         textVisible = true;
     }
 
-    double now = glfwGetTime();
+    double now = Clock::Now();
 
     if (textVisible && (now - textStartTime) < 1.0)
     {
@@ -3382,10 +3403,10 @@ void RenderThrottle(float x, float y, float w, float h)
     // Speed ​​Update
 	bool bUpdate = false;
     static double prevTime = 0.0;
-    if (g_Timer.getTime() - prevTime > 0.5)
+    if (Clock::Now() - prevTime > 0.5)
     {
         bUpdate = true;
-        prevTime = g_Timer.getTime();
+        prevTime = Clock::Now();
     }
     else
         bUpdate = false;
@@ -4014,7 +4035,7 @@ void Render()
 {
     // Physics actuator
     static bool bInit = false;
-    static float firstTime = g_Timer.getTime();
+    static double firstTime = g_SimClock.GetTime();
     static int PrevNoShip;      // to detect a change of vessel
     static int PrevNoPosition;  // to detect a change of position
     static bool PrevVisiblity;
@@ -4023,7 +4044,7 @@ void Render()
     {
         // New ship: we reset the physical tempo
         bInit = false;
-        firstTime = g_Timer.getTime();
+        firstTime = g_SimClock.GetTime();
         g_Ship->bMotion = false;            // disable physics during latency
         PrevNoShip = g_NoShip;              // memorizes the current ship
         PrevNoPosition = g_NoPosition;      // memorizes the current position
@@ -4031,60 +4052,94 @@ void Render()
     }
 
     // Physics cutoff for 1 second after any change
-    if (!bInit && (g_Timer.getTime() > firstTime + 1.0f)) 
+    if (!bInit && (g_SimClock.GetTime() > firstTime + 1.0)) 
     {
         g_Ship->bMotion = true;
         bInit = true;
     }
 
-    RenderImGui();
+    {
+        PROFILE_CPU("UI");
+        RenderImGui();
+    }
+
+    // Values shared by the shaders, after the UI that can change the sun
+    g_FrameUniforms.Update(g_Camera, *g_Sky, (float)g_SimClock.GetTime());
 
     bool bAboveWater = g_Camera.GetPosition().y > 0.0f;
+    bool bSky = !g_bWireframe && g_bSkyVisible;                                         // Background of the scene
+    bool bReflection = g_Ocean && g_Ocean->bVisible;                                    // Only the ocean samples the reflection
+    bool bRain = !g_bWireframe && (g_Sky->bRain || g_bBinoculars) && bAboveWater;      // 2 more passes: rain and/or binoculars, then FXAA
+
+    // Frame graph: each pass declares what it reads and writes, the passes whose results are not used are culled
+    // and the targets whose lifetimes do not overlap share the same texture
+    // The 3D passes are at the internal resolution, the scene is upscaled before the post processing
+    float scale = g_bWireframe ? 1.0f : g_DynamicResolution.GetScale();
+    bool bUpscale = !g_bWireframe && scale < 1.0f;
+    g_Clouds->Scale = scale;
+
+    RenderGraph& rg = g_RenderGraph;
+    rg.BeginFrame(g_WindowW, g_WindowH, scale);
+
+    int reflection      = rg.Create("Reflection", { GL_RGB8, 1, 1.0f, true });
+    int reflectionDepth = rg.Create("Reflection depth", { GL_DEPTH_COMPONENT32F, 1, 1.0f, true });
+    int sky             = rg.Import("Sky", g_Sky->GetTexture());
+    int cloudsImage     = rg.Import("Clouds images", g_Clouds->GetImage(0));
+    int clouds          = rg.Import("Clouds", g_Clouds->GetTexture());
+    int msScene         = rg.Create("Scene multisample", { GL_RGB8, 4, 1.0f, true });
+    int msSceneDepth    = rg.Create("Scene multisample depth", { GL_DEPTH_COMPONENT32F, 4, 1.0f, true });
+    int scene           = rg.Create("Scene", { GL_RGB8, 1, 1.0f, true });
+    int sceneDepth      = rg.Create("Scene depth", { GL_DEPTH_COMPONENT32F, 1, 1.0f, true });
+    int upscaled        = rg.Create("Scene upscaled", { GL_RGB8 });
+    int post            = bRain ? rg.Create("Post", { GL_RGB8 }) : RenderGraph::BACKBUFFER;
+    int rain            = rg.Create("Rain", { GL_RGB8 });
 
     // Rendering the scene inverted for the reflection texture
+    rg.AddPass("Reflection").Write(reflection).Write(reflectionDepth).Clear().Execute([&](RenderGraph&)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, FBO_REFLECTION);
-
-        glViewport(0, 0, g_WindowW, g_WindowH);
         glEnable(GL_CLIP_DISTANCE0);
         glEnable(GL_DEPTH_TEST);
-        glClearColor(0.0, 0.0, 0.0, 0.0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         if (g_Ship)
             g_Ship->RenderReflexion(g_Camera, g_Sky.get());
 
         // Revert to default
         glBindTexture(GL_TEXTURE_2D, 0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glDisable(GL_CLIP_DISTANCE0);
-    }
+    });
 
-    // Update the sky (background + clouds)
-    if (g_bSkyVisible)
+    // Update the sky texture (atmosphere)
+    rg.AddPass("Sky").Output(sky).Execute([&](RenderGraph&)
     {
-        // Update the sky texture (atmosphere)
         g_Sky->Render(g_Camera);
-        
-        // Update the clouds texture (with the atmosphere incorporated)
+    });
+
+    // Update the clouds texture (with the atmosphere incorporated): ray marching, then filtering of the images
+    rg.AddPass("Clouds").Read(sky).WriteImage(cloudsImage).Execute([&](RenderGraph&)
+    {
+        g_Clouds->Compute(g_Camera, g_Sky.get(), g_Wind);
+    });
+    rg.AddPass("Clouds post").Read(cloudsImage).Output(clouds).Execute([&](RenderGraph&)
+    {
         glDisable(GL_DEPTH_TEST);
-        g_Clouds->Render(g_Camera, g_Sky.get(), g_Wind);
+        g_Clouds->PostProcess(g_Camera, g_Sky.get());
         glEnable(GL_DEPTH_TEST);
-    }
-
-    // Main rendering to the msFBO_SCENE
+    });
+
+    // Main rendering, multisample
+    sRenderPass& scenePass = rg.AddPass("Scene").Clear();
+    if (g_bWireframe)   scenePass.Write(RenderGraph::BACKBUFFER);
+    else                scenePass.Write(msScene).Write(msSceneDepth);
+    if (g_bSkyVisible)  scenePass.Read(sky);
+    if (bSky)           scenePass.Read(clouds);
+    if (bReflection)    scenePass.Read(reflection);
+    scenePass.Execute([&](RenderGraph&)
     {
-        if (!g_bWireframe)  glBindFramebuffer(GL_FRAMEBUFFER, msFBO_SCENE);
-        else                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        glViewport(0, 0, g_WindowW, g_WindowH);
+        TexReflectionColor = bReflection ? rg.GetTexture(reflection) : 0;
         glPolygonMode(GL_FRONT_AND_BACK, g_bWireframe ? GL_LINE : GL_FILL);
 
-        glClearColor(0.0, 0.0, 0.0, 0.0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
         // Render the sky
-        if (!g_bWireframe && g_bSkyVisible)
+        if (bSky)
         {
             g_ShaderBackground->use();
             g_ShaderBackground->setSampler2D("uTexture", g_Clouds->GetTexture(), 0);
@@ -4095,8 +4150,14 @@ void Render()
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         // Render all the other objects
-        RenderTerrains(0);
-        g_Markup->Render(g_Camera, g_Ocean.get(), g_Sky.get());
+        {
+            PROFILE_GPU("Terrain");
+            RenderTerrains(0);
+        }
+        {
+            PROFILE_GPU("Marks");
+            g_Markup->Render(g_Camera);
+        }
         RenderAxis();
         RenderBalls();
         RenderCentralGridColored();
@@ -4119,6 +4180,7 @@ void Render()
         // Particles
         if (bAboveWater)
         {
+            PROFILE_GPU("Particles");
             g_Ship->RenderSmoke(g_Camera, g_Sky.get());
             g_Ship->RenderSpray(g_Camera, g_Sky.get());
             g_Ship->RenderWakeVao(g_Camera);
@@ -4129,90 +4191,85 @@ void Render()
 
         // Revert to default
         glBindTexture(GL_TEXTURE_2D, 0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
+    });
 
-    // Post processing (mist + fog + underwater)
+    // Post processing (mist + fog + underwater), not in wireframe where the scene is drawn on the screen
     if (!g_bWireframe)
     {
-        // Copies the entire window from the source framebuffer (msFBO_SCENE) to the destination framebuffer (FBO_SCENE), transferring the color and depth buffers, pixel by pixel (GL_NEAREST)
-        
-        // Résoudre couleur principale
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, msFBO_SCENE);
-        glReadBuffer(GL_COLOR_ATTACHMENT0);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO_SCENE);
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
-        glBlitFramebuffer(0, 0, g_WindowW, g_WindowH, 0, 0, g_WindowW, g_WindowH, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-
-        // Résoudre profondeur (idem, si besoin)
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, msFBO_SCENE);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO_SCENE);
-        glBlitFramebuffer(0, 0, g_WindowW, g_WindowH, 0, 0, g_WindowW, g_WindowH, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-
-        // Do the 1st post processing
-        if ((g_Sky->bRain || g_bBinoculars) && g_Camera.GetPosition().y > 0.0f)
-            glBindFramebuffer(GL_FRAMEBUFFER, FBO_POST);
-        else
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, g_WindowW, g_WindowH);
-        glClearColor(0.0, 0.0, 0.0, 0.0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        g_ShaderPostProcessing->use();  // Shaders/post_processing.vert Shaders/post_processing.frag
-        g_ShaderPostProcessing->setSampler2D("texColor", TexSceneColor, 0);     // Get the previous color texture (from the scene)
-        g_ShaderPostProcessing->setSampler2D("texDepth", TexSceneDepth, 1);
-        g_ShaderPostProcessing->setFloat("exposure", g_Sky->Exposure);
-        g_ShaderPostProcessing->setFloat("near", 0.1f);
-        g_ShaderPostProcessing->setFloat("far", 30000.f);
-        g_ShaderPostProcessing->setFloat("horizonHeight", g_Camera.GetHorizonViewportY());
-        g_ShaderPostProcessing->setVec3("eyePos", g_Camera.GetPosition());          // For underwater effect
-        g_ShaderPostProcessing->setVec3("oceanColor", g_Ocean->OceanColor);
-        g_ShaderPostProcessing->setVec3("fogColor", g_Sky->FogColor);
-        g_ShaderPostProcessing->setFloat("mistDensity", g_Sky->MistDensity);
-        g_ShaderPostProcessing->setFloat("fogDensity", g_Sky->FogDensity);
-        g_ShaderPostProcessing->setFloat("uTime", g_Timer.getTime());               // For underwater particles
-        g_ShaderPostProcessing->setVec2("screenSize", vec2(g_WindowW, g_WindowH));
-        g_ShaderPostProcessing->setBool("bLowIntensity", g_bLowIntensity && bAboveWater);
-        g_ShaderPostProcessing->setBool("bNightVision", g_bNightVision && bAboveWater);
-        g_ScreenQuadPost->Render();
-
-        if ((g_Sky->bRain || g_bBinoculars) && bAboveWater)
+        // Copies the entire window from the multisample scene to the textures, color and depth, pixel by pixel (GL_NEAREST)
+        rg.AddPass("Resolve").Read(msScene).Read(msSceneDepth).Write(scene).Write(sceneDepth).Execute([&](RenderGraph&)
         {
-            // 2 passes: 1 for the rain And or the binoculars, 2 for the fxaa
-            
-            // Rendering to a FBO for the 1st pass
-            glBindFramebuffer(GL_FRAMEBUFFER, FBO_RAIN);
-            glViewport(0, 0, g_WindowW, g_WindowH);
-            glClearColor(0.0, 0.0, 0.0, 0.0);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-            g_ShaderRain->use();    // Shaders/rain.vert Shaders/rain.frag
-            g_ShaderRain->setSampler2D("texColor", TexPostColor, 0);    // Get the previous color texture (post processing)
-            g_ShaderRain->setFloat("uTime", g_Timer.getTime());           
-            g_ShaderRain->setVec2("screenSize", vec2(g_WindowW, g_WindowH));
-            g_ShaderRain->setBool("bBinoculars", g_bBinoculars);
-            g_ShaderRain->setBool("bRainDropsTrails", g_Sky->bRainDropsTrails);
-            g_ShaderRain->setBool("bRainBlurDrips", g_Sky->bRainBlurDrips);
-            g_ScreenQuadPost->Render();
-            
-            // Rendering to the screen for the 2nd pass (FXAA)
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glViewport(0, 0, g_WindowW, g_WindowH);
-            glClearColor(0.0, 0.0, 0.0, 0.0);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-            g_ShaderFXAA->use();    // Shaders/fxaa.vert Shaders/fxaa.frag
-            g_ShaderFXAA->setSampler2D("texInput", TexRainColor, 0);    // Get the previous color texture (rain)
-            g_ShaderFXAA->setVec2("invScreenSize", vec2(1.0f / g_WindowW, 1.0f / g_WindowH));
+            int w, h;
+            rg.GetSize(scene, w, h);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, rg.GetFramebuffer(msScene, msSceneDepth));
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        });
+
+        // Edge aware upscaling to the window, the depth is sampled at the internal resolution
+        int sceneColor = bUpscale ? upscaled : scene;
+        if (bUpscale)
+        {
+            rg.AddPass("Upscale").Read(scene).Write(upscaled).Execute([&](RenderGraph&)
+            {
+                int w, h;
+                rg.GetSize(scene, w, h);
+                g_ShaderUpscale->use();     // Shaders/fxaa.vert Shaders/upscale.frag
+                g_ShaderUpscale->setSampler2D("texInput", rg.GetTexture(scene), 0);
+                g_ShaderUpscale->setVec2("inputSize", vec2(w, h));
+                g_ScreenQuadPost->Render();
+            });
+        }
+
+        // On the screen, or in a texture for the rain
+        rg.AddPass("Mist, fog, underwater").Read(sceneColor).Read(sceneDepth).Write(post).Clear().Execute([&](RenderGraph&)
+        {
+            g_ShaderPostProcessing->use();  // Shaders/post_processing.vert Shaders/post_processing.frag
+            g_ShaderPostProcessing->setSampler2D("texColor", rg.GetTexture(sceneColor), 0);   // Get the previous color texture (from the scene)
+            g_ShaderPostProcessing->setSampler2D("texDepth", rg.GetTexture(sceneDepth), 1);
+            g_ShaderPostProcessing->setFloat("near", 0.1f);
+            g_ShaderPostProcessing->setFloat("far", 30000.f);
+            g_ShaderPostProcessing->setFloat("horizonHeight", g_Camera.GetHorizonViewportY());
+            g_ShaderPostProcessing->setVec3("oceanColor", g_Ocean->OceanColor);
+            g_ShaderPostProcessing->setVec2("screenSize", vec2(g_WindowW, g_WindowH));
+            g_ShaderPostProcessing->setBool("bLowIntensity", g_bLowIntensity && bAboveWater);
+            g_ShaderPostProcessing->setBool("bNightVision", g_bNightVision && bAboveWater);
             g_ScreenQuadPost->Render();
+        });
+
+        if (bRain)
+        {
+            rg.AddPass("Rain, binoculars").Read(post).Write(rain).Clear().Execute([&](RenderGraph&)
+            {
+                g_ShaderRain->use();    // Shaders/rain.vert Shaders/rain.frag
+                g_ShaderRain->setSampler2D("texColor", rg.GetTexture(post), 0);     // Get the previous color texture (post processing)
+                g_ShaderRain->setFloat("uTime", (float)g_SimClock.GetTime());
+                g_ShaderRain->setVec2("screenSize", vec2(g_WindowW, g_WindowH));
+                g_ShaderRain->setBool("bBinoculars", g_bBinoculars);
+                g_ShaderRain->setBool("bRainDropsTrails", g_Sky->bRainDropsTrails);
+                g_ShaderRain->setBool("bRainBlurDrips", g_Sky->bRainBlurDrips);
+                g_ScreenQuadPost->Render();
+            });
+
+            rg.AddPass("FXAA").Read(rain).Write(RenderGraph::BACKBUFFER).Clear().Execute([&](RenderGraph&)
+            {
+                g_ShaderFXAA->use();    // Shaders/fxaa.vert Shaders/fxaa.frag
+                g_ShaderFXAA->setSampler2D("texInput", rg.GetTexture(rain), 0);     // Get the previous color texture (rain)
+                g_ShaderFXAA->setVec2("invScreenSize", vec2(1.0f / g_WindowW, 1.0f / g_WindowH));
+                g_ScreenQuadPost->Render();
+            });
         }
     }
 
+    rg.Compile();
+    rg.Execute();
+
     // Revert to default
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // Nanovg
+    PROFILE_GPU("Overlays");
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     nvgBeginFrame(g_Nvg, g_WindowW, g_WindowH, g_DevicePixelRatio);
     {
@@ -29,9 +29,11 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 #pragma comment(lib, "OpenGL32.lib")
 // glfw
 #include <glfw/glfw3.h>
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WGL
 #define GLFW_EXPOSE_NATIVE_WIN32 
 #include <glfw/glfw3native.h>
+#endif
 // stb_image
 #include "stb_image.h"
 #include "stb_image_write.h"
@@ -52,9 +54,20 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 #include "Shapes.h"
 #include "Model.h"
 #include "Ocean.h"
-#include "Timer.h"
+#include "Clock.h"
+#include "Benchmark.h"
 #include "Spectra.h"
 #include "Texture.h"
+#include "TransientBuffer.h"
+#include "FrameUniforms.h"
+#include "Profiler.h"
+#include "Scenario.h"
+#include "FrameRecorder.h"
+#include "RenderGraph.h"
+#include "DynamicResolution.h"
+#include "AssetLoader.h"
+#include "TextureCache.h"
+#include "TerrainManager.h"
 #include "Ship.h"
 #include "Markup.h"
 #include "Clouds.h"
@@ -69,7 +82,9 @@ namespace fs = std::filesystem;
 
 
 GLFWwindow        * g_hWindow			= nullptr;
+#ifdef _WIN32
 HWND				g_hWnd				= nullptr;
+#endif
 uint32_t			g_WindowW			= 1600;
 uint32_t			g_WindowH			= 1040;
 uint32_t			g_WindowW_2			= 800;
@@ -88,6 +103,7 @@ bool                g_bShowSceneWindow			= false;	// [ F2 ]
 bool                g_bShowShipWindow			= false;    // [ F3 ]
 bool                g_bShowStatusBar			= false;	// [ F4 ]
 bool                g_bShowAutopilotWindow		= false;	// [ F5 ]
+bool                g_bShowProfilerWindow		= false;	// [ F6 ]
 bool                g_bShowOceanAnalysisWindow	= false;
 bool				g_bShowShortcuts			= false;
 
@@ -107,13 +123,11 @@ bool				g_bLowIntensity		= false;
 bool				g_bNightVision		= false;
 
 // TIME //////////////////////////////////////////
-LARGE_INTEGER		g_Frequency;
-LARGE_INTEGER		g_LastTime, g_CurrentTime;
+double				g_LastTime			= 0.0;		// s, Clock::Now() of the last FPS count
+float				g_RenderCpuMs = 0.0f;			// CPU time of Render() (smoothed)
 int					g_FrameCount		= 0;
 int					g_Fps				= 0;
-eh::Timer			g_Timer;
-float				g_TimeSpeed			= 1.0f;
-bool				g_bPause			= false;
+SimClock			g_SimClock;						// Time of the ocean, the ship, the wake and the buoys
 bool				g_bVsync			= false;
 
 // SHADERS ////////////////////////////////////////
@@ -122,29 +136,26 @@ unique_ptr<Shader>	g_ShaderCamera;
 unique_ptr<Shader>  g_ShaderPostProcessing;
 unique_ptr<Shader>  g_ShaderRain;
 unique_ptr<Shader>  g_ShaderFXAA;
+unique_ptr<Shader>  g_ShaderUpscale;
 
 // FRAMEBUFFERS ////////////////////////////////////
-GLuint              FBO_REFLECTION		= 0;        // Used only for the ship reflection 
-GLuint              TexReflectionColor	= 0;		// Used by the ocean rendering
-GLuint              TexReflectionDepth	= 0;		// To be deleted?
+RenderGraph         g_RenderGraph;                  // Passes of the frame and their targets (reflection, scene, post processing, rain)
+DynamicResolution   g_DynamicResolution;            // Internal resolution of the reflection, the scene and the clouds
+GLuint              TexReflectionColor	= 0;		// Reflection of the ship, given by the render graph to the ocean rendering
 
-GLuint              msFBO_SCENE			= 0;        // Used to Draw the whole scene (including the ship reflection) - Multisample
-GLuint              msTexSceneColor		= 0;        // Multisample
-GLuint				msTexSceneDepth		= 0;        // Multisample
-
-GLuint              FBO_SCENE			= 0;        // Used to blit multisample for postprocessing
-GLuint              TexSceneColor		= 0;		// The scene on a texture
-GLuint              TexSceneDepth		= 0;
-
-GLuint              FBO_POST			= 0;		// Used to Draw the postprocessing (in: TexSceneColor, TexSceneDepth)
-GLuint              TexPostColor		= 0;
-GLuint              TexPostDepth		= 0;
+unique_ptr<ScreenQuad> g_ScreenQuadPost;
 
-GLuint              FBO_RAIN			= 0;		// Used to Draw the rain and/or the binoculars (in: TexPostColor)
-GLuint              TexRainColor		= 0;
-GLuint              TexRainDepth		= 0;
+// DYNAMIC BUFFERS ///////////////////////////////
+TransientBuffer		g_TransientBuffer;				// Per-frame uploads (instances, lines, wake)
+FrameUniforms		g_FrameUniforms;				// Camera, sun, exposure and fog shared by the shaders (block Frame)
 
-unique_ptr<ScreenQuad> g_ScreenQuadPost;
+// ASSETS ////////////////////////////////////////
+AssetLoader			g_AssetLoader;					// Files decoded by workers, GL uploads by the main thread
+const double		ASSETS_BUDGET_MS	= 8.0;		// Time given to the uploads per frame of the loading screen
+const double		STREAM_BUDGET_MS	= 2.0;		// Time given to the uploads per frame of the simulation
+Profiler			g_Profiler;						// Scopes of the main loop (CPU and GPU), window [F6]
+ShaderCache			g_ShaderCache;					// Binaries of the linked programs (Resources/Shaders/Cache)
+TextureCache		g_TextureCache;					// Textures shared by the models and the textures loaded from files (before their owners)
 
 // OBJECTS ///////////////////////////////////////
 bool				g_bWireframe		= false;   // For the entire scene
@@ -203,9 +214,25 @@ unique_ptr<QuadTexture> g_QuadTexture;					// For the rendering of the 2D textur
 
 // TERRAIN ///////////////////////////////////////
 bool                g_bShowTerrain			= false;
-vector<sTerrain>    g_vTerrains;
+TerrainManager      g_Terrains;							// Tiles streamed around the camera
+vec3                g_PierPosition			= vec3(0.0f);
 unique_ptr<Markup>  g_Markup;
 
+// BENCHMARKS ////////////////////////////////////
+const string		BENCH_FOLDER			= "Benchmarks/";	// Recorded data, baseline and results
+bool				g_bBenchRecord			= false;	// --bench-record : records the ocean for SimShipBench in a hidden window, then quit
+
+// HEADLESS //////////////////////////////////////
+bool				g_bHeadless				= false;	// --headless [scenario] : scripted run in a hidden window, then quit
+wstring				g_ScenarioPathname		= L"Resources/Scenarios/default.xml";
+string				g_HeadlessOutput		= "Outputs/headless.csv";	// --headless-output : times of the frames
+int					g_ContextApi			= GLFW_NATIVE_CONTEXT_API;	// --context osmesa|egl : software or surfaceless drivers
+Scenario			g_Scenario;
+int					g_HeadlessFrame			= 0;
+
+// RECORDING /////////////////////////////////////
+FrameRecorder		g_FrameRecorder;					// [ F9 ] Video of the window (Y4M)
+
 //////////////////////////////////////////////////
 vector<pair<string, string>> vShortcuts = {
 	{ "W", "Forward" },
@@ -237,6 +264,7 @@ vector<pair<string, string>> vShortcuts = {
 	{ "F4", "Status bar" },
 	{ "F5", "Autopilot settings" },
 	{ "F8", "Window capture" },
+	{ "F9", "Video recording" },
 	{ "F11", "Full screen" },
 };
 
@@ -248,8 +276,13 @@ void	InitFPSCounter();
 void	LoadPositions();
 void	LoadModels();
 void    LoadTerrains();
+void    WaitAssets();
 void    LoadShips();
 void    LoadSounds();
+void    RecordBenchmarks();
+void    StartHeadless();
+void    EndHeadlessFrame();
+void    SwitchRecording();
 void    UpdateSounds();
 void	UpdateFPS();
 void	Render();
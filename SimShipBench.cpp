@@ -0,0 +1,200 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+// Micro-benchmarks of the simulation kernels, without OpenGL nor window (console target, Windows or Linux)
+// The ocean is recorded once by SimShip --bench-record, the runs time the same data
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <filesystem>
+
+#include <igl/readOBJ.h>
+
+#include "Clock.h"
+#include "Benchmark.h"
+#include "WaveSpectra.h"
+#include "WaveField.h"
+#include "HullImmersion.h"
+
+using namespace std;
+using namespace glm;
+
+const string    BENCH_FOLDER    = "Benchmarks/";
+const float     GRAVITY         = 9.81f;
+const float     WATER_DENSITY   = 1027.f;   // SI = kg / m3
+
+struct sHull
+{
+    string  ShortName;
+    string  PathnameHull;
+};
+
+// Hulls of SimShip (LoadShips), the missing ones are skipped
+const vector<sHull> HULLS =
+{
+    { "Support vessel",         "Resources/Models/support_vessel/support_vessel_hull.obj" },
+    { "Grand Banks 43",         "Resources/Models/grand_banks/grand_banks_hull.obj" },
+    { "Trawler Doga",           "Resources/Models/doga/doga_hull_sharp6.obj" },
+    { "Trawler Boga",           "Resources/Models/boga/boga_hull.obj" },
+    { "Submarine Jang Bogo",    "Resources/Models/jang_bogo/jang_bogo_hull.obj" },
+    { "Gun Ship",               "Resources/Models/gun_ship/gun_ship_hull.obj" },
+    { "Cargo bulk carrier",     "Resources/Models/cargo/cargo_sharp6.obj" },
+    { "Frigate Type 054A",      "Resources/Models/frigate/frigate_hull.obj" },
+    { "Tanker Spyrosk",         "Resources/Models/spyrosk/spyrosk_sharp7.obj" },
+    { "Gas Carrier",            "Resources/Models/gas_carrier/gas_carrier_sharp7.obj" },
+};
+
+void BenchOcean(Benchmark& bench, const vector<float>& ocean, const vector<vector<float>>& snapshots, const vector<float>& buoy)
+{
+    const int FFT_SIZE = (int)ocean[0];
+    const int MESH_SIZE = (int)ocean[1];
+    const int PATCH_SIZE = (int)ocean[2];
+    const int LengthWave = (int)ocean[3];
+    WaveSpectra spectra(vec2(ocean[4], ocean[5]), ocean[7], ocean[6], MESH_SIZE);
+
+    // Spectra on the whole grid of wave numbers, as in Ocean::InitFrequencies
+    auto spectrum = [&](const string& name, float (WaveSpectra::*S)(vec2) const)
+    {
+        bench.Run("Ocean/Spectrum " + name, [&]
+        {
+            double sum = 0.0;
+            for (int m = 0; m <= FFT_SIZE; ++m)
+                for (int n = 0; n <= FFT_SIZE; ++n)
+                {
+                    vec2 k(2.0 * M_PI * (n - FFT_SIZE / 2) / LengthWave, 2.0 * M_PI * (m - FFT_SIZE / 2) / LengthWave);
+                    sum += (spectra.*S)(k);
+                }
+            Benchmark::Keep(sum);
+        });
+    };
+    spectrum("Phillips", &WaveSpectra::Phillips);
+    spectrum("JONSWAP", &WaveSpectra::JONSWAP);
+    spectrum("PiersonMoskowitz", &WaveSpectra::PiersonMoskowitz);
+    spectrum("DonelanBanner", &WaveSpectra::DonelanBanner);
+    spectrum("Elfouhaily", &WaveSpectra::Elfouhaily);
+    spectrum("TexelMarsenArsloe", &WaveSpectra::TexelMarsenArsloe);
+
+    // Heights under 10000 points spread on 2 km, as asked by the buoys
+    WaveField field;
+    auto load = [&](int i) { field = WaveField(snapshots[i % snapshots.size()].data(), FFT_SIZE, MESH_SIZE, PATCH_SIZE); };
+    mt19937 gen(1);
+    uniform_real_distribution<float> distrib(-1000.0f, 1000.0f);
+    vector<vec2> points(10000);
+    for (auto& p : points)
+        p = vec2(distrib(gen), distrib(gen));
+    vector<float> heights;
+    bench.Run("Ocean/GetHeights 10000", [&] { field.GetHeights(points, heights); }, load);
+
+    // Wave by wave analysis of the recorded series of the buoy (time, dx, dy, dz)
+    if (buoy.size() >= 4 * 3)
+    {
+        vector<WaveData> data(buoy.size() / 4);
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = { buoy[4 * i], buoy[4 * i + 1], buoy[4 * i + 2], buoy[4 * i + 3] };
+        float waves1_3, waveMax, period;
+        int nWaves;
+        bench.Run("Ocean/GetWaveByWaveAnalysis", [&] { WaveField::GetWaveByWaveAnalysis(data, waves1_3, waveMax, nWaves, period); });
+    }
+}
+
+void BenchHull(Benchmark& bench, const sHull& hull, const vector<float>& ocean, const vector<vector<float>>& snapshots)
+{
+    Eigen::MatrixXd V;
+    Eigen::MatrixXi F;
+    if (!igl::readOBJ(hull.PathnameHull, V, F) || V.rows() == 0)
+    {
+        cout << "Benchmark : no hull " << hull.PathnameHull << endl;
+        return;
+    }
+
+    // The ship at the origin, as in Ship::Init
+    const mat4 world = mat4(1.0f);
+    vector<vec3> vertices(V.rows());
+    vector<int> submerged(V.rows());
+    vector<float> waterHeight(V.rows());
+    vector<sTriangle> tris;
+    HullImmersion::TransformVertices(V, world, vertices);
+    HullImmersion::InitTriangles(F, vertices, tris);
+
+    WaveField field;
+    sForce archimede;
+    float areaWetted, lwl;
+
+    auto load = [&](int i) { field = WaveField(snapshots[i % snapshots.size()].data(), (int)ocean[0], (int)ocean[1], (int)ocean[2]); };
+    auto transformed = [&](int i)
+    {
+        load(i);
+        HullImmersion::TransformVertices(V, world, vertices);
+    };
+    auto heights = [&](int i)
+    {
+        transformed(i);
+        HullImmersion::GetHeightOfAllVertices(field, vertices, submerged, waterHeight);
+    };
+    auto immersed = [&](int i)
+    {
+        heights(i);
+        HullImmersion::GetTrisUnderWater(tris, submerged);
+    };
+
+    string name = "Ship/" + hull.ShortName + "/";
+    bench.Run(name + "TransformVertices", [&] { HullImmersion::TransformVertices(V, world, vertices); }, load);
+    bench.Run(name + "GetHeightFast (all vertices)", [&] { HullImmersion::GetHeightOfAllVertices(field, vertices, submerged, waterHeight); }, transformed);
+    bench.Run(name + "GetTrisUnderWater", [&] { HullImmersion::GetTrisUnderWater(tris, submerged); }, heights);
+    bench.Run(name + "ComputeArchimede", [&] { HullImmersion::ComputeArchimede(tris, vertices, waterHeight, WATER_DENSITY, GRAVITY, archimede, areaWetted, lwl); }, immersed);
+    bench.Run(name + "MeshPlaneIntersect", [&] { Benchmark::Keep((double)HullImmersion::ComputeContour(vertices, tris).size()); }, transformed);
+}
+
+// SimShipBench [--baseline] [--threshold %] [hull.obj ...]
+// Exit code 1 when a median is slower than the baseline, 2 when the ocean is not recorded
+int main(int argc, char** argv)
+{
+    bool bSaveBaseline = false;
+    float threshold = 10.0f;
+    vector<sHull> hulls = HULLS;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--baseline")                            bSaveBaseline = true;
+        else if (arg == "--threshold" && i + 1 < argc)      threshold = (float)atof(argv[++i]);
+        else                                                hulls.push_back({ filesystem::path(arg).stem().string(), arg });
+    }
+
+    Clock::Calibrate();
+
+    const int SNAPSHOTS = 8;
+    vector<float> ocean, buoy;
+    vector<vector<float>> snapshots(SNAPSHOTS);
+    bool bRecorded = Benchmark::LoadFloats(BENCH_FOLDER + "ocean.bin", ocean) && ocean.size() == 8 && Benchmark::LoadFloats(BENCH_FOLDER + "buoy.bin", buoy);
+    for (int i = 0; i < SNAPSHOTS && bRecorded; i++)
+        bRecorded = Benchmark::LoadFloats(BENCH_FOLDER + "ocean_" + to_string(i) + ".bin", snapshots[i]) && snapshots[i].size() == size_t(4 * ocean[0] * ocean[0]);
+    if (!bRecorded)
+    {
+        cerr << "Benchmark : no ocean in " << BENCH_FOLDER << ", record it with SimShip --bench-record" << endl;
+        return 2;
+    }
+
+    Benchmark bench;
+    bench.Threshold = threshold / 100.0f;
+    if (!bench.LoadBaseline(BENCH_FOLDER + "baseline.json"))
+        cout << "Benchmark : no baseline in " << BENCH_FOLDER << endl;
+    cout << "Benchmark : " << bench.Warmup << " warm-up, " << bench.Repetitions << " repetitions, clock " << (Clock::IsTsc() ? "TSC" : "steady") << endl;
+
+    BenchOcean(bench, ocean, snapshots, buoy);
+    for (auto& hull : hulls)
+        BenchHull(bench, hull, ocean, snapshots);
+
+    if (!bench.Save(BENCH_FOLDER + "results.json"))
+        cerr << "Benchmark : cannot write " << BENCH_FOLDER << "results.json" << endl;
+    if (bSaveBaseline && bench.Save(BENCH_FOLDER + "baseline.json"))
+        cout << "Benchmark : baseline saved" << endl;
+
+    int regressions = bench.GetRegressions();
+    cout << "Benchmark : " << bench.GetResults().size() << " kernels, " << regressions << " regression(s) above " << threshold << " %" << endl;
+    return regressions > 0 ? 1 : 0;
+}
@@ -402,8 +402,8 @@ void Sky::Render(Camera& camera)
     glDisable(GL_CULL_FACE); // Disables face rendering choice
 
     mShader->use();     // Sky/sky.vert Sky/sky.frag
-    glUniformMatrix4fv(glGetUniformLocation(mShader->ID, "screenToCamera"), 1, true, proj.inverse().coefficients());
-    glUniformMatrix4fv(glGetUniformLocation(mShader->ID, "cameraToWorld"), 1, true, view.inverse().coefficients());
+    glUniformMatrix4fv(mShader->getLocation("screenToCamera"), 1, true, proj.inverse().coefficients());
+    glUniformMatrix4fv(mShader->getLocation("cameraToWorld"), 1, true, view.inverse().coefficients());
 
     mShader->setVec3("worldCamera", 0.0f, 0.0f, 3.5f);
     mShader->setVec3("worldSunDir", SunDirectionEB);
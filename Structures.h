@@ -131,21 +131,6 @@ struct sShip
 	// Waves
 	float		CenterFore		= 0.0f;
 };
-struct sTerrain
-{
-	string	file;
-	float	xMin			= 0.0f;
-	float	xMax			= 0.0f;
-	float	zMin			= 0.0f;
-	float	zMax			= 0.0f;
-	vec2	center			= vec2(0.0f);
-	float	widthMeters		= 0.0f;
-	float	heightMeters	= 0.0f;
-	int		zoom			= 14;
-	unique_ptr<Model> model;
-	vec3	pos				= vec3(0.0f);
-	vec3	scale			= vec3(1.0f);
-};
 struct sPositions 
 {
 	string	name;
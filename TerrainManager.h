@@ -0,0 +1,347 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#define NOMINMAX
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <filesystem>
+#include <algorithm>
+#include <iomanip>
+#include <cfloat>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Model.h"
+#include "Shader.h"
+#include "AssetLoader.h"
+#include "Utility.h"
+
+using namespace std;
+using namespace glm;
+
+
+// Terrain tiles: OBJ whose header of comments gives the centre and the corners in lon/lat
+// The bounds of the tiles of a folder are indexed once in a catalogue (rebuilt when an OBJ changes),
+// the tiles are streamed in and out around the camera, drawn with a LOD by distance and culled by the frustum
+class TerrainManager
+{
+public:
+	static const int	LODS				= 3;
+
+	bool				bVisible			= true;
+	float				LoadDistance		= 20000.0f;					// m, from the camera to the bounds of the tile
+	float				UnloadDistance		= 25000.0f;
+	float				LodDistance[LODS - 1] = { 3000.0f, 8000.0f };
+	float				LodCell[LODS - 1]	= { 10.0f, 40.0f };			// m, vertex clustering of the simplified LODs
+	int					MaxLoads			= 2;						// Tiles decoded at the same time
+
+	~TerrainManager()
+	{
+		Release();
+	}
+
+	// Must be called while the context is alive
+	void Release()
+	{
+		for (auto& tile : mvTiles)
+			if (tile->state == LOADED)
+				Unload(*tile);
+	}
+
+	void AddFolder(const string& folder)
+	{
+		string catalogue = folder + "terrains.catalogue";
+		vector<string> files = ListFiles(folder, ".obj");
+		size_t first = mvTiles.size();
+
+		if (!ReadCatalogue(catalogue, files))
+		{
+			mvTiles.resize(first);
+			for (auto& file : files)
+			{
+				auto tile = make_unique<sTile>();
+				tile->file = file;
+				IndexTile(*tile);
+				mvTiles.push_back(move(tile));
+			}
+			WriteCatalogue(catalogue, first);
+			cout << "Terrains: " << files.size() << " tiles indexed in " << catalogue << endl;
+		}
+
+		for (size_t t = first; t < mvTiles.size(); t++)
+		{
+			sTile& tile = *mvTiles[t];
+			vec2 p = LonLatToOpenGL(tile.center.x, tile.center.y);
+			tile.pos = vec3(p.x, 0.0f, p.y);
+		}
+	}
+
+	// Loads the tiles coming within LoadDistance (the nearest first), unloads the ones beyond UnloadDistance
+	// bAll: no limit of simultaneous loads (loading screen)
+	void Update(const vec3& camera, AssetLoader& loader, bool bAll = false)
+	{
+		vector<pair<float, sTile*>> candidates;
+		int loading = 0;
+		for (auto& tile : mvTiles)
+		{
+			float d = Distance(*tile, camera);
+			if (tile->state == LOADING)
+				loading++;
+			else if (tile->state == LOADED && d > UnloadDistance)
+				Unload(*tile);
+			else if (tile->state == UNLOADED && d < LoadDistance)
+				candidates.push_back({ d, tile.get() });
+		}
+
+		sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		for (auto& candidate : candidates)
+		{
+			if (!bAll && loading >= MaxLoads)
+				break;
+			Load(*candidate.second, loader);
+			loading++;
+		}
+	}
+
+	void Render(Shader& shader, const mat4& viewProj, const vec3& camera)
+	{
+		mDrawn = 0;
+		if (!bVisible)
+			return;
+
+		for (auto& tile : mvTiles)
+		{
+			if (tile->state != LOADED || !IsBoxInFrustum(viewProj, tile->pos + tile->bbMin, tile->pos + tile->bbMax))
+				continue;
+
+			int lod = 0;
+			float d = Distance(*tile, camera);
+			while (lod < LODS - 1 && d > LodDistance[lod])
+				lod++;
+
+			shader.setMat4("model", glm::translate(mat4(1.0f), tile->pos));
+			if (lod == 0)
+				tile->model->Render(shader);
+			else
+				for (auto& mesh : tile->lods[lod - 1])
+					mesh.Draw(shader);
+			mDrawn++;
+		}
+	}
+
+	// Position of the tile of a file (its vertices are relative to it), 0 if unknown
+	vec3 GetPosition(const string& name) const
+	{
+		for (auto& tile : mvTiles)
+			if (filesystem::path(tile->file).filename() == name)
+				return tile->pos;
+		return vec3(0.0f);
+	}
+
+	int		GetCount()	const { return (int)mvTiles.size(); }
+	int		GetDrawn()	const { return mDrawn; }
+	int		GetLoaded() const
+	{
+		return (int)count_if(mvTiles.begin(), mvTiles.end(), [](const unique_ptr<sTile>& tile) { return tile->state == LOADED; });
+	}
+
+private:
+	enum eState { UNLOADED, LOADING, LOADED };
+
+	struct sTile
+	{
+		string				file;
+		vec2				center		= vec2(0.0f);			// lon, lat
+		vec2				cornerNW	= vec2(0.0f);
+		vec2				cornerSE	= vec2(0.0f);
+		vec3				bbMin		= vec3(0.0f);			// Bounds of the vertices, relative to pos
+		vec3				bbMax		= vec3(0.0f);
+		vec3				pos			= vec3(0.0f);
+
+		eState				state		= UNLOADED;
+		unique_ptr<Model>	model;
+		vector<Mesh>		lods[LODS - 1];
+	};
+
+	static float Distance(const sTile& tile, const vec3& camera)
+	{
+		vec3 p = glm::clamp(camera, tile.pos + tile.bbMin, tile.pos + tile.bbMax);
+		return length(p - camera);
+	}
+
+	void Load(sTile& tile, AssetLoader& loader)
+	{
+		tile.state = LOADING;
+		sTile* pTile = &tile;
+		tile.model = make_unique<Model>(tile.file, loader, false,
+			[this, pTile](Model& model)
+			{
+				// Worker: simplified copies of the meshes
+				for (int lod = 0; lod < LODS - 1; lod++)
+					for (auto& mesh : model.meshes)
+						pTile->lods[lod].push_back(Simplify(mesh, LodCell[lod]));
+			},
+			[pTile](Model& model)
+			{
+				// The textures are known once the model is uploaded
+				for (int lod = 0; lod < LODS - 1; lod++)
+					for (size_t m = 0; m < pTile->lods[lod].size(); m++)
+					{
+						pTile->lods[lod][m].textures = model.meshes[m].textures;
+						pTile->lods[lod][m].Upload();
+					}
+				pTile->state = LOADED;
+			});
+	}
+
+	void Unload(sTile& tile)
+	{
+		for (int lod = 0; lod < LODS - 1; lod++)
+		{
+			for (auto& mesh : tile.lods[lod])
+				mesh.Release();
+			tile.lods[lod].clear();
+		}
+		tile.model->Release();
+		tile.model.reset();
+		tile.state = UNLOADED;
+	}
+
+	// Vertex clustering: the vertices of a cell are merged (mean position), the degenerated triangles are dropped
+	static Mesh Simplify(const Mesh& mesh, float cell)
+	{
+		unordered_map<int64_t, unsigned int> cells;
+		vector<Vertex> vertices;
+		vector<int> counts;
+		vector<unsigned int> remap(mesh.vertices.size());
+		for (size_t i = 0; i < mesh.vertices.size(); i++)
+		{
+			const Vertex& v = mesh.vertices[i];
+			ivec3 c = ivec3(glm::floor(v.Position / cell));
+			int64_t key = (int64_t(c.x & 0x1FFFFF) << 42) | (int64_t(c.y & 0x1FFFFF) << 21) | int64_t(c.z & 0x1FFFFF);
+			auto it = cells.find(key);
+			if (it == cells.end())
+			{
+				it = cells.insert({ key, (unsigned int)vertices.size() }).first;
+				vertices.push_back(v);
+				counts.push_back(1);
+			}
+			else
+			{
+				vertices[it->second].Position += v.Position;
+				counts[it->second]++;
+			}
+			remap[i] = it->second;
+		}
+		for (size_t i = 0; i < vertices.size(); i++)
+			vertices[i].Position /= float(counts[i]);
+
+		vector<unsigned int> indices;
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			unsigned int a = remap[mesh.indices[i]], b = remap[mesh.indices[i + 1]], c = remap[mesh.indices[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			indices.insert(indices.end(), { a, b, c });
+		}
+		return Mesh(vertices, indices, mesh.textures, mesh.material, false);
+	}
+
+	// The header (comments) gives the position, the vertices give the bounds: read once for the catalogue
+	static void IndexTile(sTile& tile)
+	{
+		ifstream file(tile.file);
+		string line;
+		vec3 bbMin(FLT_MAX), bbMax(-FLT_MAX);
+		while (getline(file, line))
+		{
+			if (line.size() > 2 && line[0] == 'v' && line[1] == ' ')
+			{
+				vec3 v;
+				if (sscanf_s(line.c_str() + 2, "%f %f %f", &v.x, &v.y, &v.z) == 3)
+				{
+					bbMin = glm::min(bbMin, v);
+					bbMax = glm::max(bbMax, v);
+				}
+			}
+			else if (line.size() && line[0] == '#')
+			{
+				istringstream iss(line.substr(1));
+				string token;
+				iss >> token;
+				if (token == "Centre")
+					iss >> tile.center.x >> tile.center.y;
+				else if (token == "Corner")
+				{
+					iss >> token;
+					if (token == "NW")
+						iss >> tile.cornerNW.x >> tile.cornerNW.y;
+					else if (token == "SE")
+						iss >> tile.cornerSE.x >> tile.cornerSE.y;
+				}
+			}
+		}
+		if (bbMin.x > bbMax.x)
+			bbMin = bbMax = vec3(0.0f);
+		tile.bbMin = bbMin;
+		tile.bbMax = bbMax;
+	}
+
+	// One line per tile: centre, corners, bounds, file. False if missing or older than one of the files
+	bool ReadCatalogue(const string& catalogue, const vector<string>& files)
+	{
+		error_code ec;
+		auto time = filesystem::last_write_time(catalogue, ec);
+		if (ec)
+			return false;
+		for (auto& file : files)
+			if (filesystem::last_write_time(file, ec) > time || ec)
+				return false;
+
+		ifstream in(catalogue);
+		size_t count = 0;
+		string line;
+		while (getline(in, line))
+		{
+			istringstream iss(line);
+			auto tile = make_unique<sTile>();
+			iss >> tile->center.x >> tile->center.y >> tile->cornerNW.x >> tile->cornerNW.y >> tile->cornerSE.x >> tile->cornerSE.y;
+			iss >> tile->bbMin.x >> tile->bbMin.y >> tile->bbMin.z >> tile->bbMax.x >> tile->bbMax.y >> tile->bbMax.z;
+			iss >> ws;
+			getline(iss, tile->file);
+			if (iss.fail() || find(files.begin(), files.end(), tile->file) == files.end())
+				return false;
+			mvTiles.push_back(move(tile));
+			count++;
+		}
+		return count == files.size();
+	}
+
+	void WriteCatalogue(const string& catalogue, size_t first)
+	{
+		ofstream out(catalogue);
+		if (!out)
+			return;
+		out << setprecision(9);
+		for (size_t t = first; t < mvTiles.size(); t++)
+		{
+			const sTile& tile = *mvTiles[t];
+			out << tile.center.x << ' ' << tile.center.y << ' ' << tile.cornerNW.x << ' ' << tile.cornerNW.y << ' ' << tile.cornerSE.x << ' ' << tile.cornerSE.y << ' ';
+			out << tile.bbMin.x << ' ' << tile.bbMin.y << ' ' << tile.bbMin.z << ' ' << tile.bbMax.x << ' ' << tile.bbMax.y << ' ' << tile.bbMax.z << ' ';
+			out << tile.file << '\n';
+		}
+	}
+
+	vector<unique_ptr<sTile>>	mvTiles;				// Stable addresses for the jobs of the loader
+	int							mDrawn		= 0;
+};
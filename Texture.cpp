@@ -3,6 +3,7 @@ This work is licensed under a Creative Commons Attribution-NonCommercial-NoDeriv
 http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 
 #include "Texture.h"
+#include "TextureCache.h"
 
 #include <iostream>
 
@@ -29,7 +30,10 @@ Texture::Texture(unsigned int width_, unsigned int height_, GLint internal_forma
 }
 Texture::~Texture()
 {
-    glDeleteTextures(1, &id);
+    if (!cacheKey.empty())
+        g_TextureCache.Release(cacheKey);
+    else
+        glDeleteTextures(1, &id);
 }
 void Texture::Init(unsigned int width_, unsigned int height_, GLint internal_format_, GLenum format, GLenum type, GLint min_filter, GLint max_filter, GLint wrap_r, GLint wrap_s, const GLvoid* data)
 {
@@ -53,138 +57,31 @@ void Texture::Init(unsigned int width_, unsigned int height_, GLint internal_for
 
 void Texture::CreateFromFile(const char* path, bool flip_vertically)
 {
-    stbi_set_flip_vertically_on_load(flip_vertically);
-
-    int width, height, channel_count;
-    stbi_uc* data = stbi_load(path, &width, &height, &channel_count, 0);
-
-    if (data)
-    {
-        GLint internal_format(-1);
-        GLenum format(-1);
-
-        switch (channel_count)
-        {
-            case 1:
-            {
-                internal_format = GL_R8;
-                format = GL_RED;
-            } 
-            break;
-
-            case 3:
-            {
-                internal_format = GL_RGB8;
-                format = GL_RGB;
-            } 
-            break;
-
-            case 4:
-            {
-                internal_format = GL_RGBA8;
-                format = GL_RGBA;
-            } 
-            break;
-
-            default:
-            {
-                cout << "File format not supported yet!" << endl;
-            } 
-            break;
-        }
-
-        Init(width, height, internal_format, format, GL_UNSIGNED_BYTE, GL_NEAREST, GL_NEAREST, GL_REPEAT, GL_REPEAT, data);
-    }
-    else
-    {
-        cout << "Failed to load image at path: " << path << endl;
-    }
-
-    stbi_image_free(data);
-    stbi_set_flip_vertically_on_load(false);
+    // Shared with the other loads of the same file
+    cacheKey = g_TextureCache.Acquire(path, flip_vertically ? TextureCache::IMAGE_FLIPPED : TextureCache::IMAGE);
+    const TextureCache::sInfo& info = g_TextureCache.Get(cacheKey);
+    if (!info.id)
+        return;
 
+    id = info.id;
+    width = info.width;
+    height = info.height;
+    internal_format = info.internalFormat;
 }
 void Texture::CreateFromDDSFile(const char* path)
 {
-    gli::texture texture = gli::load(path);
-    if (texture.empty())
-    {
-        std::cerr << "Erreur : Impossible de charger la texture DDS " << path << std::endl;
+    // Shared with the other loads of the same file
+    cacheKey = g_TextureCache.Acquire(path, TextureCache::DDS);
+    const TextureCache::sInfo& info = g_TextureCache.Get(cacheKey);
+    if (!info.id)
         return;
-    }
-
-    gli::gl gl(gli::gl::PROFILE_GL33);
-    gli::gl::format const format = gl.translate(texture.format(), texture.swizzles());
-    GLenum target = gl.translate(texture.target());
-
-    glGenTextures(1, &id);
-    glBindTexture(target, id);
-
-    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
-    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levels() - 1));
-    glTexParameteri(target, GL_TEXTURE_SWIZZLE_R, format.Swizzles[0]);
-    glTexParameteri(target, GL_TEXTURE_SWIZZLE_G, format.Swizzles[1]);
-    glTexParameteri(target, GL_TEXTURE_SWIZZLE_B, format.Swizzles[2]);
-    glTexParameteri(target, GL_TEXTURE_SWIZZLE_A, format.Swizzles[3]);
 
-    glm::tvec3<GLsizei> const extent(texture.extent());
-    GLsizei const face_total = static_cast<GLsizei>(texture.layers() * texture.faces());
-
-    switch (texture.target())
-    {
-    case gli::TARGET_2D:
-        glTexStorage2D(target, static_cast<GLint>(texture.levels()), format.Internal, extent.x, extent.y);
-        break;
-    case gli::TARGET_3D:
-        glTexStorage3D(target, static_cast<GLint>(texture.levels()), format.Internal, extent.x, extent.y, extent.z);
-        break;
-    case gli::TARGET_CUBE:
-        glTexStorage2D(target, static_cast<GLint>(texture.levels()), format.Internal, extent.x, extent.y);
-        break;
-    default:
-        assert(0);
-        break;
-    }
-
-    for (std::size_t layer = 0; layer < texture.layers(); ++layer)
-    {
-        for (std::size_t face = 0; face < texture.faces(); ++face)
-        {
-            for (std::size_t level = 0; level < texture.levels(); ++level)
-            {
-                GLsizei const layer_gl = static_cast<GLsizei>(layer);
-                glm::tvec3<GLsizei> extent(texture.extent(level));
-                GLenum target_face = gli::is_target_cube(texture.target()) ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) : target;
-
-                switch (texture.target())
-                {
-                case gli::TARGET_2D:
-                case gli::TARGET_CUBE:
-                {
-                    if (gli::is_compressed(texture.format()))
-                        glCompressedTexSubImage2D(target_face, static_cast<GLint>(level), 0, 0, extent.x, extent.y, format.Internal, static_cast<GLsizei>(texture.size(level)), texture.data(layer, face, level));
-                    else
-                        glTexSubImage2D(target_face, static_cast<GLint>(level), 0, 0, extent.x, extent.y, format.External, format.Type, texture.data(layer, face, level));
-                }
-                break;
-                case gli::TARGET_3D:
-                {
-                    if (gli::is_compressed(texture.format()))
-                        glCompressedTexSubImage3D(target, static_cast<GLint>(level), 0, 0, 0, extent.x, extent.y, extent.z, format.Internal, static_cast<GLsizei>(texture.size(level)), texture.data(layer, face, level));
-                    else
-                        glTexSubImage3D(target, static_cast<GLint>(level), 0, 0, 0, extent.x, extent.y, extent.z, format.External, format.Type, texture.data(layer, face, level));
-                }
-                break;
-                default: assert(0); break;
-                }
-            }
-        }
-    }
-    width = extent.x;
-    height = extent.y;
-    depth = (texture.target() == gli::TARGET_3D) ? extent.z : 1;
-    internal_format = format.Internal;
-    is_cubemap = (texture.target() == gli::TARGET_CUBE);
+    id = info.id;
+    width = info.width;
+    height = info.height;
+    depth = info.depth;
+    internal_format = info.internalFormat;
+    is_cubemap = info.bCubemap;
 }
 void Texture::SetWrappingParams(GLint wrap_r, GLint wrap_s)
 {
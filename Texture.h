@@ -6,6 +6,7 @@ http://creativecommons.org/licenses/by-nc-nd/4.0/ */
 
 #define NOMINMAX
 #include <vector>
+#include <string>
 
 #include <glad/glad.h>
 #include <gli/gli/gli.hpp>
@@ -45,6 +46,7 @@ struct Texture
 
     int             depth = 0;  // texture 3D from dds
     bool            is_cubemap = false;
+    string          cacheKey;   // files shared through g_TextureCache
 };
 
 void SaveTexture2D(GLuint texture, int width, int height, int channels, int format, string name);
@@ -0,0 +1,370 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#define NOMINMAX
+#include <iostream>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <thread>
+#include <sstream>
+
+#include <glad/glad.h>
+#include <gli/gli/gli.hpp>
+#include <stb/stb_image.h>
+
+#include "BCEncoder.h"
+
+using namespace std;
+
+
+// Textures shared by all the loads of the same file (Model, Texture, Markup), reference counted
+// The pixels are decoded once by the first thread asking for them (workers of the loader included), the GL objects are created by the GL thread
+// The GL parameters of a shared texture are seen by all its users
+// PNG/JPG are converted once to a compressed DDS with mips next to the file ("foam.png" -> "foam.png.dds"), loaded instead while it is up to date
+class TextureCache
+{
+public:
+	bool	bCompress	= true;				// Without it, the images are uploaded uncompressed as before
+
+	enum eKind
+	{
+		MATERIAL = 0,			// Model: unsized format, mips, repeat
+		IMAGE,					// Texture::CreateFromFile: sized format, nearest, no mips
+		IMAGE_FLIPPED,
+		DDS						// Texture::CreateFromDDSFile
+	};
+
+	struct sInfo
+	{
+		GLuint	id				= 0;
+		int		width			= 0;
+		int		height			= 0;
+		int		depth			= 1;
+		GLint	internalFormat	= 0;
+		bool	bCubemap		= false;
+	};
+
+	// Any thread: one more reference, the file is decoded the first time. Returns the key for Get and Release
+	string Acquire(const string& pathname, eKind kind)
+	{
+		string key = MakeKey(pathname, kind);
+		shared_ptr<sEntry> entry;
+		{
+			lock_guard<mutex> lock(mMutex);
+			auto& slot = mEntries[key];
+			if (slot)
+			{
+				slot->refs++;
+				mHits++;
+				return key;
+			}
+			slot = make_shared<sEntry>();
+			slot->pathname = pathname;
+			slot->kind = kind;
+			slot->refs = 1;
+			entry = slot;
+		}
+
+		Decode(*entry);
+		{
+			lock_guard<mutex> lock(mMutex);
+			entry->bDecoded = true;
+		}
+		mCondition.notify_all();
+		return key;
+	}
+
+	// GL thread: the texture of a key, created at the first call (waits if another thread is still decoding it)
+	const sInfo& Get(const string& key)
+	{
+		static const sInfo none;
+		shared_ptr<sEntry> entry;
+		{
+			unique_lock<mutex> lock(mMutex);
+			auto it = mEntries.find(key);
+			if (it == mEntries.end())
+				return none;
+			entry = it->second;
+			mCondition.wait(lock, [&entry] { return entry->bDecoded; });
+		}
+		if (!entry->info.id)
+			Upload(*entry);
+		return entry->info;
+	}
+
+	// GL thread: the texture is deleted with its last reference
+	void Release(const string& key)
+	{
+		shared_ptr<sEntry> entry;
+		{
+			lock_guard<mutex> lock(mMutex);
+			auto it = mEntries.find(key);
+			if (it == mEntries.end() || --it->second->refs > 0)
+				return;
+			entry = it->second;
+			mEntries.erase(it);
+		}
+		if (entry->info.id)
+			glDeleteTextures(1, &entry->info.id);
+		mBytes -= entry->bytes;
+		FreePixels(*entry);
+	}
+
+	int		GetCount()	{ lock_guard<mutex> lock(mMutex); return (int)mEntries.size(); }
+	int		GetHits()	const { return mHits; }						// Loads served without decoding
+	size_t	GetBytes()	const { return mBytes; }					// Estimated GPU memory
+
+private:
+	struct sEntry
+	{
+		string			pathname;
+		eKind			kind			= MATERIAL;
+		int				refs			= 0;
+		bool			bDecoded		= false;
+		sInfo			info;
+		size_t			bytes			= 0;
+
+		// Decoded, freed after the upload
+		unsigned char*	pixels			= nullptr;
+		int				components		= 0;
+		gli::texture	dds;
+	};
+
+	static string MakeKey(const string& pathname, eKind kind)
+	{
+		string key = pathname;
+		replace(key.begin(), key.end(), '\\', '/');
+		transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)tolower(c); });	// Windows paths
+		return key + '#' + to_string((int)kind);
+	}
+
+	// No GL call, no change of the stb_image flip flag (global for the GL thread)
+	void Decode(sEntry& entry)
+	{
+		if (entry.kind == DDS)
+		{
+			entry.dds = gli::load(entry.pathname);
+			if (entry.dds.empty())
+				cerr << "Erreur : Impossible de charger la texture DDS " << entry.pathname << endl;
+			return;
+		}
+
+		string compressed = entry.pathname + (entry.kind == IMAGE_FLIPPED ? ".flip.dds" : ".dds");
+		if (bCompress && IsUpToDate(compressed, entry.pathname))
+		{
+			entry.dds = gli::load(compressed);
+			if (!entry.dds.empty())
+				return;
+		}
+
+		int w, h, n;
+		entry.pixels = stbi_load(entry.pathname.c_str(), &w, &h, &n, 0);
+		if (!entry.pixels)
+		{
+			cout << "Texture failed to load at path: " << entry.pathname << endl;
+			return;
+		}
+		entry.info.width = w;
+		entry.info.height = h;
+		entry.components = n;
+
+		if (entry.kind == IMAGE_FLIPPED)
+		{
+			int stride = w * n;
+			for (int y = 0; y < h / 2; y++)
+				swap_ranges(entry.pixels + y * stride, entry.pixels + (y + 1) * stride, entry.pixels + (h - 1 - y) * stride);
+		}
+
+		if (bCompress)
+		{
+			entry.dds = BCEncoder::Compress(entry.pixels, w, h, n);
+			Save(entry.dds, compressed);
+			stbi_image_free(entry.pixels);
+			entry.pixels = nullptr;
+		}
+	}
+
+	static bool IsUpToDate(const string& compressed, const string& source)
+	{
+		error_code ec;
+		auto time = filesystem::last_write_time(compressed, ec);
+		if (ec)
+			return false;
+		auto timeSource = filesystem::last_write_time(source, ec);
+		return ec || time >= timeSource;
+	}
+
+	// Written under a temporary name: two loads of the same file may convert it at the same time
+	static void Save(const gli::texture& texture, const string& pathname)
+	{
+		ostringstream tmp;
+		tmp << pathname << '.' << this_thread::get_id() << ".tmp";
+		error_code ec;
+		bool bOk = gli::save_dds(texture, tmp.str());
+		if (bOk)
+		{
+			filesystem::rename(tmp.str(), pathname, ec);
+			bOk = !ec;
+		}
+		if (!bOk)
+		{
+			cout << "Unable to write " << pathname << endl;
+			filesystem::remove(tmp.str(), ec);
+		}
+	}
+
+	void FreePixels(sEntry& entry)
+	{
+		if (entry.pixels)
+			stbi_image_free(entry.pixels);
+		entry.pixels = nullptr;
+		entry.dds = gli::texture();
+	}
+
+	void Upload(sEntry& entry)
+	{
+		if (entry.kind == DDS)
+			UploadDDS(entry);
+		else if (!entry.dds.empty())
+		{
+			// Converted image: trilinear with its mips
+			UploadDDS(entry);
+			glTextureParameteri(entry.info.id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTextureParameteri(entry.info.id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTextureParameteri(entry.info.id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTextureParameteri(entry.info.id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
+		else if (entry.pixels)
+			UploadImage(entry);
+		mBytes += entry.bytes;
+		FreePixels(entry);
+	}
+
+	void UploadImage(sEntry& entry)
+	{
+		int w = entry.info.width;
+		int h = entry.info.height;
+		int n = entry.components;
+		GLenum format = n == 1 ? GL_RED : n == 2 ? GL_RG : n == 3 ? GL_RGB : GL_RGBA;
+
+		if (entry.kind != MATERIAL)
+			glActiveTexture(GL_TEXTURE0);
+		glGenTextures(1, &entry.info.id);
+		glBindTexture(GL_TEXTURE_2D, entry.info.id);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Essential addition for RGB textures
+
+		if (entry.kind == MATERIAL)
+		{
+			glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE, entry.pixels);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			entry.info.internalFormat = format;
+			entry.bytes = size_t(w) * h * n * 4 / 3;
+		}
+		else
+		{
+			GLint internalFormat = n == 1 ? GL_R8 : n == 2 ? GL_RG8 : n == 3 ? GL_RGB8 : GL_RGBA8;
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_UNSIGNED_BYTE, entry.pixels);
+			entry.info.internalFormat = internalFormat;
+			entry.bytes = size_t(w) * h * n;
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void UploadDDS(sEntry& entry)
+	{
+		gli::texture& texture = entry.dds;
+		if (texture.empty())
+			return;
+
+		gli::gl gl(gli::gl::PROFILE_GL33);
+		gli::gl::format const format = gl.translate(texture.format(), texture.swizzles());
+		GLenum target = gl.translate(texture.target());
+
+		glGenTextures(1, &entry.info.id);
+		glBindTexture(target, entry.info.id);
+
+		glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levels() - 1));
+		glTexParameteri(target, GL_TEXTURE_SWIZZLE_R, format.Swizzles[0]);
+		glTexParameteri(target, GL_TEXTURE_SWIZZLE_G, format.Swizzles[1]);
+		glTexParameteri(target, GL_TEXTURE_SWIZZLE_B, format.Swizzles[2]);
+		glTexParameteri(target, GL_TEXTURE_SWIZZLE_A, format.Swizzles[3]);
+
+		glm::tvec3<GLsizei> const extent(texture.extent());
+
+		switch (texture.target())
+		{
+		case gli::TARGET_2D:
+		case gli::TARGET_CUBE:
+			glTexStorage2D(target, static_cast<GLint>(texture.levels()), format.Internal, extent.x, extent.y);
+			break;
+		case gli::TARGET_3D:
+			glTexStorage3D(target, static_cast<GLint>(texture.levels()), format.Internal, extent.x, extent.y, extent.z);
+			break;
+		default:
+			cerr << "Unsupported DDS target: " << entry.pathname << endl;
+			return;
+		}
+
+		for (size_t layer = 0; layer < texture.layers(); ++layer)
+		{
+			for (size_t face = 0; face < texture.faces(); ++face)
+			{
+				for (size_t level = 0; level < texture.levels(); ++level)
+				{
+					glm::tvec3<GLsizei> extent(texture.extent(level));
+					GLenum target_face = gli::is_target_cube(texture.target()) ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) : target;
+
+					if (texture.target() == gli::TARGET_3D)
+					{
+						if (gli::is_compressed(texture.format()))
+							glCompressedTexSubImage3D(target, static_cast<GLint>(level), 0, 0, 0, extent.x, extent.y, extent.z, format.Internal, static_cast<GLsizei>(texture.size(level)), texture.data(layer, face, level));
+						else
+							glTexSubImage3D(target, static_cast<GLint>(level), 0, 0, 0, extent.x, extent.y, extent.z, format.External, format.Type, texture.data(layer, face, level));
+					}
+					else
+					{
+						if (gli::is_compressed(texture.format()))
+							glCompressedTexSubImage2D(target_face, static_cast<GLint>(level), 0, 0, extent.x, extent.y, format.Internal, static_cast<GLsizei>(texture.size(level)), texture.data(layer, face, level));
+						else
+							glTexSubImage2D(target_face, static_cast<GLint>(level), 0, 0, extent.x, extent.y, format.External, format.Type, texture.data(layer, face, level));
+					}
+				}
+			}
+		}
+		glBindTexture(target, 0);
+
+		entry.info.width = extent.x;
+		entry.info.height = extent.y;
+		entry.info.depth = (texture.target() == gli::TARGET_3D) ? extent.z : 1;
+		entry.info.internalFormat = format.Internal;
+		entry.info.bCubemap = (texture.target() == gli::TARGET_CUBE);
+		entry.bytes = texture.size();
+	}
+
+	unordered_map<string, shared_ptr<sEntry>>	mEntries;
+	mutex										mMutex;
+	condition_variable							mCondition;
+	atomic<int>									mHits{ 0 };
+	size_t										mBytes		= 0;
+};
+
+extern TextureCache g_TextureCache;
@@ -9,9 +9,8 @@
 
 namespace eh
 {
-    Timer::Timer() : mRunning(false), mAccumulatedTime(0)
+    Timer::Timer() : mRunning(false), mAccumulatedTime(0), mStartTime(0)
     {
-        QueryPerformanceFrequency(&mFrequency);
     }
     //===========================================================================
     // Init a timer.  If it is already running, let it continue running.
@@ -36,7 +35,7 @@ namespace eh
         // Set timer status to running and set the start time
         mRunning = true;
 
-        QueryPerformanceCounter(&mStartTime);
+        mStartTime = Clock::Ticks();
     }
 
     //===========================================================================
@@ -47,7 +46,7 @@ namespace eh
         mRunning = true;
         mAccumulatedTime = 0;
 
-        QueryPerformanceCounter(&mStartTime);
+        mStartTime = Clock::Ticks();
     }
 
     //===========================================================================
@@ -76,10 +75,7 @@ namespace eh
     // used is reported instead of the elapsed time.
     double Timer::getElapsedTime() const
     {
-        LARGE_INTEGER currentTime;
-        QueryPerformanceCounter(&currentTime);
-
-        return (currentTime.QuadPart - mStartTime.QuadPart) / double(mFrequency.QuadPart);
+        return Clock::ToSeconds(Clock::Ticks() - mStartTime);
     }
 
     //===========================================================================
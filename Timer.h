@@ -7,7 +7,7 @@
 
 #include <iomanip>
 #include <iostream>
-#include <Windows.h>
+#include "Clock.h"
 
 namespace eh
 {
@@ -52,8 +52,7 @@ namespace eh
 		bool     mRunning;
 		double   mAccumulatedTime; ///> Accumulated time in seconds
 
-		LARGE_INTEGER  mFrequency;
-		LARGE_INTEGER  mStartTime;    ///< Start time of the timer.
+		uint64_t mStartTime;    ///< Start time of the timer, in ticks of Clock.
 	};
 
 	class DelayTimer : private Timer
@@ -0,0 +1,172 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+using namespace std;
+
+
+struct sTransientAlloc
+{
+	GLuint		buffer	= 0;		// Buffer to bind (GL_ARRAY_BUFFER, GL_SHADER_STORAGE_BUFFER, ...)
+	GLintptr	offset	= 0;		// Offset of the data in the buffer
+	void	  * ptr		= nullptr;	// Mapped address where to write the data
+};
+
+// Dynamic data uploaded every frame (instances, lines, wake...)
+// One big persistently mapped buffer divided into FRAMES regions, a region is reused only when its fence is signaled
+class TransientBuffer
+{
+public:
+	static const int FRAMES = 3;
+	static const int ALIGNMENT = 256;
+
+	TransientBuffer() {}
+	~TransientBuffer()
+	{
+		Release();
+	}
+
+	void Init(size_t bytesPerFrame)
+	{
+		Create(bytesPerFrame);
+	}
+
+	// Must be called while the context is alive
+	void Release()
+	{
+		for (int i = 0; i < FRAMES; i++)
+		{
+			if (mFences[i])
+				glDeleteSync(mFences[i]);
+			mFences[i] = 0;
+		}
+		for (auto& retired : mvRetired)
+			glDeleteBuffers(1, &retired.first);
+		mvRetired.clear();
+		if (mBuffer)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glDeleteBuffers(1, &mBuffer);
+		}
+		mBuffer = 0;
+		mpData = nullptr;
+	}
+
+	// Call once at the beginning of the frame, before any allocation
+	void BeginFrame()
+	{
+		mFrame++;
+		mRegion = mFrame % FRAMES;
+		if (mFences[mRegion])
+		{
+			glClientWaitSync(mFences[mRegion], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			glDeleteSync(mFences[mRegion]);
+			mFences[mRegion] = 0;
+		}
+		mHead = 0;
+		mBytesFrame = 0;
+
+		// Buffers replaced by a bigger one are deleted when the GPU can no longer use them
+		for (auto it = mvRetired.begin(); it != mvRetired.end(); )
+		{
+			if (mFrame >= it->second + FRAMES)
+			{
+				glDeleteBuffers(1, &it->first);
+				it = mvRetired.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+
+	// Call once at the end of the frame, after the last draw call using the allocations
+	void EndFrame()
+	{
+		mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mBytesLastFrame = mBytesFrame;
+		mHighWater = std::max(mHighWater, mBytesFrame);
+	}
+
+	// Space for 'size' bytes, valid until the end of the frame
+	sTransientAlloc Allocate(size_t size)
+	{
+		size_t aligned = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+		if (mHead + aligned > mBytesPerFrame)
+		{
+			// The region is too small: the current buffer is retired and a bigger one is created
+			size_t bytes = std::max(mBytesPerFrame, (size_t)ALIGNMENT);
+			while (bytes < mHead + aligned)
+				bytes *= 2;
+			cout << "TransientBuffer : " << mBytesPerFrame / 1024 << " KB per frame is not enough, growing to " << bytes / 1024 << " KB" << endl;
+			mvRetired.push_back({ mBuffer, mFrame });
+			glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			mBuffer = 0;
+			Create(bytes);
+		}
+
+		sTransientAlloc alloc;
+		alloc.buffer = mBuffer;
+		alloc.offset = mRegion * mBytesPerFrame + mHead;
+		alloc.ptr = mpData + alloc.offset;
+		mHead += aligned;
+		mBytesFrame += size;
+		return alloc;
+	}
+
+	// Allocation + copy
+	sTransientAlloc Upload(const void* data, size_t size)
+	{
+		sTransientAlloc alloc = Allocate(size);
+		memcpy(alloc.ptr, data, size);
+		return alloc;
+	}
+
+	unsigned int	GetFrame() const			{ return mFrame; }
+	size_t			GetBytesLastFrame() const	{ return mBytesLastFrame; }
+	size_t			GetHighWater() const		{ return mHighWater; }
+	size_t			GetCapacity() const			{ return mBytesPerFrame; }
+
+private:
+	void Create(size_t bytesPerFrame)
+	{
+		mBytesPerFrame = (bytesPerFrame + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &mBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+		glBufferStorage(GL_ARRAY_BUFFER, FRAMES * mBytesPerFrame, nullptr, flags);
+		mpData = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, FRAMES * mBytesPerFrame, flags);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		if (!mpData)
+			cout << "TransientBuffer : unable to map " << FRAMES * mBytesPerFrame / 1024 << " KB" << endl;
+	}
+
+	GLuint			mBuffer			= 0;
+	char		  * mpData			= nullptr;
+	size_t			mBytesPerFrame	= 0;
+	GLsync			mFences[FRAMES]	= { 0 };
+	unsigned int	mFrame			= 0;
+	int				mRegion			= 0;
+	size_t			mHead			= 0;		// Next free byte in the region of the frame
+
+	vector<pair<GLuint, unsigned int>> mvRetired;	// Buffer, last frame of use
+
+	// Statistics
+	size_t			mBytesFrame		= 0;
+	size_t			mBytesLastFrame	= 0;
+	size_t			mHighWater		= 0;
+};
@@ -305,26 +305,18 @@ vec2 OpenGLToLonLat(float x, float z)
 
     return vec2(lon, lat);
 }
-bool InterpolateTriangle(const vec3& p1, const vec3& p2, const vec3& p3, vec3& pos)
+bool IsBoxInFrustum(const mat4& viewProj, const vec3& bbMin, const vec3& bbMax)
 {
-    // Calcul des coordonnes barycentriques
-    float det = ((p2.z - p3.z) * (p1.x - p3.x) + (p3.x - p2.x) * (p1.z - p3.z));
-    float w1 = ((p2.z - p3.z) * (pos.x - p3.x) + (p3.x - p2.x) * (pos.z - p3.z)) / det;
-    float w2 = ((p3.z - p1.z) * (pos.x - p3.x) + (p1.x - p3.x) * (pos.z - p3.z)) / det;
-    float w3 = 1.0f - w1 - w2;
-
-    // Vrification si le point est  l'intrieur du triangle
-    if (w1 >= 0 && w2 >= 0 && w3 >= 0 && w1 <= 1 && w2 <= 1 && w3 <= 1)
-    {
-        // Interpolation de la valeur y
-        pos.y = w1 * p1.y + w2 * p2.y + w3 * p3.y;
-        return true;
-    }
-    else
+    // Planes of the frustum from the rows of viewProj, the box is out if it is behind one of them
+    mat4 rows = transpose(viewProj);
+    vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+    for (auto& plane : planes)
     {
-        // Le point est en dehors du triangle
-        return false;
+        vec3 p(plane.x > 0.0f ? bbMax.x : bbMin.x, plane.y > 0.0f ? bbMax.y : bbMin.y, plane.z > 0.0f ? bbMax.z : bbMin.z);
+        if (dot(vec3(plane), p) + plane.w < 0.0f)
+            return false;
     }
+    return true;
 }
 vector<string> ListFiles(const string& folder, const string& ext)
 {
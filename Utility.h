@@ -128,7 +128,7 @@ template <class T> inline int AreAnglesSorted(T angle1, T angle2)
 vec2 LonLatToOpenGL(float lon, float lat);
 vec2 OpenGLToLonLat(float x, float z);
 
-bool InterpolateTriangle(const vec3& p1, const vec3& p2, const vec3& p3, vec3& pos);
+bool IsBoxInFrustum(const mat4& viewProj, const vec3& bbMin, const vec3& bbMax);
 vector<string> ListFiles(const string& folder, const string& ext);
 
 vec3 ConvertToFloat(vec3 v);
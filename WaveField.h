@@ -0,0 +1,379 @@
+/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+
+// glm
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+
+struct WaveData
+{
+	double time;
+	double dx, dy, dz;
+};
+
+// Displacements of the ocean read back on the CPU: FFT_SIZE x FFT_SIZE texels (dx, dy, dz, -) of a patch repeated every PATCH_SIZE
+// The heights under the hull are searched in the displaced mesh, the other points sample the map bilinearly
+// No OpenGL, so that the ship, the buoys and the benchmarks share the same code
+class WaveField
+{
+public:
+	WaveField() {}
+	WaveField(const float* displacement, int fftSize, int meshSize, int patchSize)
+		: mDisplacement(displacement), mFftSize(fftSize), mMeshSize(meshSize), mPatchSize(patchSize) {}
+
+	bool IsValid() const { return mDisplacement != nullptr; }
+
+	vec3 GetVerticeAtMeshIndex(int x, int z) const
+	{
+		int xx = x;
+		int zz = z;
+
+		int i = 0;
+		int j = 0;
+
+		while (xx < 0)
+		{
+			xx += mMeshSize;
+			i--;
+		}
+		while (zz < 0)
+		{
+			zz += mMeshSize;
+			j--;
+		}
+
+		while (xx >= mMeshSize)
+		{
+			xx -= mMeshSize;
+			i++;
+		}
+		while (zz >= mMeshSize)
+		{
+			zz -= mMeshSize;
+			j++;
+		}
+
+		vec3 pos;
+		// Correspondence between MESH coordinates and FFT coordinates
+		int xFft = (xx - mMeshSize / 2) * mFftSize / mMeshSize + mFftSize / 2;
+		int yFft = (zz - mMeshSize / 2) * mFftSize / mMeshSize + mFftSize / 2;
+		int index = 4 * (yFft * mFftSize + xFft);
+
+		pos.x = (xx - mMeshSize / 2.0f) * mPatchSize / mMeshSize + i * mPatchSize + mDisplacement[index + 0];
+		pos.y = mDisplacement[index + 1];
+		pos.z = (zz - mMeshSize / 2.0f) * mPatchSize / mMeshSize + j * mPatchSize + mDisplacement[index + 2];
+
+		return pos;
+	}
+	int GetHeightFast(vec3& pos) const
+	{
+		// Update pos vector and return the number of computations (higher the lambda is, higher the computations are)
+
+		int x = pos.x * mMeshSize / mPatchSize + mMeshSize / 2;
+		int z = pos.z * mMeshSize / mPatchSize + mMeshSize / 2;
+
+		vec3 posR = pos;
+
+		while (x < 0)
+		{
+			x += mMeshSize;
+			posR.x += mPatchSize;
+		}
+		while (z < 0)
+		{
+			z += mMeshSize;
+			posR.z += mPatchSize;
+		}
+
+		while (x >= mMeshSize)
+		{
+			x -= mMeshSize;
+			posR.x -= mPatchSize;
+		}
+		while (z >= mMeshSize)
+		{
+			z -= mMeshSize;
+			posR.z -= mPatchSize;
+		}
+
+
+		int n = 0;
+		float xReal, zReal;
+		vec3 p1, p2, p3, p4;
+
+		// First level of searching, step by step, x then z
+
+		// X to the left
+		int xGrid;
+		for (xGrid = x; xGrid >= 0; xGrid--)
+		{
+			n++;
+			xReal = GetVerticeAtMeshIndex(xGrid, z).x;
+			if (xReal < posR.x)
+				break;
+		}
+		int indexX1 = xGrid;
+		if (x == indexX1)
+		{
+			// X to the right
+			for (xGrid = x; xGrid < (mMeshSize + 1); xGrid++)
+			{
+				n++;
+				xReal = GetVerticeAtMeshIndex(xGrid, z).x;
+				if (xReal > posR.x)
+					break;
+			}
+			indexX1 = xGrid - 1;
+		}
+
+
+		// Z to the bottom
+		int zGrid;
+		for (zGrid = z; zGrid >= 0; zGrid--)
+		{
+			n++;
+			zReal = GetVerticeAtMeshIndex(x, zGrid).z;
+			if (zReal < posR.z)
+				break;
+		}
+		int indexZ1 = zGrid;
+		if (z == indexZ1)
+		{
+			// Z to the top
+			for (zGrid = z; zGrid < (mMeshSize + 1); zGrid++)
+			{
+				n++;
+				zReal = GetVerticeAtMeshIndex(x, zGrid).z;
+				if (zReal > posR.z)
+					break;
+			}
+			indexZ1 = zGrid - 1;
+		}
+		if (indexZ1 == -1)  indexZ1 = 0;
+
+		// Try with these indexes
+		p1 = GetVerticeAtMeshIndex(indexX1, indexZ1);          // Bottom Left
+		p2 = GetVerticeAtMeshIndex(indexX1 + 1, indexZ1);      // Bottom Right
+		p3 = GetVerticeAtMeshIndex(indexX1 + 1, indexZ1 + 1);  // Top Right
+
+		if (InterpolateTriangle(p1, p2, p3, posR))
+		{
+			pos.y = posR.y;
+			return n;
+		}
+
+		p4 = GetVerticeAtMeshIndex(indexX1, indexZ1 + 1);      // Top Left
+		if (InterpolateTriangle(p1, p3, p4, posR))
+		{
+			pos.y = posR.y;
+			return n;
+		}
+
+		// Second level of searching. From the indexes, start around the last indexes on a 5 x 5 basis
+		for (int i = -2; i <= 2; i++)
+		{
+			for (int j = -2; j <= 2; j++)
+			{
+				n++;
+				p1 = GetVerticeAtMeshIndex(indexX1 + i, indexZ1 + j);          // Bottom Left
+				p2 = GetVerticeAtMeshIndex(indexX1 + 1 + i, indexZ1 + j);      // Bottom Right
+				p3 = GetVerticeAtMeshIndex(indexX1 + 1 + i, indexZ1 + 1 + j);  // Top Right
+
+				if (InterpolateTriangle(p1, p2, p3, posR))
+				{
+					pos.y = posR.y;
+					return n;
+				}
+
+				p4 = GetVerticeAtMeshIndex(indexX1 + i, indexZ1 + 1 + j);      // Top Left
+				if (InterpolateTriangle(p1, p3, p4, posR))
+				{
+					pos.y = posR.y;
+					return n;
+				}
+			}
+		}
+
+		// Second level of searching, extend the grid in another method
+		n += GetHeightSlow(pos);
+
+		return n;
+	}
+	int GetHeightSlow(vec3& pos) const
+	{
+		int x = pos.x * mMeshSize / mPatchSize + mMeshSize / 2;
+		int z = pos.z * mMeshSize / mPatchSize + mMeshSize / 2;
+
+		int n = 0;
+
+		// Find the index in mDisplacement
+
+		vec3 p1, p2, p3, p4;
+		int xGrid, zGrid;
+		for (xGrid = x - 20; xGrid <= x + 20; xGrid++)
+		{
+			for (zGrid = z - 20; zGrid <= z + 20; zGrid++)
+			{
+				n++;
+				p1 = GetVerticeAtMeshIndex(xGrid, zGrid);          // Bottom Left
+				p2 = GetVerticeAtMeshIndex(xGrid + 1, zGrid);      // Bottom Right
+				p3 = GetVerticeAtMeshIndex(xGrid + 1, zGrid + 1);  // Top Right
+
+				if (InterpolateTriangle(p1, p2, p3, pos))
+					return n;
+
+				p4 = GetVerticeAtMeshIndex(xGrid, zGrid + 1);      // Top Left
+				if (InterpolateTriangle(p1, p3, p4, pos))
+					return n;
+			}
+		}
+
+		// No triangle found
+		pos.y = 0.0f;
+		return 0;
+	}
+	void GetHeights(const vector<vec2>& points, vector<float>& heights) const
+	{
+		// Heights of the surface at world positions (x, z), from the displacements read back after the FFT
+		// The ocean repeats every PATCH_SIZE, the map is sampled bilinearly and wraps
+		float scale = (float)mFftSize / mPatchSize;
+		auto sample = [&](vec2 p)
+		{
+			float u = p.x * scale + mFftSize / 2;
+			float v = p.y * scale + mFftSize / 2;
+			float fu = floor(u);
+			float fv = floor(v);
+			int x0 = ((int)fu % mFftSize + mFftSize) % mFftSize;
+			int z0 = ((int)fv % mFftSize + mFftSize) % mFftSize;
+			int x1 = (x0 + 1) % mFftSize;
+			int z1 = (z0 + 1) % mFftSize;
+			auto texel = [&](int x, int z) { const float* d = &mDisplacement[4 * (z * mFftSize + x)]; return vec3(d[0], d[1], d[2]); };
+			vec3 a = mix(texel(x0, z0), texel(x1, z0), u - fu);
+			vec3 b = mix(texel(x0, z1), texel(x1, z1), u - fu);
+			return mix(a, b, v - fv);
+		};
+
+		heights.resize(points.size());
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			// The vertices are moved horizontally by the choppiness, one step back to the texel that lands on the point
+			vec3 d = sample(points[i]);
+			d = sample(points[i] - vec2(d.x, d.z));
+			heights[i] = d.y;
+		}
+	}
+
+	// Height of pos interpolated in the triangle if its projection on XZ is inside
+	static bool InterpolateTriangle(const vec3& p1, const vec3& p2, const vec3& p3, vec3& pos)
+	{
+		// Barycentric coordinates
+		float det = ((p2.z - p3.z) * (p1.x - p3.x) + (p3.x - p2.x) * (p1.z - p3.z));
+		float w1 = ((p2.z - p3.z) * (pos.x - p3.x) + (p3.x - p2.x) * (pos.z - p3.z)) / det;
+		float w2 = ((p3.z - p1.z) * (pos.x - p3.x) + (p1.x - p3.x) * (pos.z - p3.z)) / det;
+		float w3 = 1.0f - w1 - w2;
+
+		if (w1 >= 0 && w2 >= 0 && w3 >= 0 && w1 <= 1 && w2 <= 1 && w3 <= 1)
+		{
+			pos.y = w1 * p1.y + w2 * p2.y + w3 * p3.y;
+			return true;
+		}
+		return false;
+	}
+
+	// Wave by wave analysis of the record of a buoy: waves between 2 crests, mean of the highest third
+	static bool GetWaveByWaveAnalysis(const vector<WaveData>& data, float& waves1_3, float& waveMax, int& nWaves, float& average_period)
+	{
+		const size_t size = data.size();
+		if (size < 3)
+			return false;
+
+		// Temporary vectors
+		vector<size_t> crest_indices;
+		vector<size_t> trough_indices;
+
+		static vector<float> vWaves;
+		static vector<float> vPeriods;
+
+		// Peak and trough detection
+		for (size_t i = 1; i < size - 1; ++i)
+		{
+			float prev = data[i - 1].dy;
+			float curr = data[i].dy;
+			float next = data[i + 1].dy;
+
+			if (curr > prev && curr > next)
+				crest_indices.push_back(i);
+			else if (curr < prev && curr < next)
+				trough_indices.push_back(i);
+		}
+
+		if (crest_indices.size() < 2 || trough_indices.empty())
+			return false;
+
+		// Wave calculation: associate each wave with a neighboring trough
+		vWaves.clear();
+		vPeriods.clear();
+
+		// To simplify, we will go through ridges in pairs and look for hollows between these ridges
+		for (size_t i = 0; i < crest_indices.size() - 1; ++i)
+		{
+			size_t crest1 = crest_indices[i];
+			size_t crest2 = crest_indices[i + 1];
+
+			// Find the minimum trough between these two peaks
+			auto trough_it = std::min_element(trough_indices.begin(), trough_indices.end(),
+				[&](size_t a, size_t b)
+				{
+					return (data[a].dy < data[b].dy) &&
+						(a > crest1 && a < crest2);
+				});
+
+			if (trough_it != trough_indices.end() && *trough_it > crest1 && *trough_it < crest2)
+			{
+				float height = data[crest1].dy - data[*trough_it].dy;
+				if (height > 0)
+				{
+					vWaves.push_back(height);
+					// Period between 2 crests
+					float period = data[crest2].time - data[crest1].time;
+					vPeriods.push_back(period);
+				}
+			}
+		}
+
+		nWaves = (int)vWaves.size();
+		if (nWaves == 0)
+			return false;
+
+		average_period = std::accumulate(vPeriods.begin(), vPeriods.end(), 0.0f) / vPeriods.size();
+
+		std::sort(vWaves.begin(), vWaves.end(), std::greater<float>());
+		waveMax = vWaves[0];
+
+		size_t nbSignificantWaves = nWaves / 3;
+		if (nbSignificantWaves == 0)
+			return false;
+
+		waves1_3 = std::accumulate(vWaves.begin(), vWaves.begin() + nbSignificantWaves, 0.0f) / nbSignificantWaves;
+
+		return true;
+	}
+
+private:
+	const float	  * mDisplacement	= nullptr;
+	int				mFftSize		= 0;
+	int				mMeshSize		= 0;
+	int				mPatchSize		= 0;
+};
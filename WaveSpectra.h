@@ -0,0 +1,317 @@
+﻿/* SimShip by Edouard Halbert
+This work is licensed under a Creative Commons Attribution-NonCommercial-NoDerivatives 4.0 International License
+http://creativecommons.org/licenses/by-nc-nd/4.0/ */
+
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <cmath>
+
+// glm
+#include <glm/glm.hpp>
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include <glm/gtx/norm.hpp>
+
+using namespace std;
+using namespace glm;
+
+
+// Spectra of the ocean S(k) for a wave number k, sampled by Ocean::InitFrequencies on the grid of the FFT
+// No OpenGL, so that they are also timed by the benchmarks
+class WaveSpectra
+{
+public:
+	WaveSpectra(vec2 wind, float gravity, float amplitude, int meshSize)
+		: Wind(wind), mGravity(gravity), Amplitude(amplitude), MESH_SIZE(meshSize) {}
+
+	float Phillips(vec2 k) const
+	{
+		/*
+		*   For FFT + 1 = 513 => there are 269169 calls to this function (513 x 513).
+		*   Due to 2 possibilities to exit before the result, there are only 131854 calls which succeed.
+		*   Wind force is divided by 2 (more realistic)
+		*/
+
+		float k_length = glm::length(k);
+		if (k_length < 0.000001f)
+			return 0.0f;
+
+		// k^2 & k^4
+		float k_length2 = k_length * k_length;
+		float k_length4 = k_length2 * k_length2;
+
+		float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind * 0.7f));   
+
+		// If wave is moving against wind direction
+		if (k_dot_w < 0.0f)	
+			return 0.0f;
+
+		// Directional distribution (added to Phillips spectrum)
+		k_dot_w = pow(cos(1.0f * acos(k_dot_w)), 3);
+
+		float k_dot_w2 = k_dot_w * k_dot_w;	// The higher the exponent in (k_dot_w)exp will be set (2 in this case), the more the waves will be aligned with the wind direction
+
+		float L = glm::length2(Wind * 0.7f) / mGravity;	// Largest possible wave for wind speed V. L = V^2 / g
+		float L2 = L * L;
+
+		// Suppress waves smaller than 1 / 1000
+		float damping = 0.0001f;
+		float l2 = L2 * damping * damping;
+		float S = exp(-1.0f / (k_length2 * L2)) / k_length4 * k_dot_w2 * exp(-k_length2 * l2);
+		return S * 0.0000375f;      // Acceptable factor to have the Amplitude around 1.0f
+	}
+	float JONSWAP(vec2 k) const
+	{
+		// Le spectre JONSWAP est plus complexe et prend en compte plus de paramètres que le spectre de Phillips. Il produit généralement des vagues plus prononcées et plus réalistes, en particulier pour les mers en développement.
+
+		k *= 6.0f;
+
+		if (k.x == 0.0f && k.y == 0.0f)
+			return 0.0f;
+
+		float k_length = glm::length(k);
+		//MinMax(k_length);
+
+		float w_length = glm::length(Wind);
+		float fetch = 1000.0f; // Longueur du fetch en mètres (à ajuster selon vos besoins)
+		float g = mGravity;
+
+		// Paramètres JONSWAP
+		float alpha = 0.076f * pow(w_length * w_length / (fetch * g), -0.22f);
+		float omega_p = 22.0f * pow(g * g / (w_length * fetch), 1.0f / 3.0f); // Fréquence de pic
+		float gamma = 3.3f; // Facteur de pic (typiquement entre 1 et 7)
+		float sigma = (k_length <= omega_p) ? 0.07f : 0.09f;
+
+		// Calcul du spectre
+		float omega = sqrt(g * k_length);
+		float r = exp(-(omega - omega_p) * (omega - omega_p) / (2.0f * sigma * sigma * omega_p * omega_p));
+		float S_pm = (alpha * g * g / pow(omega, 5)) * exp(-1.25f * pow(omega_p / omega, 4));
+		float S_j = S_pm * pow(gamma, r);
+
+		// Directionnalité
+		float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind));
+		float D = pow(cos(0.5f * acos(k_dot_w)), 2); // Distribution directionnelle
+
+		float S = S_j * D / (k_length * k_length * k_length * k_length);
+		return S * 1.0f;
+	}
+	float JONSWAP2(vec2 k) const
+	{
+		float k_length = glm::length(k * 0.001f);
+		if (k_length < 0.000001f)
+			return 0.0f;
+
+		float omega = sqrt(mGravity * k_length);
+		float omega_p = 0.855f * mGravity / glm::length(Wind);  // Fréquence de pic
+
+		float alpha = 0.0081f;  // Constante de Phillips
+		float gamma = 3.3f;     // Facteur de pic
+		float sigma = (omega <= omega_p) ? 0.07f : 0.09f;
+
+		float r = exp(-(omega - omega_p) * (omega - omega_p) / (2.0f * sigma * sigma * omega_p * omega_p));
+
+		float S = (alpha * mGravity * mGravity / (omega * omega * omega * omega * omega)) * exp(-1.25f * pow(omega_p / omega, 4)) * pow(gamma, r);
+
+		// Distribution directionnelle
+		float theta = atan2(k.y, k.x);
+		float cos_theta = cos(theta - atan2(Wind.y, Wind.x));
+		float D = pow(cos_theta, 2);  // Distribution cosinus carré
+
+		return S * D * 0.0375f * Amplitude;  // Facteur d'échelle pour ajuster l'amplitude
+	}
+	float PiersonMoskowitz(vec2 k) const
+	{
+		// Ce spectre est souvent utilisé pour modéliser des mers complètement développées. Il est plus simple que le spectre JONSWAP et ne prend pas en compte le fetch limité.
+
+		k *= 5.5f;
+
+		if (k.x == 0.0f && k.y == 0.0f)
+			return 0.0f;
+
+		float k_length = glm::length(k);
+
+		float g = mGravity;
+		float w_length = glm::length(Wind);
+
+		// Paramètres du spectre Pierson-Moskowitz
+		float alpha = 0.0081f; // Constante de Phillips qui contrôle l'amplitude globale du spectre.
+		float omega_p = g / w_length; // Fréquence de pic
+
+		// Calcul du spectre
+		float omega = sqrt(g * k_length);
+		float S_pm = (alpha * g * g / pow(omega, 5)) * exp(-5.0f / 4.0f * pow(omega_p / omega, 4));
+
+		// Directionnalité
+		float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind));
+		float D = pow(cos(0.5f * acos(k_dot_w)), 2); // Distribution directionnelle
+
+		float S = S_pm * D / (k_length * k_length * k_length * k_length);
+		return S * 1.0f;
+	}
+	float DonelanBanner(vec2 k) const
+	{
+		// Ce spectre est une amélioration du spectre JONSWAP, particulièrement adapté pour les vents forts et les vagues courtes.
+
+		k *= 3.0f;
+
+		if (k.x == 0.0f && k.y == 0.0f)
+			return 0.0f;
+
+		float k_length = glm::length(k);
+
+		float g = mGravity;
+		float w_length = glm::length(Wind);
+
+		// Paramètres du spectre Donelan-Banner
+		float alpha = 0.006f * sqrt(w_length / g);
+		float omega_p = 0.877f * g / w_length;
+		float gamma = 1.7f;
+		float sigma = 0.08f * (1.0f + 4.0f / pow(omega_p * w_length / g, 3));
+
+		// Calcul du spectre
+		float omega = sqrt(g * k_length);
+		float r = exp(-pow(omega - omega_p, 2) / (2.0f * sigma * sigma * omega_p * omega_p));
+		float S_db = alpha * g * g / pow(omega, 4) * exp(-pow(omega_p / omega, 4)) * pow(gamma, r);
+
+		// Directionnalité
+		float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind));
+		float theta = acos(k_dot_w);
+		float beta = 2.61f * pow(omega / omega_p, 0.65f);
+		float sech = 1.0f / cosh(beta * theta);
+		float D = pow(sech, 2);
+
+		float S = S_db * D / (k_length * k_length * k_length * k_length);
+		return S * 0.1f;
+	}
+	float Elfouhaily(vec2 k) const
+	{
+		const float KM = 370.0;
+		const float CM = 0.23;
+
+		vec2 wave_vector = k;
+
+		wave_vector *= 80.f;
+
+		float k_length = length(wave_vector);
+
+		float U10 = length(Wind);
+
+		float Omega = 0.84f;
+		float kp = mGravity * (Omega / U10) * (Omega / U10);
+
+		float c = sqrt(mGravity * k_length * (1.f + ((k_length * k_length) / (KM * KM)))) / k_length;
+		float cp = sqrt(mGravity * kp * (1.f + ((kp * kp) / (KM * KM)))) / kp;
+
+		float Lpm = exp(-1.25 * (kp / k_length) * (kp / k_length));
+		float gamma = 1.7;
+		float sigma = 0.08 * (1.0 + 4.0 * pow(Omega, -3.0));
+		float Gamma = exp(-(sqrt(k_length / kp) - 1.0) * (sqrtf(k_length / kp) - 1.0) / 2.0 * (sigma * sigma));
+		float Jp = pow(gamma, Gamma);
+		float Fp = Lpm * Jp * exp(-Omega / sqrt(10.0) * (sqrt(k_length / kp) - 1.0));
+		float alphap = 0.006 * sqrt(Omega);
+		float Bl = 0.5 * alphap * cp / c * Fp;
+
+		float z0 = 0.000037 * U10 * U10 / mGravity * pow(U10 / cp, 0.9);
+		float uStar = 0.41 * U10 / log(10.0 / z0);
+		float alpham = 0.01 * ((uStar < CM) ? (1.0 + log(uStar / CM)) : (1.0 + 3.0 * log(uStar / CM)));
+		float Fm = exp(-0.25 * (k_length / KM - 1.0) * (k_length / KM - 1.0));
+		float Bh = 0.5 * alpham * CM / c * Fm * Lpm;
+
+		float a0 = log(2.0) / 4.0;
+		float am = 0.13 * uStar / CM;
+		float Delta = tanh(a0 + 4.0 * pow(c / cp, 2.5) + am * pow(CM / c, 2.5));
+
+		float cosPhi = glm::dot(glm::normalize(Wind), glm::normalize(wave_vector));
+
+		float S = (1.0 / (2.0 * M_PI)) * pow(k_length, -4.0) * (Bl + Bh) * (1.0 + Delta * (2.0 * cosPhi * cosPhi - 1.0));
+
+		float dk = 2.0 * M_PI / MESH_SIZE;
+		float h = sqrt(S / 2.0) * dk;
+
+		if (wave_vector.x == 0.0 && wave_vector.y == 0.0) h = 0.f;
+		return h;
+	}
+	float Elfouhaily2(vec2 k) const
+	{
+		float Hs = 2.0f;
+		float U10 = glm::length(Wind);
+		float fetch = 100.0f;
+
+		float g = 9.81f; // Accélération due à la gravité
+		float kp = (g / U10) * std::pow(fetch, -0.33f); // Nombre d'onde pic
+		float alpha = 0.0074f; // Coefficient de Phillips
+
+		float k_length = glm::length(k);
+
+		if (k_length == 0.0f)
+			return 0.0f;
+
+		// Spectre d'Elfouhaily
+		float S = alpha * Hs * Hs * std::pow(kp, 2) * std::pow(k_length, -3) * std::exp(-5.0f / 4.0f * std::pow(k_length / kp, -2)) * std::exp(-0.5f * std::pow(k_length / kp - 1, 2));
+		return S * 0.01f;
+	}
+	float TexelMarsenArsloe(vec2 k) const
+	{
+		// Ce spectre de Texel-MARSEN-ARSLOE (TMA) est une modification du spectre JONSWAP pour les eaux peu profondes
+
+		k *= 6.f;
+
+		float windSpeed = glm::length(Wind);    // Vitesse du vent en m/s
+		float fetchLength = 100000.0f;          // 100 km
+		float peakFrequency = 0.1f;             // 0.1 Hz
+		float depth = 10.0f;
+
+		if (k.x == 0.0f && k.y == 0.0f)
+			return 0.0f;
+
+		float k_length = glm::length(k);
+
+		float g = mGravity;
+		float omega = sqrt(g * k_length * tanh(k_length * depth));
+		float omega_p = 2.0f * M_PI * peakFrequency;
+
+		// Paramètres JONSWAP
+		float alpha = 0.076f * pow(windSpeed * windSpeed / (fetchLength * g), 0.22f);
+		float gamma = 3.3f;
+		float sigma = (omega <= omega_p) ? 0.07f : 0.09f;
+
+		// Calcul du spectre JONSWAP
+		float r = exp(-pow(omega - omega_p, 2) / (2 * sigma * sigma * omega_p * omega_p));
+		float S_j = alpha * g * g / pow(omega, 5) * exp(-5.0f / 4.0f * pow(omega_p / omega, 4)) * pow(gamma, r);
+
+		// Facteur de profondeur limitée
+		float k_h = k_length * depth;
+		float phi = 0.5f + 0.5f * tanh(2.0f * k_h);
+
+		// Directionnalité
+		float k_dot_w = glm::dot(glm::normalize(k), glm::normalize(Wind));
+		float D = pow(cos(0.5f * acos(k_dot_w)), 2);
+
+		float S = S_j * phi * D / (k_length * k_length * k_length * k_length);
+		return S * 1.0f;
+	}
+	float TexelMarsenArsloe2(vec2 k) const
+	{
+		float omega = glm::length(k);
+		if (omega == 0.0f)
+			return 0.0f;
+
+		float Hs = 2.0f;    // Hauteur significative
+		float Tp = 10.0f;   // Période de pic
+		float omega_p = 2 * M_PI / Tp;  // Fréquence de pic
+		float alpha = 0.0081f;  // Coefficient empirique
+
+		// Spectre de Texel Marsen Arsloe
+		float S = (alpha * Hs * Hs) / std::pow(omega, 5) * std::exp(-1.25f * std::pow(omega_p / omega, 4)) * std::exp(-0.5f * std::pow((omega - omega_p) / (0.07f * omega_p), 2));
+		return S * 0.01f;
+	}
+
+private:
+	vec2	Wind;
+	float	mGravity;
+	float	Amplitude;
+	int		MESH_SIZE;
+};